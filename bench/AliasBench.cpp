@@ -0,0 +1,116 @@
+#include "TestCommon.h"
+#include "Trampy.h"
+#include <chrono>
+
+/*
+Measures installing Hooks whose patches are written through a writable alias of their pages (see HOOK_FLAG_WRITABLE_ALIAS),
+against changing the protection of their pages around every write: preparing them (which remaps the pages, see Memory::AliasCode),
+enabling & disabling them one at a time, and committing them in transactions, with the targets packed together and one per page.
+*/
+
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+/* The amount of Hooks */
+#define HOOK_AMOUNT 1000
+
+/* The amount of enable & disable cycles measured one at a time, and in transactions */
+#define CYCLE_AMOUNT 10
+
+INT64 AliasHook(INT64 x) { return -x; }
+
+/*
+Measure a call, in nanoseconds.
+*/
+template <typename CALL>
+DWORD64 Measure(CALL call)
+{
+	auto start = std::chrono::steady_clock::now();
+	call();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+Change every Hook in a transaction.
+@param hooks, the Hooks.
+@param bEnable, whether they're enabled or disabled.
+@return whether the transaction succeeded.
+*/
+BOOL CommitAll(const std::vector<PHOOK_DESCRIPTOR> &hooks, BOOL bEnable)
+{
+	if (!Trampy::BeginTransaction())
+		return FALSE;
+
+	for (PHOOK_DESCRIPTOR pHook : hooks)
+		bEnable ? Trampy::QueueEnableHook(pHook) : Trampy::QueueDisableHook(pHook);
+
+	return Trampy::CommitTransaction();
+}
+
+/*
+Measure the Hooks of targets that are a given amount of functions apart.
+@param spread, the distance between the targets, in functions.
+@param bAlias, whether the patches are written through aliases.
+@return whether every change succeeded, and the targets are hooked while their Hooks are enabled.
+*/
+BOOL MeasureInstall(SIZE_T spread, BOOL bAlias)
+{
+	PBYTE pTargets = GenerateTargets(HOOK_AMOUNT * spread);
+	if (!pTargets)
+		return FALSE;
+
+	std::vector<PHOOK_DESCRIPTOR> hooks;
+	std::vector<LPVOID> trampolines(HOOK_AMOUNT);
+	for (SIZE_T i = 0; i < HOOK_AMOUNT; i++)
+	{
+		PBYTE pTarget = pTargets + i * spread * GENERATED_TARGET_SIZE;
+		hooks.push_back(Trampy::CreateHook(pTarget, (LPVOID) AliasHook, &trampolines[i], bAlias ? HOOK_FLAG_WRITABLE_ALIAS : 0));
+		if (!hooks.back())
+			return FALSE;
+	}
+
+	BOOL bSucceeded = TRUE;
+	DWORD64 prepareTotal = Measure([&]()
+	{
+		for (PHOOK_DESCRIPTOR pHook : hooks)
+			bSucceeded = bSucceeded && Trampy::PrepareHook(pHook);
+	});
+
+	DWORD64 eachTotal = Measure([&]()
+	{
+		for (SIZE_T cycle = 0; cycle < CYCLE_AMOUNT; cycle++)
+			for (PHOOK_DESCRIPTOR pHook : hooks)
+				bSucceeded = bSucceeded && Trampy::EnableHook(pHook) && Trampy::DisableHook(pHook);
+	});
+
+	DWORD64 commitTotal = Measure([&]()
+	{
+		for (SIZE_T cycle = 0; cycle < CYCLE_AMOUNT; cycle++)
+			bSucceeded = bSucceeded && CommitAll(hooks, TRUE) && CommitAll(hooks, FALSE);
+	});
+
+	bSucceeded = bSucceeded && CommitAll(hooks, TRUE) && ((TARGET_FUNCTION) pTargets)(5) == -5 && CommitAll(hooks, FALSE);
+
+	printf("%6zu %-8s %12.2f %12.2f %12.2f\n", spread, bAlias ? "alias" : "protect",
+		prepareTotal / 1e3 / HOOK_AMOUNT, eachTotal / 1e3 / (CYCLE_AMOUNT * HOOK_AMOUNT), commitTotal / 1e6 / (CYCLE_AMOUNT * 2));
+
+	return bSucceeded && ((TARGET_FUNCTION) pTargets)(5) == 5;
+}
+
+int main()
+{
+	printf("%6s %-8s %12s %12s %12s\n", "spread", "", "prepare us", "cycle us", "commit ms");
+
+	for (SIZE_T spread : { 1, 256 })
+	{
+		for (BOOL bAlias : { FALSE, TRUE })
+		{
+			if (!MeasureInstall(spread, bAlias))
+			{
+				printf("a change failed\n");
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include "TestCommon.h"
+#include "disasm/disasm.h"
+#include "disasm/instr/OpcodeTables.h"
+#include <chrono>
+
+/*
+Compares classifying the bytes of instructions (prefixes, ModRM, immediate size & relative branches) through the flat tables,
+to classifying them by scanning the prefix & Addressing Method caches, as the decoder did before the tables.
+Runs over the instructions of the text sections of local binaries (or the binaries given on the command line).
+*/
+
+/* The amount of passes over the corpus, the fastest one is reported */
+#define PASS_AMOUNT 5
+
+/* The escape byte of the two-byte opcode map */
+#define TWO_BYTE_ESCAPE 0x0F
+
+/* The opcode flags both methods classify */
+#define COMPARED_FLAGS (OPF_MODRM | OPF_RELATIVE)
+
+/*
+Check whether a byte is a prefix, by scanning the prefix cache.
+*/
+BOOL ScanIsPrefix(BYTE value)
+{
+	for (BYTE prefix : g_PrefixCache)
+	{
+		if (prefix == value)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+Classify the instruction at given code, by scanning the caches.
+@param code, the instruction.
+@return a checksum of its properties.
+*/
+DWORD ClassifyByScan(PBYTE code)
+{
+	while (ScanIsPrefix(*code))
+		code++;
+
+	if ((*code & REX_PREFIX_MASK) == REX_PREFIX)
+		code++;
+
+	const OPCODE_DESCRIPTOR *pDescriptor = &g_OpcodeMap[*code];
+	if (*code == TWO_BYTE_ESCAPE)
+		pDescriptor = &g_OpcodeMap0F[code[1]];
+
+	OPCODE_PROPERTIES properties = BuildOpcodeProperties(*pDescriptor);
+	return (properties.Flags & COMPARED_FLAGS) | properties.ImmSize[OPSIZE_32] << 8;
+}
+
+/*
+Classify the instruction at given code, through the flat tables.
+@param code, the instruction.
+@return a checksum of its properties.
+*/
+DWORD ClassifyByTable(PBYTE code)
+{
+	while (g_PrefixTable.Classes[*code] != PREFIX_NONE)
+		code++;
+
+	if ((*code & REX_PREFIX_MASK) == REX_PREFIX)
+		code++;
+
+	const OPCODE_PROPERTIES *pProperties = &g_OpcodeTables[OPMAP_1BYTE].Entries[*code];
+	if (*code == TWO_BYTE_ESCAPE)
+		pProperties = &g_OpcodeTables[OPMAP_0F].Entries[code[1]];
+
+	return (pProperties->Flags & COMPARED_FLAGS) | pProperties->ImmSize[OPSIZE_32] << 8;
+}
+
+/*
+Report the rate of a classification method.
+@param name, the name of the method.
+@param classify, the method.
+@param code, the corpus.
+@param offsets, the offset of every instruction within the corpus.
+@return the checksum of the entire corpus, so both methods may be compared.
+*/
+DWORD64 MeasureClassification(const char *name, DWORD (*classify)(PBYTE), PBYTE code, const std::vector<DWORD> &offsets)
+{
+	double fastest = 0;
+	DWORD64 checksum = 0;
+	for (SIZE_T i = 0; i < PASS_AMOUNT; i++)
+	{
+		checksum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (DWORD offset : offsets)
+			checksum = checksum * 31 + classify(code + offset);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!i || seconds < fastest)
+			fastest = seconds;
+	}
+
+	printf("%-8s %10.2f M instructions/sec\n", name, offsets.size() / fastest / 1e6);
+	return checksum;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<const char *> paths = GetCorpusBinaries(argc, argv);
+
+	std::vector<BYTE> code;
+	for (const char *path : paths)
+	{
+		TEXT_SECTION section;
+		if (ReadTextSection(path, &section))
+			code.insert(code.end(), section.Code.begin(), section.Code.end());
+	}
+
+	std::vector<DWORD> offsets;
+	INSTRUCTION_ITERATOR iterator;
+	DECODED_INSTRUCTION instruction;
+	Disassembler::InitializeIterator(&iterator, code.data(), code.size(), DISASM_MODE_64);
+	while (Disassembler::NextInstruction(&iterator, &instruction))
+		offsets.push_back(instruction.Offset);
+
+	if (offsets.empty())
+	{
+		printf("the corpus is empty\n");
+		return 1;
+	}
+
+	code.resize(code.size() + MAX_INSTRUCTION_SIZE * 2);
+	DWORD64 scanChecksum = MeasureClassification("scan", ClassifyByScan, code.data(), offsets);
+	DWORD64 tableChecksum = MeasureClassification("table", ClassifyByTable, code.data(), offsets);
+	if (scanChecksum != tableChecksum)
+	{
+		printf("the methods disagree\n");
+		return 1;
+	}
+
+	return 0;
+}
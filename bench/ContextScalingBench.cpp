@@ -0,0 +1,103 @@
+#include "TestCommon.h"
+#include "disasm/disasm.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+/*
+Measures how the decode rate scales with the amount of threads, each decoding the corpus through its own context.
+Runs over the text sections of local binaries (or the binaries given on the command line).
+*/
+
+/* The amount of runs per thread amount, the fastest one is reported */
+#define RUN_AMOUNT 3
+
+/*
+Decode the entire corpus, an instruction at a time.
+@param code, the corpus.
+@param size, the size of the corpus (the code is followed by zeros, so the last instruction is never decoded beyond it).
+@return the amount of decoded instructions.
+*/
+SIZE_T DecodeCorpus(PBYTE code, SIZE_T size)
+{
+	DISASSEMBLER_CONTEXT context;
+	Disassembler::InitializeContext(&context);
+	context.Mode = DISASM_MODE_64;
+
+	SIZE_T amount = 0;
+	for (PBYTE end = code + size; code < end; amount++)
+		code += Disassembler::Run(&context, code, 1);
+
+	return amount;
+}
+
+/*
+Decode the corpus on multiple threads at once.
+@param code, the corpus.
+@param size, the size of the corpus.
+@param threadAmount, the amount of threads, each decoding the entire corpus.
+@return the total amount of decoded instructions.
+*/
+SIZE_T DecodeOnThreads(PBYTE code, SIZE_T size, SIZE_T threadAmount)
+{
+	std::vector<std::thread> threads;
+	std::vector<SIZE_T> amounts(threadAmount);
+	for (SIZE_T i = 0; i < threadAmount; i++)
+		threads.emplace_back([&, i]() { amounts[i] = DecodeCorpus(code, size); });
+
+	SIZE_T total = 0;
+	for (SIZE_T i = 0; i < threadAmount; i++)
+	{
+		threads[i].join();
+		total += amounts[i];
+	}
+
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<const char *> paths = GetCorpusBinaries(argc, argv);
+
+	std::vector<BYTE> code;
+	for (const char *path : paths)
+	{
+		TEXT_SECTION section;
+		if (ReadTextSection(path, &section))
+			code.insert(code.end(), section.Code.begin(), section.Code.end());
+	}
+
+	SIZE_T size = code.size();
+	if (!size)
+	{
+		printf("the corpus is empty\n");
+		return 1;
+	}
+	code.resize(size + MAX_INSTRUCTION_SIZE * 2);
+
+	SIZE_T processorAmount = std::max(std::thread::hardware_concurrency(), 1U);
+	printf("%zu bytes, %zu processors\n", size, processorAmount);
+
+	double singleRate = 0;
+	for (SIZE_T threadAmount = 1; threadAmount <= processorAmount * 2; threadAmount *= 2)
+	{
+		double fastest = 0;
+		SIZE_T amount = 0;
+		for (SIZE_T i = 0; i < RUN_AMOUNT; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			amount = DecodeOnThreads(code.data(), size, threadAmount);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (!i || seconds < fastest)
+				fastest = seconds;
+		}
+
+		double rate = amount / fastest;
+		if (threadAmount == 1)
+			singleRate = rate;
+
+		printf("%3zu threads %10.2f M instructions/sec (%.2fx)\n", threadAmount, rate / 1e6, rate / singleRate);
+	}
+
+	return 0;
+}
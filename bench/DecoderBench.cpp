@@ -0,0 +1,159 @@
+#include "TestCommon.h"
+#include "disasm/disasm.h"
+#include <algorithm>
+#include <chrono>
+#include <x86intrin.h>
+
+/*
+Measures the decoder over the text sections of local binaries (or the binaries given on the command line):
+instructions/sec & bytes/sec of a linear sweep, and the latency percentiles of decoding a single instruction.
+*/
+
+/* The amount of sweeps over the corpus, the fastest one is reported */
+#define SWEEP_AMOUNT 5
+
+/*
+Struct describing the code the benchmark runs over.
+*/
+typedef struct _CORPUS
+{
+	/* The text sections, one after the other, followed by zeros so the last instruction is never decoded beyond the buffer */
+	std::vector<BYTE> Code;
+	/* The offset of every instruction within the code */
+	std::vector<DWORD> Offsets;
+}
+CORPUS, *PCORPUS;
+
+/*
+Read the corpus, and find its instructions.
+@param paths, the binaries the corpus is made of.
+@param pCorpus, receives the corpus.
+*/
+void ReadCorpus(const std::vector<const char *> &paths, OUT PCORPUS pCorpus)
+{
+	for (const char *path : paths)
+	{
+		TEXT_SECTION section;
+		if (!ReadTextSection(path, &section))
+			continue;
+
+		printf("corpus: %s, %zu bytes\n", path, section.Code.size());
+		pCorpus->Code.insert(pCorpus->Code.end(), section.Code.begin(), section.Code.end());
+	}
+
+	INSTRUCTION_ITERATOR iterator;
+	DECODED_INSTRUCTION instruction;
+	Disassembler::InitializeIterator(&iterator, pCorpus->Code.data(), pCorpus->Code.size(), DISASM_MODE_64);
+	while (Disassembler::NextInstruction(&iterator, &instruction))
+		pCorpus->Offsets.push_back(instruction.Offset);
+
+	pCorpus->Code.resize(pCorpus->Code.size() + MAX_INSTRUCTION_SIZE * 2);
+}
+
+/*
+Report the throughput of a sweep.
+@param name, the name of the sweep.
+@param pSweep, a function which sweeps the corpus once, and returns the amount of instructions it decoded.
+@param pCorpus, the corpus.
+*/
+template <typename SWEEP>
+void MeasureSweep(const char *name, SWEEP sweep, PCORPUS pCorpus)
+{
+	double fastest = 0;
+	SIZE_T instructionAmount = 0;
+	for (SIZE_T i = 0; i < SWEEP_AMOUNT; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		instructionAmount = sweep();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!i || seconds < fastest)
+			fastest = seconds;
+	}
+
+	SIZE_T byteAmount = pCorpus->Code.size() - MAX_INSTRUCTION_SIZE * 2;
+	printf("%-24s %10.2f M instructions/sec %10.2f MB/sec (%zu instructions)\n",
+		name, instructionAmount / fastest / 1e6, byteAmount / fastest / 1e6, instructionAmount);
+}
+
+/*
+Report the latency percentiles of decoding a single instruction through Disassembler::Run, in cycles.
+@param pCorpus, the corpus.
+*/
+void MeasureLatency(PCORPUS pCorpus)
+{
+	DISASSEMBLER_CONTEXT context;
+	Disassembler::InitializeContext(&context);
+	context.Mode = DISASM_MODE_64;
+
+	/* The cost of the measurement itself, which is subtracted from every sample */
+	unsigned aux;
+	DWORD64 overhead = ~0ULL;
+	for (SIZE_T i = 0; i < 1000; i++)
+	{
+		DWORD64 start = __rdtscp(&aux);
+		overhead = std::min<DWORD64>(overhead, __rdtscp(&aux) - start);
+	}
+
+	std::vector<DWORD64> samples;
+	samples.reserve(pCorpus->Offsets.size());
+	for (DWORD offset : pCorpus->Offsets)
+	{
+		DWORD64 start = __rdtscp(&aux);
+		Disassembler::Run(&context, pCorpus->Code.data() + offset, 1);
+		DWORD64 cycles = __rdtscp(&aux) - start;
+		samples.push_back(cycles > overhead ? cycles - overhead : 0);
+	}
+
+	std::sort(samples.begin(), samples.end());
+	printf("Run latency (cycles): p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu\n",
+		(unsigned long long) samples[samples.size() / 2],
+		(unsigned long long) samples[samples.size() * 9 / 10],
+		(unsigned long long) samples[samples.size() * 99 / 100],
+		(unsigned long long) samples[samples.size() * 999 / 1000],
+		(unsigned long long) samples.back());
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<const char *> paths = GetCorpusBinaries(argc, argv);
+
+	CORPUS corpus;
+	ReadCorpus(paths, &corpus);
+	if (corpus.Offsets.empty())
+	{
+		printf("the corpus is empty\n");
+		return 1;
+	}
+
+	MeasureSweep("Run", [&]()
+	{
+		DISASSEMBLER_CONTEXT context;
+		Disassembler::InitializeContext(&context);
+		context.Mode = DISASM_MODE_64;
+
+		SIZE_T amount = 0;
+		PBYTE code = corpus.Code.data();
+		PBYTE end = code + corpus.Code.size() - MAX_INSTRUCTION_SIZE * 2;
+		while (code < end)
+		{
+			code += Disassembler::Run(&context, code, 1);
+			amount++;
+		}
+		return amount;
+	}, &corpus);
+
+	MeasureSweep("NextInstruction", [&]()
+	{
+		INSTRUCTION_ITERATOR iterator;
+		DECODED_INSTRUCTION instruction;
+		Disassembler::InitializeIterator(&iterator, corpus.Code.data(), corpus.Code.size() - MAX_INSTRUCTION_SIZE * 2, DISASM_MODE_64);
+
+		SIZE_T amount = 0;
+		while (Disassembler::NextInstruction(&iterator, &instruction))
+			amount++;
+		return amount;
+	}, &corpus);
+
+	MeasureLatency(&corpus);
+	return 0;
+}
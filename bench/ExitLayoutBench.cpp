@@ -0,0 +1,189 @@
+#include "TestCommon.h"
+#include "Trampy.h"
+#include "Memory.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+/*
+Measures the cost of a call through Trampoline with every exit layout (see HOOK_FLAG_ABSOLUTE_EXIT & HOOK_FLAG_PUSH_RET_EXIT),
+and with an unaligned Trampoline (see HOOK_FLAG_UNALIGNED_TRAMPOLINE), against calling Original directly,
+over growing amounts of Hooks, with hot caches (the same functions are called over & over) and with cold caches (evicted before every pass).
+*/
+
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+/* The largest amount of Hooks that's measured */
+#define MAX_HOOK_AMOUNT 100000
+
+/* The least amount of calls per hot measurement */
+#define HOT_CALL_AMOUNT 2000000
+
+/* The amount of passes per cold measurement, each of which is preceded by an eviction */
+#define COLD_PASS_AMOUNT 20
+
+/* The size of the buffer that's written to evict the caches, larger than the last level cache */
+#define EVICTION_SIZE 0x4000000
+
+/* The amount of runs per hot measurement, the fastest one is reported */
+#define RUN_AMOUNT 3
+
+/*
+Struct describing a measured layout, i.e. the functions that are called, and the flags of their Hooks.
+*/
+typedef struct _EXIT_LAYOUT
+{
+	const char *Name;
+	/* Hook flags, or -1 for calling Original directly */
+	int Flags;
+	std::vector<TARGET_FUNCTION> Functions;
+}
+EXIT_LAYOUT, *PEXIT_LAYOUT;
+
+INT64 ExitHook(INT64 x) { return x; }
+
+/*
+Build the functions of a layout: MAX_HOOK_AMOUNT generated targets, and the Trampolines of their Hooks, which are prepared but never enabled.
+@param pLayout, the layout.
+@return whether the functions were built, and they return what the targets return.
+*/
+BOOL BuildLayout(PEXIT_LAYOUT pLayout)
+{
+	PBYTE pTargets = GenerateTargets(MAX_HOOK_AMOUNT);
+	if (!pTargets)
+		return FALSE;
+
+	pLayout->Functions.resize(MAX_HOOK_AMOUNT);
+	for (SIZE_T i = 0; i < MAX_HOOK_AMOUNT; i++)
+	{
+		LPVOID pTarget = pTargets + i * GENERATED_TARGET_SIZE;
+		if (pLayout->Flags < 0)
+		{
+			pLayout->Functions[i] = (TARGET_FUNCTION) pTarget;
+			continue;
+		}
+
+		PHOOK_DESCRIPTOR pHook = Trampy::CreateHook(pTarget, (LPVOID) ExitHook, (LPVOID *) &pLayout->Functions[i], (BYTE) pLayout->Flags);
+		if (!pHook || !Trampy::PrepareHook(pHook))
+			return FALSE;
+	}
+
+	for (SIZE_T i = 0; i < MAX_HOOK_AMOUNT; i++)
+		if (pLayout->Functions[i](5) != (INT64) (5 + i))
+			return FALSE;
+
+	return TRUE;
+}
+
+/*
+Call functions in a given order.
+@param pFunctions, the functions.
+@param order, the indexes of the called functions.
+@return the sum of their results, so the calls aren't optimized away.
+*/
+INT64 CallFunctions(const TARGET_FUNCTION *pFunctions, const std::vector<DWORD> &order)
+{
+	INT64 sum = 0;
+	for (DWORD i : order)
+		sum += pFunctions[i](sum);
+
+	return sum;
+}
+
+/*
+Measure the cost of a call with hot caches.
+@param pLayout, the layout.
+@param order, the indexes of the called functions.
+@return the cost of a call, in nanoseconds.
+*/
+double MeasureHot(PEXIT_LAYOUT pLayout, const std::vector<DWORD> &order)
+{
+	SIZE_T passAmount = std::max((SIZE_T) HOT_CALL_AMOUNT / order.size(), (SIZE_T) 1);
+	volatile INT64 sum = CallFunctions(pLayout->Functions.data(), order);
+
+	double fastest = 0;
+	for (SIZE_T i = 0; i < RUN_AMOUNT; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (SIZE_T j = 0; j < passAmount; j++)
+			sum = sum + CallFunctions(pLayout->Functions.data(), order);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!i || seconds < fastest)
+			fastest = seconds;
+	}
+
+	return fastest * 1e9 / (passAmount * order.size());
+}
+
+/*
+Measure the cost of a call with cold caches, i.e. every pass is preceded by writing a buffer larger than the caches.
+@param pLayout, the layout.
+@param order, the indexes of the called functions.
+@param eviction, the buffer that's written.
+@return the cost of a call, in nanoseconds.
+*/
+double MeasureCold(PEXIT_LAYOUT pLayout, const std::vector<DWORD> &order, std::vector<BYTE> &eviction)
+{
+	volatile INT64 sum = 0;
+	double seconds = 0;
+	for (SIZE_T i = 0; i < COLD_PASS_AMOUNT; i++)
+	{
+		for (SIZE_T j = 0; j < eviction.size(); j += CACHE_LINE_SIZE)
+			eviction[j]++;
+
+		auto start = std::chrono::steady_clock::now();
+		sum = sum + CallFunctions(pLayout->Functions.data(), order);
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	return seconds * 1e9 / (COLD_PASS_AMOUNT * order.size());
+}
+
+int main()
+{
+	EXIT_LAYOUT layouts[] =
+	{
+		{ "direct", -1 },
+		{ "rel32", 0 },
+		{ "jmp [rip]", HOOK_FLAG_ABSOLUTE_EXIT },
+		{ "push/ret", HOOK_FLAG_PUSH_RET_EXIT },
+		{ "unaligned", HOOK_FLAG_UNALIGNED_TRAMPOLINE },
+	};
+
+	for (EXIT_LAYOUT &layout : layouts)
+	{
+		if (!BuildLayout(&layout))
+		{
+			printf("couldn't build the %s layout\n", layout.Name);
+			return 1;
+		}
+	}
+
+	std::vector<BYTE> eviction(EVICTION_SIZE);
+	std::mt19937 random(0);
+
+	for (BOOL bCold : { FALSE, TRUE })
+	{
+		printf("%s caches, ns/call\n%8s", bCold ? "cold" : "hot", "hooks");
+		for (const EXIT_LAYOUT &layout : layouts)
+			printf(" %10s", layout.Name);
+		printf("\n");
+
+		for (DWORD hookAmount = 1; hookAmount <= MAX_HOOK_AMOUNT; hookAmount *= 10)
+		{
+			/* Hot passes call the functions in order, cold passes in a random order, so they aren't prefetched */
+			std::vector<DWORD> order(hookAmount);
+			for (DWORD i = 0; i < hookAmount; i++)
+				order[i] = i;
+			if (bCold)
+				std::shuffle(order.begin(), order.end(), random);
+
+			printf("%8u", hookAmount);
+			for (EXIT_LAYOUT &layout : layouts)
+				printf(" %10.2f", bCold ? MeasureCold(&layout, order, eviction) : MeasureHot(&layout, order));
+			printf("\n");
+		}
+	}
+
+	return 0;
+}
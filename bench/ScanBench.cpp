@@ -0,0 +1,113 @@
+#include "TestCommon.h"
+#include "disasm/disasm.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+/*
+Measures the boundary scanner (ScanBoundaries) with every instruction set, against decoding one instruction at a time (NextInstruction),
+and the scaling curve of the parallel scanner (ScanBoundariesParallel),
+over the text sections of local binaries (or the binaries given on the command line).
+*/
+
+/* The amount of runs per measurement, the fastest one is reported */
+#define RUN_AMOUNT 9
+
+/*
+Measure the rate of a scan.
+@param scan, a function which scans the entire corpus once.
+@param size, the size of the corpus.
+@return the rate of the scan, in bytes/sec.
+*/
+template <typename SCAN>
+double MeasureScan(SCAN scan, SIZE_T size)
+{
+	double fastest = 0;
+	for (SIZE_T i = 0; i < RUN_AMOUNT; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		scan();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!i || seconds < fastest)
+			fastest = seconds;
+	}
+
+	return size / fastest;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<BYTE> code;
+	for (const char *path : GetCorpusBinaries(argc, argv))
+	{
+		TEXT_SECTION section;
+		if (ReadTextSection(path, &section))
+			code.insert(code.end(), section.Code.begin(), section.Code.end());
+	}
+
+	if (code.empty())
+	{
+		printf("the corpus is empty\n");
+		return 1;
+	}
+
+	printf("%zu bytes\n", code.size());
+	std::vector<BYTE> bitmap((code.size() + 7) / 8);
+
+	double rate = MeasureScan([&]()
+	{
+		INSTRUCTION_ITERATOR iterator;
+		DECODED_INSTRUCTION instruction;
+		Disassembler::InitializeIterator(&iterator, code.data(), code.size(), DISASM_MODE_64);
+		while (Disassembler::NextInstruction(&iterator, &instruction));
+	}, code.size());
+	printf("%-24s %10.2f MB/sec\n", "NextInstruction", rate / 1e6);
+
+	static const struct
+	{
+		const char *Name;
+		SCAN_INSTRUCTION_SET InstructionSet;
+	}
+	instructionSets[] = { { "ScanBoundaries scalar", SCAN_ISA_SCALAR }, { "ScanBoundaries SSSE3", SCAN_ISA_SSSE3 }, { "ScanBoundaries AVX2", SCAN_ISA_AVX2 } };
+
+	for (auto &instructionSet : instructionSets)
+	{
+		rate = MeasureScan([&]()
+		{
+			DISASSEMBLER_CONTEXT context;
+			Disassembler::InitializeContext(&context);
+			context.Mode = DISASM_MODE_64;
+			context.ScanInstructionSet = instructionSet.InstructionSet;
+			Disassembler::ScanBoundaries(&context, code.data(), code.size(), bitmap.data());
+		}, code.size());
+		printf("%-24s %10.2f MB/sec\n", instructionSet.Name, rate / 1e6);
+	}
+
+	/* Repeat the corpus, so starting the threads is negligible next to scanning */
+	std::vector<BYTE> repeated;
+	for (SIZE_T i = 0; i < 8; i++)
+		repeated.insert(repeated.end(), code.begin(), code.end());
+	bitmap.resize((repeated.size() + 7) / 8);
+
+	SIZE_T processorAmount = std::max(std::thread::hardware_concurrency(), 1U);
+	printf("\nScanBoundariesParallel, %zu bytes, %zu processors\n", repeated.size(), processorAmount);
+
+	double singleRate = 0;
+	for (SIZE_T threadAmount = 1; threadAmount <= processorAmount * 2; threadAmount *= 2)
+	{
+		rate = MeasureScan([&]()
+		{
+			DISASSEMBLER_CONTEXT context;
+			Disassembler::InitializeContext(&context);
+			context.Mode = DISASM_MODE_64;
+			Disassembler::ScanBoundariesParallel(&context, repeated.data(), repeated.size(), bitmap.data(), threadAmount);
+		}, repeated.size());
+
+		if (threadAmount == 1)
+			singleRate = rate;
+
+		printf("%3zu threads %22.2f MB/sec (%.2fx)\n", threadAmount, rate / 1e6, rate / singleRate);
+	}
+
+	return 0;
+}
@@ -0,0 +1,122 @@
+#include "TestCommon.h"
+#include "Trampy.h"
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+
+/*
+Measures the latency of enabling & disabling a prepared Hook over a million cycles, against preparing it,
+and the growth of the resident memory along the way (which stays flat, as the Trampoline & patch are built once).
+*/
+
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+/* The amount of enable & disable cycles */
+#define CYCLE_AMOUNT 1000000
+
+/* The amount of cycles between reports */
+#define REPORT_INTERVAL 100000
+
+TARGET_FUNCTION g_ToggleTrampoline;
+
+INT64 ToggleHook(INT64 x) { return g_ToggleTrampoline(x) + 1; }
+
+/*
+@return the resident memory of the process, in KB.
+*/
+SIZE_T ResidentSize()
+{
+	SIZE_T totalPages = 0;
+	SIZE_T residentPages = 0;
+
+	FILE *pFile = fopen("/proc/self/statm", "r");
+	if (pFile)
+	{
+		if (fscanf(pFile, "%zu %zu", &totalPages, &residentPages) != 2)
+			residentPages = 0;
+		fclose(pFile);
+	}
+
+	return residentPages * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+/*
+Measure a call, in nanoseconds.
+*/
+template <typename CALL>
+DWORD64 Measure(CALL call)
+{
+	auto start = std::chrono::steady_clock::now();
+	call();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+@return a percentile of latencies (reorders them).
+*/
+DWORD64 Percentile(std::vector<DWORD64> &latencies, double percentile)
+{
+	auto nth = latencies.begin() + (SIZE_T) (percentile * (latencies.size() - 1));
+	std::nth_element(latencies.begin(), nth, latencies.end());
+	return *nth;
+}
+
+int main()
+{
+	TARGET_FUNCTION pTarget = (TARGET_FUNCTION) GenerateTargets(1);
+	PHOOK_DESCRIPTOR pHook = pTarget ? Trampy::CreateHook((LPVOID) pTarget, (LPVOID) ToggleHook, (LPVOID *) &g_ToggleTrampoline) : NULL;
+	if (!pHook)
+	{
+		printf("couldn't create the Hook\n");
+		return 1;
+	}
+
+	/* The latencies are allocated (and touched) up front, so they aren't counted as growth */
+	std::vector<DWORD64> enableLatencies(CYCLE_AMOUNT);
+	std::vector<DWORD64> disableLatencies(CYCLE_AMOUNT);
+
+	BOOL bSucceeded = TRUE;
+	DWORD64 prepareLatency = Measure([&]() { bSucceeded = Trampy::PrepareHook(pHook); });
+	DWORD64 firstLatency = Measure([&]() { bSucceeded = bSucceeded && Trampy::EnableHook(pHook) && Trampy::DisableHook(pHook); });
+	if (!bSucceeded)
+	{
+		printf("couldn't prepare the Hook\n");
+		return 1;
+	}
+
+	printf("prepare %llu ns, first cycle %llu ns\n", (unsigned long long) prepareLatency, (unsigned long long) firstLatency);
+	printf("%8s %12s %12s %10s\n", "cycles", "enable ns", "disable ns", "rss KB");
+
+	SIZE_T baseResidentSize = ResidentSize();
+	printf("%8d %12s %12s %10zu\n", 0, "", "", baseResidentSize);
+
+	for (SIZE_T cycle = 0; cycle < CYCLE_AMOUNT; cycle += REPORT_INTERVAL)
+	{
+		DWORD64 enableTotal = 0;
+		DWORD64 disableTotal = 0;
+		for (SIZE_T i = cycle; i < cycle + REPORT_INTERVAL; i++)
+		{
+			enableLatencies[i] = Measure([&]() { bSucceeded &= Trampy::EnableHook(pHook); });
+			disableLatencies[i] = Measure([&]() { bSucceeded &= Trampy::DisableHook(pHook); });
+			enableTotal += enableLatencies[i];
+			disableTotal += disableLatencies[i];
+		}
+
+		SIZE_T residentSize = ResidentSize();
+		printf("%8zu %12llu %12llu %10zu (%+lld)\n", cycle + REPORT_INTERVAL,
+			(unsigned long long) (enableTotal / REPORT_INTERVAL), (unsigned long long) (disableTotal / REPORT_INTERVAL),
+			residentSize, (long long) residentSize - (long long) baseResidentSize);
+	}
+
+	if (!bSucceeded || pTarget(5) != 5)
+	{
+		printf("a cycle failed\n");
+		return 1;
+	}
+
+	printf("enable p50 %llu ns, p99 %llu ns, disable p50 %llu ns, p99 %llu ns\n",
+		(unsigned long long) Percentile(enableLatencies, 0.5), (unsigned long long) Percentile(enableLatencies, 0.99),
+		(unsigned long long) Percentile(disableLatencies, 0.5), (unsigned long long) Percentile(disableLatencies, 0.99));
+
+	return 0;
+}
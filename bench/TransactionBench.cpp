@@ -0,0 +1,152 @@
+#include "TestCommon.h"
+#include "Trampy.h"
+#include <chrono>
+#include <set>
+#include <unistd.h>
+
+/*
+Measures enabling & disabling 10k Hooks in a transaction, phase by phase, against enabling & disabling them one at a time,
+with the Hooks packed together and spread over a large amount of code (as they are over a large binary),
+which changes how many pages (and how many separate ranges of pages) each transaction changes the protection of.
+*/
+
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+/* The amount of Hooks */
+#define HOOK_AMOUNT 10000
+
+INT64 BatchHook(INT64 x) { return -x; }
+
+/*
+Print a line of the results.
+@param spread, the distance between the targets, in functions.
+@param pageAmount, the amount of pages the targets are on.
+@param name, what was measured.
+@param pTiming, the phases of the commit, or NULL if the Hooks were changed one at a time.
+@param total, how long it took, in nanoseconds.
+*/
+void PrintResult(SIZE_T spread, SIZE_T pageAmount, const char *name, PTRANSACTION_TIMING pTiming, DWORD64 total)
+{
+	printf("%6zu %6zu %-16s", spread, pageAmount, name);
+	if (pTiming)
+		printf(" %9.2f %9.2f %9.2f %9.2f", pTiming->Prepare / 1e6, pTiming->Protect / 1e6, pTiming->Write / 1e6, pTiming->Restore / 1e6);
+	else
+		printf(" %9s %9s %9s %9s", "", "", "", "");
+	printf(" %9.2f\n", total / 1e6);
+}
+
+/*
+Change every Hook in a transaction.
+@param hooks, the Hooks.
+@param bEnable, whether they're enabled or disabled.
+@param pTiming, receives the phases of the commit.
+@return how long it took, in nanoseconds, or 0 if it failed.
+*/
+DWORD64 CommitAll(const std::vector<PHOOK_DESCRIPTOR> &hooks, BOOL bEnable, OUT PTRANSACTION_TIMING pTiming)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	BOOL bSucceeded = Trampy::BeginTransaction();
+	for (PHOOK_DESCRIPTOR pHook : hooks)
+		bSucceeded = bSucceeded && (bEnable ? Trampy::QueueEnableHook(pHook) : Trampy::QueueDisableHook(pHook));
+
+	if (!bSucceeded)
+	{
+		Trampy::AbortTransaction();
+		return 0;
+	}
+
+	bSucceeded = Trampy::CommitTransaction(pTiming);
+	DWORD64 total = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	return bSucceeded ? total : 0;
+}
+
+/*
+Change every Hook, one at a time.
+@param hooks, the Hooks.
+@param bEnable, whether they're enabled or disabled.
+@return how long it took, in nanoseconds, or 0 if it failed.
+*/
+DWORD64 ChangeEach(const std::vector<PHOOK_DESCRIPTOR> &hooks, BOOL bEnable)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (PHOOK_DESCRIPTOR pHook : hooks)
+		if (!(bEnable ? Trampy::EnableHook(pHook) : Trampy::DisableHook(pHook)))
+			return 0;
+
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+Measure the Hooks of targets that are a given amount of functions apart.
+@param spread, the distance between the targets, in functions.
+@return whether every change succeeded, and the targets are hooked while their Hooks are enabled.
+*/
+BOOL MeasureSpread(SIZE_T spread)
+{
+	PBYTE pTargets = GenerateTargets(HOOK_AMOUNT * spread);
+	if (!pTargets)
+		return FALSE;
+
+	std::vector<PHOOK_DESCRIPTOR> hooks;
+	std::vector<LPVOID> trampolines(HOOK_AMOUNT);
+	std::set<ULONG_PTR> pages;
+	for (SIZE_T i = 0; i < HOOK_AMOUNT; i++)
+	{
+		PBYTE pTarget = pTargets + i * spread * GENERATED_TARGET_SIZE;
+		pages.insert((ULONG_PTR) pTarget / sysconf(_SC_PAGESIZE));
+
+		hooks.push_back(Trampy::CreateHook(pTarget, (LPVOID) BatchHook, &trampolines[i]));
+		if (!hooks.back())
+			return FALSE;
+	}
+
+	/* The first commit prepares the Hooks as well */
+	TRANSACTION_TIMING timing;
+	DWORD64 total = CommitAll(hooks, TRUE, &timing);
+	PrintResult(spread, pages.size(), "commit (first)", &timing, total);
+	if (!total || ((TARGET_FUNCTION) pTargets)(5) != -5)
+		return FALSE;
+
+	/* The next commits only write the prepared patches */
+	const char *names[] = { "commit disable", "commit enable" };
+	for (SIZE_T i = 0; i < 2; i++)
+	{
+		BOOL bEnable = i % 2;
+		total = CommitAll(hooks, bEnable, &timing);
+		PrintResult(spread, pages.size(), names[bEnable], &timing, total);
+		if (!total)
+			return FALSE;
+	}
+
+	if (((TARGET_FUNCTION) pTargets)(5) != -5)
+		return FALSE;
+
+	/* Each of them is disabled & enabled by itself from now on */
+	for (BOOL bEnable : { FALSE, TRUE })
+	{
+		total = ChangeEach(hooks, bEnable);
+		PrintResult(spread, pages.size(), bEnable ? "each enable" : "each disable", NULL, total);
+		if (!total)
+			return FALSE;
+	}
+
+	return ((TARGET_FUNCTION) pTargets)(5) == -5;
+}
+
+int main()
+{
+	printf("%6s %6s %-16s %9s %9s %9s %9s %9s (ms)\n", "spread", "pages", "", "prepare", "protect", "write", "restore", "total");
+
+	for (SIZE_T spread : { 1, 16, 256, 512 })
+	{
+		if (!MeasureSpread(spread))
+		{
+			printf("a change failed\n");
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,591 @@
+#include "Emitter.h"
+#include <stdio.h>
+
+/* Opcodes the emitter writes */
+#define JMP_REL8_OPCODE 0xEB
+#define JMP_REL32_OPCODE 0xE9
+#define JCC_REL8_OPCODE 0x70
+#define JCC_REL32_OPCODE 0x80
+#define CALL_REL32_OPCODE 0xE8
+#define TWO_BYTE_ESCAPE 0x0F
+#define INDIRECT_OPCODE 0xFF
+#define PUSH_OPCODE 0x50
+#define POP_OPCODE 0x58
+#define PUSH_IMM8_OPCODE 0x6A
+#define PUSH_IMM32_OPCODE 0x68
+#define RET_OPCODE 0xC3
+#define MOV_OPCODE 0x89
+#define MOV_IMM_OPCODE 0xB8
+#define MOV_IMM32_OPCODE 0xC7
+#define LEA_OPCODE 0x8D
+
+/* The Reg field of the indirect JMP & CALL (FF /4 & FF /2) */
+#define INDIRECT_JMP 4
+#define INDIRECT_CALL 2
+
+/* The stack slot a push/ret JMP writes the high half of its target to, [RSP+4] */
+#define STACK_HIGH_HALF 4
+
+/* The R/M field that selects a SIB byte, and the one that selects a disp32 (which is RIP-relative in 64-bit mode) */
+#define RM_SIB 0b100
+#define RM_DISP32 0b101
+
+/*
+@return whether the emitted code is 64-bit code.
+*/
+constexpr bool IsLongMode()
+{
+	return sizeof(LPVOID) == QWORD_SIZE;
+}
+
+/*
+@return the ModRM byte of given fields (only the low 3 bits of Reg & R/M are encoded in it).
+*/
+constexpr BYTE ModRM(BYTE mod, BYTE reg, BYTE rm)
+{
+	return (BYTE) ((mod << 6) | ((reg & 0b111) << 3) | (rm & 0b111));
+}
+
+/*
+@return the REX prefix of given operand size & registers, which extends the Reg & R/M fields.
+*/
+constexpr BYTE Rex(bool bOperand64, BYTE reg, BYTE rm)
+{
+	return (BYTE) (0x40 | (bOperand64 << 3) | ((reg >> 3) << 2) | (rm >> 3));
+}
+
+/*
+@return whether a value fits a sign-extended 8-bit immediate (or Relative Address).
+*/
+constexpr bool IsInt8(INT64 value)
+{
+	return value == (int8_t) value;
+}
+
+/*
+@return whether a value fits a sign-extended 32-bit immediate (or Relative Address).
+*/
+constexpr bool IsInt32(INT64 value)
+{
+	return value == (int32_t) value;
+}
+
+/*
+Mark an emitter as failed.
+@param pEmitter, the emitter.
+@param functionName, the name of the failing function.
+@param reason, the reason it failed.
+@return FALSE.
+*/
+BOOL FailEmitter(PEMITTER pEmitter, const char *functionName, const char *reason)
+{
+	printf("Emitter::%s failed: %s.\n", functionName, reason);
+	pEmitter->bFailed = TRUE;
+	return FALSE;
+}
+
+/*
+Reserve bytes at the end of the code.
+@param pEmitter, the emitter.
+@param size, the amount of bytes.
+@return pointer to the bytes within the buffer, or NULL if the buffer is full (or the emitter failed before).
+*/
+PBYTE ReserveBytes(PEMITTER pEmitter, SIZE_T size)
+{
+	if (pEmitter->bFailed)
+		return NULL;
+
+	if (size > pEmitter->Capacity - pEmitter->Size)
+	{
+		FailEmitter(pEmitter, "Reserve", "buffer is full");
+		return NULL;
+	}
+
+	PBYTE pBytes = pEmitter->pBuffer + pEmitter->Size;
+	pEmitter->Size += size;
+	return pBytes;
+}
+
+/*
+Emit bytes at the end of the code.
+@param pEmitter, the emitter.
+@param pBytes, the bytes.
+@param size, the amount of bytes.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL EmitBytes(PEMITTER pEmitter, const void *pBytes, SIZE_T size)
+{
+	PBYTE pReserved = ReserveBytes(pEmitter, size);
+	if (!pReserved)
+		return FALSE;
+
+	memcpy(pReserved, pBytes, size);
+	return TRUE;
+}
+
+/*
+Emit a single byte at the end of the code.
+*/
+BOOL EmitByte(PEMITTER pEmitter, BYTE value)
+{
+	return EmitBytes(pEmitter, &value, BYTE_SIZE);
+}
+
+/*
+Emit a REX prefix if the instruction requires one (64-bit operand size, or R8-R15).
+@param pEmitter, the emitter.
+@param functionName, the name of the emitting function.
+@param bOperand64, whether the instruction has a 64-bit operand size (ignored in 32-bit mode).
+@param reg, the register encoded in the Reg field (or 0).
+@param rm, the register encoded in the R/M field, or in the opcode itself (or 0).
+@return TRUE if the function succeeds, FALSE if it fails (e.g. R8-R15 in 32-bit mode).
+*/
+BOOL EmitRex(PEMITTER pEmitter, const char *functionName, bool bOperand64, BYTE reg, BYTE rm)
+{
+	if (reg > GPR_R15 || rm > GPR_R15 || (!IsLongMode() && (reg > GPR_DI || rm > GPR_DI)))
+		return FailEmitter(pEmitter, functionName, "invalid register");
+
+	if (!IsLongMode() || (!bOperand64 && reg <= GPR_DI && rm <= GPR_DI))
+		return TRUE;
+
+	return EmitByte(pEmitter, Rex(bOperand64, reg, rm));
+}
+
+/*
+Emit a 32-bit value, e.g. an immediate or a Relative Address.
+*/
+BOOL EmitDword(PEMITTER pEmitter, DWORD value)
+{
+	return EmitBytes(pEmitter, &value, DWORD_SIZE);
+}
+
+/*
+Emit a native-sized address, e.g. the target of an absolute JMP.
+*/
+BOOL EmitAddress(PEMITTER pEmitter, LPVOID pAddress)
+{
+	return EmitBytes(pEmitter, &pAddress, sizeof(pAddress));
+}
+
+/*
+Emit a relative branch to an address, or to a label (which is fixed once the code is finished if it isn't bound yet).
+@param pEmitter, the emitter.
+@param functionName, the name of the emitting function.
+@param shortOpcode, the opcode of the branch's rel8 form, or 0 if it has none.
+@param nearOpcode, the opcode of the branch's rel32 form, its first byte is the two-byte escape if nearOpcodeSize is 2.
+@param nearOpcodeSize, the size of the rel32 form's opcode.
+@param pTarget, the target, or NULL if the branch's target is a label that isn't bound yet.
+@param label, the label the branch targets (only used if pTarget is NULL).
+@param branchSize, the size of the Relative Address (BRANCH_SIZE).
+@return TRUE if the function succeeds, FALSE if it fails (e.g. the target is out of reach).
+*/
+BOOL EmitBranch(PEMITTER pEmitter, const char *functionName, BYTE shortOpcode, BYTE nearOpcode, SIZE_T nearOpcodeSize, PBYTE pTarget, LABEL label, BYTE branchSize)
+{
+	PBYTE pIp = pEmitter->pRuntime + pEmitter->Size;
+
+	/* A branch that can't be short is near, and so is a branch whose target isn't known yet (when its size is chosen automatically) */
+	if (!shortOpcode)
+		branchSize = BRANCH_SIZE_NEAR;
+	else if (branchSize == BRANCH_SIZE_AUTO)
+		branchSize = pTarget && IsInt8(pTarget - (pIp + JMP_REL8_SIZE)) ? BRANCH_SIZE_SHORT : BRANCH_SIZE_NEAR;
+
+	SIZE_T offsetSize = branchSize == BRANCH_SIZE_SHORT ? BYTE_SIZE : DWORD_SIZE;
+	SIZE_T opcodeSize = branchSize == BRANCH_SIZE_SHORT ? BYTE_SIZE : nearOpcodeSize;
+	PBYTE pNextIp = pIp + opcodeSize + offsetSize;
+
+	INT64 offset = 0;
+	if (pTarget)
+	{
+		offset = pTarget - pNextIp;
+		if (offsetSize == BYTE_SIZE ? !IsInt8(offset) : !IsInt32(offset))
+			return FailEmitter(pEmitter, functionName, "target is out of reach");
+	}
+	else
+	{
+		if (pEmitter->FixupAmount == EMITTER_MAX_FIXUPS)
+			return FailEmitter(pEmitter, functionName, "too many label references");
+
+		pEmitter->Fixups[pEmitter->FixupAmount++] = { (WORD) (pEmitter->Size + opcodeSize), (BYTE) offsetSize, label };
+	}
+
+	if (branchSize == BRANCH_SIZE_SHORT)
+		return EmitByte(pEmitter, shortOpcode) && EmitByte(pEmitter, (BYTE) offset);
+
+	if (nearOpcodeSize == 2 && !EmitByte(pEmitter, TWO_BYTE_ESCAPE))
+		return FALSE;
+
+	return EmitByte(pEmitter, nearOpcode) && EmitDword(pEmitter, (DWORD) offset);
+}
+
+/*
+@return the address a label is bound to, or NULL if it isn't bound yet.
+*/
+PBYTE LabelTarget(PEMITTER pEmitter, LABEL label)
+{
+	SIZE_T offset = pEmitter->LabelOffsets[label];
+	return offset == EMITTER_UNBOUND ? NULL : pEmitter->pRuntime + offset;
+}
+
+/*
+Emit an indirect JMP or CALL through a native-sized address (FF /4 or FF /2), which is stored at a given offset after it.
+@param pEmitter, the emitter.
+@param reg, the Reg field that selects the instruction (INDIRECT_JMP or INDIRECT_CALL).
+@param addressDistance, the distance from the end of the instruction to the address.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL EmitIndirect(PEMITTER pEmitter, BYTE reg, DWORD addressDistance)
+{
+	/* The address is RIP-relative in 64-bit mode, and absolute in 32-bit mode */
+	DWORD displacement = addressDistance;
+	if (!IsLongMode())
+		displacement += (DWORD) (ULONG_PTR) (pEmitter->pRuntime + pEmitter->Size + 6);
+
+	return EmitByte(pEmitter, INDIRECT_OPCODE) &&
+		EmitByte(pEmitter, ModRM(0b00, reg, RM_DISP32)) &&
+		EmitDword(pEmitter, displacement);
+}
+
+/*
+Initialize an emitter.
+@param pEmitter, the emitter.
+@param pBuffer, the buffer the code is written to.
+@param capacity, the capacity of the buffer.
+@param pRuntime, the address the code is executed from (e.g. pBuffer, or where a staging buffer is copied to).
+*/
+void Emitter::Initialize(OUT PEMITTER pEmitter, PBYTE pBuffer, SIZE_T capacity, LPVOID pRuntime)
+{
+	pEmitter->pBuffer = pBuffer;
+	pEmitter->Capacity = capacity;
+	pEmitter->pRuntime = (PBYTE) pRuntime;
+	pEmitter->Size = 0;
+	pEmitter->bFailed = FALSE;
+	pEmitter->LabelAmount = 0;
+	pEmitter->FixupAmount = 0;
+}
+
+/*
+Finish the code, fixing every reference to a label that was bound after it was referenced.
+@param pEmitter, the emitter.
+@param pSize, receives the size of the code.
+@return TRUE if the code was emitted successfully, FALSE if any of the emitter's functions failed.
+*/
+BOOL Emitter::Finish(PEMITTER pEmitter, OUT SIZE_T *pSize)
+{
+	for (SIZE_T i = 0; i < pEmitter->FixupAmount && !pEmitter->bFailed; i++)
+	{
+		PEMITTER_FIXUP pFixup = &pEmitter->Fixups[i];
+		SIZE_T labelOffset = pEmitter->LabelOffsets[pFixup->Label];
+		if (labelOffset == EMITTER_UNBOUND)
+			return FailEmitter(pEmitter, "Finish", "a referenced label isn't bound");
+
+		/* The Relative Address is the last field of the branch */
+		INT64 offset = (INT64) labelOffset - (INT64) (pFixup->Offset + pFixup->Size);
+		if (pFixup->Size == BYTE_SIZE)
+		{
+			if (!IsInt8(offset))
+				return FailEmitter(pEmitter, "Finish", "a label is out of reach of a short branch");
+
+			pEmitter->pBuffer[pFixup->Offset] = (BYTE) offset;
+		}
+		else
+		{
+			int32_t rel32 = (int32_t) offset;
+			memcpy(pEmitter->pBuffer + pFixup->Offset, &rel32, DWORD_SIZE);
+		}
+	}
+
+	*pSize = pEmitter->Size;
+	return !pEmitter->bFailed;
+}
+
+/*
+@return the address the next instruction is executed from.
+*/
+LPVOID Emitter::Position(PEMITTER pEmitter)
+{
+	return pEmitter->pRuntime + pEmitter->Size;
+}
+
+/*
+Reserve space for code that's written by the caller (e.g. relocated instructions).
+@param pEmitter, the emitter.
+@param size, the size of the code.
+@return pointer to the reserved space within the buffer, or NULL if the function failed.
+*/
+PBYTE Emitter::Reserve(PEMITTER pEmitter, SIZE_T size)
+{
+	return ReserveBytes(pEmitter, size);
+}
+
+/*
+Create a new label, which isn't bound yet.
+@param pEmitter, the emitter.
+@return the label (which is invalid if the emitter ran out of labels, in which case the emitter fails).
+*/
+LABEL Emitter::NewLabel(PEMITTER pEmitter)
+{
+	if (pEmitter->LabelAmount == EMITTER_MAX_LABELS)
+	{
+		FailEmitter(pEmitter, "NewLabel", "too many labels");
+		return EMITTER_MAX_LABELS;
+	}
+
+	pEmitter->LabelOffsets[pEmitter->LabelAmount] = EMITTER_UNBOUND;
+	return (LABEL) pEmitter->LabelAmount++;
+}
+
+/*
+Bind a label to the position of the next instruction.
+@param pEmitter, the emitter.
+@param label, the label.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Emitter::Bind(PEMITTER pEmitter, LABEL label)
+{
+	if (label >= pEmitter->LabelAmount || pEmitter->LabelOffsets[label] != EMITTER_UNBOUND)
+		return FailEmitter(pEmitter, "Bind", "invalid label");
+
+	pEmitter->LabelOffsets[label] = pEmitter->Size;
+	return TRUE;
+}
+
+/*
+Emit a relative JMP (EB rel8 / E9 rel32).
+@param pEmitter, the emitter.
+@param pTarget, the target (or label, for JmpLabel).
+@param branchSize, the size of the Relative Address (BRANCH_SIZE).
+@return TRUE if the function succeeds, FALSE if it fails (e.g. the target is out of reach).
+*/
+BOOL Emitter::Jmp(PEMITTER pEmitter, LPVOID pTarget, BYTE branchSize)
+{
+	if (!pTarget)
+		return FailEmitter(pEmitter, "Jmp", "invalid target");
+
+	return EmitBranch(pEmitter, "Jmp", JMP_REL8_OPCODE, JMP_REL32_OPCODE, 1, (PBYTE) pTarget, 0, branchSize);
+}
+
+BOOL Emitter::JmpLabel(PEMITTER pEmitter, LABEL label, BYTE branchSize)
+{
+	if (label >= pEmitter->LabelAmount)
+		return FailEmitter(pEmitter, "JmpLabel", "invalid label");
+
+	return EmitBranch(pEmitter, "JmpLabel", JMP_REL8_OPCODE, JMP_REL32_OPCODE, 1, LabelTarget(pEmitter, label), label, branchSize);
+}
+
+/*
+Emit a conditional relative JMP (7x rel8 / 0F 8x rel32).
+@param pEmitter, the emitter.
+@param condition, the branch's condition (CONDITION).
+@param pTarget, the target (or label, for JccLabel).
+@param branchSize, the size of the Relative Address (BRANCH_SIZE).
+@return TRUE if the function succeeds, FALSE if it fails (e.g. the target is out of reach).
+*/
+BOOL Emitter::Jcc(PEMITTER pEmitter, BYTE condition, LPVOID pTarget, BYTE branchSize)
+{
+	if (condition > CONDITION_G || !pTarget)
+		return FailEmitter(pEmitter, "Jcc", "invalid condition or target");
+
+	return EmitBranch(pEmitter, "Jcc", JCC_REL8_OPCODE | condition, JCC_REL32_OPCODE | condition, 2, (PBYTE) pTarget, 0, branchSize);
+}
+
+BOOL Emitter::JccLabel(PEMITTER pEmitter, BYTE condition, LABEL label, BYTE branchSize)
+{
+	if (condition > CONDITION_G || label >= pEmitter->LabelAmount)
+		return FailEmitter(pEmitter, "JccLabel", "invalid condition or label");
+
+	return EmitBranch(pEmitter, "JccLabel", JCC_REL8_OPCODE | condition, JCC_REL32_OPCODE | condition, 2, LabelTarget(pEmitter, label), label, branchSize);
+}
+
+/*
+Emit a relative CALL (E8 rel32).
+@param pEmitter, the emitter.
+@param pTarget, the target.
+@return TRUE if the function succeeds, FALSE if it fails (e.g. the target is out of reach).
+*/
+BOOL Emitter::Call(PEMITTER pEmitter, LPVOID pTarget)
+{
+	if (!pTarget)
+		return FailEmitter(pEmitter, "Call", "invalid target");
+
+	return EmitBranch(pEmitter, "Call", 0, CALL_REL32_OPCODE, 1, (PBYTE) pTarget, 0, BRANCH_SIZE_NEAR);
+}
+
+/*
+Emit an absolute JMP, which reaches any address (FF 25, followed by the target's address).
+@param pEmitter, the emitter.
+@param pTarget, the target.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Emitter::JmpAbsolute(PEMITTER pEmitter, LPVOID pTarget)
+{
+	/* JMP [RIP+0], the address directly follows the JMP */
+	return EmitIndirect(pEmitter, INDIRECT_JMP, 0) && EmitAddress(pEmitter, pTarget);
+}
+
+/*
+Emit a JMP that pushes the target's address & returns to it, which reaches any address without storing it apart from the code
+(68 imm32, C7 44 24 04 imm32 in 64-bit mode, C3).
+The RET isn't paired with a CALL, so it's mispredicted by the return stack, and it's rejected by shadow stacks (e.g. CET).
+@param pEmitter, the emitter.
+@param pTarget, the target.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Emitter::JmpPushRet(PEMITTER pEmitter, LPVOID pTarget)
+{
+	/* PUSH imm32 is always used (rather than imm8), so the JMP is of a known size */
+	ULONG_PTR target = (ULONG_PTR) pTarget;
+	if (!EmitByte(pEmitter, PUSH_IMM32_OPCODE) || !EmitDword(pEmitter, (DWORD) target))
+		return FALSE;
+
+	/* The pushed imm32 is sign-extended in 64-bit mode, so the high half is overwritten by MOV DWORD [RSP+4], imm32 */
+	if (IsLongMode() &&
+		(!EmitByte(pEmitter, MOV_IMM32_OPCODE) ||
+		!EmitByte(pEmitter, ModRM(0b01, 0, RM_SIB)) ||
+		!EmitByte(pEmitter, ModRM(0b00, RM_SIB, GPR_SP)) ||
+		!EmitByte(pEmitter, STACK_HIGH_HALF) ||
+		!EmitDword(pEmitter, (DWORD) ((INT64) target >> 32))))
+	{
+		return FALSE;
+	}
+
+	return EmitByte(pEmitter, RET_OPCODE);
+}
+
+/*
+Emit an absolute CALL, which reaches any address (FF 15, then a JMP over the target's address).
+@param pEmitter, the emitter.
+@param pTarget, the target.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Emitter::CallAbsolute(PEMITTER pEmitter, LPVOID pTarget)
+{
+	/* CALL [RIP+2], which returns to a JMP over the address */
+	return EmitIndirect(pEmitter, INDIRECT_CALL, JMP_REL8_SIZE) &&
+		EmitByte(pEmitter, JMP_REL8_OPCODE) &&
+		EmitByte(pEmitter, sizeof(LPVOID)) &&
+		EmitAddress(pEmitter, pTarget);
+}
+
+/*
+Emit a PUSH, POP or RET.
+@param pEmitter, the emitter.
+@param reg, the register (GP_REGISTER).
+@param value, the pushed immediate, which is sign-extended to the native width.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Emitter::Push(PEMITTER pEmitter, BYTE reg)
+{
+	/* PUSH is 64-bit by default in 64-bit mode, so REX only extends the register */
+	return EmitRex(pEmitter, "Push", false, 0, reg) && EmitByte(pEmitter, PUSH_OPCODE | (reg & 0b111));
+}
+
+BOOL Emitter::PushImmediate(PEMITTER pEmitter, int32_t value)
+{
+	if (IsInt8(value))
+		return EmitByte(pEmitter, PUSH_IMM8_OPCODE) && EmitByte(pEmitter, (BYTE) value);
+
+	return EmitByte(pEmitter, PUSH_IMM32_OPCODE) && EmitDword(pEmitter, (DWORD) value);
+}
+
+BOOL Emitter::Pop(PEMITTER pEmitter, BYTE reg)
+{
+	return EmitRex(pEmitter, "Pop", false, 0, reg) && EmitByte(pEmitter, POP_OPCODE | (reg & 0b111));
+}
+
+BOOL Emitter::Ret(PEMITTER pEmitter)
+{
+	return EmitByte(pEmitter, RET_OPCODE);
+}
+
+/*
+Emit a MOV between registers, or of an immediate to a register (the shortest form that loads the whole value).
+@param pEmitter, the emitter.
+@param destination, the destination register (GP_REGISTER).
+@param source, the source register (GP_REGISTER).
+@param value, the immediate.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Emitter::Mov(PEMITTER pEmitter, BYTE destination, BYTE source)
+{
+	return EmitRex(pEmitter, "Mov", true, source, destination) &&
+		EmitByte(pEmitter, MOV_OPCODE) &&
+		EmitByte(pEmitter, ModRM(0b11, source, destination));
+}
+
+BOOL Emitter::MovImmediate(PEMITTER pEmitter, BYTE destination, ULONG_PTR value)
+{
+	/* A 32-bit MOV zero-extends to 64 bits, and C7 /0 sign-extends its imm32 */
+	if (!IsLongMode() || value == (DWORD) value)
+	{
+		return EmitRex(pEmitter, "MovImmediate", false, 0, destination) &&
+			EmitByte(pEmitter, MOV_IMM_OPCODE | (destination & 0b111)) &&
+			EmitDword(pEmitter, (DWORD) value);
+	}
+
+	if (IsInt32((INT64) value))
+	{
+		return EmitRex(pEmitter, "MovImmediate", true, 0, destination) &&
+			EmitByte(pEmitter, MOV_IMM32_OPCODE) &&
+			EmitByte(pEmitter, ModRM(0b11, 0, destination)) &&
+			EmitDword(pEmitter, (DWORD) value);
+	}
+
+	return EmitRex(pEmitter, "MovImmediate", true, 0, destination) &&
+		EmitByte(pEmitter, MOV_IMM_OPCODE | (destination & 0b111)) &&
+		EmitBytes(pEmitter, &value, sizeof(value));
+}
+
+/*
+Emit a LEA of a register-relative address, or of an absolute address (which is RIP-relative in 64-bit mode).
+@param pEmitter, the emitter.
+@param destination, the destination register (GP_REGISTER).
+@param base, the base register (GP_REGISTER).
+@param displacement, the displacement from the base register.
+@param pAddress, the absolute address.
+@return TRUE if the function succeeds, FALSE if it fails (e.g. the address is out of reach).
+*/
+BOOL Emitter::Lea(PEMITTER pEmitter, BYTE destination, BYTE base, int32_t displacement)
+{
+	/* BP & R13 have no form without a displacement (it selects disp32), so they're given a zero disp8 */
+	BYTE mod = 0b10;
+	if (!displacement && (base & 0b111) != RM_DISP32)
+		mod = 0b00;
+	else if (IsInt8(displacement))
+		mod = 0b01;
+
+	if (!EmitRex(pEmitter, "Lea", true, destination, base) ||
+		!EmitByte(pEmitter, LEA_OPCODE) ||
+		!EmitByte(pEmitter, ModRM(mod, destination, base)))
+	{
+		return FALSE;
+	}
+
+	/* SP & R12 select a SIB byte, which selects them as the base without an index */
+	if ((base & 0b111) == RM_SIB && !EmitByte(pEmitter, ModRM(0b00, RM_SIB, base)))
+		return FALSE;
+
+	if (mod == 0b01)
+		return EmitByte(pEmitter, (BYTE) displacement);
+
+	return mod == 0b00 || EmitDword(pEmitter, (DWORD) displacement);
+}
+
+BOOL Emitter::LeaAddress(PEMITTER pEmitter, BYTE destination, LPVOID pAddress)
+{
+	if (!EmitRex(pEmitter, "LeaAddress", true, destination, 0) ||
+		!EmitByte(pEmitter, LEA_OPCODE) ||
+		!EmitByte(pEmitter, ModRM(0b00, destination, RM_DISP32)))
+	{
+		return FALSE;
+	}
+
+	if (!IsLongMode())
+		return EmitDword(pEmitter, (DWORD) (ULONG_PTR) pAddress);
+
+	/* The displacement is the last field, so it's relative to the end of the instruction */
+	INT64 displacement = (PBYTE) pAddress - (pEmitter->pRuntime + pEmitter->Size + DWORD_SIZE);
+	if (!IsInt32(displacement))
+		return FailEmitter(pEmitter, "LeaAddress", "address is out of reach");
+
+	return EmitDword(pEmitter, (DWORD) displacement);
+}
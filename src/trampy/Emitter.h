@@ -0,0 +1,256 @@
+#pragma once
+#include "TrampyDefs.h"
+
+/*
+Max amount of labels & label references (fixups) within a single piece of code.
+Stubs are small, so both are stored within the emitter rather than allocated.
+*/
+#define EMITTER_MAX_LABELS 8
+#define EMITTER_MAX_FIXUPS 16
+
+/*
+Sizes of the branches the emitter writes.
+An absolute JMP is an indirect JMP through the address stored right after it (JMP [RIP+0] in 64-bit mode).
+A push/ret JMP pushes the target & returns to it, in 64-bit mode the target's high half is moved onto the stack separately.
+*/
+#define JMP_REL8_SIZE 2
+#define JMP_REL32_SIZE 5
+#define JCC_REL32_SIZE 6
+#define CALL_REL32_SIZE 5
+#define JMP_ABSOLUTE_SIZE (6 + sizeof(LPVOID))
+#define JMP_PUSH_RET_SIZE (sizeof(LPVOID) == QWORD_SIZE ? 14 : 6)
+
+/*
+A general-purpose register, of the native width (e.g. RAX in 64-bit mode, EAX in 32-bit mode).
+R8-R15 only exist in 64-bit mode.
+*/
+enum GP_REGISTER : BYTE
+{
+	GPR_AX, GPR_CX, GPR_DX, GPR_BX, GPR_SP, GPR_BP, GPR_SI, GPR_DI,
+	GPR_R8, GPR_R9, GPR_R10, GPR_R11, GPR_R12, GPR_R13, GPR_R14, GPR_R15,
+};
+
+/*
+The condition of a conditional branch, which is encoded in the low nibble of its opcode.
+*/
+enum CONDITION : BYTE
+{
+	CONDITION_O, CONDITION_NO, CONDITION_B, CONDITION_AE, CONDITION_E, CONDITION_NE, CONDITION_BE, CONDITION_A,
+	CONDITION_S, CONDITION_NS, CONDITION_P, CONDITION_NP, CONDITION_L, CONDITION_GE, CONDITION_LE, CONDITION_G,
+};
+
+/*
+Selects the size of a relative branch's Relative Address.
+*/
+enum BRANCH_SIZE : BYTE
+{
+	/* rel8 if the target is known & within reach, rel32 otherwise (e.g. a label that isn't bound yet) */
+	BRANCH_SIZE_AUTO,
+	/* Always rel8, the emitter fails if the target is out of reach */
+	BRANCH_SIZE_SHORT,
+	/* Always rel32, e.g. when the branch must be of a known size */
+	BRANCH_SIZE_NEAR,
+};
+
+/*
+A label, i.e. a position within the emitted code that's bound once it's reached.
+Branches may reference a label before it's bound, their Relative Address is fixed once the code is finished.
+*/
+typedef BYTE LABEL;
+
+/*
+Struct describing a reference to a label that's fixed once the code is finished.
+*/
+typedef struct _EMITTER_FIXUP
+{
+	/*
+	Offset of the Relative Address within the code, and its size (BYTE_SIZE or DWORD_SIZE).
+	*/
+	WORD Offset;
+	BYTE Size;
+	/*
+	The referenced label.
+	*/
+	LABEL Label;
+}
+EMITTER_FIXUP, *PEMITTER_FIXUP;
+
+/*
+Struct describing the state of an emitter, which writes code to a caller-provided buffer.
+Failures are sticky, so a sequence of instructions may be emitted & checked once by Emitter::Finish.
+*/
+typedef struct _EMITTER
+{
+	/*
+	The buffer the code is written to, and its capacity.
+	*/
+	PBYTE pBuffer;
+	SIZE_T Capacity;
+	/*
+	The address the code is executed from, which Relative Addresses are relative to.
+	It may differ from the buffer, e.g. when code is built in a staging buffer.
+	*/
+	PBYTE pRuntime;
+	/*
+	The size of the code emitted so far.
+	*/
+	SIZE_T Size;
+	/*
+	Did any of the emitter's functions fail.
+	*/
+	BOOL bFailed;
+	/*
+	The offset of every label within the code, or EMITTER_UNBOUND if it isn't bound yet.
+	*/
+	SIZE_T LabelAmount;
+	SIZE_T LabelOffsets[EMITTER_MAX_LABELS];
+	/*
+	The references to labels that weren't bound when they were referenced.
+	*/
+	SIZE_T FixupAmount;
+	EMITTER_FIXUP Fixups[EMITTER_MAX_FIXUPS];
+}
+EMITTER, *PEMITTER;
+
+/*
+The offset of a label that isn't bound yet.
+*/
+#define EMITTER_UNBOUND ((SIZE_T) -1)
+
+/*
+The Emitter writes x86/x64 machine code of the native mode, for the stubs the library generates (e.g. Trampolines).
+It never allocates: the code is written to a caller-provided buffer, and labels & fixups are kept within the emitter.
+Every function returns whether it succeeded, and failures are sticky, so Emitter::Finish reports whether all of them succeeded.
+*/
+namespace Emitter
+{
+	/*
+	Initialize an emitter.
+	@param pEmitter, the emitter.
+	@param pBuffer, the buffer the code is written to.
+	@param capacity, the capacity of the buffer.
+	@param pRuntime, the address the code is executed from (e.g. pBuffer, or where a staging buffer is copied to).
+	*/
+	void Initialize(OUT PEMITTER pEmitter, PBYTE pBuffer, SIZE_T capacity, LPVOID pRuntime);
+
+	/*
+	Finish the code, fixing every reference to a label that was bound after it was referenced.
+	@param pEmitter, the emitter.
+	@param pSize, receives the size of the code.
+	@return TRUE if the code was emitted successfully, FALSE if any of the emitter's functions failed.
+	*/
+	BOOL Finish(PEMITTER pEmitter, OUT SIZE_T *pSize);
+
+	/*
+	@return the address the next instruction is executed from.
+	*/
+	LPVOID Position(PEMITTER pEmitter);
+
+	/*
+	Reserve space for code that's written by the caller (e.g. relocated instructions).
+	@param pEmitter, the emitter.
+	@param size, the size of the code.
+	@return pointer to the reserved space within the buffer, or NULL if the function failed.
+	*/
+	PBYTE Reserve(PEMITTER pEmitter, SIZE_T size);
+
+	/*
+	Create a new label, which isn't bound yet.
+	@param pEmitter, the emitter.
+	@return the label (which is invalid if the emitter ran out of labels, in which case the emitter fails).
+	*/
+	LABEL NewLabel(PEMITTER pEmitter);
+	/*
+	Bind a label to the position of the next instruction.
+	@param pEmitter, the emitter.
+	@param label, the label.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL Bind(PEMITTER pEmitter, LABEL label);
+
+	/*
+	Emit a relative JMP (EB rel8 / E9 rel32).
+	@param pEmitter, the emitter.
+	@param pTarget, the target (or label, for JmpLabel).
+	@param branchSize, the size of the Relative Address (BRANCH_SIZE).
+	@return TRUE if the function succeeds, FALSE if it fails (e.g. the target is out of reach).
+	*/
+	BOOL Jmp(PEMITTER pEmitter, LPVOID pTarget, BYTE branchSize);
+	BOOL JmpLabel(PEMITTER pEmitter, LABEL label, BYTE branchSize);
+	/*
+	Emit a conditional relative JMP (7x rel8 / 0F 8x rel32).
+	@param pEmitter, the emitter.
+	@param condition, the branch's condition (CONDITION).
+	@param pTarget, the target (or label, for JccLabel).
+	@param branchSize, the size of the Relative Address (BRANCH_SIZE).
+	@return TRUE if the function succeeds, FALSE if it fails (e.g. the target is out of reach).
+	*/
+	BOOL Jcc(PEMITTER pEmitter, BYTE condition, LPVOID pTarget, BYTE branchSize);
+	BOOL JccLabel(PEMITTER pEmitter, BYTE condition, LABEL label, BYTE branchSize);
+	/*
+	Emit a relative CALL (E8 rel32).
+	@param pEmitter, the emitter.
+	@param pTarget, the target.
+	@return TRUE if the function succeeds, FALSE if it fails (e.g. the target is out of reach).
+	*/
+	BOOL Call(PEMITTER pEmitter, LPVOID pTarget);
+
+	/*
+	Emit an absolute JMP, which reaches any address (FF 25, followed by the target's address).
+	@param pEmitter, the emitter.
+	@param pTarget, the target.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL JmpAbsolute(PEMITTER pEmitter, LPVOID pTarget);
+	/*
+	Emit a JMP that pushes the target's address & returns to it, which reaches any address without storing it apart from the code
+	(68 imm32, C7 44 24 04 imm32 in 64-bit mode, C3).
+	The RET isn't paired with a CALL, so it's mispredicted by the return stack, and it's rejected by shadow stacks (e.g. CET).
+	@param pEmitter, the emitter.
+	@param pTarget, the target.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL JmpPushRet(PEMITTER pEmitter, LPVOID pTarget);
+	/*
+	Emit an absolute CALL, which reaches any address (FF 15, then a JMP over the target's address).
+	@param pEmitter, the emitter.
+	@param pTarget, the target.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL CallAbsolute(PEMITTER pEmitter, LPVOID pTarget);
+
+	/*
+	Emit a PUSH, POP or RET.
+	@param pEmitter, the emitter.
+	@param reg, the register (GP_REGISTER).
+	@param value, the pushed immediate, which is sign-extended to the native width.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL Push(PEMITTER pEmitter, BYTE reg);
+	BOOL PushImmediate(PEMITTER pEmitter, int32_t value);
+	BOOL Pop(PEMITTER pEmitter, BYTE reg);
+	BOOL Ret(PEMITTER pEmitter);
+
+	/*
+	Emit a MOV between registers, or of an immediate to a register (the shortest form that loads the whole value).
+	@param pEmitter, the emitter.
+	@param destination, the destination register (GP_REGISTER).
+	@param source, the source register (GP_REGISTER).
+	@param value, the immediate.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL Mov(PEMITTER pEmitter, BYTE destination, BYTE source);
+	BOOL MovImmediate(PEMITTER pEmitter, BYTE destination, ULONG_PTR value);
+
+	/*
+	Emit a LEA of a register-relative address, or of an absolute address (which is RIP-relative in 64-bit mode).
+	@param pEmitter, the emitter.
+	@param destination, the destination register (GP_REGISTER).
+	@param base, the base register (GP_REGISTER).
+	@param displacement, the displacement from the base register.
+	@param pAddress, the absolute address.
+	@return TRUE if the function succeeds, FALSE if it fails (e.g. the address is out of reach).
+	*/
+	BOOL Lea(PEMITTER pEmitter, BYTE destination, BYTE base, int32_t displacement);
+	BOOL LeaAddress(PEMITTER pEmitter, BYTE destination, LPVOID pAddress);
+}
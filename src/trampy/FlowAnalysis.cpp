@@ -0,0 +1,562 @@
+#include "FlowAnalysis.h"
+#include "Memory.h"
+#include "disasm/disasm.h"
+#include "disasm/instr/OpcodeMaps.h"
+#include "disasm/instr/Vex.h"
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+
+/* The opcodes of INT3 (one-byte map) & UD2 (0F map), which compilers place where the flow never continues */
+#define INT3_OPCODE 0xCC
+#define UD2_OPCODE 0x0B
+
+/* The opcode of ENDBR32 & ENDBR64 (F3 0F 1E FB & F3 0F 1E FA), which mark the targets of indirect branches */
+#define ENDBR_OPCODE 0x1E
+#define ENDBR_MODRM_FIRST 0xFA
+#define ENDBR_MODRM_LAST 0xFB
+
+/* The opcodes of NOPs: NOP (90), multi-byte NOP (0F 1F /0) & MOV EDI, EDI (8B FF, which is only a NOP in 32-bit mode) */
+#define NOP_OPCODE 0x90
+#define MULTI_BYTE_NOP_OPCODE 0x1F
+#define MOV_OPCODE 0x8B
+#define MOV_EDI_EDI_MODRM 0xFF
+
+/* The bytes compilers pad functions with */
+#define INT3_PADDING 0xCC
+#define NOP_PADDING 0x90
+
+/* The opcode of an indirect JMP (FF /4), and its ModRM when it reads from an absolute address (JMP [disp32] in 32-bit mode) */
+#define INDIRECT_OPCODE 0xFF
+#define INDIRECT_JMP_REG 4
+#define INDIRECT_JMP_ABSOLUTE_MODRM 0x25
+
+/* The opcodes of PUSH Iz & JMP rel32, which a PLT entry's binding code starts with (PUSH relocation index; JMP PLT0) */
+#define PUSH_IMMEDIATE_OPCODE 0x68
+#define JMP_REL32_OPCODE 0xE9
+
+/*
+Struct describing the control-flow of a function.
+*/
+typedef struct _FUNCTION_FLOW
+{
+	/*
+	The function's entry, and the amount of bytes its flow was followed within.
+	*/
+	PBYTE pFunction;
+	SIZE_T MaxSize;
+	/*
+	The function's basic blocks, sorted by offset.
+	*/
+	std::vector<BASIC_BLOCK> Blocks;
+	/*
+	Offsets of the targets of the function's relative branches, sorted.
+	*/
+	std::vector<DWORD> BranchTargets;
+}
+FUNCTION_FLOW, *PFUNCTION_FLOW;
+
+/*
+Struct describing an instruction found while following a function's flow.
+*/
+typedef struct _FLOW_INSTRUCTION
+{
+	/*
+	Size of the instruction, or 0 if no instruction was found at its offset.
+	*/
+	BYTE Size;
+	/*
+	The kind of control transfer the instruction performs (BRANCH_KIND).
+	*/
+	BYTE BranchKind;
+	/*
+	Describes whether the flow continues to the next instruction.
+	*/
+	BYTE bFallsThrough;
+}
+FLOW_INSTRUCTION, *PFLOW_INSTRUCTION;
+
+/*
+The cache of analyzed functions, keyed by their entry.
+Hooks may be planned from any thread, so the cache is guarded by a lock.
+*/
+std::unordered_map<LPVOID, FLOW_REFERENCE> g_FlowCache;
+std::mutex g_FlowCacheLock;
+
+/*
+@return whether the flow continues past given instruction.
+*/
+bool FallsThrough(PDECODED_INSTRUCTION pInstruction)
+{
+	switch (pInstruction->BranchKind)
+	{
+	case BRANCH_JMP:
+	case BRANCH_JMP_INDIRECT:
+	case BRANCH_RET:
+		return false;
+	}
+
+	if (pInstruction->Encoding != ENCODING_LEGACY)
+		return true;
+
+	return !(pInstruction->Map == OPMAP_1BYTE && pInstruction->Opcode == INT3_OPCODE) &&
+		!(pInstruction->Map == OPMAP_0F && pInstruction->Opcode == UD2_OPCODE);
+}
+
+/*
+@return whether given instruction ends a basic block (i.e. it's a branch, or the flow doesn't continue past it).
+*/
+bool EndsBlock(PFLOW_INSTRUCTION pInstruction)
+{
+	return !pInstruction->bFallsThrough || pInstruction->BranchKind == BRANCH_JCC;
+}
+
+/*
+Follow the control-flow of a function from its entry, finding its basic blocks & branch targets.
+The flow is only followed within readable memory (e.g. a function that ends with a call that never returns may be the last code of its mapping).
+@param pFunction, the function's entry, whose page is readable.
+@param maxSize, the amount of bytes from the entry the flow is followed within.
+@return the function's newly allocated flow.
+*/
+std::shared_ptr<FUNCTION_FLOW> AnalyzeFunction(PBYTE pFunction, SIZE_T maxSize)
+{
+	/* The instruction found at every offset, which offsets start a block, and which offsets are branch targets */
+	std::vector<FLOW_INSTRUCTION> instructions(maxSize);
+	std::vector<bool> leaders(maxSize);
+	std::vector<bool> targets(maxSize);
+
+	/* Offsets the flow reaches, which weren't decoded yet */
+	std::vector<SIZE_T> pending = { 0 };
+	leaders[0] = true;
+
+	/* Most flows end within the entry's page, so the pages past it are only queried once the flow reaches them */
+	SIZE_T pageSize = Memory::PageSize();
+	SIZE_T readableSize = min(maxSize, pageSize - (ULONG_PTR) pFunction % pageSize);
+	BOOL bQueried = readableSize == maxSize;
+
+	while (!pending.empty())
+	{
+		SIZE_T offset = pending.back();
+		pending.pop_back();
+
+		INSTRUCTION_ITERATOR iterator;
+		DECODED_INSTRUCTION instruction;
+		Disassembler::InitializeIterator(&iterator, pFunction + offset, offset < readableSize ? readableSize - offset : 0, DISASM_MODE_NATIVE);
+
+		/* Decode linearly until the flow ends, or reaches instructions that were already decoded */
+		while (offset < readableSize && !instructions[offset].Size && Disassembler::NextInstruction(&iterator, &instruction))
+		{
+			PFLOW_INSTRUCTION pInstruction = &instructions[offset];
+			*pInstruction = { instruction.Size, instruction.BranchKind, FallsThrough(&instruction) };
+
+			/* Follow relative branches within the function (CALLs lead to other functions) */
+			if ((instruction.BranchKind == BRANCH_JMP || instruction.BranchKind == BRANCH_JCC) &&
+				instruction.Target >= pFunction && instruction.Target < pFunction + maxSize)
+			{
+				SIZE_T targetOffset = instruction.Target - pFunction;
+				targets[targetOffset] = true;
+
+				if (!leaders[targetOffset])
+				{
+					leaders[targetOffset] = true;
+					pending.push_back(targetOffset);
+				}
+			}
+
+			if (!pInstruction->bFallsThrough)
+				break;
+
+			offset += instruction.Size;
+
+			/* A conditional branch's fall-through starts a block of its own */
+			if (instruction.BranchKind == BRANCH_JCC && offset < maxSize)
+				leaders[offset] = true;
+		}
+
+		/* The flow reached the end of the entry's page (or an instruction that crosses it), the rest of the bytes are queried once */
+		if (!bQueried && offset < maxSize && !instructions[offset].Size && offset + MAX_INSTRUCTION_SIZE > readableSize)
+		{
+			readableSize += Memory::ReadableSize(pFunction + readableSize, maxSize - readableSize);
+			bQueried = TRUE;
+			pending.push_back(offset);
+		}
+	}
+
+	std::shared_ptr<FUNCTION_FLOW> pFlow = std::make_shared<FUNCTION_FLOW>();
+	pFlow->pFunction = pFunction;
+	pFlow->MaxSize = maxSize;
+
+	/* Every decoded leader starts a block, which lasts until it's left or another block starts */
+	for (SIZE_T offset = 0; offset < maxSize; offset++)
+	{
+		if (targets[offset])
+			pFlow->BranchTargets.push_back((DWORD) offset);
+
+		if (!leaders[offset] || !instructions[offset].Size)
+			continue;
+
+		PFLOW_INSTRUCTION pLast;
+		SIZE_T end = offset;
+		do
+		{
+			pLast = &instructions[end];
+			end += pLast->Size;
+		}
+		while (!EndsBlock(pLast) && end < maxSize && instructions[end].Size && !leaders[end]);
+
+		pFlow->Blocks.push_back({ (DWORD) offset, (DWORD) (end - offset), EndsBlock(pLast) ? pLast->BranchKind : (BYTE) BRANCH_NONE, pLast->bFallsThrough });
+	}
+
+	return pFlow;
+}
+
+/*
+Find the basic block that starts at given offset.
+@param pFlow, the function's flow.
+@param offset, the block's offset.
+@return pointer to the block, or NULL if no block starts at given offset.
+*/
+const BASIC_BLOCK *FindBlock(const FLOW_REFERENCE &pFlow, SIZE_T offset)
+{
+	auto block = std::lower_bound(
+		pFlow->Blocks.begin(), pFlow->Blocks.end(), offset,
+		[](const BASIC_BLOCK &block, SIZE_T offset) { return block.Offset < offset; }
+	);
+
+	if (block == pFlow->Blocks.end() || block->Offset != offset)
+		return NULL;
+
+	return &*block;
+}
+
+/*
+Analyze the control-flow of a function, or get its cached flow if it was already analyzed.
+The flow is shared with the cache, and remains valid for as long as it's referenced, however the cache changes meanwhile.
+@param pFunction, the function's entry.
+@param maxSize, the amount of bytes from the entry the flow is followed within (e.g. FLOW_DEFAULT_MAX_SIZE),
+as long as they're readable (the function may be the last code of its mapping). The entry's page must be readable.
+A cached flow is reused if it was followed within at least as many bytes.
+@return reference to the function's flow, or NULL if the function failed.
+*/
+FLOW_REFERENCE FlowAnalysis::Analyze(LPVOID pFunction, SIZE_T maxSize)
+{
+	if (!pFunction || !maxSize)
+	{
+		printf("FlowAnalysis::Analyze failed: invalid function.\n");
+		return NULL;
+	}
+
+	std::lock_guard<std::mutex> lock(g_FlowCacheLock);
+
+	FLOW_REFERENCE &pFlow = g_FlowCache[pFunction];
+	if (pFlow && pFlow->MaxSize >= maxSize)
+		return pFlow;
+
+	/* The function wasn't analyzed yet, or not within enough bytes (the flow that's replaced is freed once it's no longer referenced) */
+	pFlow = AnalyzeFunction((PBYTE) pFunction, maxSize);
+
+	return pFlow;
+}
+
+/*
+Evict a function's flow from the cache (e.g. once its code has changed), references to it remain valid.
+@param pFunction, the function's entry.
+*/
+void FlowAnalysis::Evict(LPVOID pFunction)
+{
+	std::lock_guard<std::mutex> lock(g_FlowCacheLock);
+
+	g_FlowCache.erase(pFunction);
+}
+
+/*
+Evict all flows from the cache, references to them remain valid.
+*/
+void FlowAnalysis::EvictAll()
+{
+	std::lock_guard<std::mutex> lock(g_FlowCacheLock);
+
+	g_FlowCache.clear();
+}
+
+/*
+@param pFlow, the function's flow.
+@param pBlockAmount, receives the amount of basic blocks.
+@return the function's basic blocks, sorted by offset.
+*/
+const BASIC_BLOCK *FlowAnalysis::GetBlocks(const FLOW_REFERENCE &pFlow, OUT SIZE_T *pBlockAmount)
+{
+	*pBlockAmount = pFlow->Blocks.size();
+	return pFlow->Blocks.data();
+}
+
+/*
+@param pFlow, the function's flow.
+@param pAddress, an address within the function.
+@return whether a relative branch (JMP, Jcc) within the function targets given address.
+*/
+BOOL FlowAnalysis::IsBranchTarget(const FLOW_REFERENCE &pFlow, LPVOID pAddress)
+{
+	if (pAddress < pFlow->pFunction || pAddress >= pFlow->pFunction + pFlow->MaxSize)
+		return FALSE;
+
+	DWORD offset = (DWORD) ((PBYTE) pAddress - pFlow->pFunction);
+	return std::binary_search(pFlow->BranchTargets.begin(), pFlow->BranchTargets.end(), offset);
+}
+
+/*
+Check whether the first bytes of a function may be safely overwritten, i.e. stolen by a hook.
+They may not be if a branch within the function lands within them (past the entry itself),
+or if the function's flow ends within them (e.g. a tiny function, followed by another).
+@param pFlow, the function's flow.
+@param stolenSize, the amount of bytes to be stolen, covering whole instructions.
+@param pConflictOffset, receives the offset within the stolen bytes that makes them unsafe (optional).
+@return TRUE if the bytes may be stolen, FALSE otherwise.
+*/
+BOOL FlowAnalysis::IsHookable(const FLOW_REFERENCE &pFlow, SIZE_T stolenSize, OUT SIZE_T *pConflictOffset)
+{
+	BOOL bHookable = TRUE;
+	SIZE_T conflictOffset = 0;
+
+	/* Find the first branch target past the entry, branching to the entry itself is harmless */
+	auto target = std::upper_bound(pFlow->BranchTargets.begin(), pFlow->BranchTargets.end(), (DWORD) 0);
+	if (target != pFlow->BranchTargets.end() && *target < stolenSize)
+	{
+		bHookable = FALSE;
+		conflictOffset = *target;
+	}
+
+	/* Follow the blocks from the entry through the stolen bytes, the flow must not end before they do */
+	SIZE_T offset = 0;
+	while (bHookable && offset < stolenSize)
+	{
+		const BASIC_BLOCK *pBlock = FindBlock(pFlow, offset);
+		if (!pBlock)
+		{
+			bHookable = FALSE;
+			conflictOffset = offset;
+			break;
+		}
+
+		offset += pBlock->Size;
+		if (!pBlock->bFallsThrough && offset < stolenSize)
+		{
+			bHookable = FALSE;
+			conflictOffset = offset;
+		}
+	}
+
+	if (pConflictOffset)
+		*pConflictOffset = conflictOffset;
+
+	return bHookable;
+}
+
+/*
+@return whether an instruction is an ENDBR32 or ENDBR64.
+*/
+bool IsEndbr(PDECODED_INSTRUCTION pInstruction, PBYTE pCode)
+{
+	return pInstruction->Map == OPMAP_0F && pInstruction->Opcode == ENDBR_OPCODE &&
+		(pInstruction->Prefixes & PREFIX_FLAG_REP) &&
+		pCode[pInstruction->ModRMOffset] >= ENDBR_MODRM_FIRST && pCode[pInstruction->ModRMOffset] <= ENDBR_MODRM_LAST;
+}
+
+/*
+Find where an indirect JMP reads its target from, if it's a pointer in memory at a fixed address.
+@param pInstruction, the instruction.
+@param pCode, the instruction's code.
+@return the address of the pointer (JMP [RIP+X], or JMP [X] in 32-bit mode), or NULL if it isn't such a JMP.
+*/
+LPVOID *FindJumpPointer(PDECODED_INSTRUCTION pInstruction, PBYTE pCode)
+{
+	if (pInstruction->BranchKind != BRANCH_JMP_INDIRECT ||
+		pInstruction->Map != OPMAP_1BYTE || pInstruction->Opcode != INDIRECT_OPCODE ||
+		((pCode[pInstruction->ModRMOffset] >> 3) & 0b111) != INDIRECT_JMP_REG)
+	{
+		return NULL;
+	}
+
+	if (pInstruction->bRipRelative)
+		return (LPVOID *) pInstruction->Target;
+
+	/* In 32-bit mode the same ModRM selects an absolute address */
+	if (DISASM_MODE_NATIVE == DISASM_MODE_32 && pCode[pInstruction->ModRMOffset] == INDIRECT_JMP_ABSOLUTE_MODRM)
+	{
+		DWORD address;
+		memcpy(&address, pCode + pInstruction->DisplacementOffset, DWORD_SIZE);
+		return (LPVOID *) (ULONG_PTR) address;
+	}
+
+	return NULL;
+}
+
+/*
+Check whether code binds a lazily-bound PLT entry: [ENDBR] PUSH Iz (the entry's relocation index); JMP rel32 (to PLT0).
+@param pCode, the code.
+@return whether the code binds a PLT entry.
+*/
+bool IsPltBinder(PBYTE pCode)
+{
+	INSTRUCTION_ITERATOR iterator;
+	DECODED_INSTRUCTION instruction;
+	Disassembler::InitializeIterator(&iterator, pCode, MAX_INSTRUCTION_SIZE * 3, DISASM_MODE_NATIVE);
+
+	if (!Disassembler::NextInstruction(&iterator, &instruction))
+		return false;
+
+	if (IsEndbr(&instruction, pCode + instruction.Offset) && !Disassembler::NextInstruction(&iterator, &instruction))
+		return false;
+
+	if (instruction.Map != OPMAP_1BYTE || instruction.Opcode != PUSH_IMMEDIATE_OPCODE)
+		return false;
+
+	return Disassembler::NextInstruction(&iterator, &instruction) &&
+		instruction.Map == OPMAP_1BYTE && instruction.Opcode == JMP_REL32_OPCODE;
+}
+
+/*
+Follow the unconditional jumps a function's entry goes through to reach its body,
+e.g. incremental-link thunks (JMP rel32), import stubs (JMP [X]) & PLT entries (JMP [RIP+X]).
+Relative JMPs & indirect JMPs through a pointer in memory are followed, and an ENDBR preceding a jump is skipped.
+A lazily-bound PLT entry isn't followed (it's resolved on its first call), i.e. one whose pointer still points right past its JMP,
+or at the PLT code that binds it ([ENDBR] PUSH Iz; JMP rel32, e.g. from a .plt.sec entry to its .plt entry).
+@param pFunction, the function's entry.
+@param maxJumps, the maximum amount of jumps that are followed, up to FLOW_MAX_JUMPS (e.g. FLOW_DEFAULT_MAX_JUMPS).
+@return the function's body (pFunction itself if it doesn't start with a jump),
+or NULL if the jumps form a cycle, or the body is more than maxJumps jumps away.
+*/
+LPVOID FlowAnalysis::FollowJumps(LPVOID pFunction, SIZE_T maxJumps)
+{
+	if (!pFunction || maxJumps > FLOW_MAX_JUMPS)
+	{
+		printf("FlowAnalysis::FollowJumps failed: invalid function or jump amount.\n");
+		return NULL;
+	}
+
+	/* Every entry that was jumped through, so a cycle is noticed */
+	PBYTE visited[FLOW_MAX_JUMPS + 1];
+	SIZE_T visitedAmount = 0;
+
+	PBYTE pEntry = (PBYTE) pFunction;
+	while (true)
+	{
+		for (SIZE_T i = 0; i < visitedAmount; i++)
+		{
+			if (visited[i] == pEntry)
+			{
+				printf("FlowAnalysis::FollowJumps failed: the jumps from %p form a cycle.\n", pFunction);
+				return NULL;
+			}
+		}
+
+		visited[visitedAmount++] = pEntry;
+
+		/* Decode the entry's first instruction, or the one after its ENDBR */
+		INSTRUCTION_ITERATOR iterator;
+		DECODED_INSTRUCTION instruction;
+		Disassembler::InitializeIterator(&iterator, pEntry, MAX_INSTRUCTION_SIZE * 2, DISASM_MODE_NATIVE);
+
+		if (!Disassembler::NextInstruction(&iterator, &instruction))
+			return pEntry;
+
+		if (IsEndbr(&instruction, pEntry + instruction.Offset) && !Disassembler::NextInstruction(&iterator, &instruction))
+			return pEntry;
+
+		/* Find where the jump leads, the entry is the body if it doesn't start with a jump */
+		PBYTE pCode = pEntry + instruction.Offset;
+		PBYTE pNext = NULL;
+		if (instruction.BranchKind == BRANCH_JMP)
+		{
+			pNext = instruction.Target;
+		}
+		else
+		{
+			LPVOID *ppPointer = FindJumpPointer(&instruction, pCode);
+			if (!ppPointer)
+				return pEntry;
+
+			pNext = (PBYTE) *ppPointer;
+
+			/* A lazily-bound entry jumps to the code that binds it, right past its JMP, or to its entry in the PLT (IBT's .plt.sec) */
+			if (!pNext || pNext == pCode + instruction.Size || IsPltBinder(pNext))
+				return pEntry;
+		}
+
+		if (visitedAmount > maxJumps)
+		{
+			printf("FlowAnalysis::FollowJumps failed: the body of %p is more than %zu jumps away.\n", pFunction, maxJumps);
+			return NULL;
+		}
+
+		pEntry = pNext;
+	}
+}
+
+/*
+@return whether an instruction is a NOP, i.e. it may be skipped without any effect.
+*/
+bool IsNop(PDECODED_INSTRUCTION pInstruction, PBYTE pCode)
+{
+	if (pInstruction->Map == OPMAP_0F)
+		return pInstruction->Opcode == MULTI_BYTE_NOP_OPCODE && ((pCode[pInstruction->ModRMOffset] >> 3) & 0b111) == 0;
+
+	if (pInstruction->Map != OPMAP_1BYTE || (pInstruction->Prefixes & PREFIX_FLAG_REP))
+		return false;
+
+	/* With REX.B, 90 is XCHG R8, RAX */
+	if (pInstruction->Opcode == NOP_OPCODE)
+		return !(pInstruction->Rex & 1);
+
+	/* In 64-bit mode MOV EDI, EDI clears the upper half of RDI */
+	return DISASM_MODE_NATIVE == DISASM_MODE_32 && pInstruction->Opcode == MOV_OPCODE && !pInstruction->Prefixes &&
+		pCode[pInstruction->ModRMOffset] == MOV_EDI_EDI_MODRM;
+}
+
+/*
+Find the area a compiler reserved for patching a function, i.e. padding of at least HOT_PATCH_PADDING_SIZE bytes
+before it, and NOPs covering at least HOT_PATCH_ENTRY_SIZE bytes at its entry (a single NOP, or several of them).
+The padding must be readable, as it's read from before the function.
+@param pFunction, the function's entry.
+@param pArea, receives the function's hot-patch area.
+@return TRUE if the function has a hot-patch area, FALSE otherwise.
+*/
+BOOL FlowAnalysis::FindHotPatchArea(LPVOID pFunction, OUT PHOT_PATCH_AREA pArea)
+{
+	if (!pFunction)
+		return FALSE;
+
+	/* The padding is never executed, MSVC fills it with INT3s or NOPs, GCC & Clang with NOPs */
+	PBYTE pPadding = (PBYTE) pFunction - HOT_PATCH_PADDING_SIZE;
+	for (SIZE_T i = 0; i < HOT_PATCH_PADDING_SIZE; i++)
+	{
+		if (pPadding[i] != INT3_PADDING && pPadding[i] != NOP_PADDING)
+			return FALSE;
+	}
+
+	/* The short JMP replaces whole NOPs, so the body that follows them is unaffected */
+	INSTRUCTION_ITERATOR iterator;
+	DECODED_INSTRUCTION instruction;
+	Disassembler::InitializeIterator(&iterator, (PBYTE) pFunction, MAX_INSTRUCTION_SIZE * HOT_PATCH_ENTRY_SIZE, DISASM_MODE_NATIVE);
+
+	SIZE_T entrySize = 0;
+	SIZE_T nopAmount = 0;
+	while (entrySize < HOT_PATCH_ENTRY_SIZE)
+	{
+		if (!Disassembler::NextInstruction(&iterator, &instruction) ||
+			!IsNop(&instruction, (PBYTE) pFunction + instruction.Offset))
+		{
+			return FALSE;
+		}
+
+		entrySize += instruction.Size;
+		nopAmount++;
+	}
+
+	pArea->pPadding = pPadding;
+	pArea->EntrySize = entrySize;
+	pArea->bSingleInstruction = nopAmount == 1;
+	return TRUE;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include "TrampyDefs.h"
+#include <memory>
+
+/*
+The default amount of bytes a function's control-flow is followed within.
+*/
+#define FLOW_DEFAULT_MAX_SIZE 0x1000
+
+/*
+The default & maximum amount of jumps that are followed from a function's entry to its body.
+*/
+#define FLOW_DEFAULT_MAX_JUMPS 8
+#define FLOW_MAX_JUMPS 32
+
+/*
+The size of the padding that precedes a hot-patchable function, which fits a JMP rel32,
+and the size of the short JMP to it, which replaces the NOPs at the function's entry.
+*/
+#define HOT_PATCH_PADDING_SIZE 5
+#define HOT_PATCH_ENTRY_SIZE 2
+
+/*
+Definition of the Function Flow struct.
+*/
+typedef struct _FUNCTION_FLOW
+FUNCTION_FLOW, *PFUNCTION_FLOW;
+
+/*
+A reference to a function's flow, which keeps the flow valid for as long as it's held,
+even once the function is evicted from the cache, or analyzed again (within more bytes) by another thread.
+*/
+typedef std::shared_ptr<const FUNCTION_FLOW> FLOW_REFERENCE;
+
+/*
+Struct describing a basic block, i.e. a sequence of instructions that's only entered at its first instruction,
+and only left after its last instruction.
+*/
+typedef struct _BASIC_BLOCK
+{
+	/*
+	Offset of the block from the beginning of the function, and its size in bytes.
+	*/
+	DWORD Offset;
+	DWORD Size;
+	/*
+	The kind of control transfer the block's last instruction performs (BRANCH_KIND).
+	BRANCH_NONE if the block isn't left through a branch (e.g. it runs into the next block, or ends with INT3).
+	*/
+	BYTE BranchKind;
+	/*
+	Describes whether the flow may continue right after the block (i.e. it doesn't end with a JMP, RET, INT3, e.t.c).
+	*/
+	BYTE bFallsThrough;
+}
+BASIC_BLOCK, *PBASIC_BLOCK;
+
+/*
+Struct describing the area a compiler reserves for patching a function: padding before it, and NOPs at its entry.
+MSVC's /hotpatch & /FUNCTIONPADMIN produce MOV EDI, EDI preceded by 5 bytes of padding (32-bit),
+and GCC & Clang's -fpatchable-function-entry=N,M produce N-M NOPs at the entry, preceded by M NOPs (e.g. N=7, M=5).
+*/
+typedef struct _HOT_PATCH_AREA
+{
+	/*
+	The padding before the function, which is never executed, so a JMP rel32 may be written to it at any time.
+	*/
+	PBYTE pPadding;
+	/*
+	The size of the whole NOPs at the entry that a short JMP to the padding replaces, the function's body follows them.
+	*/
+	SIZE_T EntrySize;
+	/*
+	Whether the entry is a single NOP (e.g. 66 90, MOV EDI, EDI or 0F 1F /0), so no thread may be within it,
+	and the short JMP may be stored over it at once. An entry made of several NOPs (e.g. GCC's 90 90) may have a thread
+	between them, which would execute the short JMP's displacement, so it's only replaced while every other thread is suspended.
+	*/
+	BOOL bSingleInstruction;
+}
+HOT_PATCH_AREA, *PHOT_PATCH_AREA;
+
+/*
+A Function Flow describes the control-flow of a function: its basic blocks, and the targets of its relative branches.
+It's found by following the function's branches from its entry, within a limited amount of bytes,
+so code that's only reached through indirect branches (e.g. jump tables) isn't part of it.
+Flows are cached per function, so a function is only analyzed once, however many times it's queried.
+*/
+namespace FlowAnalysis
+{
+	/*
+	Analyze the control-flow of a function, or get its cached flow if it was already analyzed.
+	The flow is shared with the cache, and remains valid for as long as it's referenced, however the cache changes meanwhile.
+	@param pFunction, the function's entry.
+	@param maxSize, the amount of bytes from the entry the flow is followed within (e.g. FLOW_DEFAULT_MAX_SIZE),
+	as long as they're readable (the function may be the last code of its mapping). The entry's page must be readable.
+	A cached flow is reused if it was followed within at least as many bytes.
+	@return reference to the function's flow, or NULL if the function failed.
+	*/
+	FLOW_REFERENCE Analyze(LPVOID pFunction, SIZE_T maxSize);
+
+	/*
+	Evict a function's flow from the cache (e.g. once its code has changed), references to it remain valid.
+	@param pFunction, the function's entry.
+	*/
+	void Evict(LPVOID pFunction);
+	/*
+	Evict all flows from the cache, references to them remain valid.
+	*/
+	void EvictAll();
+
+	/*
+	@param pFlow, the function's flow.
+	@param pBlockAmount, receives the amount of basic blocks.
+	@return the function's basic blocks, sorted by offset.
+	*/
+	const BASIC_BLOCK *GetBlocks(const FLOW_REFERENCE &pFlow, OUT SIZE_T *pBlockAmount);
+
+	/*
+	@param pFlow, the function's flow.
+	@param pAddress, an address within the function.
+	@return whether a relative branch (JMP, Jcc) within the function targets given address.
+	*/
+	BOOL IsBranchTarget(const FLOW_REFERENCE &pFlow, LPVOID pAddress);
+
+	/*
+	Check whether the first bytes of a function may be safely overwritten, i.e. stolen by a hook.
+	They may not be if a branch within the function lands within them (past the entry itself),
+	or if the function's flow ends within them (e.g. a tiny function, followed by another).
+	@param pFlow, the function's flow.
+	@param stolenSize, the amount of bytes to be stolen, covering whole instructions.
+	@param pConflictOffset, receives the offset within the stolen bytes that makes them unsafe (optional).
+	@return TRUE if the bytes may be stolen, FALSE otherwise.
+	*/
+	BOOL IsHookable(const FLOW_REFERENCE &pFlow, SIZE_T stolenSize, OUT SIZE_T *pConflictOffset);
+
+	/*
+	Follow the unconditional jumps a function's entry goes through to reach its body,
+	e.g. incremental-link thunks (JMP rel32), import stubs (JMP [X]) & PLT entries (JMP [RIP+X]).
+	Relative JMPs & indirect JMPs through a pointer in memory are followed, and an ENDBR preceding a jump is skipped.
+	A lazily-bound PLT entry isn't followed (it's resolved on its first call), i.e. one whose pointer still points right past its JMP,
+	or at the PLT code that binds it ([ENDBR] PUSH Iz; JMP rel32, e.g. from a .plt.sec entry to its .plt entry).
+	@param pFunction, the function's entry.
+	@param maxJumps, the maximum amount of jumps that are followed, up to FLOW_MAX_JUMPS (e.g. FLOW_DEFAULT_MAX_JUMPS).
+	@return the function's body (pFunction itself if it doesn't start with a jump),
+	or NULL if the jumps form a cycle, or the body is more than maxJumps jumps away.
+	*/
+	LPVOID FollowJumps(LPVOID pFunction, SIZE_T maxJumps);
+
+	/*
+	Find the area a compiler reserved for patching a function, i.e. padding of at least HOT_PATCH_PADDING_SIZE bytes
+	before it, and NOPs covering at least HOT_PATCH_ENTRY_SIZE bytes at its entry (a single NOP, or several of them).
+	The padding must be readable, as it's read from before the function.
+	@param pFunction, the function's entry.
+	@param pArea, receives the function's hot-patch area.
+	@return TRUE if the function has a hot-patch area, FALSE otherwise.
+	*/
+	BOOL FindHotPatchArea(LPVOID pFunction, OUT PHOT_PATCH_AREA pArea);
+}
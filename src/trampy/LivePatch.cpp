@@ -0,0 +1,316 @@
+#include "LivePatch.h"
+#include "Memory.h"
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#ifndef _WIN32
+#include <signal.h>
+#include <ucontext.h>
+#endif
+
+/* The opcode of INT3, which traps a thread that reaches a patch while it's written */
+#define INT3_OPCODE 0xCC
+
+/* The register of a signal's context which holds the instruction pointer */
+#ifndef _WIN32
+#ifdef __x86_64__
+#define CONTEXT_IP REG_RIP
+#else
+#define CONTEXT_IP REG_EIP
+#endif
+#endif
+
+/*
+Struct describing a site that's trapped by an INT3 while it's patched, and where threads that hit it are forwarded.
+Both are atomic, as they're read by the trap handler, which may interrupt any thread.
+*/
+typedef struct _TRAP_SITE
+{
+	std::atomic<ULONG_PTR> Site;
+	std::atomic<ULONG_PTR> Forward;
+}
+TRAP_SITE, *PTRAP_SITE;
+
+/*
+The trapped sites, which are replaced oldest-first, and the site that's replaced next.
+Patches are written by a single thread at a time, so they're guarded by a lock (the trap handler only reads the sites),
+which is recursive, as it's also held around whole writes (see LivePatch::LockWrites).
+*/
+TRAP_SITE g_TrapSites[LIVE_PATCH_TRAP_SITES];
+SIZE_T g_NextTrapSite = 0;
+BOOL g_bTrapHandler = FALSE;
+std::recursive_mutex g_LivePatchLock;
+
+#ifndef _WIN32
+/*
+The action SIGTRAP had before the trap handler was installed, which handles traps that weren't caused by a patch.
+*/
+struct sigaction g_PreviousTrapAction;
+#endif
+
+/*
+Track a site that's trapped while it's patched, so threads that hit it are forwarded.
+@param pSite, the site.
+@param pForward, where threads that hit it are forwarded.
+*/
+void TrackTrapSite(PBYTE pSite, LPVOID pForward)
+{
+	/* A site that's tracked already (e.g. by a previous patch) is updated in place */
+	PTRAP_SITE pTrapSite = NULL;
+	for (TRAP_SITE &trapSite : g_TrapSites)
+	{
+		if (trapSite.Site == (ULONG_PTR) pSite)
+			pTrapSite = &trapSite;
+	}
+
+	if (!pTrapSite)
+	{
+		pTrapSite = &g_TrapSites[g_NextTrapSite];
+		g_NextTrapSite = (g_NextTrapSite + 1) % LIVE_PATCH_TRAP_SITES;
+	}
+
+	/* The site is cleared while it's updated, so the trap handler never pairs it with another site's forward */
+	pTrapSite->Site = 0;
+	pTrapSite->Forward = (ULONG_PTR) pForward;
+	pTrapSite->Site = (ULONG_PTR) pSite;
+}
+
+/*
+@return where threads that hit given trapped site are forwarded, or 0 if the site isn't tracked (i.e. the trap isn't a patch's).
+*/
+ULONG_PTR FindTrapForward(ULONG_PTR site)
+{
+	for (TRAP_SITE &trapSite : g_TrapSites)
+	{
+		if (trapSite.Site != site)
+			continue;
+
+		ULONG_PTR forward = trapSite.Forward;
+		if (trapSite.Site == site)
+			return forward;
+	}
+
+	return 0;
+}
+
+#ifdef _WIN32
+/*
+Forward a thread that hit a patch's INT3 (a vectored exception handler).
+@param pExceptionInfo, the exception & the thread's context.
+@return whether the thread continues, or the exception is passed to the next handler.
+*/
+LONG CALLBACK TrapHandler(PEXCEPTION_POINTERS pExceptionInfo)
+{
+	if (pExceptionInfo->ExceptionRecord->ExceptionCode != EXCEPTION_BREAKPOINT)
+		return EXCEPTION_CONTINUE_SEARCH;
+
+	/* The exception's address is the INT3 itself */
+	ULONG_PTR forward = FindTrapForward((ULONG_PTR) pExceptionInfo->ExceptionRecord->ExceptionAddress);
+	if (!forward)
+		return EXCEPTION_CONTINUE_SEARCH;
+
+#ifdef _WIN64
+	pExceptionInfo->ContextRecord->Rip = forward;
+#else
+	pExceptionInfo->ContextRecord->Eip = forward;
+#endif
+
+	return EXCEPTION_CONTINUE_EXECUTION;
+}
+#else
+/*
+Forward a thread that hit a patch's INT3 (a SIGTRAP handler), other traps are passed to the previous action.
+@param signalNumber, the signal.
+@param pInfo, the signal's info.
+@param pContext, the thread's context.
+*/
+void TrapHandler(int signalNumber, siginfo_t *pInfo, void *pContext)
+{
+	/* The instruction pointer follows the INT3 */
+	greg_t *pRegisters = ((ucontext_t *) pContext)->uc_mcontext.gregs;
+	ULONG_PTR forward = FindTrapForward((ULONG_PTR) pRegisters[CONTEXT_IP] - 1);
+	if (forward)
+	{
+		pRegisters[CONTEXT_IP] = (greg_t) forward;
+		return;
+	}
+
+	if (g_PreviousTrapAction.sa_flags & SA_SIGINFO)
+	{
+		g_PreviousTrapAction.sa_sigaction(signalNumber, pInfo, pContext);
+		return;
+	}
+
+	if (g_PreviousTrapAction.sa_handler == SIG_IGN)
+		return;
+
+	if (g_PreviousTrapAction.sa_handler != SIG_DFL)
+	{
+		g_PreviousTrapAction.sa_handler(signalNumber);
+		return;
+	}
+
+	/* The default action terminates the process, as if the handler wasn't installed */
+	sigaction(SIGTRAP, &g_PreviousTrapAction, NULL);
+	raise(SIGTRAP);
+}
+#endif
+
+/*
+Hold off patches from other threads, e.g. while code is copied & remapped (see Memory::AliasCode), which would lose a patch that's written meanwhile,
+or while pages are made writable & written, so they aren't remapped in between. The lock is recursive.
+*/
+void LivePatch::LockWrites()
+{
+	g_LivePatchLock.lock();
+}
+
+void LivePatch::UnlockWrites()
+{
+	g_LivePatchLock.unlock();
+}
+
+/*
+Install the trap handler that forwards threads which hit a patch while it's written, unless it was installed already.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL LivePatch::InstallTrapHandler()
+{
+	std::lock_guard<std::recursive_mutex> lock(g_LivePatchLock);
+
+	if (g_bTrapHandler)
+		return TRUE;
+
+#ifdef _WIN32
+	/* The handler is called first, so traps of patches are never passed to a debugger */
+	g_bTrapHandler = AddVectoredExceptionHandler(TRUE, TrapHandler) != NULL;
+#else
+	struct sigaction action = { };
+	action.sa_sigaction = TrapHandler;
+	action.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	g_bTrapHandler = !sigaction(SIGTRAP, &action, &g_PreviousTrapAction);
+#endif
+
+	if (!g_bTrapHandler)
+		printf("LivePatch::InstallTrapHandler failed: couldn't install the trap handler.\n");
+
+	return g_bTrapHandler;
+}
+
+/*
+Publish a pointer to other threads (e.g. Trampoline), with release ordering,
+so a thread that observes anything written after it (e.g. a patch that leads to a Hook) observes the pointer as well.
+@param ppPointer, where the pointer is published.
+@param pValue, the pointer.
+*/
+void LivePatch::Publish(LPVOID *ppPointer, LPVOID pValue)
+{
+#ifdef _WIN32
+	InterlockedExchangePointer(ppPointer, pValue);
+#else
+	__atomic_store_n(ppPointer, pValue, __ATOMIC_RELEASE);
+#endif
+}
+
+/*
+Store a single byte of code.
+*/
+void StoreCodeByte(PBYTE pDestination, BYTE value)
+{
+#ifdef _WIN32
+	InterlockedExchange8((CHAR volatile *) pDestination, (CHAR) value);
+#else
+	__atomic_store_n(pDestination, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/*
+Write a patch at once, by a compare-exchange of the aligned QWORD it's within.
+@param pPatch, the patch.
+@return TRUE if the patch was written, FALSE if it isn't within an aligned QWORD.
+*/
+BOOL WritePatchQword(const LIVE_PATCH *pPatch)
+{
+	SIZE_T offset = (ULONG_PTR) pPatch->pDestination % QWORD_SIZE;
+	if (offset + pPatch->Size > QWORD_SIZE)
+		return FALSE;
+
+	/* The QWORD's other bytes may be another function's, they're kept as they are when the exchange succeeds */
+	volatile INT64 *pQword = (volatile INT64 *) (pPatch->pWritable - offset);
+	INT64 expected = *pQword;
+	for (;;)
+	{
+		INT64 desired = expected;
+		memcpy((PBYTE) &desired + offset, pPatch->pCode, pPatch->Size);
+
+#ifdef _WIN32
+		INT64 initial = InterlockedCompareExchange64((LONG64 volatile *) pQword, desired, expected);
+		if (initial == expected)
+			return TRUE;
+
+		expected = initial;
+#else
+		if (__atomic_compare_exchange_n(pQword, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			return TRUE;
+#endif
+	}
+}
+
+/*
+Write patches in three steps, with an INT3 over their first byte while the rest of their bytes are written.
+@param patches, the patches, up to LIVE_PATCH_MAX_TRAPPED.
+*/
+void WritePatchesTrapped(const std::vector<const LIVE_PATCH *> &patches)
+{
+	/* Trap the first byte of every patch, a thread that reaches a patch from now on is forwarded */
+	for (const LIVE_PATCH *pPatch : patches)
+	{
+		TrackTrapSite(pPatch->pDestination, pPatch->pForward);
+		StoreCodeByte(pPatch->pWritable, INT3_OPCODE);
+	}
+
+	Memory::SynchronizeCores();
+
+	/* Write the rest of the bytes, which are only reached through the INT3 */
+	for (const LIVE_PATCH *pPatch : patches)
+		memcpy(pPatch->pWritable + 1, pPatch->pCode + 1, pPatch->Size - 1);
+
+	Memory::SynchronizeCores();
+
+	/* Replace the INT3 by the first byte, which completes the new instruction */
+	for (const LIVE_PATCH *pPatch : patches)
+		StoreCodeByte(pPatch->pWritable, pPatch->pCode[0]);
+
+	Memory::SynchronizeCores();
+}
+
+/*
+Write patches over code other threads may be running.
+The trap handler must be installed (see LivePatch::InstallTrapHandler).
+@param pPatches, the patches, which mustn't overlap.
+@param amount, the amount of patches.
+*/
+void LivePatch::Write(const LIVE_PATCH *pPatches, SIZE_T amount)
+{
+	std::lock_guard<std::recursive_mutex> lock(g_LivePatchLock);
+
+	/* Patches within an aligned QWORD are written at once, the rest are trapped in batches, so processors are serialized per batch */
+	std::vector<const LIVE_PATCH *> trapped;
+	for (SIZE_T i = 0; i < amount; i++)
+	{
+		if (WritePatchQword(&pPatches[i]))
+			continue;
+
+		trapped.push_back(&pPatches[i]);
+		if (trapped.size() == LIVE_PATCH_MAX_TRAPPED)
+		{
+			WritePatchesTrapped(trapped);
+			trapped.clear();
+		}
+	}
+
+	if (!trapped.empty())
+		WritePatchesTrapped(trapped);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "TrampyDefs.h"
+
+/*
+The amount of trapped sites the trap handler keeps track of, the oldest site is replaced by a newly trapped one.
+*/
+#define LIVE_PATCH_TRAP_SITES 1024
+
+/*
+The max amount of sites trapped at once, half of the tracked sites,
+so a site is still tracked while the next sites are patched (in case a thread that hit it is late to reach the handler).
+*/
+#define LIVE_PATCH_MAX_TRAPPED (LIVE_PATCH_TRAP_SITES / 2)
+
+/*
+Struct describing code that's written over code other threads may be running.
+*/
+typedef struct _LIVE_PATCH
+{
+	/*
+	The code that's overwritten, where threads execute it.
+	*/
+	PBYTE pDestination;
+	/*
+	Where the code is written: either the destination itself, once it's made writable (e.g. through Memory::BeginCodeWrite),
+	or a writable alias of it, which keeps the destination's offset within its page (see Memory::AliasCode).
+	*/
+	PBYTE pWritable;
+	/*
+	The new code, and its size.
+	*/
+	const BYTE *pCode;
+	SIZE_T Size;
+	/*
+	Where a thread that reaches the code while it's patched continues,
+	which must behave like the code at the destination (e.g. Trampoline, which behaves like Original).
+	*/
+	LPVOID pForward;
+}
+LIVE_PATCH, *PLIVE_PATCH;
+
+/*
+LivePatch writes code over code other threads may be running, without stopping them,
+so a thread executes either the old or the new instruction, never a mix of them.
+A patch within an aligned QWORD is written at once, by an atomic compare-exchange.
+Other patches are written in three steps: an INT3 over their first byte, then the rest of their bytes, then their first byte,
+and processors are serialized between the steps. A thread that hits the INT3 is forwarded by a trap handler.
+Threads that are within the overwritten instructions (rather than at their beginning) aren't handled.
+*/
+namespace LivePatch
+{
+	/*
+	Publish a pointer to other threads (e.g. Trampoline), with release ordering,
+	so a thread that observes anything written after it (e.g. a patch that leads to a Hook) observes the pointer as well.
+	@param ppPointer, where the pointer is published.
+	@param pValue, the pointer.
+	*/
+	void Publish(LPVOID *ppPointer, LPVOID pValue);
+
+	/*
+	Hold off patches from other threads, e.g. while code is copied & remapped (see Memory::AliasCode), which would lose a patch that's written meanwhile,
+	or while pages are made writable & written, so they aren't remapped in between. The lock is recursive.
+	*/
+	void LockWrites();
+	void UnlockWrites();
+
+	/*
+	Install the trap handler that forwards threads which hit a patch while it's written, unless it was installed already.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL InstallTrapHandler();
+
+	/*
+	Write patches over code other threads may be running.
+	The trap handler must be installed (see LivePatch::InstallTrapHandler).
+	@param pPatches, the patches, which mustn't overlap.
+	@param amount, the amount of patches.
+	*/
+	void Write(const LIVE_PATCH *pPatches, SIZE_T amount);
+}
@@ -0,0 +1,869 @@
+#include "Memory.h"
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* Size of a large page where the platform doesn't report it (x86 transparent huge pages) */
+#define X86_LARGE_PAGE_SIZE 0x200000
+
+/* The allocation granularity of Windows, which allocations are aligned to on other platforms as well */
+#define WINDOWS_ALLOCATION_GRANULARITY 0x10000
+
+/*
+Shared memory, which aliased memory is mapped from twice (a pagefile-backed section on Windows, a memfd elsewhere),
+and the value of no shared memory (i.e. private memory).
+*/
+#ifdef _WIN32
+typedef HANDLE SHARED_MEMORY;
+#define NO_SHARED_MEMORY NULL
+#else
+typedef int SHARED_MEMORY;
+#define NO_SHARED_MEMORY -1
+#endif
+
+/*
+Struct describing memory that's mapped twice: an executable view, and a writable alias of it.
+*/
+typedef struct _ALIAS_MAPPING
+{
+	/*
+	The executable view, which code is executed from, and its size.
+	*/
+	PBYTE pExecutable;
+	SIZE_T Size;
+	/*
+	The writable view, which code is written through.
+	*/
+	PBYTE pWritable;
+}
+ALIAS_MAPPING, *PALIAS_MAPPING;
+
+/*
+The aliased memory, either allocated or remapped code.
+Hooks may be prepared from any thread, so the aliases are guarded by a lock.
+*/
+std::vector<ALIAS_MAPPING> g_Aliases;
+std::mutex g_AliasLock;
+
+#ifndef _WIN32
+/*
+Struct describing the writable view of an alias that was replaced by a larger alias (see Memory::AliasCode),
+which is mapped onto the larger alias' shared memory rather than unmapped, so pointers within it stay valid.
+*/
+typedef struct _REPLACED_VIEW
+{
+	/*
+	The view, and its size.
+	*/
+	PBYTE pView;
+	SIZE_T Size;
+	/*
+	The executable memory the view is an alias of.
+	*/
+	PBYTE pExecutable;
+}
+REPLACED_VIEW, *PREPLACED_VIEW;
+
+/*
+The replaced views, which are guarded by the aliases' lock,
+and whether the fork handlers which give a child process its own copy of the aliased memory were installed.
+*/
+std::vector<REPLACED_VIEW> g_ReplacedViews;
+BOOL g_bForkHandlers = FALSE;
+#endif
+
+/*
+@return the size of a page.
+*/
+SIZE_T Memory::PageSize()
+{
+#ifdef _WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwPageSize;
+#else
+	return (SIZE_T) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/*
+@return the granularity of allocations, which allocated addresses are aligned to (e.g. 64 KB on Windows).
+*/
+SIZE_T Memory::AllocationGranularity()
+{
+#ifdef _WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwAllocationGranularity;
+#else
+	/* mmap only requires page alignment, but allocations are aligned like on Windows, so far fewer addresses are searched */
+	return max(PageSize(), (SIZE_T) WINDOWS_ALLOCATION_GRANULARITY);
+#endif
+}
+
+/*
+@return the size of a large page, or 0 if large pages aren't supported.
+*/
+SIZE_T Memory::LargePageSize()
+{
+#ifdef _WIN32
+	return GetLargePageMinimum();
+#else
+	return X86_LARGE_PAGE_SIZE;
+#endif
+}
+
+/*
+Try to allocate executable memory at an exact address.
+@param address, the address, aligned to the allocation granularity (or the large page size).
+@param size, the size of the memory.
+@param bLargePages, whether the memory is backed by large pages.
+@param sharedMemory, the shared memory the memory is mapped from, or NO_SHARED_MEMORY for private memory.
+@return pointer to the allocated memory, or NULL if the address isn't free.
+*/
+LPVOID AllocateAt(ULONG_PTR address, SIZE_T size, BOOL bLargePages, SHARED_MEMORY sharedMemory)
+{
+#ifdef _WIN32
+	if (sharedMemory != NO_SHARED_MEMORY)
+		return MapViewOfFileEx(sharedMemory, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, size, (LPVOID) address);
+
+	DWORD allocationType = MEM_COMMIT | MEM_RESERVE | (bLargePages ? MEM_LARGE_PAGES : 0);
+	return VirtualAlloc((LPVOID) address, size, allocationType, PAGE_EXECUTE_READ);
+#else
+	/* Without MAP_FIXED the address is only a hint, so the mapping is dropped if it's elsewhere */
+	int flags = sharedMemory != NO_SHARED_MEMORY ? MAP_SHARED : MAP_PRIVATE | MAP_ANONYMOUS;
+	LPVOID pMemory = mmap((LPVOID) address, size, PROT_READ | PROT_EXEC, flags, sharedMemory, 0);
+	if (pMemory == MAP_FAILED)
+		return NULL;
+
+	if (address && (ULONG_PTR) pMemory != address)
+	{
+		munmap(pMemory, size);
+		return NULL;
+	}
+
+	/* Large pages are transparent, so they're only advised */
+	if (bLargePages)
+		madvise(pMemory, size, MADV_HUGEPAGE);
+
+	return pMemory;
+#endif
+}
+
+/*
+Struct describing a region of the address space, from its start to its end (exclusive).
+*/
+typedef struct _MEMORY_REGION
+{
+	ULONG_PTR Start;
+	ULONG_PTR End;
+}
+MEMORY_REGION, *PMEMORY_REGION;
+
+/*
+Struct describing the address space, as far as searching it for free memory is concerned.
+Windows queries the address space directly (VirtualQuery), while elsewhere it's parsed once per search, from /proc/self/maps.
+*/
+typedef struct _ADDRESS_SPACE
+{
+#ifndef _WIN32
+	/*
+	The regions in use, sorted by address, or none if the address space couldn't be read (in which case every address is tried).
+	*/
+	std::vector<MEMORY_REGION> UsedRegions;
+#endif
+}
+ADDRESS_SPACE, *PADDRESS_SPACE;
+
+/*
+Read the address space, before searching it for free memory.
+Memory may be allocated by other threads meanwhile, so AllocateAt may still fail at addresses that are free within the snapshot.
+@param pSpace, receives the address space.
+*/
+void ReadAddressSpace(OUT PADDRESS_SPACE pSpace)
+{
+#ifndef _WIN32
+	FILE *pMaps = fopen("/proc/self/maps", "r");
+	if (!pMaps)
+		return;
+
+	/* Every line starts with the region's bounds, and its permissions, offset, device, inode & path are skipped */
+	unsigned long start, end;
+	while (fscanf(pMaps, "%lx-%lx%*[^\n]", &start, &end) == 2)
+		pSpace->UsedRegions.push_back({ start, end });
+
+	fclose(pMaps);
+#endif
+}
+
+/*
+Find the region in use that overlaps a range, while searching the address space for free memory.
+@param pSpace, the address space.
+@param address, the beginning of the range.
+@param size, the size of the range.
+@param pRegion, receives the region in use (its whole allocation on Windows), so the search skips over it.
+@return whether a region in use overlaps the range, or false if the range is free.
+*/
+bool FindUsedRegion(PADDRESS_SPACE pSpace, ULONG_PTR address, SIZE_T size, OUT PMEMORY_REGION pRegion)
+{
+#ifdef _WIN32
+	for (ULONG_PTR current = address; current - address < size;)
+	{
+		MEMORY_BASIC_INFORMATION info;
+		if (!VirtualQuery((LPVOID) current, &info, sizeof(info)))
+		{
+			*pRegion = { current, current + 1 };
+			return true;
+		}
+
+		if (info.State != MEM_FREE)
+		{
+			*pRegion = { (ULONG_PTR) info.AllocationBase, (ULONG_PTR) info.BaseAddress + info.RegionSize };
+			return true;
+		}
+
+		current = (ULONG_PTR) info.BaseAddress + info.RegionSize;
+	}
+
+	return false;
+#else
+	/* The first region that ends after the range's beginning is the only one that may overlap it */
+	auto pUsed = std::upper_bound(
+		pSpace->UsedRegions.begin(), pSpace->UsedRegions.end(), address,
+		[](ULONG_PTR address, const MEMORY_REGION &region) { return address < region.End; }
+	);
+
+	if (pUsed == pSpace->UsedRegions.end() || (pUsed->Start > address && pUsed->Start - address >= size))
+		return false;
+
+	*pRegion = *pUsed;
+	return true;
+#endif
+}
+
+/*
+Search for free memory within reach of a relative-JMP from a given address, and allocate it.
+Regions in use are skipped over, so memory is only allocated at addresses that are free.
+@param pTarget, the address the memory must be within reach of.
+@param size, the size of the memory, a multiple of the allocation granularity.
+@param bLargePages, whether the memory is backed by large pages (size must be a multiple of the large page size).
+@param sharedMemory, the shared memory the memory is mapped from, or NO_SHARED_MEMORY for private memory.
+@return pointer to the allocated memory, which is executable & read-only, or NULL if the function failed.
+*/
+LPVOID SearchNear(LPVOID pTarget, SIZE_T size, BOOL bLargePages, SHARED_MEMORY sharedMemory)
+{
+	/* In 32-bit mode every address is within reach, so the platform picks the address */
+	if (sizeof(LPVOID) == DWORD_SIZE)
+		return AllocateAt(0, size, bLargePages, sharedMemory);
+
+#ifdef _WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	ULONG_PTR minApplicationAddress = (ULONG_PTR) systemInfo.lpMinimumApplicationAddress;
+	ULONG_PTR maxApplicationAddress = (ULONG_PTR) systemInfo.lpMaximumApplicationAddress;
+#else
+	ULONG_PTR minApplicationAddress = Memory::PageSize();
+	ULONG_PTR maxApplicationAddress = ~(ULONG_PTR) 0;
+#endif
+
+	/* Allocations are aligned to the granularity, so we search with granularity-sized steps */
+	ULONG_PTR granularity = bLargePages ? Memory::LargePageSize() : Memory::AllocationGranularity();
+	if (!granularity)
+		return NULL;
+
+	ULONG_PTR target = (ULONG_PTR) pTarget;
+	ULONG_PTR minAddress = max(minApplicationAddress, target > REL32_RANGE ? target - REL32_RANGE : 0);
+	ULONG_PTR maxAddress = min(maxApplicationAddress, target + REL32_RANGE - size);
+
+	ADDRESS_SPACE space;
+	ReadAddressSpace(&space);
+
+	/* Search downwards from the target, continuing below every region in use */
+	ULONG_PTR address = target - target % granularity;
+	while (address >= minAddress)
+	{
+		MEMORY_REGION used;
+		if (FindUsedRegion(&space, address, size, &used))
+		{
+			if (used.Start < minAddress || used.Start - minAddress < size)
+				break;
+
+			address = (used.Start - size) - (used.Start - size) % granularity;
+			continue;
+		}
+
+		LPVOID pMemory = AllocateAt(address, size, bLargePages, sharedMemory);
+		if (pMemory)
+			return pMemory;
+
+		if (address - minAddress < granularity)
+			break;
+
+		address -= granularity;
+	}
+
+	/* Search upwards from the target, continuing above every region in use */
+	address = target - target % granularity + granularity;
+	while (address <= maxAddress)
+	{
+		MEMORY_REGION used;
+		if (FindUsedRegion(&space, address, size, &used))
+		{
+			if (used.End > maxAddress)
+				break;
+
+			address = used.End + (granularity - used.End % granularity) % granularity;
+			continue;
+		}
+
+		LPVOID pMemory = AllocateAt(address, size, bLargePages, sharedMemory);
+		if (pMemory)
+			return pMemory;
+
+		address += granularity;
+	}
+
+	return NULL;
+}
+
+/*
+Allocate executable memory within reach of a relative-JMP from a given address.
+In 32-bit mode every address is within reach, so the memory may be anywhere.
+@param pTarget, the address the memory must be within reach of.
+@param size, the size of the memory, a multiple of the allocation granularity.
+@param bLargePages, whether the memory is backed by large pages (size must be a multiple of the large page size).
+@return pointer to the allocated memory, which is executable & read-only, or NULL if the function failed.
+*/
+LPVOID Memory::AllocateNear(LPVOID pTarget, SIZE_T size, BOOL bLargePages)
+{
+	return SearchNear(pTarget, size, bLargePages, NO_SHARED_MEMORY);
+}
+
+/*
+Create shared memory, which is mapped twice by aliased memory.
+@param size, the size of the shared memory.
+@return the shared memory, or NO_SHARED_MEMORY if the function failed.
+*/
+SHARED_MEMORY CreateSharedMemory(SIZE_T size)
+{
+#ifdef _WIN32
+	DWORD64 size64 = size;
+	return CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_EXECUTE_READWRITE | SEC_COMMIT, (DWORD) (size64 >> 32), (DWORD) size64, NULL);
+#else
+	int fd = memfd_create("trampy", MFD_CLOEXEC);
+	if (fd != NO_SHARED_MEMORY && ftruncate(fd, size))
+	{
+		close(fd);
+		return NO_SHARED_MEMORY;
+	}
+
+	return fd;
+#endif
+}
+
+/*
+Close shared memory, its views keep it alive until they're unmapped.
+*/
+void CloseSharedMemory(SHARED_MEMORY sharedMemory)
+{
+#ifdef _WIN32
+	CloseHandle(sharedMemory);
+#else
+	close(sharedMemory);
+#endif
+}
+
+/*
+Map the writable view of shared memory, anywhere.
+@param sharedMemory, the shared memory.
+@param size, the size of the shared memory.
+@return pointer to the view, which is writable & not executable, or NULL if the function failed.
+*/
+PBYTE MapWritableView(SHARED_MEMORY sharedMemory, SIZE_T size)
+{
+#ifdef _WIN32
+	return (PBYTE) MapViewOfFile(sharedMemory, FILE_MAP_WRITE, 0, 0, size);
+#else
+	LPVOID pView = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, sharedMemory, 0);
+	return pView != MAP_FAILED ? (PBYTE) pView : NULL;
+#endif
+}
+
+/*
+Unmap a view of shared memory.
+@param pView, the view.
+@param size, the size of the view.
+*/
+void UnmapView(LPVOID pView, SIZE_T size)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(pView);
+#else
+	munmap(pView, size);
+#endif
+}
+
+#ifndef _WIN32
+/*
+Map the replaced views within an alias onto its shared memory.
+@param alias, the alias.
+@param sharedMemory, the alias' shared memory.
+@return TRUE if every view was mapped, FALSE otherwise.
+*/
+BOOL MapReplacedViews(const ALIAS_MAPPING &alias, SHARED_MEMORY sharedMemory)
+{
+	BOOL bMapped = TRUE;
+	for (const REPLACED_VIEW &view : g_ReplacedViews)
+	{
+		if (view.pExecutable < alias.pExecutable || view.pExecutable + view.Size > alias.pExecutable + alias.Size)
+			continue;
+
+		if (mmap(view.pView, view.Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, sharedMemory, view.pExecutable - alias.pExecutable) == MAP_FAILED)
+			bMapped = FALSE;
+	}
+
+	return bMapped;
+}
+
+/*
+Fork handlers, which lock the aliases while the process forks, so they're consistent in the child.
+*/
+void LockAliasesForFork()
+{
+	g_AliasLock.lock();
+}
+
+void UnlockAliasesForFork()
+{
+	g_AliasLock.unlock();
+}
+
+/*
+Fork handler, which gives the child its own copy of the aliased memory.
+Aliases are shared memory, which would be shared with the parent as well (so a patch or a Trampoline written by the child would be written to the parent's code),
+so each of them is copied to new shared memory, which its views are remapped onto. Their contents & addresses are kept.
+*/
+void CopyAliasesAfterFork()
+{
+	for (const ALIAS_MAPPING &alias : g_Aliases)
+	{
+		SHARED_MEMORY sharedMemory = CreateSharedMemory(alias.Size);
+		PBYTE pCopy = sharedMemory != NO_SHARED_MEMORY ? MapWritableView(sharedMemory, alias.Size) : NULL;
+
+		BOOL bCopied = pCopy != NULL;
+		if (pCopy)
+		{
+			memcpy(pCopy, alias.pWritable, alias.Size);
+			bCopied =
+				mmap(alias.pExecutable, alias.Size, PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED, sharedMemory, 0) != MAP_FAILED &&
+				mmap(alias.pWritable, alias.Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, sharedMemory, 0) != MAP_FAILED &&
+				MapReplacedViews(alias, sharedMemory);
+			UnmapView(pCopy, alias.Size);
+		}
+
+		if (sharedMemory != NO_SHARED_MEMORY)
+			CloseSharedMemory(sharedMemory);
+
+		if (!bCopied)
+			printf("CopyAliasesAfterFork failed: couldn't copy the alias of %p, it's still shared with the parent.\n", alias.pExecutable);
+	}
+
+	g_AliasLock.unlock();
+}
+
+/*
+Install the fork handlers, unless they were installed already. The aliases' lock must be held.
+*/
+void InstallForkHandlers()
+{
+	if (!g_bForkHandlers)
+		g_bForkHandlers = !pthread_atfork(LockAliasesForFork, UnlockAliasesForFork, CopyAliasesAfterFork);
+}
+#endif
+
+/*
+Allocate executable memory within reach of a relative-JMP from a given address, along with a writable alias of it,
+so code is written through the alias while the memory itself is never writable.
+In 32-bit mode every address is within reach, so the memory may be anywhere.
+@param pTarget, the address the memory must be within reach of.
+@param size, the size of the memory, a multiple of the allocation granularity.
+@param ppWritable, receives the writable alias of the memory.
+@return pointer to the allocated memory, which is executable & read-only, or NULL if the function failed.
+*/
+LPVOID Memory::AllocateNearAliased(LPVOID pTarget, SIZE_T size, OUT LPVOID *ppWritable)
+{
+	SHARED_MEMORY sharedMemory = CreateSharedMemory(size);
+	if (sharedMemory == NO_SHARED_MEMORY)
+	{
+		printf("Memory::AllocateNearAliased failed: couldn't create shared memory.\n");
+		return NULL;
+	}
+
+	PBYTE pWritable = MapWritableView(sharedMemory, size);
+	PBYTE pExecutable = pWritable ? (PBYTE) SearchNear(pTarget, size, FALSE, sharedMemory) : NULL;
+	CloseSharedMemory(sharedMemory);
+
+	if (!pExecutable)
+	{
+		if (pWritable)
+			UnmapView(pWritable, size);
+
+		return NULL;
+	}
+
+	std::lock_guard<std::mutex> lock(g_AliasLock);
+	g_Aliases.push_back({ pExecutable, size, pWritable });
+#ifndef _WIN32
+	InstallForkHandlers();
+#endif
+
+	*ppWritable = pWritable;
+	return pExecutable;
+}
+
+/*
+Remap the pages which cover a code range (e.g. the beginning of a function), so they're mapped twice:
+executable as they are, and writable through an alias, which code within them is written through from then on.
+The pages keep their contents, and they're remapped at once, so threads may be running them meanwhile.
+Pages that are aliased already are aliased again along with the rest of the range, so the whole range has a single alias.
+A child process gets its own copy of every alias once the process forks, as they'd be shared with the parent otherwise.
+@param pCode, the beginning of the range.
+@param size, the size of the range.
+@return the writable alias of the range's beginning, or NULL if the function failed (always on Windows,
+where the pages of a module belong to its image, which can't be remapped).
+*/
+LPVOID Memory::AliasCode(LPVOID pCode, SIZE_T size)
+{
+#ifdef _WIN32
+	return NULL;
+#else
+	std::lock_guard<std::mutex> lock(g_AliasLock);
+
+	ULONG_PTR pageSize = PageSize();
+	PBYTE pStart = (PBYTE) pCode - (ULONG_PTR) pCode % pageSize;
+	PBYTE pEnd = (PBYTE) pCode + size;
+	pEnd += (pageSize - (ULONG_PTR) pEnd % pageSize) % pageSize;
+
+	/* A range within a single alias is aliased already */
+	for (const ALIAS_MAPPING &alias : g_Aliases)
+	{
+		if (pStart >= alias.pExecutable && pEnd <= alias.pExecutable + alias.Size)
+			return alias.pWritable + ((PBYTE) pCode - alias.pExecutable);
+	}
+
+	/* A range that overlaps aliases is extended over them, until it overlaps no other alias */
+	for (BOOL bExtended = TRUE; bExtended;)
+	{
+		bExtended = FALSE;
+		for (const ALIAS_MAPPING &alias : g_Aliases)
+		{
+			PBYTE pAliasEnd = alias.pExecutable + alias.Size;
+			if (pStart < pAliasEnd && pEnd > alias.pExecutable && (pStart > alias.pExecutable || pEnd < pAliasEnd))
+			{
+				pStart = min(pStart, alias.pExecutable);
+				pEnd = max(pEnd, pAliasEnd);
+				bExtended = TRUE;
+			}
+		}
+	}
+
+	SIZE_T aliasSize = pEnd - pStart;
+	SHARED_MEMORY sharedMemory = CreateSharedMemory(aliasSize);
+	PBYTE pWritable = sharedMemory != NO_SHARED_MEMORY ? MapWritableView(sharedMemory, aliasSize) : NULL;
+	if (!pWritable)
+	{
+		if (sharedMemory != NO_SHARED_MEMORY)
+			CloseSharedMemory(sharedMemory);
+
+		printf("Memory::AliasCode failed: couldn't create shared memory.\n");
+		return NULL;
+	}
+
+	/* The code is copied, then its pages are replaced by the shared memory at once, so threads never observe them unmapped */
+	memcpy(pWritable, pStart, aliasSize);
+	if (mmap(pStart, aliasSize, PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED, sharedMemory, 0) == MAP_FAILED)
+	{
+		CloseSharedMemory(sharedMemory);
+		UnmapView(pWritable, aliasSize);
+		printf("Memory::AliasCode failed: couldn't remap the code.\n");
+		return NULL;
+	}
+
+	/*
+	The aliases the range was extended over are replaced by its alias,
+	but their writable views are remapped onto its shared memory rather than unmapped, so pointers within them stay valid
+	(along with the views they replaced before).
+	*/
+	std::vector<ALIAS_MAPPING> remainingAliases;
+	for (const ALIAS_MAPPING &alias : g_Aliases)
+	{
+		if (alias.pExecutable < pStart || alias.pExecutable + alias.Size > pEnd)
+			remainingAliases.push_back(alias);
+		else
+			g_ReplacedViews.push_back({ alias.pWritable, alias.Size, alias.pExecutable });
+	}
+
+	remainingAliases.push_back({ pStart, aliasSize, pWritable });
+	if (!MapReplacedViews(remainingAliases.back(), sharedMemory))
+		printf("Memory::AliasCode failed: couldn't remap the aliases within %p.\n", pStart);
+
+	CloseSharedMemory(sharedMemory);
+
+	g_Aliases.swap(remainingAliases);
+	InstallForkHandlers();
+
+	return pWritable + ((PBYTE) pCode - pStart);
+#endif
+}
+
+/*
+Free memory allocated through AllocateNear (or AllocateNearAliased, along with its alias).
+@param pMemory, the allocated memory.
+@param size, the size it was allocated with.
+*/
+void Memory::Free(LPVOID pMemory, SIZE_T size)
+{
+	std::lock_guard<std::mutex> lock(g_AliasLock);
+
+	/* Aliased memory is a pair of views, rather than an allocation */
+	for (SIZE_T i = 0; i < g_Aliases.size(); i++)
+	{
+		if (g_Aliases[i].pExecutable != pMemory)
+			continue;
+
+		UnmapView(g_Aliases[i].pWritable, g_Aliases[i].Size);
+		UnmapView(g_Aliases[i].pExecutable, g_Aliases[i].Size);
+		g_Aliases.erase(g_Aliases.begin() + i);
+		return;
+	}
+
+#ifdef _WIN32
+	VirtualFree(pMemory, 0, MEM_RELEASE);
+#else
+	munmap(pMemory, size);
+#endif
+}
+
+/*
+Change the protection of the pages which cover a memory range.
+@param pMemory, the beginning of the range.
+@param size, the size of the range.
+@param protection, the new protection (MEMORY_PROTECTION).
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Memory::Protect(LPVOID pMemory, SIZE_T size, MEMORY_PROTECTION protection)
+{
+#ifdef _WIN32
+	DWORD oldProtect;
+	return VirtualProtect(pMemory, size, protection == MEMORY_READ_WRITE_EXECUTE ? PAGE_EXECUTE_READWRITE : PAGE_EXECUTE_READ, &oldProtect);
+#else
+	/* mprotect only takes whole pages */
+	ULONG_PTR pageSize = PageSize();
+	ULONG_PTR start = (ULONG_PTR) pMemory - (ULONG_PTR) pMemory % pageSize;
+	ULONG_PTR end = (ULONG_PTR) pMemory + size;
+	int flags = PROT_READ | PROT_EXEC | (protection == MEMORY_READ_WRITE_EXECUTE ? PROT_WRITE : 0);
+	return !mprotect((LPVOID) start, end - start, flags);
+#endif
+}
+
+/*
+Find how much of a memory range is readable, i.e. the contiguous readable regions from its beginning (e.g. so code isn't decoded past its mapping).
+@param pMemory, the beginning of the range.
+@param size, the size of the range.
+@return the amount of readable bytes from the range's beginning, up to its size, or 0 if its beginning isn't readable.
+The whole range is assumed to be readable if the address space can't be read.
+*/
+SIZE_T Memory::ReadableSize(LPVOID pMemory, SIZE_T size)
+{
+	ULONG_PTR address = (ULONG_PTR) pMemory;
+	ULONG_PTR readableEnd = address;
+
+#ifdef _WIN32
+	while (readableEnd - address < size)
+	{
+		MEMORY_BASIC_INFORMATION info;
+		if (!VirtualQuery((LPVOID) readableEnd, &info, sizeof(info)) || info.State != MEM_COMMIT ||
+			(info.Protect & (PAGE_NOACCESS | PAGE_EXECUTE | PAGE_GUARD)))
+		{
+			break;
+		}
+
+		readableEnd = (ULONG_PTR) info.BaseAddress + info.RegionSize;
+	}
+#else
+	FILE *pMaps = fopen("/proc/self/maps", "r");
+	if (!pMaps)
+		return size;
+
+	/* The regions are sorted, the range is readable as long as they're contiguous & readable */
+	unsigned long start, end;
+	char readable;
+	while (readableEnd - address < size && fscanf(pMaps, "%lx-%lx %c%*[^\n]", &start, &end, &readable) == 3)
+	{
+		if (end <= readableEnd)
+			continue;
+
+		if (start > readableEnd || readable != 'r')
+			break;
+
+		readableEnd = end;
+	}
+
+	fclose(pMaps);
+#endif
+
+	return min((SIZE_T) (readableEnd - address), size);
+}
+
+/*
+Make the pages which cover a code range writable, so many writes within it share a single protection change.
+@param pCode, the beginning of the range.
+@param size, the size of the range.
+@param pOldProtection, receives the range's protection, which is restored by EndCodeWrite.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Memory::BeginCodeWrite(LPVOID pCode, SIZE_T size, OUT DWORD *pOldProtection)
+{
+#ifdef _WIN32
+	if (!VirtualProtect(pCode, size, PAGE_EXECUTE_READWRITE, pOldProtection))
+#else
+	/* The protection of a mapping can't be queried, code is assumed to be executable & read-only */
+	*pOldProtection = MEMORY_READ_EXECUTE;
+	if (!Protect(pCode, size, MEMORY_READ_WRITE_EXECUTE))
+#endif
+	{
+		printf("Memory::BeginCodeWrite failed: couldn't make the code writable.\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+Restore the protection of a code range once code was written within it, and flush the stale instructions.
+@param pCode, the beginning of the range.
+@param size, the size of the range.
+@param oldProtection, the range's protection, as received from BeginCodeWrite.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Memory::EndCodeWrite(LPVOID pCode, SIZE_T size, DWORD oldProtection)
+{
+	FlushInstructions(pCode, size);
+
+#ifdef _WIN32
+	if (!VirtualProtect(pCode, size, oldProtection, &oldProtection))
+#else
+	if (!Protect(pCode, size, (MEMORY_PROTECTION) oldProtection))
+#endif
+	{
+		printf("Memory::EndCodeWrite failed: couldn't restore the code's protection.\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+Store 2 bytes of code at once, within a range that was made writable by BeginCodeWrite.
+@param pDestination, the code that's overwritten, which mustn't cross a cache line.
+@param value, the new code.
+*/
+void Memory::StoreCodeAtomic(LPVOID pDestination, WORD value)
+{
+#ifdef _WIN32
+	InterlockedExchange16((SHORT volatile *) pDestination, (SHORT) value);
+#else
+	__atomic_store_n((volatile WORD *) pDestination, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/*
+Write code over existing code (e.g. a JMP over the first instructions of a function), whatever the code's protection is.
+The code is made writable during the write, and its protection is restored afterwards.
+@param pDestination, the code that's overwritten.
+@param pSource, the new code.
+@param size, the size of the new code.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Memory::WriteCode(LPVOID pDestination, const void *pSource, SIZE_T size)
+{
+	DWORD oldProtection;
+	if (!BeginCodeWrite(pDestination, size, &oldProtection))
+		return FALSE;
+
+	memcpy(pDestination, pSource, size);
+
+	return EndCodeWrite(pDestination, size, oldProtection);
+}
+
+/*
+Write 2 bytes of code over existing code at once, so other threads execute either the old or the new bytes, never a mix of them.
+@param pDestination, the code that's overwritten, which mustn't cross a cache line.
+@param value, the new code.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Memory::WriteCodeAtomic(LPVOID pDestination, WORD value)
+{
+	/* Locked accesses which cross a cache line aren't guaranteed to be atomic with respect to instruction fetches */
+	if ((ULONG_PTR) pDestination % CACHE_LINE_SIZE == CACHE_LINE_SIZE - 1)
+	{
+		printf("Memory::WriteCodeAtomic failed: the code crosses a cache line.\n");
+		return FALSE;
+	}
+
+	DWORD oldProtection;
+	if (!BeginCodeWrite(pDestination, WORD_SIZE, &oldProtection))
+		return FALSE;
+
+	StoreCodeAtomic(pDestination, value);
+
+	return EndCodeWrite(pDestination, WORD_SIZE, oldProtection);
+}
+
+/*
+Make sure the processor executes the newly written code within a memory range, rather than stale instructions.
+@param pMemory, the beginning of the range.
+@param size, the size of the range.
+*/
+void Memory::FlushInstructions(LPVOID pMemory, SIZE_T size)
+{
+#ifdef _WIN32
+	FlushInstructionCache(GetCurrentProcess(), pMemory, size);
+#else
+	__builtin___clear_cache((char *) pMemory, (char *) pMemory + size);
+#endif
+}
+
+/*
+Make every processor that runs a thread of the process serialize, so none of them executes instructions it fetched before
+code was modified (e.g. between the steps of a patch that other threads may be running through).
+*/
+void Memory::SynchronizeCores()
+{
+#ifdef _WIN32
+	/* Interrupts every processor that runs a thread of the process, and interrupts serialize */
+	FlushProcessWriteBuffers();
+#else
+	/* The core-serializing membarrier must be registered once per process, it's skipped on kernels that don't support it */
+	static const bool bRegistered = !syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE, 0);
+	if (bRegistered)
+		syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE, 0);
+#endif
+}
+
+/*
+@return whether a relative-JMP at given source can reach given destination.
+*/
+BOOL Memory::IsRel32Reachable(LPVOID pSource, LPVOID pDestination)
+{
+	INT64 distance = (PBYTE) pDestination - (PBYTE) pSource;
+	return distance >= -REL32_RANGE && distance <= REL32_RANGE;
+}
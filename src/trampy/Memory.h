@@ -0,0 +1,157 @@
+#pragma once
+#include "TrampyDefs.h"
+
+/*
+The maximum distance a relative-JMP (or a RIP-relative address) can reach, with some slack for the instruction itself.
+*/
+#define REL32_RANGE 0x7FFF0000
+
+/*
+The size of a cache line, which a write must not cross to be atomic.
+*/
+#define CACHE_LINE_SIZE 64
+
+/*
+The protection of a memory region.
+*/
+enum MEMORY_PROTECTION : BYTE
+{
+	/* Executable & read-only, the protection of code once it's written */
+	MEMORY_READ_EXECUTE,
+	/* Executable & writable, the protection of code while it's written */
+	MEMORY_READ_WRITE_EXECUTE,
+};
+
+/*
+The Memory layer hides the platform's virtual memory API, so code is allocated & protected the same way on every platform:
+VirtualAlloc & VirtualProtect on Windows, mmap & mprotect elsewhere (e.g. for testing on Linux).
+Code may also be mapped twice, executable & read-only as well as writable through an alias (a section's views on Windows,
+a memfd's mappings elsewhere), so it's written without ever changing its protection.
+*/
+namespace Memory
+{
+	/*
+	@return the size of a page.
+	*/
+	SIZE_T PageSize();
+	/*
+	@return the granularity of allocations, which allocated addresses are aligned to (e.g. 64 KB on Windows).
+	*/
+	SIZE_T AllocationGranularity();
+	/*
+	@return the size of a large page, or 0 if large pages aren't supported.
+	*/
+	SIZE_T LargePageSize();
+
+	/*
+	Allocate executable memory within reach of a relative-JMP from a given address.
+	In 32-bit mode every address is within reach, so the memory may be anywhere.
+	@param pTarget, the address the memory must be within reach of.
+	@param size, the size of the memory, a multiple of the allocation granularity.
+	@param bLargePages, whether the memory is backed by large pages (size must be a multiple of the large page size).
+	@return pointer to the allocated memory, which is executable & read-only, or NULL if the function failed.
+	*/
+	LPVOID AllocateNear(LPVOID pTarget, SIZE_T size, BOOL bLargePages);
+	/*
+	Allocate executable memory within reach of a relative-JMP from a given address, along with a writable alias of it,
+	so code is written through the alias while the memory itself is never writable.
+	In 32-bit mode every address is within reach, so the memory may be anywhere.
+	@param pTarget, the address the memory must be within reach of.
+	@param size, the size of the memory, a multiple of the allocation granularity.
+	@param ppWritable, receives the writable alias of the memory.
+	@return pointer to the allocated memory, which is executable & read-only, or NULL if the function failed.
+	*/
+	LPVOID AllocateNearAliased(LPVOID pTarget, SIZE_T size, OUT LPVOID *ppWritable);
+	/*
+	Remap the pages which cover a code range (e.g. the beginning of a function), so they're mapped twice:
+	executable as they are, and writable through an alias, which code within them is written through from then on.
+	The pages keep their contents, and they're remapped at once, so threads may be running them meanwhile.
+	Pages that are aliased already are aliased again along with the rest of the range, so the whole range has a single alias.
+	A child process gets its own copy of every alias once the process forks, as they'd be shared with the parent otherwise.
+	@param pCode, the beginning of the range.
+	@param size, the size of the range.
+	@return the writable alias of the range's beginning, or NULL if the function failed (always on Windows,
+	where the pages of a module belong to its image, which can't be remapped).
+	*/
+	LPVOID AliasCode(LPVOID pCode, SIZE_T size);
+	/*
+	Free memory allocated through AllocateNear (or AllocateNearAliased, along with its alias).
+	@param pMemory, the allocated memory.
+	@param size, the size it was allocated with.
+	*/
+	void Free(LPVOID pMemory, SIZE_T size);
+
+	/*
+	Change the protection of the pages which cover a memory range.
+	@param pMemory, the beginning of the range.
+	@param size, the size of the range.
+	@param protection, the new protection (MEMORY_PROTECTION).
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL Protect(LPVOID pMemory, SIZE_T size, MEMORY_PROTECTION protection);
+	/*
+	Find how much of a memory range is readable, i.e. the contiguous readable regions from its beginning (e.g. so code isn't decoded past its mapping).
+	@param pMemory, the beginning of the range.
+	@param size, the size of the range.
+	@return the amount of readable bytes from the range's beginning, up to its size, or 0 if its beginning isn't readable.
+	The whole range is assumed to be readable if the address space can't be read.
+	*/
+	SIZE_T ReadableSize(LPVOID pMemory, SIZE_T size);
+
+	/*
+	Write code over existing code (e.g. a JMP over the first instructions of a function), whatever the code's protection is.
+	The code is made writable during the write, and its protection is restored afterwards.
+	@param pDestination, the code that's overwritten.
+	@param pSource, the new code.
+	@param size, the size of the new code.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL WriteCode(LPVOID pDestination, const void *pSource, SIZE_T size);
+	/*
+	Write 2 bytes of code over existing code at once, so other threads execute either the old or the new bytes, never a mix of them.
+	@param pDestination, the code that's overwritten, which mustn't cross a cache line.
+	@param value, the new code.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL WriteCodeAtomic(LPVOID pDestination, WORD value);
+
+	/*
+	Make the pages which cover a code range writable, so many writes within it share a single protection change.
+	@param pCode, the beginning of the range.
+	@param size, the size of the range.
+	@param pOldProtection, receives the range's protection, which is restored by EndCodeWrite.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL BeginCodeWrite(LPVOID pCode, SIZE_T size, OUT DWORD *pOldProtection);
+	/*
+	Restore the protection of a code range once code was written within it, and flush the stale instructions.
+	@param pCode, the beginning of the range.
+	@param size, the size of the range.
+	@param oldProtection, the range's protection, as received from BeginCodeWrite.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL EndCodeWrite(LPVOID pCode, SIZE_T size, DWORD oldProtection);
+	/*
+	Store 2 bytes of code at once, within a range that was made writable by BeginCodeWrite.
+	@param pDestination, the code that's overwritten, which mustn't cross a cache line.
+	@param value, the new code.
+	*/
+	void StoreCodeAtomic(LPVOID pDestination, WORD value);
+
+	/*
+	Make sure the processor executes the newly written code within a memory range, rather than stale instructions.
+	@param pMemory, the beginning of the range.
+	@param size, the size of the range.
+	*/
+	void FlushInstructions(LPVOID pMemory, SIZE_T size);
+	/*
+	Make every processor that runs a thread of the process serialize, so none of them executes instructions it fetched before
+	code was modified (e.g. between the steps of a patch that other threads may be running through).
+	*/
+	void SynchronizeCores();
+
+	/*
+	@return whether a relative-JMP at given source can reach given destination.
+	*/
+	BOOL IsRel32Reachable(LPVOID pSource, LPVOID pDestination);
+}
@@ -0,0 +1,936 @@
+#include "ModuleIndex.h"
+#include "disasm/disasm.h"
+#include <stdio.h>
+#include <vector>
+
+#ifndef _WIN32
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Magic of Module Index data ("TIDX") */
+#define MODULE_INDEX_MAGIC 0x58444954
+
+/* Version of the Module Index data layout, bumped whenever the layout (or the decoder's output) changes */
+#define MODULE_INDEX_VERSION 1
+
+#ifdef _WIN32
+/* Signature of a PDB 7.0 CodeView record ("RSDS") */
+#define CV_SIGNATURE_RSDS 0x53445352
+
+/*
+Struct describing a PDB 7.0 CodeView record, which the debug directory points at.
+Its GUID & age identify the module's build.
+*/
+typedef struct _CV_INFO_PDB70
+{
+	DWORD CvSignature;
+	GUID Signature;
+	DWORD Age;
+	CHAR PdbFileName[1];
+}
+CV_INFO_PDB70, *PCV_INFO_PDB70;
+
+/*
+Struct identifying the build of a module.
+Two modules with the same key have the same code, so they share the same index.
+*/
+typedef struct _MODULE_KEY
+{
+	/*
+	The CodeView GUID & age of the module, or zeros if it has no CodeView record.
+	*/
+	GUID Signature;
+	DWORD Age;
+	/*
+	The timestamp & image size of the module, from its PE headers.
+	*/
+	DWORD TimeDateStamp;
+	DWORD SizeOfImage;
+}
+MODULE_KEY, *PMODULE_KEY;
+#else
+/* Max size of a GNU build-id, 20 bytes (SHA-1) in practice */
+#define MAX_BUILD_ID_SIZE 32
+
+/* Name of the notes written by the GNU toolchain, including its null-terminator */
+#define GNU_NOTE_NAME "GNU"
+
+/*
+Struct identifying the build of a module.
+Two modules with the same key have the same code, so they share the same index.
+*/
+typedef struct _MODULE_KEY
+{
+	/*
+	The GNU build-id of the module (NT_GNU_BUILD_ID), and its size.
+	If the module wasn't linked with a build-id, its size is 0 & CodeHash identifies the module instead.
+	*/
+	BYTE BuildId[MAX_BUILD_ID_SIZE];
+	DWORD BuildIdSize;
+	/*
+	The size of the module's image, i.e. the extent of its loadable segments.
+	*/
+	DWORD SizeOfImage;
+	/*
+	FNV-1a hash of the module's executable segments, or 0 if it has a build-id.
+	*/
+	DWORD64 CodeHash;
+}
+MODULE_KEY, *PMODULE_KEY;
+
+/*
+Struct describing a module loaded by the dynamic linker.
+*/
+typedef struct _ELF_MODULE
+{
+	/*
+	The module's program headers, and their amount.
+	*/
+	const ElfW(Phdr) *pProgramHeaders;
+	SIZE_T ProgramHeaderAmount;
+	/*
+	The difference between the module's addresses and their link-time addresses (p_vaddr).
+	*/
+	ULONG_PTR LoadBias;
+}
+ELF_MODULE, *PELF_MODULE;
+
+/*
+Struct passed to FindElfModuleCallback, describing the module being searched for.
+*/
+typedef struct _ELF_MODULE_SEARCH
+{
+	PBYTE ImageBase;
+	PELF_MODULE pModule;
+	bool bFound;
+}
+ELF_MODULE_SEARCH, *PELF_MODULE_SEARCH;
+#endif
+
+/*
+Struct describing the beginning of Module Index data.
+Module Index data is laid out the same in memory & in cache files, so a cache file is used directly once it's mapped:
+the header is followed by the indexed sections, which are followed by their bitmaps.
+*/
+typedef struct _MODULE_INDEX_HEADER
+{
+	DWORD Magic;
+	DWORD Version;
+	MODULE_KEY Key;
+	/*
+	The mode the module was decoded in (DISASSEMBLER_MODE).
+	*/
+	DWORD Mode;
+	/*
+	The amount of indexed (i.e. executable) sections.
+	*/
+	DWORD SectionAmount;
+	/*
+	The total size of the Module Index data, including this header.
+	*/
+	DWORD64 TotalSize;
+}
+MODULE_INDEX_HEADER, *PMODULE_INDEX_HEADER;
+
+/*
+Struct describing an indexed section.
+*/
+typedef struct _INDEXED_SECTION
+{
+	/*
+	The section's RVA & size, in bytes.
+	*/
+	DWORD Rva;
+	DWORD Size;
+	/*
+	Offsets of the section's bitmaps within the Module Index data.
+	Bit X of each bitmap describes offset X within the section.
+	*/
+	DWORD BoundariesOffset;
+	DWORD TargetsOffset;
+}
+INDEXED_SECTION, *PINDEXED_SECTION;
+
+/*
+Struct describing a Module Index.
+*/
+typedef struct _MODULE_INDEX
+{
+	/*
+	Base address of the indexed module.
+	*/
+	PBYTE ImageBase;
+	/*
+	The Module Index data, and its size.
+	*/
+	PBYTE pData;
+	SIZE_T DataSize;
+#ifdef _WIN32
+	/*
+	Handles of the mapped cache file, or NULL if the index was built rather than loaded.
+	*/
+	HANDLE hFile;
+	HANDLE hMapping;
+#else
+	/*
+	Whether the data is a mapped cache file, rather than a built index.
+	*/
+	bool bMapped;
+#endif
+}
+MODULE_INDEX, *PMODULE_INDEX;
+
+/*
+@return the size of a bitmap with a bit for every byte of given size.
+*/
+SIZE_T BitmapSize(SIZE_T size)
+{
+	return (size + 7) / 8;
+}
+
+/*
+@return whether given bit of a bitmap is set.
+*/
+bool TestBit(const BYTE *pBitmap, SIZE_T bit)
+{
+	return (pBitmap[bit / 8] >> (bit % 8)) & 1;
+}
+
+/*
+Set given bit of a bitmap.
+*/
+void SetBit(PBYTE pBitmap, SIZE_T bit)
+{
+	pBitmap[bit / 8] |= 1 << (bit % 8);
+}
+
+#ifdef _WIN32
+/*
+@return the NT headers of a loaded module, or NULL if its headers are invalid.
+*/
+PIMAGE_NT_HEADERS GetNtHeaders(PBYTE imageBase)
+{
+	PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER) imageBase;
+	if (pDosHeader->e_magic != IMAGE_DOS_SIGNATURE)
+		return NULL;
+
+	PIMAGE_NT_HEADERS pNtHeaders = (PIMAGE_NT_HEADERS) (imageBase + pDosHeader->e_lfanew);
+	if (pNtHeaders->Signature != IMAGE_NT_SIGNATURE)
+		return NULL;
+
+	return pNtHeaders;
+}
+
+/*
+Identify the build of a loaded module.
+@param imageBase, base address of the module.
+@param pKey, receives the module's key.
+@return whether the module's headers are valid.
+*/
+bool GetModuleKey(PBYTE imageBase, OUT PMODULE_KEY pKey)
+{
+	PIMAGE_NT_HEADERS pNtHeaders = GetNtHeaders(imageBase);
+	if (!pNtHeaders)
+		return false;
+
+	*pKey = { };
+	pKey->TimeDateStamp = pNtHeaders->FileHeader.TimeDateStamp;
+	pKey->SizeOfImage = pNtHeaders->OptionalHeader.SizeOfImage;
+
+	/* Find the module's CodeView record within its debug directory, if it has one */
+	IMAGE_DATA_DIRECTORY debugDirectory = pNtHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG];
+	PIMAGE_DEBUG_DIRECTORY pDebugEntries = (PIMAGE_DEBUG_DIRECTORY) (imageBase + debugDirectory.VirtualAddress);
+	SIZE_T debugEntryAmount = debugDirectory.VirtualAddress ? debugDirectory.Size / sizeof(IMAGE_DEBUG_DIRECTORY) : 0;
+
+	for (SIZE_T i = 0; i < debugEntryAmount; i++)
+	{
+		if (pDebugEntries[i].Type != IMAGE_DEBUG_TYPE_CODEVIEW || !pDebugEntries[i].AddressOfRawData)
+			continue;
+
+		PCV_INFO_PDB70 pCodeView = (PCV_INFO_PDB70) (imageBase + pDebugEntries[i].AddressOfRawData);
+		if (pCodeView->CvSignature != CV_SIGNATURE_RSDS)
+			continue;
+
+		pKey->Signature = pCodeView->Signature;
+		pKey->Age = pCodeView->Age;
+		break;
+	}
+
+	return true;
+}
+
+/*
+Find the executable sections of a loaded module.
+@param imageBase, base address of the module.
+@param pSections, receives the RVA & size of each of the module's executable sections.
+@return whether the module's headers are valid.
+*/
+bool GetExecutableSections(PBYTE imageBase, OUT std::vector<INDEXED_SECTION> *pSections)
+{
+	PIMAGE_NT_HEADERS pNtHeaders = GetNtHeaders(imageBase);
+	if (!pNtHeaders)
+		return false;
+
+	PIMAGE_SECTION_HEADER pSectionHeaders = IMAGE_FIRST_SECTION(pNtHeaders);
+	for (WORD i = 0; i < pNtHeaders->FileHeader.NumberOfSections; i++)
+		if (pSectionHeaders[i].Characteristics & IMAGE_SCN_MEM_EXECUTE)
+			pSections->push_back({ pSectionHeaders[i].VirtualAddress, pSectionHeaders[i].Misc.VirtualSize });
+
+	return true;
+}
+
+/*
+Format the path of a module's cache file, which is named after the module's key.
+@param pKey, the module's key.
+@param cacheDirectory, the directory the cache files are stored in.
+@param path, receives the path of the cache file.
+@return TRUE if the function succeeds, FALSE if the path is too long.
+*/
+BOOL GetCachePath(PMODULE_KEY pKey, LPCSTR cacheDirectory, OUT CHAR (&path)[MAX_PATH])
+{
+	const GUID &guid = pKey->Signature;
+
+	int length = sprintf_s(
+		path,
+		"%s\\%08lX%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X-%lX-%08lX-%lX.tidx",
+		cacheDirectory,
+		guid.Data1, guid.Data2, guid.Data3,
+		guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+		guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7],
+		pKey->Age, pKey->TimeDateStamp, pKey->SizeOfImage
+	);
+
+	return length > 0;
+}
+#else
+/*
+dl_iterate_phdr callback, which stops at the module whose image starts at the searched base address.
+*/
+int FindElfModuleCallback(struct dl_phdr_info *pInfo, size_t infoSize, void *pContext)
+{
+	PELF_MODULE_SEARCH pSearch = (PELF_MODULE_SEARCH) pContext;
+
+	/* The image starts with the ELF header, which is mapped by the lowest loadable segment */
+	for (ElfW(Half) i = 0; i < pInfo->dlpi_phnum; i++)
+	{
+		const ElfW(Phdr) &programHeader = pInfo->dlpi_phdr[i];
+		if (programHeader.p_type != PT_LOAD)
+			continue;
+
+		if ((PBYTE) (pInfo->dlpi_addr + programHeader.p_vaddr - programHeader.p_offset) != pSearch->ImageBase)
+			return 0;
+
+		*pSearch->pModule = { pInfo->dlpi_phdr, pInfo->dlpi_phnum, pInfo->dlpi_addr };
+		pSearch->bFound = true;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+Find a module loaded by the dynamic linker.
+@param imageBase, base address of the module (its ELF header).
+@param pModule, receives the module's program headers.
+@return whether a module is loaded at given address.
+*/
+bool FindElfModule(PBYTE imageBase, OUT PELF_MODULE pModule)
+{
+	ELF_MODULE_SEARCH search = { imageBase, pModule, false };
+	dl_iterate_phdr(FindElfModuleCallback, &search);
+
+	return search.bFound;
+}
+
+/*
+@return the address a segment of a module is loaded at.
+*/
+PBYTE GetSegmentAddress(PELF_MODULE pModule, const ElfW(Phdr) &programHeader)
+{
+	return (PBYTE) (pModule->LoadBias + programHeader.p_vaddr);
+}
+
+/*
+Find the executable sections of a loaded module.
+ELF modules are indexed by their executable segments, which span all of their code sections.
+@param imageBase, base address of the module.
+@param pSections, receives the RVA & size of each of the module's executable sections.
+@return whether a module is loaded at given address.
+*/
+bool GetExecutableSections(PBYTE imageBase, OUT std::vector<INDEXED_SECTION> *pSections)
+{
+	ELF_MODULE module;
+	if (!FindElfModule(imageBase, &module))
+		return false;
+
+	for (SIZE_T i = 0; i < module.ProgramHeaderAmount; i++)
+	{
+		const ElfW(Phdr) &programHeader = module.pProgramHeaders[i];
+		if (programHeader.p_type == PT_LOAD && (programHeader.p_flags & PF_X))
+			pSections->push_back({ (DWORD) (GetSegmentAddress(&module, programHeader) - imageBase), (DWORD) programHeader.p_memsz });
+	}
+
+	return true;
+}
+
+/*
+@return given size, rounded up to a multiple of given alignment (a power of 2).
+*/
+SIZE_T AlignUp(SIZE_T size, SIZE_T alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/*
+Find the GNU build-id of a loaded module, within its PT_NOTE segments.
+@param pModule, the module.
+@param pKey, receives the build-id.
+@return whether the module has a build-id.
+*/
+bool FindBuildId(PELF_MODULE pModule, OUT PMODULE_KEY pKey)
+{
+	for (SIZE_T i = 0; i < pModule->ProgramHeaderAmount; i++)
+	{
+		const ElfW(Phdr) &programHeader = pModule->pProgramHeaders[i];
+		if (programHeader.p_type != PT_NOTE)
+			continue;
+
+		/* Notes are aligned to 4 bytes, unless their segment says otherwise */
+		PBYTE pNotes = GetSegmentAddress(pModule, programHeader);
+		SIZE_T alignment = programHeader.p_align == 8 ? 8 : 4;
+		SIZE_T offset = 0;
+
+		while (programHeader.p_memsz - offset >= sizeof(ElfW(Nhdr)))
+		{
+			const ElfW(Nhdr) *pNote = (const ElfW(Nhdr) *) (pNotes + offset);
+			SIZE_T nameOffset = offset + sizeof(ElfW(Nhdr));
+			SIZE_T descriptorOffset = nameOffset + AlignUp(pNote->n_namesz, alignment);
+			SIZE_T nextOffset = descriptorOffset + AlignUp(pNote->n_descsz, alignment);
+
+			if (nextOffset > programHeader.p_memsz)
+				break;
+
+			if (pNote->n_type == NT_GNU_BUILD_ID &&
+				pNote->n_namesz == sizeof(GNU_NOTE_NAME) &&
+				!memcmp(pNotes + nameOffset, GNU_NOTE_NAME, sizeof(GNU_NOTE_NAME)) &&
+				pNote->n_descsz && pNote->n_descsz <= MAX_BUILD_ID_SIZE)
+			{
+				memcpy(pKey->BuildId, pNotes + descriptorOffset, pNote->n_descsz);
+				pKey->BuildIdSize = pNote->n_descsz;
+				return true;
+			}
+
+			offset = nextOffset;
+		}
+	}
+
+	return false;
+}
+
+/*
+Identify the build of a loaded module.
+Modules are identified by their build-id, or by a hash of their code if they weren't linked with one.
+@param imageBase, base address of the module.
+@param pKey, receives the module's key.
+@return whether a module is loaded at given address.
+*/
+bool GetModuleKey(PBYTE imageBase, OUT PMODULE_KEY pKey)
+{
+	ELF_MODULE module;
+	if (!FindElfModule(imageBase, &module))
+		return false;
+
+	*pKey = { };
+
+	PBYTE imageEnd = imageBase;
+	for (SIZE_T i = 0; i < module.ProgramHeaderAmount; i++)
+	{
+		const ElfW(Phdr) &programHeader = module.pProgramHeaders[i];
+		if (programHeader.p_type == PT_LOAD)
+			imageEnd = max(imageEnd, GetSegmentAddress(&module, programHeader) + programHeader.p_memsz);
+	}
+
+	pKey->SizeOfImage = (DWORD) (imageEnd - imageBase);
+
+	if (FindBuildId(&module, pKey))
+		return true;
+
+	/* FNV-1a */
+	DWORD64 hash = 0xCBF29CE484222325;
+	for (SIZE_T i = 0; i < module.ProgramHeaderAmount; i++)
+	{
+		const ElfW(Phdr) &programHeader = module.pProgramHeaders[i];
+		if (programHeader.p_type != PT_LOAD || !(programHeader.p_flags & PF_X))
+			continue;
+
+		PBYTE pSegment = GetSegmentAddress(&module, programHeader);
+		for (SIZE_T j = 0; j < programHeader.p_memsz; j++)
+			hash = (hash ^ pSegment[j]) * 0x100000001B3;
+	}
+
+	pKey->CodeHash = hash;
+	return true;
+}
+
+/*
+Format the path of a module's cache file, which is named after the module's key.
+@param pKey, the module's key.
+@param cacheDirectory, the directory the cache files are stored in.
+@param path, receives the path of the cache file.
+@return TRUE if the function succeeds, FALSE if the path is too long.
+*/
+BOOL GetCachePath(PMODULE_KEY pKey, LPCSTR cacheDirectory, OUT CHAR (&path)[MAX_PATH])
+{
+	/* Modules without a build-id are named after their code hash, prefixed so it can't collide with a build-id */
+	CHAR name[2 * MAX_BUILD_ID_SIZE + 1];
+	if (pKey->BuildIdSize)
+	{
+		for (DWORD i = 0; i < pKey->BuildIdSize; i++)
+			snprintf(name + 2 * i, sizeof(name) - 2 * i, "%02X", pKey->BuildId[i]);
+	}
+	else
+	{
+		snprintf(name, sizeof(name), "H%016llX", (unsigned long long) pKey->CodeHash);
+	}
+
+	int length = snprintf(path, MAX_PATH, "%s/%s-%X.tidx", cacheDirectory, name, pKey->SizeOfImage);
+
+	return length > 0 && length < MAX_PATH;
+}
+#endif
+
+/*
+@return the header of given Module Index data.
+*/
+PMODULE_INDEX_HEADER GetHeader(PBYTE pData)
+{
+	return (PMODULE_INDEX_HEADER) pData;
+}
+
+/*
+@return the indexed sections of given Module Index data.
+*/
+PINDEXED_SECTION GetSections(PBYTE pData)
+{
+	return (PINDEXED_SECTION) (pData + sizeof(MODULE_INDEX_HEADER));
+}
+
+/*
+Find the indexed section an RVA lies within.
+@param pData, the Module Index data.
+@param rva, the RVA to be found.
+@return the section the RVA lies within, or NULL if it isn't within an indexed section.
+*/
+PINDEXED_SECTION FindSection(PBYTE pData, ULONG_PTR rva)
+{
+	PINDEXED_SECTION pSections = GetSections(pData);
+
+	/* Modules only have a handful of executable sections, usually just one */
+	for (DWORD i = 0; i < GetHeader(pData)->SectionAmount; i++)
+		if (rva >= pSections[i].Rva && rva - pSections[i].Rva < pSections[i].Size)
+			return &pSections[i];
+
+	return NULL;
+}
+
+/*
+Find the indexed section an address lies within.
+@param pIndex, the Module Index.
+@param pAddress, the address to be found.
+@param pOffset, receives the offset of the address within its section.
+@return the section the address lies within, or NULL if it isn't within an indexed section.
+*/
+PINDEXED_SECTION FindAddress(PMODULE_INDEX pIndex, LPVOID pAddress, OUT SIZE_T *pOffset)
+{
+	if ((PBYTE) pAddress < pIndex->ImageBase)
+		return NULL;
+
+	ULONG_PTR rva = (PBYTE) pAddress - pIndex->ImageBase;
+	PINDEXED_SECTION pSection = FindSection(pIndex->pData, rva);
+
+	if (pSection)
+		*pOffset = rva - pSection->Rva;
+
+	return pSection;
+}
+
+/*
+Check whether Module Index data is valid & belongs to a module.
+Cache files may be truncated or outdated, so they're validated before they're used.
+@param pData, the Module Index data.
+@param dataSize, the size of the data.
+@param pKey, the key of the module.
+@return whether the data is valid.
+*/
+bool IsValidIndexData(PBYTE pData, SIZE_T dataSize, PMODULE_KEY pKey)
+{
+	if (dataSize < sizeof(MODULE_INDEX_HEADER))
+		return false;
+
+	PMODULE_INDEX_HEADER pHeader = GetHeader(pData);
+	if (pHeader->Magic != MODULE_INDEX_MAGIC ||
+		pHeader->Version != MODULE_INDEX_VERSION ||
+		pHeader->Mode != DISASM_MODE_NATIVE ||
+		pHeader->TotalSize != dataSize ||
+		memcmp(&pHeader->Key, pKey, sizeof(MODULE_KEY)))
+		return false;
+
+	if (pHeader->SectionAmount > (dataSize - sizeof(MODULE_INDEX_HEADER)) / sizeof(INDEXED_SECTION))
+		return false;
+
+	PINDEXED_SECTION pSections = GetSections(pData);
+	for (DWORD i = 0; i < pHeader->SectionAmount; i++)
+	{
+		SIZE_T bitmapSize = BitmapSize(pSections[i].Size);
+		if (pSections[i].BoundariesOffset > dataSize || dataSize - pSections[i].BoundariesOffset < bitmapSize ||
+			pSections[i].TargetsOffset > dataSize || dataSize - pSections[i].TargetsOffset < bitmapSize)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+Build the index of a loaded module, by decoding all of its executable sections.
+@param hModule, the module to be indexed.
+@return pointer to the newly built index, or NULL if the function failed.
+*/
+PMODULE_INDEX ModuleIndex::Build(HMODULE hModule)
+{
+	PBYTE imageBase = (PBYTE) hModule;
+	MODULE_KEY key;
+	std::vector<INDEXED_SECTION> sections;
+
+	if (!GetModuleKey(imageBase, &key) || !GetExecutableSections(imageBase, &sections))
+	{
+		printf("ModuleIndex::Build failed: invalid module headers.\n");
+		return NULL;
+	}
+
+	/* Measure the index: its header, followed by the executable sections, followed by two bitmaps per section */
+	DWORD sectionAmount = (DWORD) sections.size();
+	SIZE_T dataSize = sizeof(MODULE_INDEX_HEADER);
+	for (const INDEXED_SECTION &section : sections)
+		dataSize += sizeof(INDEXED_SECTION) + 2 * BitmapSize(section.Size);
+
+	PMODULE_INDEX pIndex = (PMODULE_INDEX) calloc(1, sizeof(MODULE_INDEX));
+	PBYTE pData = (PBYTE) calloc(dataSize, 1);
+
+	if (!pIndex || !pData)
+	{
+		printf("ModuleIndex::Build failed: couldn't allocate index.\n");
+		free(pIndex);
+		free(pData);
+		return NULL;
+	}
+
+	*pIndex = { imageBase, pData, dataSize };
+
+	/* Initialize header */
+	PMODULE_INDEX_HEADER pHeader = GetHeader(pData);
+	pHeader->Magic = MODULE_INDEX_MAGIC;
+	pHeader->Version = MODULE_INDEX_VERSION;
+	pHeader->Key = key;
+	pHeader->Mode = DISASM_MODE_NATIVE;
+	pHeader->SectionAmount = sectionAmount;
+	pHeader->TotalSize = dataSize;
+
+	/* Lay out the sections & their bitmaps */
+	PINDEXED_SECTION pSections = GetSections(pData);
+	DWORD bitmapOffset = (DWORD) (sizeof(MODULE_INDEX_HEADER) + sectionAmount * sizeof(INDEXED_SECTION));
+	for (DWORD i = 0; i < sectionAmount; i++)
+	{
+		PINDEXED_SECTION pSection = &pSections[i];
+		pSection->Rva = sections[i].Rva;
+		pSection->Size = sections[i].Size;
+		pSection->BoundariesOffset = bitmapOffset;
+		pSection->TargetsOffset = bitmapOffset + (DWORD) BitmapSize(pSection->Size);
+		bitmapOffset = pSection->TargetsOffset + (DWORD) BitmapSize(pSection->Size);
+	}
+
+	/* Decode every section, marking instruction starts & the targets of relative branches (which may lie in any section) */
+	for (DWORD i = 0; i < sectionAmount; i++)
+	{
+		PINDEXED_SECTION pSection = &pSections[i];
+		PBYTE pBoundaries = pData + pSection->BoundariesOffset;
+
+		INSTRUCTION_ITERATOR iterator;
+		DECODED_INSTRUCTION instruction;
+		Disassembler::InitializeIterator(&iterator, imageBase + pSection->Rva, pSection->Size, DISASM_MODE_NATIVE);
+
+		while (Disassembler::NextInstruction(&iterator, &instruction))
+		{
+			SetBit(pBoundaries, instruction.Offset);
+
+			if (instruction.BranchKind != BRANCH_JMP &&
+				instruction.BranchKind != BRANCH_JCC &&
+				instruction.BranchKind != BRANCH_CALL)
+				continue;
+
+			if (instruction.Target < imageBase)
+				continue;
+
+			ULONG_PTR targetRva = instruction.Target - imageBase;
+			PINDEXED_SECTION pTargetSection = FindSection(pData, targetRva);
+
+			if (pTargetSection)
+				SetBit(pData + pTargetSection->TargetsOffset, targetRva - pTargetSection->Rva);
+		}
+	}
+
+	return pIndex;
+}
+
+/*
+Load the index of a loaded module from the cache.
+If the module's build isn't cached yet, or its cache file is invalid, the index is built & cached instead.
+@param hModule, the module whose index is loaded.
+@param cacheDirectory, the directory the cache files are stored in.
+@return pointer to the loaded index, or NULL if the function failed.
+*/
+PMODULE_INDEX ModuleIndex::Load(HMODULE hModule, LPCSTR cacheDirectory)
+{
+	PBYTE imageBase = (PBYTE) hModule;
+	MODULE_KEY key;
+
+	if (!GetModuleKey(imageBase, &key))
+	{
+		printf("ModuleIndex::Load failed: invalid module headers.\n");
+		return NULL;
+	}
+
+	CHAR path[MAX_PATH];
+#ifdef _WIN32
+	HANDLE hFile = GetCachePath(&key, cacheDirectory, path) ?
+		CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) :
+		INVALID_HANDLE_VALUE;
+
+	/* If the module's build is cached, map its cache file */
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER fileSize = { };
+		GetFileSizeEx(hFile, &fileSize);
+
+		HANDLE hMapping = fileSize.QuadPart ? CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+		PBYTE pData = hMapping ? (PBYTE) MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		PMODULE_INDEX pIndex = NULL;
+
+		if (pData && IsValidIndexData(pData, (SIZE_T) fileSize.QuadPart, &key))
+			pIndex = (PMODULE_INDEX) calloc(1, sizeof(MODULE_INDEX));
+
+		if (pIndex)
+		{
+			*pIndex = { imageBase, pData, (SIZE_T) fileSize.QuadPart, hFile, hMapping };
+			return pIndex;
+		}
+
+		/* The cache file is invalid (or we're out of memory), so it's rebuilt */
+		if (pData)
+			UnmapViewOfFile(pData);
+		if (hMapping)
+			CloseHandle(hMapping);
+		CloseHandle(hFile);
+	}
+#else
+	int fd = GetCachePath(&key, cacheDirectory, path) ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+
+	/* If the module's build is cached, map its cache file (the mapping outlives the descriptor) */
+	if (fd != -1)
+	{
+		struct stat fileStatus = { };
+		fstat(fd, &fileStatus);
+
+		SIZE_T fileSize = (SIZE_T) fileStatus.st_size;
+		PBYTE pData = fileSize ? (PBYTE) mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0) : (PBYTE) MAP_FAILED;
+		PMODULE_INDEX pIndex = NULL;
+		close(fd);
+
+		if (pData != MAP_FAILED && IsValidIndexData(pData, fileSize, &key))
+			pIndex = (PMODULE_INDEX) calloc(1, sizeof(MODULE_INDEX));
+
+		if (pIndex)
+		{
+			*pIndex = { imageBase, pData, fileSize, true };
+			return pIndex;
+		}
+
+		/* The cache file is invalid (or we're out of memory), so it's rebuilt */
+		if (pData != MAP_FAILED)
+			munmap(pData, fileSize);
+	}
+#endif
+
+	PMODULE_INDEX pIndex = Build(hModule);
+
+	/* Failing to cache the index isn't fatal, it'll simply be rebuilt next time */
+	if (pIndex)
+		Save(pIndex, cacheDirectory);
+
+	return pIndex;
+}
+
+/*
+Save an index to the cache.
+@param pIndex, the index to be saved.
+@param cacheDirectory, the directory the cache files are stored in.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL ModuleIndex::Save(PMODULE_INDEX pIndex, LPCSTR cacheDirectory)
+{
+	CHAR path[MAX_PATH];
+
+	if (!GetCachePath(&GetHeader(pIndex->pData)->Key, cacheDirectory, path))
+	{
+		printf("ModuleIndex::Save failed: cache path is too long.\n");
+		return FALSE;
+	}
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		printf("ModuleIndex::Save failed: CreateFileA returned error %lu.\n", GetLastError());
+		return FALSE;
+	}
+
+	DWORD writtenAmount = 0;
+	BOOL bWritten = WriteFile(hFile, pIndex->pData, (DWORD) pIndex->DataSize, &writtenAmount, NULL) &&
+		writtenAmount == pIndex->DataSize;
+	CloseHandle(hFile);
+
+	/* Never leave a partial cache file behind, even though it'd fail validation */
+	if (!bWritten)
+	{
+		printf("ModuleIndex::Save failed: WriteFile returned error %lu.\n", GetLastError());
+		DeleteFileA(path);
+		return FALSE;
+	}
+#else
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (fd == -1)
+	{
+		printf("ModuleIndex::Save failed: open returned error %d.\n", errno);
+		return FALSE;
+	}
+
+	SIZE_T writtenAmount = 0;
+	while (writtenAmount < pIndex->DataSize)
+	{
+		ssize_t result = write(fd, pIndex->pData + writtenAmount, pIndex->DataSize - writtenAmount);
+		if (result > 0)
+			writtenAmount += result;
+		else if (!result || errno != EINTR)
+			break;
+	}
+
+	int writeError = errno;
+	close(fd);
+
+	/* Never leave a partial cache file behind, even though it'd fail validation */
+	if (writtenAmount != pIndex->DataSize)
+	{
+		printf("ModuleIndex::Save failed: write returned error %d.\n", writeError);
+		unlink(path);
+		return FALSE;
+	}
+#endif
+
+	return TRUE;
+}
+
+/*
+Free an index, whether it was built or loaded.
+@param pIndex, the index to be freed.
+*/
+void ModuleIndex::Free(PMODULE_INDEX pIndex)
+{
+#ifdef _WIN32
+	if (pIndex->hMapping)
+	{
+		UnmapViewOfFile(pIndex->pData);
+		CloseHandle(pIndex->hMapping);
+		CloseHandle(pIndex->hFile);
+	}
+#else
+	if (pIndex->bMapped)
+	{
+		munmap(pIndex->pData, pIndex->DataSize);
+	}
+#endif
+	else
+	{
+		free(pIndex->pData);
+	}
+
+	free(pIndex);
+}
+
+/*
+@param pIndex, the module's index.
+@param pAddress, an address within the module.
+@return whether an instruction starts at given address.
+*/
+BOOL ModuleIndex::IsInstructionStart(PMODULE_INDEX pIndex, LPVOID pAddress)
+{
+	SIZE_T offset;
+	PINDEXED_SECTION pSection = FindAddress(pIndex, pAddress, &offset);
+
+	return pSection && TestBit(pIndex->pData + pSection->BoundariesOffset, offset);
+}
+
+/*
+@param pIndex, the module's index.
+@param pAddress, an address within the module.
+@return whether a relative branch (JMP, Jcc, CALL) within the module's executable sections targets given address.
+*/
+BOOL ModuleIndex::IsBranchTarget(PMODULE_INDEX pIndex, LPVOID pAddress)
+{
+	SIZE_T offset;
+	PINDEXED_SECTION pSection = FindAddress(pIndex, pAddress, &offset);
+
+	return pSection && TestBit(pIndex->pData + pSection->TargetsOffset, offset);
+}
+
+/*
+Find the size of the whole instructions which cover a given amount of bytes, like Disassembler::Run does.
+@param pIndex, the module's index.
+@param pAddress, the address of the first instruction.
+@param requiredBytes, the amount of bytes that must be covered.
+@param pInstructionAmount, receives the amount of covering instructions (optional).
+@return the size of the covering instructions, or 0 if no instruction starts at given address.
+*/
+SIZE_T ModuleIndex::CoveringSize(PMODULE_INDEX pIndex, LPVOID pAddress, SIZE_T requiredBytes, OUT SIZE_T *pInstructionAmount)
+{
+	SIZE_T offset;
+	PINDEXED_SECTION pSection = FindAddress(pIndex, pAddress, &offset);
+
+	if (!pSection)
+		return 0;
+
+	const BYTE *pBoundaries = pIndex->pData + pSection->BoundariesOffset;
+	if (!TestBit(pBoundaries, offset))
+		return 0;
+
+	/* Count the instructions starting within the required bytes */
+	SIZE_T end = min(offset + max(requiredBytes, (SIZE_T) 1), (SIZE_T) pSection->Size);
+	SIZE_T instructionAmount = 0;
+	for (SIZE_T i = offset; i < end; i++)
+		instructionAmount += TestBit(pBoundaries, i);
+
+	/* The last of them ends where the next instruction starts, which is at most MAX_INSTRUCTION_SIZE bytes away */
+	while (end < pSection->Size && !TestBit(pBoundaries, end))
+		end++;
+
+	if (pInstructionAmount)
+		*pInstructionAmount = instructionAmount;
+
+	return end - offset;
+}
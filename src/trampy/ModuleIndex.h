@@ -0,0 +1,72 @@
+#pragma once
+#include "TrampyDefs.h"
+
+/*
+Definition of the Module Index struct.
+*/
+typedef struct _MODULE_INDEX
+MODULE_INDEX, *PMODULE_INDEX;
+
+/*
+A Module Index records where every instruction of a loaded module's executable sections starts,
+and which of them are targets of relative branches, so hooks may be planned without decoding the module again.
+Indexes are cached to files, keyed by the module's build (its CodeView GUID & age, timestamp and image size on Windows,
+its GNU build-id and image size on Linux), and later loads map the cached index directly into memory.
+On Linux, executable segments are indexed as sections, and RVAs are relative to the module's ELF header.
+*/
+namespace ModuleIndex
+{
+	/*
+	Build the index of a loaded module, by decoding all of its executable sections.
+	@param hModule, the module to be indexed.
+	@return pointer to the newly built index, or NULL if the function failed.
+	*/
+	PMODULE_INDEX Build(HMODULE hModule);
+
+	/*
+	Load the index of a loaded module from the cache.
+	If the module's build isn't cached yet, or its cache file is invalid, the index is built & cached instead.
+	@param hModule, the module whose index is loaded.
+	@param cacheDirectory, the directory the cache files are stored in.
+	@return pointer to the loaded index, or NULL if the function failed.
+	*/
+	PMODULE_INDEX Load(HMODULE hModule, LPCSTR cacheDirectory);
+
+	/*
+	Save an index to the cache.
+	@param pIndex, the index to be saved.
+	@param cacheDirectory, the directory the cache files are stored in.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL Save(PMODULE_INDEX pIndex, LPCSTR cacheDirectory);
+
+	/*
+	Free an index, whether it was built or loaded.
+	@param pIndex, the index to be freed.
+	*/
+	void Free(PMODULE_INDEX pIndex);
+
+	/*
+	@param pIndex, the module's index.
+	@param pAddress, an address within the module.
+	@return whether an instruction starts at given address.
+	*/
+	BOOL IsInstructionStart(PMODULE_INDEX pIndex, LPVOID pAddress);
+
+	/*
+	@param pIndex, the module's index.
+	@param pAddress, an address within the module.
+	@return whether a relative branch (JMP, Jcc, CALL) within the module's executable sections targets given address.
+	*/
+	BOOL IsBranchTarget(PMODULE_INDEX pIndex, LPVOID pAddress);
+
+	/*
+	Find the size of the whole instructions which cover a given amount of bytes, like Disassembler::Run does.
+	@param pIndex, the module's index.
+	@param pAddress, the address of the first instruction.
+	@param requiredBytes, the amount of bytes that must be covered.
+	@param pInstructionAmount, receives the amount of covering instructions (optional).
+	@return the size of the covering instructions, or 0 if no instruction starts at given address.
+	*/
+	SIZE_T CoveringSize(PMODULE_INDEX pIndex, LPVOID pAddress, SIZE_T requiredBytes, OUT SIZE_T *pInstructionAmount);
+}
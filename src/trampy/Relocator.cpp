@@ -0,0 +1,269 @@
+#include "Relocator.h"
+#include "Emitter.h"
+#include "disasm/instr/OpcodeMaps.h"
+#include <stdio.h>
+
+/* Opcodes of the relative branches the Relocator emits */
+#define JMP_REL8_OPCODE 0xEB
+#define JMP_REL32_OPCODE 0xE9
+#define JCC_REL32_OPCODE 0x80
+#define TWO_BYTE_ESCAPE 0x0F
+
+/* Opcodes of the short branches with a condition (Jcc rel8: 70-7F, LOOPcc & JrCXZ: E0-E3) */
+#define JCC_REL8_FIRST 0x70
+#define JCC_REL8_LAST 0x7F
+#define LOOP_FIRST 0xE0
+#define LOOP_LAST 0xE3
+
+/*
+Choose how an instruction is rewritten once it's relocated.
+@param pInstruction, the instruction.
+@param pKind, receives the instruction's relocation kind (RELOCATION_KIND).
+@return TRUE if the function succeeds, FALSE if the instruction can't be relocated.
+*/
+BOOL ChooseRelocationKind(PDECODED_INSTRUCTION pInstruction, OUT BYTE *pKind)
+{
+	if (pInstruction->BranchKind != BRANCH_JMP &&
+		pInstruction->BranchKind != BRANCH_JCC &&
+		pInstruction->BranchKind != BRANCH_CALL)
+	{
+		*pKind = pInstruction->bRipRelative ? RELOCATION_RIP_RELATIVE : RELOCATION_COPY;
+		return TRUE;
+	}
+
+	switch (pInstruction->ImmediateSize)
+	{
+	case DWORD_SIZE:
+		*pKind = RELOCATION_REL32;
+		return TRUE;
+
+	case BYTE_SIZE:
+		/* The operand-size-override prefix truncates the target of a short branch, and would turn its widened rel32 into a rel16 */
+		if (pInstruction->Map != OPMAP_1BYTE || (pInstruction->Prefixes & PREFIX_FLAG_OPERAND_SIZE))
+			break;
+
+		if (pInstruction->Opcode == JMP_REL8_OPCODE)
+			*pKind = RELOCATION_WIDEN_JMP;
+		else if (pInstruction->Opcode >= JCC_REL8_FIRST && pInstruction->Opcode <= JCC_REL8_LAST)
+			*pKind = RELOCATION_WIDEN_JCC;
+		else if (pInstruction->Opcode >= LOOP_FIRST && pInstruction->Opcode <= LOOP_LAST)
+			*pKind = RELOCATION_WIDEN_LOOP;
+		else
+			break;
+
+		return TRUE;
+	}
+
+	/* 16-bit Relative Addresses truncate the instruction pointer, so they only work from where they are */
+	printf("Relocator::Plan failed: unsupported relative branch at offset %u.\n", pInstruction->Offset);
+	return FALSE;
+}
+
+/*
+@return the size of a relocated instruction, once rewritten.
+*/
+WORD RelocatedInstructionSize(PRELOCATED_INSTRUCTION pRelocated)
+{
+	switch (pRelocated->Kind)
+	{
+	case RELOCATION_WIDEN_JMP:
+		return pRelocated->PrefixSize + JMP_REL32_SIZE;
+	case RELOCATION_WIDEN_JCC:
+		return pRelocated->PrefixSize + JCC_REL32_SIZE;
+	case RELOCATION_WIDEN_LOOP:
+		/* LOOPcc +2, JMP +5, JMP rel32 */
+		return pRelocated->PrefixSize + 2 + JMP_REL8_SIZE + JMP_REL32_SIZE;
+	default:
+		return pRelocated->Instruction.Size;
+	}
+}
+
+/*
+Find the relocated instruction that starts at given address.
+@param pPlan, the relocation plan.
+@param pAddress, an address within the source.
+@return pointer to the relocated instruction, or NULL if no relocated instruction starts at given address.
+*/
+const RELOCATED_INSTRUCTION *FindRelocatedInstruction(const RELOCATION_PLAN *pPlan, PBYTE pAddress)
+{
+	for (SIZE_T i = 0; i < pPlan->InstructionAmount; i++)
+	{
+		if (pPlan->pSource + pPlan->Instructions[i].Instruction.Offset == pAddress)
+			return &pPlan->Instructions[i];
+	}
+
+	return NULL;
+}
+
+/*
+@return whether given address is within the source of a relocation plan.
+*/
+bool IsWithinSource(const RELOCATION_PLAN *pPlan, PBYTE pAddress)
+{
+	return pAddress >= pPlan->pSource && pAddress < pPlan->pSource + pPlan->SourceSize;
+}
+
+/*
+Plan the relocation of the whole instructions which cover a given amount of bytes (the sizing pass).
+@param pSource, the address of the first instruction.
+@param requiredBytes, the amount of bytes that must be covered, up to RELOCATION_MAX_REQUIRED_SIZE.
+@param pPlan, receives the relocation plan.
+@return TRUE if the function succeeds, FALSE if it fails (e.g. an instruction can't be relocated).
+*/
+BOOL Relocator::Plan(PBYTE pSource, SIZE_T requiredBytes, OUT PRELOCATION_PLAN pPlan)
+{
+	if (requiredBytes > RELOCATION_MAX_REQUIRED_SIZE)
+	{
+		printf("Relocator::Plan failed: can't relocate more than %d bytes.\n", RELOCATION_MAX_REQUIRED_SIZE);
+		return FALSE;
+	}
+
+	pPlan->pSource = pSource;
+	pPlan->SourceSize = 0;
+	pPlan->RelocatedSize = 0;
+	pPlan->InstructionAmount = 0;
+
+	/* Size every instruction, as it'll be rewritten */
+	INSTRUCTION_ITERATOR iterator;
+	Disassembler::InitializeIterator(&iterator, pSource, RELOCATION_MAX_SOURCE_SIZE, DISASM_MODE_NATIVE);
+
+	while (pPlan->SourceSize < requiredBytes)
+	{
+		PRELOCATED_INSTRUCTION pRelocated = &pPlan->Instructions[pPlan->InstructionAmount];
+		if (!Disassembler::NextInstruction(&iterator, &pRelocated->Instruction))
+		{
+			printf("Relocator::Plan failed: invalid instruction at offset %zu.\n", pPlan->SourceSize);
+			return FALSE;
+		}
+
+		if (!ChooseRelocationKind(&pRelocated->Instruction, &pRelocated->Kind))
+			return FALSE;
+
+		/* The opcode of a short branch directly precedes its Relative Address, so everything before it is a prefix */
+		pRelocated->PrefixSize = pRelocated->Kind >= RELOCATION_WIDEN_JMP ? pRelocated->Instruction.ImmediateOffset - 1 : 0;
+		pRelocated->RelocatedOffset = (WORD) pPlan->RelocatedSize;
+		pRelocated->RelocatedSize = RelocatedInstructionSize(pRelocated);
+
+		pPlan->SourceSize += pRelocated->Instruction.Size;
+		pPlan->RelocatedSize += pRelocated->RelocatedSize;
+		pPlan->InstructionAmount++;
+	}
+
+	/* Branches within the source must land on one of its instructions, which is where they'll land within the relocated code */
+	for (SIZE_T i = 0; i < pPlan->InstructionAmount; i++)
+	{
+		PDECODED_INSTRUCTION pInstruction = &pPlan->Instructions[i].Instruction;
+		if (pPlan->Instructions[i].Kind >= RELOCATION_REL32 &&
+			IsWithinSource(pPlan, pInstruction->Target) &&
+			!FindRelocatedInstruction(pPlan, pInstruction->Target))
+		{
+			printf("Relocator::Plan failed: branch at offset %u lands within an instruction.\n", pInstruction->Offset);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+Write a 32-bit relative offset from the end of a rewritten instruction to its target.
+@param pOffset, where the offset is written.
+@param pNextIp, the address of the instruction following the rewritten instruction.
+@param pTarget, the target.
+@return TRUE if the function succeeds, FALSE if the target is out of 32-bit reach.
+*/
+BOOL WriteRel32(PBYTE pOffset, PBYTE pNextIp, PBYTE pTarget)
+{
+	INT64 offset = pTarget - pNextIp;
+	if (offset != (int32_t) offset)
+		return FALSE;
+
+	int32_t rel32 = (int32_t) offset;
+	memcpy(pOffset, &rel32, DWORD_SIZE);
+	return TRUE;
+}
+
+/*
+Write the relocated instructions (the emit pass).
+The instructions may be written to a staging buffer rather than to their destination, e.g. when the destination isn't writable yet.
+@param pPlan, the relocation plan.
+@param pDestination, the address the instructions are relocated to, which they're executed from.
+@param pBuffer, where the instructions are written, which is either the destination itself or a staging buffer that's copied to it.
+@param bufferSize, the size of the buffer, at least the plan's RelocatedSize.
+@return TRUE if the function succeeds, FALSE if it fails (e.g. a target is out of 32-bit reach from the destination).
+*/
+BOOL Relocator::Emit(const RELOCATION_PLAN *pPlan, PBYTE pDestination, OUT PBYTE pBuffer, SIZE_T bufferSize)
+{
+	if (bufferSize < pPlan->RelocatedSize)
+	{
+		printf("Relocator::Emit failed: buffer is too small (%zu bytes required).\n", pPlan->RelocatedSize);
+		return FALSE;
+	}
+
+	for (SIZE_T i = 0; i < pPlan->InstructionAmount; i++)
+	{
+		const RELOCATED_INSTRUCTION *pRelocated = &pPlan->Instructions[i];
+		const DECODED_INSTRUCTION *pInstruction = &pRelocated->Instruction;
+		PBYTE pCode = pPlan->pSource + pInstruction->Offset;
+		/* The instruction is written to the buffer, but it's relative to where it's executed from */
+		PBYTE pOutput = pBuffer + pRelocated->RelocatedOffset;
+		PBYTE pNextIp = pDestination + pRelocated->RelocatedOffset + pRelocated->RelocatedSize;
+
+		/* Branches within the source land on the relocated copy of their target */
+		PBYTE pTarget = pInstruction->Target;
+		if (pRelocated->Kind >= RELOCATION_REL32 && IsWithinSource(pPlan, pTarget))
+			pTarget = pDestination + FindRelocatedInstruction(pPlan, pTarget)->RelocatedOffset;
+
+		BOOL bReachable = TRUE;
+		switch (pRelocated->Kind)
+		{
+		case RELOCATION_COPY:
+			memcpy(pOutput, pCode, pInstruction->Size);
+			break;
+
+		case RELOCATION_RIP_RELATIVE:
+			memcpy(pOutput, pCode, pInstruction->Size);
+			bReachable = WriteRel32(pOutput + pInstruction->DisplacementOffset, pNextIp, pTarget);
+			break;
+
+		case RELOCATION_REL32:
+			memcpy(pOutput, pCode, pInstruction->Size);
+			bReachable = WriteRel32(pOutput + pInstruction->ImmediateOffset, pNextIp, pTarget);
+			break;
+
+		case RELOCATION_WIDEN_JMP:
+			memcpy(pOutput, pCode, pRelocated->PrefixSize);
+			pOutput += pRelocated->PrefixSize;
+			pOutput[0] = JMP_REL32_OPCODE;
+			bReachable = WriteRel32(pOutput + 1, pNextIp, pTarget);
+			break;
+
+		case RELOCATION_WIDEN_JCC:
+			memcpy(pOutput, pCode, pRelocated->PrefixSize);
+			pOutput += pRelocated->PrefixSize;
+			pOutput[0] = TWO_BYTE_ESCAPE;
+			pOutput[1] = JCC_REL32_OPCODE | (pInstruction->Opcode & 0xF);
+			bReachable = WriteRel32(pOutput + 2, pNextIp, pTarget);
+			break;
+
+		case RELOCATION_WIDEN_LOOP:
+			/* LOOPcc skips over the JMP +5 to the JMP rel32 that's taken whenever it branches */
+			memcpy(pOutput, pCode, pRelocated->PrefixSize + 1);
+			pOutput += pRelocated->PrefixSize + 1;
+			pOutput[0] = 2;
+			pOutput[1] = JMP_REL8_OPCODE;
+			pOutput[2] = JMP_REL32_SIZE;
+			pOutput[3] = JMP_REL32_OPCODE;
+			bReachable = WriteRel32(pOutput + 4, pNextIp, pTarget);
+			break;
+		}
+
+		if (!bReachable)
+		{
+			printf("Relocator::Emit failed: target of instruction at offset %u is out of reach.\n", pInstruction->Offset);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "TrampyDefs.h"
+#include "disasm/disasm.h"
+
+/*
+Max amount of bytes that may be relocated at once.
+*/
+#define RELOCATION_MAX_REQUIRED_SIZE 16
+
+/*
+Max size of the whole instructions which cover RELOCATION_MAX_REQUIRED_SIZE bytes,
+and max amount of such instructions (each is at least a byte).
+*/
+#define RELOCATION_MAX_SOURCE_SIZE (RELOCATION_MAX_REQUIRED_SIZE - 1 + MAX_INSTRUCTION_SIZE)
+#define RELOCATION_MAX_INSTRUCTIONS RELOCATION_MAX_REQUIRED_SIZE
+
+/*
+Max size of the relocated instructions.
+Widening a short branch grows it by at most 7 bytes (LOOPcc rel8 is rewritten as 9 bytes).
+*/
+#define RELOCATION_MAX_RELOCATED_SIZE (RELOCATION_MAX_SOURCE_SIZE + RELOCATION_MAX_INSTRUCTIONS * 7)
+
+/*
+Specifies how an instruction is rewritten once it's relocated.
+*/
+enum RELOCATION_KIND : BYTE
+{
+	/* The instruction doesn't depend on its address, and is copied as-is */
+	RELOCATION_COPY,
+	/* The instruction is copied, and its RIP-relative displacement is adjusted to address the same memory */
+	RELOCATION_RIP_RELATIVE,
+	/* The instruction is copied, and its 32-bit Relative Address is adjusted (JMP, CALL & Jcc rel32, XBEGIN) */
+	RELOCATION_REL32,
+	/* A JMP rel8, widened to JMP rel32 (EB to E9) */
+	RELOCATION_WIDEN_JMP,
+	/* A Jcc rel8, widened to Jcc rel32 (7x to 0F 8x) */
+	RELOCATION_WIDEN_JCC,
+	/*
+	A LOOPcc or JrCXZ, which have no rel32 form, so they're rewritten as a branch over a JMP rel32:
+	LOOPcc +2, JMP +5, JMP rel32
+	*/
+	RELOCATION_WIDEN_LOOP,
+};
+
+/*
+Struct describing an instruction that's relocated.
+*/
+typedef struct _RELOCATED_INSTRUCTION
+{
+	/*
+	The instruction, as decoded at its source.
+	*/
+	DECODED_INSTRUCTION Instruction;
+	/*
+	How the instruction is rewritten (RELOCATION_KIND).
+	*/
+	BYTE Kind;
+	/*
+	Size of the prefixes preceding the opcode of a widened branch, which are kept (e.g. branch hints).
+	*/
+	BYTE PrefixSize;
+	/*
+	Offset & size of the rewritten instruction, within the relocated code.
+	*/
+	WORD RelocatedOffset;
+	WORD RelocatedSize;
+}
+RELOCATED_INSTRUCTION, *PRELOCATED_INSTRUCTION;
+
+/*
+Struct describing the relocation of the instructions at the beginning of a function (e.g. the stolen bytes of a Hook).
+A plan is made before the relocated code is allocated, so its exact size is known up front.
+*/
+typedef struct _RELOCATION_PLAN
+{
+	/*
+	The instructions' source, and the size of the whole instructions being relocated.
+	*/
+	PBYTE pSource;
+	SIZE_T SourceSize;
+	/*
+	The exact size of the relocated code.
+	*/
+	SIZE_T RelocatedSize;
+	/*
+	The instructions being relocated.
+	*/
+	SIZE_T InstructionAmount;
+	RELOCATED_INSTRUCTION Instructions[RELOCATION_MAX_INSTRUCTIONS];
+}
+RELOCATION_PLAN, *PRELOCATION_PLAN;
+
+/*
+The Relocator moves instructions to another address, keeping them valid & working from it, in two passes.
+The sizing pass (Plan) decodes the instructions, and sizes each of them once rewritten:
+short branches are widened to rel32, as their targets are rarely within 8-bit reach of the relocated code.
+The emit pass (Emit) writes the rewritten instructions, adjusting every Relative Address & RIP-relative displacement.
+Branches which target one of the relocated instructions are kept pointing at its relocated copy.
+*/
+namespace Relocator
+{
+	/*
+	Plan the relocation of the whole instructions which cover a given amount of bytes (the sizing pass).
+	@param pSource, the address of the first instruction.
+	@param requiredBytes, the amount of bytes that must be covered, up to RELOCATION_MAX_REQUIRED_SIZE.
+	@param pPlan, receives the relocation plan.
+	@return TRUE if the function succeeds, FALSE if it fails (e.g. an instruction can't be relocated).
+	*/
+	BOOL Plan(PBYTE pSource, SIZE_T requiredBytes, OUT PRELOCATION_PLAN pPlan);
+
+	/*
+	Write the relocated instructions (the emit pass).
+	The instructions may be written to a staging buffer rather than to their destination, e.g. when the destination isn't writable yet.
+	@param pPlan, the relocation plan.
+	@param pDestination, the address the instructions are relocated to, which they're executed from.
+	@param pBuffer, where the instructions are written, which is either the destination itself or a staging buffer that's copied to it.
+	@param bufferSize, the size of the buffer, at least the plan's RelocatedSize.
+	@return TRUE if the function succeeds, FALSE if it fails (e.g. a target is out of 32-bit reach from the destination).
+	*/
+	BOOL Emit(const RELOCATION_PLAN *pPlan, PBYTE pDestination, OUT PBYTE pBuffer, SIZE_T bufferSize);
+}
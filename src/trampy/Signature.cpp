@@ -0,0 +1,527 @@
+#include "Signature.h"
+#include "disasm/disasm.h"
+#include "disasm/instr/OpcodeMaps.h"
+#include "disasm/instr/Vex.h"
+#include <stdio.h>
+#include <vector>
+
+#ifndef _WIN32
+#include <link.h>
+#endif
+
+/*
+Struct describing an executable section of a loaded module.
+*/
+typedef struct _CODE_SECTION
+{
+	PBYTE Start;
+	SIZE_T Size;
+}
+CODE_SECTION, *PCODE_SECTION;
+
+/*
+Struct describing a loaded module, as far as signatures are concerned.
+*/
+typedef struct _MODULE_IMAGE
+{
+	/*
+	Base address of the module, and the size of its image.
+	*/
+	PBYTE Base;
+	SIZE_T Size;
+	/*
+	The module's executable sections, which signatures are matched within.
+	*/
+	std::vector<CODE_SECTION> Sections;
+}
+MODULE_IMAGE, *PMODULE_IMAGE;
+
+/*
+Struct describing a match of a signature that's being generated.
+*/
+typedef struct _SIGNATURE_MATCH
+{
+	/*
+	The match's address, and the end of the section it's in (which the signature mustn't cross as it grows).
+	*/
+	PBYTE pAddress;
+	PBYTE pSectionEnd;
+}
+SIGNATURE_MATCH, *PSIGNATURE_MATCH;
+
+#ifdef _WIN32
+/*
+Find the image & executable sections of a loaded module.
+@param hModule, the module.
+@param pImage, receives the module's image.
+@return TRUE if the function succeeds, FALSE if the module's headers are invalid.
+*/
+BOOL GetModuleImage(HMODULE hModule, OUT PMODULE_IMAGE pImage)
+{
+	PBYTE imageBase = (PBYTE) hModule;
+	PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER) imageBase;
+	if (pDosHeader->e_magic != IMAGE_DOS_SIGNATURE)
+		return FALSE;
+
+	PIMAGE_NT_HEADERS pNtHeaders = (PIMAGE_NT_HEADERS) (imageBase + pDosHeader->e_lfanew);
+	if (pNtHeaders->Signature != IMAGE_NT_SIGNATURE)
+		return FALSE;
+
+	pImage->Base = imageBase;
+	pImage->Size = pNtHeaders->OptionalHeader.SizeOfImage;
+
+	PIMAGE_SECTION_HEADER pSectionHeaders = IMAGE_FIRST_SECTION(pNtHeaders);
+	for (WORD i = 0; i < pNtHeaders->FileHeader.NumberOfSections; i++)
+	{
+		if (pSectionHeaders[i].Characteristics & IMAGE_SCN_MEM_EXECUTE)
+			pImage->Sections.push_back({ imageBase + pSectionHeaders[i].VirtualAddress, pSectionHeaders[i].Misc.VirtualSize });
+	}
+
+	return TRUE;
+}
+#else
+/*
+dl_iterate_phdr callback, which fills the image of the module whose ELF header is at the image's base address.
+The image spans the module's loadable segments, and its executable segments are its executable sections.
+*/
+int GetModuleImageCallback(struct dl_phdr_info *pInfo, size_t infoSize, void *pContext)
+{
+	PMODULE_IMAGE pImage = (PMODULE_IMAGE) pContext;
+	PBYTE imageEnd = NULL;
+
+	for (ElfW(Half) i = 0; i < pInfo->dlpi_phnum; i++)
+	{
+		const ElfW(Phdr) &programHeader = pInfo->dlpi_phdr[i];
+		if (programHeader.p_type != PT_LOAD)
+			continue;
+
+		/* The ELF header is mapped by the lowest loadable segment */
+		PBYTE pSegment = (PBYTE) (pInfo->dlpi_addr + programHeader.p_vaddr);
+		if (!imageEnd && pSegment - programHeader.p_offset != pImage->Base)
+			return 0;
+
+		imageEnd = max(imageEnd, pSegment + programHeader.p_memsz);
+
+		if (programHeader.p_flags & PF_X)
+			pImage->Sections.push_back({ pSegment, programHeader.p_memsz });
+	}
+
+	pImage->Size = imageEnd - pImage->Base;
+	return imageEnd != NULL;
+}
+
+/*
+Find the image & executable sections of a loaded module.
+@param hModule, the module, i.e. the address of its ELF header.
+@param pImage, receives the module's image.
+@return TRUE if the function succeeds, FALSE if no module is loaded at given address.
+*/
+BOOL GetModuleImage(HMODULE hModule, OUT PMODULE_IMAGE pImage)
+{
+	pImage->Base = (PBYTE) hModule;
+	pImage->Size = 0;
+
+	return dl_iterate_phdr(GetModuleImageCallback, pImage) != 0;
+}
+#endif
+
+/*
+@return the executable section given address is in, or NULL if it isn't in any.
+*/
+const CODE_SECTION *FindCodeSection(PMODULE_IMAGE pImage, PBYTE pAddress)
+{
+	for (const CODE_SECTION &section : pImage->Sections)
+	{
+		if (pAddress >= section.Start && (SIZE_T) (pAddress - section.Start) < section.Size)
+			return &section;
+	}
+
+	return NULL;
+}
+
+/*
+@return whether given value is an address within the module's image (i.e. it's relocated, and changes between builds).
+*/
+bool IsImageAddress(PMODULE_IMAGE pImage, DWORD64 value)
+{
+	return value >= (ULONG_PTR) pImage->Base && value - (ULONG_PTR) pImage->Base < pImage->Size;
+}
+
+/*
+@return whether an instruction's ModRM displacement is wildcarded.
+*/
+bool IsDisplacementWildcarded(PMODULE_IMAGE pImage, PDECODED_INSTRUCTION pInstruction, const BYTE *pCode, BYTE flags)
+{
+	if (!pInstruction->DisplacementSize)
+		return false;
+
+	if (pInstruction->bRipRelative)
+		return true;
+
+	/* 8-bit displacements are offsets within stack frames & small structures, which rarely change */
+	if (pInstruction->DisplacementSize < DWORD_SIZE)
+		return false;
+
+	if (flags & SIGNATURE_FLAG_DISPLACEMENTS)
+		return true;
+
+	DWORD displacement;
+	memcpy(&displacement, pCode + pInstruction->DisplacementOffset, DWORD_SIZE);
+	return IsImageAddress(pImage, displacement);
+}
+
+/*
+@return whether an instruction's immediate operands are wildcarded.
+*/
+bool IsImmediateWildcarded(PMODULE_IMAGE pImage, PDECODED_INSTRUCTION pInstruction, const BYTE *pCode, BYTE flags)
+{
+	if (!pInstruction->ImmediateSize)
+		return false;
+
+	/* Relative Addresses */
+	if (pInstruction->BranchKind == BRANCH_JMP || pInstruction->BranchKind == BRANCH_JCC || pInstruction->BranchKind == BRANCH_CALL)
+		return true;
+
+	/* Memory offsets (MOV AL, moffs8 through MOV moffs32, EAX) & far pointers (CALL & JMP ptr16:32) are always absolute addresses */
+	BYTE opcode = pInstruction->Opcode;
+	if (pInstruction->Encoding == ENCODING_LEGACY && pInstruction->Map == OPMAP_1BYTE &&
+		((opcode >= 0xA0 && opcode <= 0xA3) || opcode == 0x9A || opcode == 0xEA))
+		return true;
+
+	if (pInstruction->ImmediateSize < DWORD_SIZE)
+		return false;
+
+	if (flags & SIGNATURE_FLAG_IMMEDIATES)
+		return true;
+
+	DWORD64 immediate = 0;
+	memcpy(&immediate, pCode + pInstruction->ImmediateOffset, min(pInstruction->ImmediateSize, (BYTE) QWORD_SIZE));
+	return IsImageAddress(pImage, immediate);
+}
+
+/*
+Append an instruction to a signature, wildcarding the fields that change between builds.
+The signature must have room for the instruction.
+@param pImage, the module the instruction belongs to.
+@param pInstruction, the decoded instruction.
+@param pCode, the instruction's bytes.
+@param flags, additional fields to be wildcarded (SIGNATURE_FLAGS).
+@param pSignature, the signature the instruction is appended to.
+*/
+void AppendInstruction(PMODULE_IMAGE pImage, PDECODED_INSTRUCTION pInstruction, const BYTE *pCode, BYTE flags, PSIGNATURE pSignature)
+{
+	PBYTE pBytes = pSignature->Bytes + pSignature->Size;
+	PBYTE pMask = pSignature->Mask + pSignature->Size;
+
+	memset(pMask, 0xFF, pInstruction->Size);
+
+	if (IsDisplacementWildcarded(pImage, pInstruction, pCode, flags))
+		memset(pMask + pInstruction->DisplacementOffset, 0, pInstruction->DisplacementSize);
+
+	if (IsImmediateWildcarded(pImage, pInstruction, pCode, flags))
+		memset(pMask + pInstruction->ImmediateOffset, 0, pInstruction->ImmediateSize);
+
+	for (BYTE i = 0; i < pInstruction->Size; i++)
+		pBytes[i] = pCode[i] & pMask[i];
+
+	pSignature->Size += pInstruction->Size;
+}
+
+/*
+@return whether code matches given bytes of a signature.
+*/
+bool MatchesAt(const BYTE *pCode, const SIGNATURE *pSignature, DWORD start, DWORD end)
+{
+	for (DWORD i = start; i < end; i++)
+	{
+		if ((pCode[i] & pSignature->Mask[i]) != pSignature->Bytes[i])
+			return false;
+	}
+
+	return true;
+}
+
+/*
+@return the offset of the first byte that must match within a signature, or its size if it's entirely wildcarded.
+*/
+DWORD FindAnchor(const SIGNATURE *pSignature)
+{
+	DWORD anchor = 0;
+	while (anchor < pSignature->Size && !pSignature->Mask[anchor])
+		anchor++;
+
+	return anchor;
+}
+
+/*
+Find the next match of a signature within an executable section.
+Candidates are found by searching for the signature's anchor byte through memchr, which is vectorized by the CRT,
+and only they are compared against the whole signature.
+@param pSection, the section to be scanned.
+@param pFrom, the address the scan starts at.
+@param pSignature, the signature to be found.
+@param anchor, the signature's anchor (see FindAnchor).
+@return the address of the next match, or NULL if there are no more matches.
+*/
+PBYTE ScanSection(const CODE_SECTION *pSection, PBYTE pFrom, const SIGNATURE *pSignature, DWORD anchor)
+{
+	if (pSignature->Size > pSection->Size)
+		return NULL;
+
+	/* The last address a match may start at */
+	PBYTE pLast = pSection->Start + pSection->Size - pSignature->Size;
+
+	if (anchor == pSignature->Size)
+		return pFrom <= pLast ? pFrom : NULL;
+
+	while (pFrom <= pLast)
+	{
+		PBYTE pFound = (PBYTE) memchr(pFrom + anchor, pSignature->Bytes[anchor], pLast - pFrom + 1);
+		if (!pFound)
+			return NULL;
+
+		pFrom = pFound - anchor;
+		if (MatchesAt(pFrom, pSignature, 0, pSignature->Size))
+			return pFrom;
+
+		pFrom++;
+	}
+
+	return NULL;
+}
+
+/*
+Generate the signature of a function, made of as few leading instructions as make it unique within its module.
+@param hModule, the module the function belongs to.
+@param pFunction, the function's entry, within one of the module's executable sections.
+@param flags, additional fields to be wildcarded (SIGNATURE_FLAGS), or 0.
+@param pSignature, receives the function's signature.
+@return TRUE if the function succeeds, FALSE if it fails (e.g. no signature of up to SIGNATURE_MAX_SIZE bytes is unique).
+*/
+BOOL Signature::Generate(HMODULE hModule, LPVOID pFunction, BYTE flags, OUT PSIGNATURE pSignature)
+{
+	MODULE_IMAGE image;
+	if (!GetModuleImage(hModule, &image))
+	{
+		printf("Signature::Generate failed: invalid module headers.\n");
+		return FALSE;
+	}
+
+	PBYTE pCode = (PBYTE) pFunction;
+	const CODE_SECTION *pSection = FindCodeSection(&image, pCode);
+
+	if (!pSection)
+	{
+		printf("Signature::Generate failed: function isn't within an executable section.\n");
+		return FALSE;
+	}
+
+	*pSignature = { };
+
+	INSTRUCTION_ITERATOR iterator;
+	DECODED_INSTRUCTION instruction;
+	Disassembler::InitializeIterator(&iterator, pCode, pSection->Start + pSection->Size - pCode, DISASM_MODE_NATIVE);
+
+	std::vector<SIGNATURE_MATCH> matches;
+	while (Disassembler::NextInstruction(&iterator, &instruction))
+	{
+		if (pSignature->Size + instruction.Size > SIGNATURE_MAX_SIZE)
+			break;
+
+		DWORD start = pSignature->Size;
+		AppendInstruction(&image, &instruction, pCode + instruction.Offset, flags, pSignature);
+
+		/* The first instruction is scanned for throughout the module, and every following instruction only narrows down its matches */
+		if (!start)
+		{
+			DWORD anchor = FindAnchor(pSignature);
+			for (const CODE_SECTION &section : image.Sections)
+			{
+				PBYTE pSectionEnd = section.Start + section.Size;
+				for (PBYTE pMatch = ScanSection(&section, section.Start, pSignature, anchor); pMatch; pMatch = ScanSection(&section, pMatch + 1, pSignature, anchor))
+					matches.push_back({ pMatch, pSectionEnd });
+			}
+		}
+		else
+		{
+			SIZE_T kept = 0;
+			for (const SIGNATURE_MATCH &match : matches)
+			{
+				if ((SIZE_T) (match.pSectionEnd - match.pAddress) >= pSignature->Size && MatchesAt(match.pAddress, pSignature, start, pSignature->Size))
+					matches[kept++] = match;
+			}
+
+			matches.resize(kept);
+		}
+
+		/* The function itself always matches, so it's the only match */
+		if (matches.size() == 1)
+			return TRUE;
+	}
+
+	printf("Signature::Generate failed: no signature of up to %d bytes is unique.\n", SIGNATURE_MAX_SIZE);
+	return FALSE;
+}
+
+/*
+Find the first match of a signature within a module.
+@param hModule, the module to be scanned.
+@param pSignature, the signature to be found.
+@return the address of the first match, or NULL if the signature isn't found.
+*/
+LPVOID Signature::Find(HMODULE hModule, const SIGNATURE *pSignature)
+{
+	MODULE_IMAGE image;
+	if (!GetModuleImage(hModule, &image))
+	{
+		printf("Signature::Find failed: invalid module headers.\n");
+		return NULL;
+	}
+
+	DWORD anchor = FindAnchor(pSignature);
+	for (const CODE_SECTION &section : image.Sections)
+	{
+		PBYTE pMatch = ScanSection(&section, section.Start, pSignature, anchor);
+		if (pMatch)
+			return pMatch;
+	}
+
+	return NULL;
+}
+
+/*
+Count the matches of a signature within a module.
+@param hModule, the module to be scanned.
+@param pSignature, the signature to be counted.
+@param maxAmount, the amount of matches the scan stops at (e.g. 2 to check whether the signature is unique).
+@return the amount of matches, up to maxAmount.
+*/
+SIZE_T Signature::Count(HMODULE hModule, const SIGNATURE *pSignature, SIZE_T maxAmount)
+{
+	MODULE_IMAGE image;
+	if (!GetModuleImage(hModule, &image))
+	{
+		printf("Signature::Count failed: invalid module headers.\n");
+		return 0;
+	}
+
+	SIZE_T amount = 0;
+	DWORD anchor = FindAnchor(pSignature);
+	for (const CODE_SECTION &section : image.Sections)
+	{
+		for (PBYTE pMatch = ScanSection(&section, section.Start, pSignature, anchor); pMatch && amount < maxAmount; pMatch = ScanSection(&section, pMatch + 1, pSignature, anchor))
+			amount++;
+	}
+
+	return amount;
+}
+
+/*
+Format a signature as text, where wildcarded bytes are question marks (e.g. "48 8b 05 ?? ?? ?? ?? c3").
+@param pSignature, the signature to be formatted.
+@param text, the buffer receiving the null-terminated text.
+@param textSize, the size of the buffer, SIGNATURE_TEXT_SIZE always suffices.
+@return the length of the text, or 0 if the buffer is too small.
+*/
+SIZE_T Signature::Format(const SIGNATURE *pSignature, OUT CHAR *text, SIZE_T textSize)
+{
+	const CHAR digits[] = "0123456789abcdef";
+
+	/* Every byte takes 2 characters, followed by a space (or the null-terminator, after the last byte) */
+	if (!textSize || textSize < pSignature->Size * 3)
+	{
+		if (textSize)
+			text[0] = '\0';
+
+		return 0;
+	}
+
+	SIZE_T length = 0;
+	for (DWORD i = 0; i < pSignature->Size; i++)
+	{
+		if (i)
+			text[length++] = ' ';
+
+		BYTE value = pSignature->Bytes[i];
+		text[length++] = pSignature->Mask[i] ? digits[value >> 4] : '?';
+		text[length++] = pSignature->Mask[i] ? digits[value & 0xF] : '?';
+	}
+
+	text[length] = '\0';
+	return length;
+}
+
+/*
+@return the value of a hexadecimal digit, or -1 if the character isn't one.
+*/
+int HexDigitValue(CHAR character)
+{
+	if (character >= '0' && character <= '9')
+		return character - '0';
+
+	if (character >= 'a' && character <= 'f')
+		return character - 'a' + 10;
+
+	if (character >= 'A' && character <= 'F')
+		return character - 'A' + 10;
+
+	return -1;
+}
+
+/*
+Parse a signature from text, as formatted by Format (a single question mark is accepted as a wildcard as well).
+@param text, the null-terminated text.
+@param pSignature, receives the parsed signature.
+@return TRUE if the function succeeds, FALSE if the text is invalid.
+*/
+BOOL Signature::Parse(LPCSTR text, OUT PSIGNATURE pSignature)
+{
+	*pSignature = { };
+
+	while (*text)
+	{
+		if (*text == ' ')
+		{
+			text++;
+			continue;
+		}
+
+		if (pSignature->Size == SIGNATURE_MAX_SIZE)
+		{
+			printf("Signature::Parse failed: signature is longer than %d bytes.\n", SIGNATURE_MAX_SIZE);
+			return FALSE;
+		}
+
+		/* Wildcarded bytes are left zeroed */
+		if (*text == '?')
+		{
+			text += text[1] == '?' ? 2 : 1;
+		}
+		else
+		{
+			int high = HexDigitValue(text[0]);
+			int low = high < 0 ? -1 : HexDigitValue(text[1]);
+
+			if (low < 0)
+			{
+				printf("Signature::Parse failed: invalid byte at \"%s\".\n", text);
+				return FALSE;
+			}
+
+			pSignature->Bytes[pSignature->Size] = (BYTE) (high << 4 | low);
+			pSignature->Mask[pSignature->Size] = 0xFF;
+			text += 2;
+		}
+
+		/* Bytes are separated by spaces */
+		if (*text && *text != ' ')
+		{
+			printf("Signature::Parse failed: invalid byte at \"%s\".\n", text);
+			return FALSE;
+		}
+
+		pSignature->Size++;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "TrampyDefs.h"
+
+/*
+Max size of a signature, in bytes.
+*/
+#define SIGNATURE_MAX_SIZE 0x80
+
+/*
+Size of a text buffer that fits any formatted signature (see Signature::Format).
+*/
+#define SIGNATURE_TEXT_SIZE (SIGNATURE_MAX_SIZE * 3)
+
+/*
+Flags controlling which fields of a function's instructions are wildcarded, beyond addresses & relative branches.
+*/
+enum SIGNATURE_FLAGS : BYTE
+{
+	/* Wildcard every 32-bit ModRM displacement (e.g. structure offsets), not only absolute addresses */
+	SIGNATURE_FLAG_DISPLACEMENTS = 1 << 0,
+	/* Wildcard every immediate of at least 32-bits (e.g. constants), not only absolute addresses */
+	SIGNATURE_FLAG_IMMEDIATES = 1 << 1,
+};
+
+/*
+Struct describing a byte signature, in a mask-and-bytes form.
+Code matches the signature if (code[i] & Mask[i]) == Bytes[i] for every byte of the signature,
+so scanners can compare a byte (or a vector of bytes) at a time, without branching on wildcards.
+*/
+typedef struct _SIGNATURE
+{
+	/*
+	Size of the signature, in bytes.
+	*/
+	DWORD Size;
+	/*
+	The signature's bytes, which are 0 where they're wildcarded.
+	*/
+	BYTE Bytes[SIGNATURE_MAX_SIZE];
+	/*
+	The signature's mask, 0xFF for bytes that must match, 0x00 for wildcarded bytes.
+	*/
+	BYTE Mask[SIGNATURE_MAX_SIZE];
+}
+SIGNATURE, *PSIGNATURE;
+
+/*
+Signatures locate functions within modules across builds.
+A function's signature is its leading instructions, where fields that change between builds are wildcarded:
+relative branch targets, RIP-relative displacements, and absolute addresses within the module (e.g. MOV EAX, [g_Global] or PUSH offset string).
+Only executable sections (executable segments, on Linux) are scanned, and signatures always cover whole instructions.
+*/
+namespace Signature
+{
+	/*
+	Generate the signature of a function, made of as few leading instructions as make it unique within its module.
+	@param hModule, the module the function belongs to.
+	@param pFunction, the function's entry, within one of the module's executable sections.
+	@param flags, additional fields to be wildcarded (SIGNATURE_FLAGS), or 0.
+	@param pSignature, receives the function's signature.
+	@return TRUE if the function succeeds, FALSE if it fails (e.g. no signature of up to SIGNATURE_MAX_SIZE bytes is unique).
+	*/
+	BOOL Generate(HMODULE hModule, LPVOID pFunction, BYTE flags, OUT PSIGNATURE pSignature);
+
+	/*
+	Find the first match of a signature within a module.
+	@param hModule, the module to be scanned.
+	@param pSignature, the signature to be found.
+	@return the address of the first match, or NULL if the signature isn't found.
+	*/
+	LPVOID Find(HMODULE hModule, const SIGNATURE *pSignature);
+
+	/*
+	Count the matches of a signature within a module.
+	@param hModule, the module to be scanned.
+	@param pSignature, the signature to be counted.
+	@param maxAmount, the amount of matches the scan stops at (e.g. 2 to check whether the signature is unique).
+	@return the amount of matches, up to maxAmount.
+	*/
+	SIZE_T Count(HMODULE hModule, const SIGNATURE *pSignature, SIZE_T maxAmount);
+
+	/*
+	Format a signature as text, where wildcarded bytes are question marks (e.g. "48 8b 05 ?? ?? ?? ?? c3").
+	@param pSignature, the signature to be formatted.
+	@param text, the buffer receiving the null-terminated text.
+	@param textSize, the size of the buffer, SIGNATURE_TEXT_SIZE always suffices.
+	@return the length of the text, or 0 if the buffer is too small.
+	*/
+	SIZE_T Format(const SIGNATURE *pSignature, OUT CHAR *text, SIZE_T textSize);
+
+	/*
+	Parse a signature from text, as formatted by Format (a single question mark is accepted as a wildcard as well).
+	@param text, the null-terminated text.
+	@param pSignature, receives the parsed signature.
+	@return TRUE if the function succeeds, FALSE if the text is invalid.
+	*/
+	BOOL Parse(LPCSTR text, OUT PSIGNATURE pSignature);
+}
@@ -0,0 +1,399 @@
+#include "Threads.h"
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#ifdef _WIN32
+#include <TlHelp32.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/* The register of a signal's context which holds the instruction pointer */
+#ifndef _WIN32
+#ifdef __x86_64__
+#define CONTEXT_IP REG_RIP
+#else
+#define CONTEXT_IP REG_EIP
+#endif
+
+/* The signal that suspends a thread, the first real-time signal that isn't reserved by the C library */
+#define THREAD_SUSPEND_SIGNAL SIGRTMIN
+#endif
+
+/*
+Struct describing a thread that's suspended.
+*/
+typedef struct _SUSPENDED_THREAD
+{
+#ifdef _WIN32
+	/*
+	The thread's handle, or NULL if the thread exited before it was suspended.
+	*/
+	HANDLE hThread;
+	/*
+	The thread's context, and whether it was changed (it's set once the thread is resumed).
+	*/
+	CONTEXT Context;
+	BOOL bContextChanged;
+#else
+	/*
+	The thread's ID, or 0 if the thread exited before it was suspended.
+	*/
+	pid_t Tid;
+	/*
+	The thread's context, as received by the suspension signal's handler (it's restored once the handler returns).
+	*/
+	ucontext_t *pContext;
+#endif
+}
+SUSPENDED_THREAD, *PSUSPENDED_THREAD;
+
+/*
+Struct describing the suspension of every other thread.
+*/
+typedef struct _THREAD_SUSPENSION
+{
+	/*
+	The suspended threads.
+	*/
+	std::vector<SUSPENDED_THREAD> Threads;
+	/*
+	When the first thread was suspended.
+	*/
+	std::chrono::steady_clock::time_point SuspendTime;
+}
+THREAD_SUSPENSION, *PTHREAD_SUSPENSION;
+
+/*
+A single suspension exists at a time, so it's guarded by a lock from Threads::SuspendOthers until Threads::Resume.
+*/
+std::mutex g_SuspensionLock;
+
+#ifndef _WIN32
+/*
+The current suspension, which threads find their context's slot in, and its epoch, which every suspension signal carries,
+so a signal that's late for its suspension (e.g. one that timed out) is told apart from the current suspension's signal.
+*/
+PTHREAD_SUSPENSION g_pSuspension = NULL;
+std::atomic<SIZE_T> g_SuspensionEpoch(0);
+/*
+The amount of threads that reached the suspension signal's handler for the current suspension,
+and the amount of threads that are within the handler (for any suspension), so the suspension is only freed once they all left.
+*/
+std::atomic<SIZE_T> g_SuspendedAmount(0);
+std::atomic<SIZE_T> g_HandlerAmount(0);
+std::atomic<bool> g_bResume(false);
+BOOL g_bSuspendHandler = FALSE;
+
+/*
+Suspend the thread that received the suspension signal, until the suspension is resumed.
+The thread's context is published, so its instruction pointer may be moved meanwhile.
+@param signalNumber, the signal.
+@param pInfo, the signal's info.
+@param pContext, the thread's context.
+*/
+void SuspendHandler(int signalNumber, siginfo_t *pInfo, void *pContext)
+{
+	int savedErrno = errno;
+
+	/*
+	The thread is counted within the handler before the epoch is checked, so the suspension isn't freed while it's used.
+	A signal of a previous suspension, or one that wasn't sent by Threads::SuspendOthers, is ignored.
+	*/
+	g_HandlerAmount++;
+	if (pInfo->si_code != SI_QUEUE || (SIZE_T) pInfo->si_value.sival_ptr != g_SuspensionEpoch)
+	{
+		g_HandlerAmount--;
+		errno = savedErrno;
+		return;
+	}
+
+	pid_t tid = (pid_t) syscall(SYS_gettid);
+	for (SUSPENDED_THREAD &thread : g_pSuspension->Threads)
+	{
+		if (thread.Tid == tid)
+			__atomic_store_n(&thread.pContext, (ucontext_t *) pContext, __ATOMIC_RELEASE);
+	}
+
+	g_SuspendedAmount++;
+
+	/* Yield rather than spin, so the suspending thread runs even if there are more threads than processors */
+	while (!g_bResume)
+		sched_yield();
+
+	g_HandlerAmount--;
+
+	errno = savedErrno;
+}
+
+/*
+Send the suspension signal to a thread, along with the current suspension's epoch.
+@param tid, the thread's ID.
+@return TRUE if the signal was sent, FALSE if it wasn't (e.g. the thread exited).
+*/
+BOOL SendSuspendSignal(pid_t tid)
+{
+	siginfo_t info = { };
+	info.si_signo = THREAD_SUSPEND_SIGNAL;
+	info.si_code = SI_QUEUE;
+	info.si_pid = getpid();
+	info.si_uid = getuid();
+	info.si_value.sival_ptr = (void *) (SIZE_T) g_SuspensionEpoch;
+
+	return !syscall(SYS_rt_tgsigqueueinfo, getpid(), tid, THREAD_SUSPEND_SIGNAL, &info);
+}
+
+/*
+Release the threads of the current suspension, and wait until every thread left the suspension signal's handler,
+so none of them uses the suspension once it's freed. Signals that reach a thread later on are ignored.
+*/
+void ReleaseSuspension()
+{
+	g_SuspensionEpoch++;
+	g_bResume = true;
+
+	while (g_HandlerAmount)
+		sched_yield();
+
+	g_pSuspension = NULL;
+}
+
+/*
+Install the suspension signal's handler, unless it was installed already.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL InstallSuspendHandler()
+{
+	if (g_bSuspendHandler)
+		return TRUE;
+
+	struct sigaction action = { };
+	action.sa_sigaction = SuspendHandler;
+	action.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigfillset(&action.sa_mask);
+	g_bSuspendHandler = !sigaction(THREAD_SUSPEND_SIGNAL, &action, NULL);
+
+	return g_bSuspendHandler;
+}
+
+/*
+Collect the IDs of every other thread of the process.
+@param pSuspension, the suspension the threads are added to.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL CollectThreads(PTHREAD_SUSPENSION pSuspension)
+{
+	DIR *pTasks = opendir("/proc/self/task");
+	if (!pTasks)
+		return FALSE;
+
+	pid_t currentTid = (pid_t) syscall(SYS_gettid);
+	for (dirent *pEntry = readdir(pTasks); pEntry; pEntry = readdir(pTasks))
+	{
+		pid_t tid = (pid_t) atoi(pEntry->d_name);
+		if (tid > 0 && tid != currentTid)
+			pSuspension->Threads.push_back({ tid, NULL });
+	}
+
+	closedir(pTasks);
+	return TRUE;
+}
+#endif
+
+/*
+Suspend every other thread of the process.
+Threads that are created meanwhile aren't suspended.
+@return the suspension, or NULL if the function failed (in which case no thread is left suspended).
+*/
+PTHREAD_SUSPENSION Threads::SuspendOthers()
+{
+	g_SuspensionLock.lock();
+
+	PTHREAD_SUSPENSION pSuspension = new THREAD_SUSPENSION{ };
+
+#ifdef _WIN32
+	/* Open every other thread of the process before any of them is suspended */
+	HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	if (hSnapshot == INVALID_HANDLE_VALUE)
+	{
+		printf("Threads::SuspendOthers failed: couldn't enumerate the threads.\n");
+		delete pSuspension;
+		g_SuspensionLock.unlock();
+		return NULL;
+	}
+
+	THREADENTRY32 entry = { };
+	entry.dwSize = sizeof(entry);
+	for (BOOL bFound = Thread32First(hSnapshot, &entry); bFound; bFound = Thread32Next(hSnapshot, &entry))
+	{
+		if (entry.th32OwnerProcessID != GetCurrentProcessId() || entry.th32ThreadID == GetCurrentThreadId())
+			continue;
+
+		HANDLE hThread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_SET_CONTEXT, FALSE, entry.th32ThreadID);
+		if (hThread)
+			pSuspension->Threads.push_back({ hThread });
+	}
+
+	CloseHandle(hSnapshot);
+
+	pSuspension->SuspendTime = std::chrono::steady_clock::now();
+
+	/* GetThreadContext only returns once the thread is actually suspended, threads that exited meanwhile are skipped */
+	for (SUSPENDED_THREAD &thread : pSuspension->Threads)
+	{
+		thread.Context.ContextFlags = CONTEXT_CONTROL;
+		if (SuspendThread(thread.hThread) == (DWORD) -1)
+		{
+			CloseHandle(thread.hThread);
+			thread.hThread = NULL;
+		}
+		else if (!GetThreadContext(thread.hThread, &thread.Context))
+		{
+			ResumeThread(thread.hThread);
+			CloseHandle(thread.hThread);
+			thread.hThread = NULL;
+		}
+	}
+#else
+	if (!InstallSuspendHandler() || !CollectThreads(pSuspension))
+	{
+		printf("Threads::SuspendOthers failed: couldn't enumerate the threads.\n");
+		delete pSuspension;
+		g_SuspensionLock.unlock();
+		return NULL;
+	}
+
+	/* The suspension is set up before its epoch begins, a thread only uses it once it received a signal of the epoch */
+	g_pSuspension = pSuspension;
+	g_SuspendedAmount = 0;
+	g_bResume = false;
+	g_SuspensionEpoch++;
+
+	pSuspension->SuspendTime = std::chrono::steady_clock::now();
+
+	/* Signal every thread, threads that exited meanwhile are skipped */
+	SIZE_T signaledAmount = 0;
+	for (SUSPENDED_THREAD &thread : pSuspension->Threads)
+	{
+		if (SendSuspendSignal(thread.Tid))
+			signaledAmount++;
+		else
+			thread.Tid = 0;
+	}
+
+	/* Wait until every signaled thread reached the handler */
+	while (g_SuspendedAmount < signaledAmount)
+	{
+		if (std::chrono::steady_clock::now() - pSuspension->SuspendTime > std::chrono::milliseconds(THREAD_SUSPEND_TIMEOUT))
+		{
+			/* The threads that were suspended are resumed, and a thread that reaches the handler late ignores the signal */
+			printf("Threads::SuspendOthers failed: a thread wasn't suspended in time.\n");
+			ReleaseSuspension();
+			delete pSuspension;
+			g_SuspensionLock.unlock();
+			return NULL;
+		}
+
+		sched_yield();
+	}
+#endif
+
+	return pSuspension;
+}
+
+/*
+@return the amount of threads within a suspension (threads that exited before they were suspended included).
+*/
+SIZE_T Threads::Amount(PTHREAD_SUSPENSION pSuspension)
+{
+	return pSuspension->Threads.size();
+}
+
+/*
+Get or set the instruction pointer of a suspended thread, which it continues from once it's resumed.
+@param pSuspension, the suspension.
+@param index, the thread's index within the suspension.
+@param pInstruction, the new instruction pointer.
+@return the instruction pointer, or NULL if the thread exited before it was suspended.
+*/
+LPVOID Threads::GetInstructionPointer(PTHREAD_SUSPENSION pSuspension, SIZE_T index)
+{
+	PSUSPENDED_THREAD pThread = &pSuspension->Threads[index];
+
+#ifdef _WIN32
+	if (!pThread->hThread)
+		return NULL;
+
+#ifdef _WIN64
+	return (LPVOID) pThread->Context.Rip;
+#else
+	return (LPVOID) (ULONG_PTR) pThread->Context.Eip;
+#endif
+#else
+	ucontext_t *pContext = __atomic_load_n(&pThread->pContext, __ATOMIC_ACQUIRE);
+	return pContext ? (LPVOID) pContext->uc_mcontext.gregs[CONTEXT_IP] : NULL;
+#endif
+}
+
+void Threads::SetInstructionPointer(PTHREAD_SUSPENSION pSuspension, SIZE_T index, LPVOID pInstruction)
+{
+	PSUSPENDED_THREAD pThread = &pSuspension->Threads[index];
+
+#ifdef _WIN32
+#ifdef _WIN64
+	pThread->Context.Rip = (DWORD64) pInstruction;
+#else
+	pThread->Context.Eip = (DWORD) (ULONG_PTR) pInstruction;
+#endif
+	pThread->bContextChanged = TRUE;
+#else
+	if (pThread->pContext)
+		pThread->pContext->uc_mcontext.gregs[CONTEXT_IP] = (greg_t) pInstruction;
+#endif
+}
+
+/*
+Resume the threads of a suspension, and free it.
+@param pSuspension, the suspension.
+@return how long the threads were suspended, in nanoseconds.
+*/
+DWORD64 Threads::Resume(PTHREAD_SUSPENSION pSuspension)
+{
+#ifdef _WIN32
+	for (SUSPENDED_THREAD &thread : pSuspension->Threads)
+	{
+		if (!thread.hThread)
+			continue;
+
+		if (thread.bContextChanged)
+			SetThreadContext(thread.hThread, &thread.Context);
+
+		ResumeThread(thread.hThread);
+	}
+
+	DWORD64 pause = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - pSuspension->SuspendTime).count();
+
+	for (SUSPENDED_THREAD &thread : pSuspension->Threads)
+	{
+		if (thread.hThread)
+			CloseHandle(thread.hThread);
+	}
+#else
+	DWORD64 pause = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - pSuspension->SuspendTime).count();
+
+	ReleaseSuspension();
+#endif
+
+	delete pSuspension;
+	g_SuspensionLock.unlock();
+
+	return pause;
+}
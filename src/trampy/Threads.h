@@ -0,0 +1,52 @@
+#pragma once
+#include "TrampyDefs.h"
+
+/*
+How long suspending the other threads may take before it fails (e.g. a thread blocks the suspension signal), in milliseconds.
+*/
+#define THREAD_SUSPEND_TIMEOUT 1000
+
+/*
+Definition of the struct describing the suspension of every other thread.
+*/
+typedef struct _THREAD_SUSPENSION
+THREAD_SUSPENSION, *PTHREAD_SUSPENSION;
+
+/*
+Threads suspends every other thread of the process, so code they may be running is modified while none of them runs,
+and their instruction pointers may be moved meanwhile (e.g. out of the stolen bytes of a Hook).
+Threads are suspended by SuspendThread on Windows, and by a signal whose handler waits until they're resumed elsewhere.
+Everything is allocated before the threads are suspended (a suspended thread may hold the heap's lock),
+so the code that runs while they're suspended mustn't allocate either.
+*/
+namespace Threads
+{
+	/*
+	Suspend every other thread of the process.
+	Threads that are created meanwhile aren't suspended.
+	@return the suspension, or NULL if the function failed (in which case no thread is left suspended).
+	*/
+	PTHREAD_SUSPENSION SuspendOthers();
+
+	/*
+	@return the amount of threads within a suspension (threads that exited before they were suspended included).
+	*/
+	SIZE_T Amount(PTHREAD_SUSPENSION pSuspension);
+
+	/*
+	Get or set the instruction pointer of a suspended thread, which it continues from once it's resumed.
+	@param pSuspension, the suspension.
+	@param index, the thread's index within the suspension.
+	@param pInstruction, the new instruction pointer.
+	@return the instruction pointer, or NULL if the thread exited before it was suspended.
+	*/
+	LPVOID GetInstructionPointer(PTHREAD_SUSPENSION pSuspension, SIZE_T index);
+	void SetInstructionPointer(PTHREAD_SUSPENSION pSuspension, SIZE_T index, LPVOID pInstruction);
+
+	/*
+	Resume the threads of a suspension, and free it.
+	@param pSuspension, the suspension.
+	@return how long the threads were suspended, in nanoseconds.
+	*/
+	DWORD64 Resume(PTHREAD_SUSPENSION pSuspension);
+}
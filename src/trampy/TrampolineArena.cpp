@@ -0,0 +1,297 @@
+#include "TrampolineArena.h"
+#include "Memory.h"
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+
+/*
+Struct describing a block of executable memory that Trampolines are allocated from.
+*/
+typedef struct _ARENA_BLOCK
+{
+	/*
+	The block's memory, and its size.
+	*/
+	PBYTE pStart;
+	SIZE_T Size;
+	/*
+	Is the block backed by large pages.
+	*/
+	BOOL bLargePages;
+	/*
+	The block's writable alias, or NULL if the block is made writable whenever a Trampoline is written.
+	*/
+	PBYTE pWritable;
+	/*
+	The amount of slots each Trampoline occupies, indexed by its first slot (0 for slots that don't start a Trampoline).
+	*/
+	std::vector<WORD> SlotAmounts;
+	/*
+	Which slots are occupied by a Trampoline.
+	*/
+	std::vector<bool> UsedSlots;
+	/*
+	The amount of occupied slots.
+	*/
+	SIZE_T UsedAmount;
+}
+ARENA_BLOCK, *PARENA_BLOCK;
+
+/*
+The arena's blocks & flags.
+Hooks may be enabled from any thread, so the arena is guarded by a lock.
+*/
+std::vector<PARENA_BLOCK> g_ArenaBlocks;
+BYTE g_ArenaFlags = 0;
+std::mutex g_ArenaLock;
+
+/*
+@return whether every address within a block is within reach of a relative-JMP from given target.
+*/
+bool IsBlockReachable(PARENA_BLOCK pBlock, LPVOID pTarget)
+{
+	return Memory::IsRel32Reachable(pTarget, pBlock->pStart) &&
+		Memory::IsRel32Reachable(pTarget, pBlock->pStart + pBlock->Size);
+}
+
+/*
+@return the block that contains given address, or NULL if no block contains it.
+*/
+PARENA_BLOCK FindBlock(LPVOID pAddress)
+{
+	for (PARENA_BLOCK pBlock : g_ArenaBlocks)
+	{
+		if ((PBYTE) pAddress >= pBlock->pStart && (PBYTE) pAddress < pBlock->pStart + pBlock->Size)
+			return pBlock;
+	}
+
+	return NULL;
+}
+
+/*
+Occupy a run of free slots within a block (first-fit).
+@param pBlock, the block.
+@param slotAmount, the amount of slots.
+@return pointer to the first slot, or NULL if the block has no such run.
+*/
+LPVOID AllocateSlots(PARENA_BLOCK pBlock, SIZE_T slotAmount)
+{
+	SIZE_T totalAmount = pBlock->UsedSlots.size();
+	if (totalAmount - pBlock->UsedAmount < slotAmount)
+		return NULL;
+
+	SIZE_T runStart = 0;
+	for (SIZE_T slot = 0; slot < totalAmount; slot++)
+	{
+		if (pBlock->UsedSlots[slot])
+		{
+			runStart = slot + 1;
+			continue;
+		}
+
+		if (slot + 1 - runStart < slotAmount)
+			continue;
+
+		/* The run is long enough, occupy it */
+		for (SIZE_T i = runStart; i <= slot; i++)
+			pBlock->UsedSlots[i] = true;
+
+		pBlock->SlotAmounts[runStart] = (WORD) slotAmount;
+		pBlock->UsedAmount += slotAmount;
+		return pBlock->pStart + runStart * TRAMPOLINE_SLOT_SIZE;
+	}
+
+	return NULL;
+}
+
+/*
+Allocate a new block within reach of a relative-JMP from a given target, and add it to the arena.
+@param pTarget, the address the block must be within reach of.
+@return pointer to the block, or NULL if the function failed.
+*/
+PARENA_BLOCK AllocateBlock(LPVOID pTarget)
+{
+	BOOL bLargePages = FALSE;
+	SIZE_T size = ARENA_BLOCK_SIZE;
+	LPVOID pMemory = NULL;
+	LPVOID pWritable = NULL;
+
+	/* Aliased blocks don't fall back to regular blocks, as their Trampolines must never be writable & executable at once */
+	if (g_ArenaFlags & ARENA_FLAG_WRITABLE_ALIAS)
+	{
+		pMemory = Memory::AllocateNearAliased(pTarget, size, &pWritable);
+		if (!pMemory)
+			return NULL;
+	}
+
+	/* Large pages are a best effort (e.g. they require a privilege on Windows), so we fall back to regular pages */
+	if (!pMemory && (g_ArenaFlags & ARENA_FLAG_LARGE_PAGES) && Memory::LargePageSize())
+	{
+		size = max(Memory::LargePageSize(), (SIZE_T) ARENA_BLOCK_SIZE);
+		pMemory = Memory::AllocateNear(pTarget, size, TRUE);
+		bLargePages = pMemory != NULL;
+	}
+
+	if (!pMemory)
+	{
+		size = ARENA_BLOCK_SIZE;
+		pMemory = Memory::AllocateNear(pTarget, size, FALSE);
+	}
+
+	if (!pMemory)
+		return NULL;
+
+	SIZE_T slotAmount = size / TRAMPOLINE_SLOT_SIZE;
+	PARENA_BLOCK pBlock = new ARENA_BLOCK{ (PBYTE) pMemory, size, bLargePages, (PBYTE) pWritable, std::vector<WORD>(slotAmount), std::vector<bool>(slotAmount), 0 };
+	g_ArenaBlocks.push_back(pBlock);
+	return pBlock;
+}
+
+/*
+Configure the arena, affects blocks that are allocated from now on.
+@param flags, the arena's flags (ARENA_FLAGS).
+*/
+void TrampolineArena::SetFlags(BYTE flags)
+{
+	std::lock_guard<std::mutex> lock(g_ArenaLock);
+	g_ArenaFlags = flags;
+}
+
+/*
+Allocate a Trampoline within reach of a relative-JMP from a given target (e.g. Original).
+@param pTarget, the address the Trampoline must be within reach of.
+@param size, the size of the Trampoline.
+@return pointer to the Trampoline, which is aligned to TRAMPOLINE_SLOT_SIZE, or NULL if the function failed.
+*/
+LPVOID TrampolineArena::Allocate(LPVOID pTarget, SIZE_T size)
+{
+	SIZE_T slotAmount = (size + TRAMPOLINE_SLOT_SIZE - 1) / TRAMPOLINE_SLOT_SIZE;
+	if (!slotAmount || slotAmount > ARENA_BLOCK_SIZE / TRAMPOLINE_SLOT_SIZE)
+	{
+		printf("TrampolineArena::Allocate failed: invalid size (%zu bytes).\n", size);
+		return NULL;
+	}
+
+	std::lock_guard<std::mutex> lock(g_ArenaLock);
+
+	/* Reuse free slots within a block that's close enough to the target */
+	for (PARENA_BLOCK pBlock : g_ArenaBlocks)
+	{
+		if (!IsBlockReachable(pBlock, pTarget))
+			continue;
+
+		LPVOID pTrampoline = AllocateSlots(pBlock, slotAmount);
+		if (pTrampoline)
+			return pTrampoline;
+	}
+
+	/* Every nearby block is full, so a new block is allocated next to the target */
+	PARENA_BLOCK pBlock = AllocateBlock(pTarget);
+	if (!pBlock)
+	{
+		printf("TrampolineArena::Allocate failed: couldn't allocate a block within reach of %p.\n", pTarget);
+		return NULL;
+	}
+
+	return AllocateSlots(pBlock, slotAmount);
+}
+
+/*
+Write the code of a Trampoline, and make sure it's executed rather than stale instructions.
+@param pTrampoline, the Trampoline, which may start anywhere within its first slot.
+@param pCode, the code.
+@param size, the size of the code, up to the size the Trampoline was allocated with.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL TrampolineArena::Write(LPVOID pTrampoline, const void *pCode, SIZE_T size)
+{
+	std::lock_guard<std::mutex> lock(g_ArenaLock);
+
+	PARENA_BLOCK pBlock = FindBlock(pTrampoline);
+	SIZE_T slot = pBlock ? ((PBYTE) pTrampoline - pBlock->pStart) / TRAMPOLINE_SLOT_SIZE : 0;
+	SIZE_T offset = pBlock ? ((PBYTE) pTrampoline - pBlock->pStart) % TRAMPOLINE_SLOT_SIZE : 0;
+	if (!pBlock || offset + size > (SIZE_T) pBlock->SlotAmounts[slot] * TRAMPOLINE_SLOT_SIZE)
+	{
+		printf("TrampolineArena::Write failed: invalid Trampoline.\n");
+		return FALSE;
+	}
+
+	/* An aliased block is written through its alias, so its protection is never changed */
+	if (pBlock->pWritable)
+	{
+		memcpy(pBlock->pWritable + ((PBYTE) pTrampoline - pBlock->pStart), pCode, size);
+		Memory::FlushInstructions(pTrampoline, size);
+		return TRUE;
+	}
+
+	/*
+	Only the Trampoline's pages are made writable, unless the block is backed by large pages,
+	which can only be protected as a whole.
+	The lock makes sure another Trampoline on the same page doesn't make it read-only mid-write.
+	*/
+	LPVOID pProtected = pBlock->bLargePages ? pBlock->pStart : pTrampoline;
+	SIZE_T protectedSize = pBlock->bLargePages ? pBlock->Size : size;
+
+	if (!Memory::Protect(pProtected, protectedSize, MEMORY_READ_WRITE_EXECUTE))
+	{
+		printf("TrampolineArena::Write failed: couldn't make the Trampoline writable.\n");
+		return FALSE;
+	}
+
+	memcpy(pTrampoline, pCode, size);
+
+	if (!Memory::Protect(pProtected, protectedSize, MEMORY_READ_EXECUTE))
+	{
+		printf("TrampolineArena::Write failed: couldn't make the Trampoline read-only.\n");
+		return FALSE;
+	}
+
+	Memory::FlushInstructions(pTrampoline, size);
+	return TRUE;
+}
+
+/*
+Free a Trampoline, so its slots may be reused.
+The Trampoline must no longer be executed by any thread.
+@param pTrampoline, the Trampoline, which may start anywhere within its first slot.
+*/
+void TrampolineArena::Free(LPVOID pTrampoline)
+{
+	std::lock_guard<std::mutex> lock(g_ArenaLock);
+
+	PARENA_BLOCK pBlock = FindBlock(pTrampoline);
+	if (!pBlock)
+		return;
+
+	SIZE_T slot = ((PBYTE) pTrampoline - pBlock->pStart) / TRAMPOLINE_SLOT_SIZE;
+	SIZE_T slotAmount = pBlock->SlotAmounts[slot];
+
+	for (SIZE_T i = slot; i < slot + slotAmount; i++)
+		pBlock->UsedSlots[i] = false;
+
+	pBlock->SlotAmounts[slot] = 0;
+	pBlock->UsedAmount -= slotAmount;
+}
+
+/*
+Release the blocks that no Trampoline is allocated from.
+*/
+void TrampolineArena::ReleaseEmptyBlocks()
+{
+	std::lock_guard<std::mutex> lock(g_ArenaLock);
+
+	std::vector<PARENA_BLOCK> remainingBlocks;
+	for (PARENA_BLOCK pBlock : g_ArenaBlocks)
+	{
+		if (pBlock->UsedAmount)
+		{
+			remainingBlocks.push_back(pBlock);
+			continue;
+		}
+
+		Memory::Free(pBlock->pStart, pBlock->Size);
+		delete pBlock;
+	}
+
+	g_ArenaBlocks.swap(remainingBlocks);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "TrampyDefs.h"
+
+/*
+The size of a slot within the arena, a cache line, so a Trampoline never shares its first cache line with another.
+*/
+#define TRAMPOLINE_SLOT_SIZE 64
+
+/*
+The size of an arena block, when it isn't backed by large pages (the allocation granularity of Windows).
+*/
+#define ARENA_BLOCK_SIZE 0x10000
+
+/*
+Flags that configure the arena.
+*/
+enum ARENA_FLAGS : BYTE
+{
+	/* Back new blocks by large pages, so many Trampolines share a single TLB entry (falls back to regular pages) */
+	ARENA_FLAG_LARGE_PAGES = 1 << 0,
+	/*
+	Map new blocks twice, executable & read-only as well as writable through an alias (see Memory::AllocateNearAliased),
+	so Trampolines are written without changing the blocks' protection, and they're never writable & executable at once.
+	Takes precedence over ARENA_FLAG_LARGE_PAGES, as aliased blocks are backed by regular pages.
+	*/
+	ARENA_FLAG_WRITABLE_ALIAS = 1 << 1,
+};
+
+/*
+The Trampoline Arena allocates Trampolines from shared executable blocks, rather than a whole allocation per Trampoline.
+Each block is placed within reach of a relative-JMP from the target it was allocated for, so nearby targets share blocks.
+Trampolines are carved out of cache-line sized slots, and freed slots are reused by later Trampolines.
+Blocks are kept executable & read-only, they're only made writable while a Trampoline is written (or written through an alias).
+*/
+namespace TrampolineArena
+{
+	/*
+	Configure the arena, affects blocks that are allocated from now on.
+	@param flags, the arena's flags (ARENA_FLAGS).
+	*/
+	void SetFlags(BYTE flags);
+
+	/*
+	Allocate a Trampoline within reach of a relative-JMP from a given target (e.g. Original).
+	@param pTarget, the address the Trampoline must be within reach of.
+	@param size, the size of the Trampoline.
+	@return pointer to the Trampoline, which is aligned to TRAMPOLINE_SLOT_SIZE, or NULL if the function failed.
+	*/
+	LPVOID Allocate(LPVOID pTarget, SIZE_T size);
+
+	/*
+	Write the code of a Trampoline, and make sure it's executed rather than stale instructions.
+	@param pTrampoline, the Trampoline, which may start anywhere within its first slot.
+	@param pCode, the code.
+	@param size, the size of the code, up to the size the Trampoline was allocated with.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL Write(LPVOID pTrampoline, const void *pCode, SIZE_T size);
+
+	/*
+	Free a Trampoline, so its slots may be reused.
+	The Trampoline must no longer be executed by any thread.
+	@param pTrampoline, the Trampoline, which may start anywhere within its first slot.
+	*/
+	void Free(LPVOID pTrampoline);
+
+	/*
+	Release the blocks that no Trampoline is allocated from.
+	*/
+	void ReleaseEmptyBlocks();
+}
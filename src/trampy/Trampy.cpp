@@ -1,25 +1,29 @@
 #include "Trampy.h"
+#include <stdio.h>
+#include <list>
 #include <vector>
+#include <algorithm>
+#include <unordered_set>
+#include <chrono>
 #include "disasm/disasm.h"
+#include "Emitter.h"
+#include "FlowAnalysis.h"
+#include "LivePatch.h"
+#include "Memory.h"
+#include "Relocator.h"
+#include "TrampolineArena.h"
+#include "Threads.h"
 #include "TrampyDefs.h"
 
-/*
-The maximum size of a single instruction.
-Including prefixes, opcode, opreands, e.t.c.
-*/
-#define MAX_INSTR_SIZE 15
-
-/*
-The opcode for a JMP.
-This is a relative-JMP, with a 4-byte relative-address operand.
-*/
-#define JMP_OPCODE 0xE9
-
 /*
 Struct describing a Hook.
 */
 typedef struct _HOOK_DESCRIPTOR
 {
+    /*
+    Is the Hook prepared, i.e. were its Trampoline & patch built (see Trampy::PrepareHook).
+    */
+    BOOL bPrepared;
     /*
     Is the Hook enabled.
     */
@@ -33,10 +37,37 @@ typedef struct _HOOK_DESCRIPTOR
     */
     LPVOID pHooked;
     /*
+    The Hook's flags (HOOK_FLAGS).
+    */
+    BYTE Flags;
+    /*
     Pointer to the target Trampoline function.
     Once created, this pointer will direct to the Trampoline.
     */
     LPVOID *ppTrampoline;
+    /*
+    Pointer to the Hook's Trampoline function within the Trampoline Arena, or NULL if it wasn't created yet.
+    The Trampoline is kept while the Hook is disabled, so it's reused once the Hook is enabled again.
+    */
+    LPVOID pTrampoline;
+    /*
+    Pointer to the Hook's relay, an absolute JMP to Hook that's placed within reach of Original (64-bit only).
+    Original jumps to the relay whenever Hook is too far for a relative-JMP, or NULL if there's no relay.
+    */
+    LPVOID pRelay;
+    /*
+    Is the Hook installed in Original's hot-patch area (see HOOK_FLAG_HOT_PATCH), rather than over its first instructions.
+    */
+    BOOL bHotPatch;
+    /*
+    Original's hot-patch area, if the Hook is installed in it.
+    */
+    HOT_PATCH_AREA HotPatch;
+    /*
+    The writable alias of Original's beginning, which the patch is written through (see HOOK_FLAG_WRITABLE_ALIAS),
+    or NULL if Original's pages are made writable whenever the patch is written.
+    */
+    PBYTE pAlias;
 
     /*
     Anonymous struct defining a StolenBytes buffer.
@@ -44,54 +75,106 @@ typedef struct _HOOK_DESCRIPTOR
     struct
     {
         /*
-        The byte-buffer itself, with a capacity of MAX_INSTR_SIZE,
-        as we won't need to steal more than a single instruction.
+        The byte-buffer itself, with a capacity of RELOCATION_MAX_SOURCE_SIZE,
+        as the stolen bytes are whole instructions which are relocated to Trampoline
+        (or the NOPs at Original's entry, which are replaced by a short JMP when the Hook is hot-patched).
         */
-        BYTE Buffer[MAX_INSTR_SIZE];
+        BYTE Buffer[RELOCATION_MAX_SOURCE_SIZE];
         /*
         The amount of stolen bytes stored in the buffer.
         */
         SIZE_T Amount;
     }
     StolenBytes;
+
+    /*
+    Anonymous struct mapping the stolen instructions to their relocated copies within Trampoline,
+    so threads that are suspended within either of them are moved to the other (see TRANSACTION_FLAG_SUSPEND_THREADS).
+    */
+    struct
+    {
+        /*
+        The offset of every stolen instruction within Original, and of its relocated copy within Trampoline.
+        */
+        BYTE SourceOffsets[RELOCATION_MAX_INSTRUCTIONS];
+        BYTE RelocatedOffsets[RELOCATION_MAX_INSTRUCTIONS];
+        /*
+        The amount of stolen instructions, and the size of their relocated copies.
+        */
+        SIZE_T Amount;
+        SIZE_T RelocatedSize;
+    }
+    Instructions;
+
+    /*
+    Anonymous struct defining the Hook's patch, which is built once the Hook is prepared,
+    and swapped with the stolen bytes whenever the Hook is enabled or disabled.
+    */
+    struct
+    {
+        /*
+        The patch itself, a JMP to Hook (or a short JMP to the hot-patch padding, if the Hook is hot-patched).
+        */
+        BYTE Buffer[JMP_REL32_SIZE];
+        /*
+        The size of the patch.
+        */
+        SIZE_T Amount;
+    }
+    Patch;
 }
 HOOK_DESCRIPTOR, *PHOOK_DESCRIPTOR;
 
 /*
-Store all hooks in a global vector.
+Store all hooks in a global list, so a Hook's descriptor never moves once it's created.
 This is bad practice to an extent, but serves me well at this stage.
 */
-std::vector<HOOK_DESCRIPTOR> g_Hooks;
+std::list<HOOK_DESCRIPTOR> g_Hooks;
 
 /*
-Struct defining a single-operand instruction (e.g. JMPs, CALLs, e.t.c).
-This struct is not padded, its size is exactly 5 bytes.
+The max size of the code following the relocated instructions in a Trampoline function.
+The relocated instructions are followed by a JMP to Original (an absolute JMP at most), and in 64-bit mode by the relay to Hook as well.
 */
-#pragma pack(push, 1)
-typedef struct _INSTR_SINGLE_OP
-{
-    /*
-    This instruction's opcode.
-    */
-    BYTE Opcode;
-    /*
-    This instruction's operand.
-    Assumes it's a 4-byte (DWORD) operand.
-    */
-    DWORD Operand;
-}
-INSTR_SINGLE_OP, *PINSTR_SINGLE_OP;
-#pragma pack(pop)
+#ifdef TRAMPY_X64
+#define TRAMPOLINE_TAIL_SIZE (JMP_ABSOLUTE_SIZE + JMP_ABSOLUTE_SIZE)
+#else
+#define TRAMPOLINE_TAIL_SIZE (JMP_ABSOLUTE_SIZE)
+#endif
+
+/*
+The offset of a Trampoline function within its first slot, if it's unaligned (see HOOK_FLAG_UNALIGNED_TRAMPOLINE),
+so its first instruction crosses into the slot's next cache line.
+*/
+#define UNALIGNED_TRAMPOLINE_OFFSET (TRAMPOLINE_SLOT_SIZE - 2)
 
 /*
 Creates a Hook desriptor.
 @param pOriginal, pointer to the original function.
 @param pHooked, pointer to the hooked function.
 @param ppTrampoline, pointer to the destination trampoline function.
-@return pointer to the newly created Hook within the Hook list.
+@param flags, the Hook's flags (HOOK_FLAGS).
+@return pointer to the newly created Hook within the Hook list, or NULL if the function failed.
 */
-PHOOK_DESCRIPTOR Trampy::CreateHook(LPVOID pOriginal, LPVOID pHooked, LPVOID *ppTrampoline)
+PHOOK_DESCRIPTOR Trampy::CreateHook(LPVOID pOriginal, LPVOID pHooked, LPVOID *ppTrampoline, BYTE flags)
 {
+    /* A Trampoline function has a single exit, so at most one of the exit layouts may be selected */
+    if ((flags & HOOK_FLAG_ABSOLUTE_EXIT) && (flags & HOOK_FLAG_PUSH_RET_EXIT))
+    {
+        printf("Failed to create hook: a Trampoline function has a single exit.\n");
+        return NULL;
+    }
+
+    /*
+    Hook the body Original jumps to, rather than the jumps themselves.
+    If FlowAnalysis::FollowJumps fails (e.g. the jumps form a cycle), CreateHook fails.
+    */
+    if (flags & HOOK_FLAG_FOLLOW_JUMPS)
+    {
+        pOriginal = FlowAnalysis::FollowJumps(pOriginal, FLOW_DEFAULT_MAX_JUMPS);
+        if (!pOriginal)
+            return NULL;
+    }
+
     /* Push empty HOOK_DESCRIPTOR to Hook list */
     g_Hooks.push_back({ });
 
@@ -101,107 +184,76 @@ PHOOK_DESCRIPTOR Trampy::CreateHook(LPVOID pOriginal, LPVOID pHooked, LPVOID *pp
     pHook->bEnabled = FALSE;
     pHook->pOriginal = pOriginal;
     pHook->pHooked = pHooked;
+    pHook->Flags = flags;
     pHook->ppTrampoline = ppTrampoline;
 
+    /* Install the Hook in Original's hot-patch area if it has one, the short JMP to it is written at once */
+    if (flags & HOOK_FLAG_HOT_PATCH)
+    {
+        pHook->bHotPatch = FlowAnalysis::FindHotPatchArea(pOriginal, &pHook->HotPatch) &&
+            (ULONG_PTR) pOriginal % CACHE_LINE_SIZE != CACHE_LINE_SIZE - 1;
+    }
+
     /* Return pointer to newly created Hook */
     return pHook;
 }
 
 /*
-Write into protected memory region.
-@param pDest, the destination of our data.
-@param pSrc, the data we want to write.
-@param byteAmount, the amount of bytes we want to write.
-@return TRUE if the function succeeds, FALSE if it fails.
+@return the size of the code following the relocated instructions in the Hook's Trampoline function (see TRAMPOLINE_TAIL_SIZE).
 */
-BOOL ProtectedWrite(LPVOID pDest, LPVOID pSrc, SIZE_T byteAmount)
+SIZE_T TrampolineTailSize(PHOOK_DESCRIPTOR pHook)
 {
-    DWORD oldProtect;
-    /*
-    Make protected destination writable.
-    If VirtualProtect returns FALSE, it failed.
-    */
-    if (!VirtualProtect(
-        pDest,
-        byteAmount,
-        PAGE_EXECUTE_READWRITE,
-        &oldProtect
-    ))
-    {
-        printf("ProtectedWrite failed: VirtualProtect returned FALSE.\n");
-        return FALSE;
-    }
-
-    /*
-    Copy bytes from from source to destination.
-    If memcpy_s returns non-zero, it failed.
-    */
-    if (memcpy_s(
-        pDest,
-        byteAmount,
-        pSrc,
-        byteAmount
-    ))
-    {
-        printf("ProtectedWrite failed: memcpy_s returned non-zero.\n");
-        return FALSE;
-    }
-
-    /*
-    Revert protection change.
-    If VirtualProtect returns FALSE, it failed.
-    */
-    if (!VirtualProtect(
-        pDest,
-        byteAmount,
-        oldProtect,
-        &oldProtect
-    ))
-    {
-        printf("ProtectedWrite failed: VirtualProtect returned FALSE.\n");
-        return FALSE;
-    }
+    SIZE_T exitSize = JMP_REL32_SIZE;
+    if (pHook->Flags & HOOK_FLAG_ABSOLUTE_EXIT)
+        exitSize = JMP_ABSOLUTE_SIZE;
+    else if (pHook->Flags & HOOK_FLAG_PUSH_RET_EXIT)
+        exitSize = JMP_PUSH_RET_SIZE;
 
-    return TRUE;
+#ifdef TRAMPY_X64
+    return exitSize + JMP_ABSOLUTE_SIZE;
+#else
+    return exitSize;
+#endif
 }
 
 /*
-Disassembles Original function of given Hook.
-Replicates Original instructions into Trampoline of Hook.
-@param pHook, the Hook's descriptor.
-@param pTrampoline, the Trampoline function pointer.
-@return the amount of bytes replicated (i.e. written into Trampoline).
+Write JMP instruction from Trampoline to Original, following the relocated instructions in Trampoline.
+@param pEmitter the emitter Trampoline is built with.
+@param pHook the Hook's descriptor.
+@return TRUE if the function succeeds, FALSE if it fails.
 */
-SIZE_T DisassembleAndReplicate(PHOOK_DESCRIPTOR pHook, PBYTE pTrampoline)
+BOOL WriteJmpToOriginal(PEMITTER pEmitter, PHOOK_DESCRIPTOR pHook)
 {
-    /* Make disassembler replicate instructions into Trampoline */
-    SIZE_T replicatedAmount;
-    Disassembler::EnableReplication(pTrampoline, MAX_INSTR_SIZE, &replicatedAmount);
-    /* Run disassembler, ensure enough bytes are disassembled for a JMP instruction */
-    pHook->StolenBytes.Amount = Disassembler::Run((PBYTE) pHook->pOriginal, sizeof(INSTR_SINGLE_OP));
-    /* Disable replication */
-    Disassembler::DisableReplication();
-    /* Return replicated amount */
-    return replicatedAmount;
+    /* IP in Original after stolen bytes, where the rest of the function exists */
+    PBYTE ipAfterStolen = (PBYTE) pHook->pOriginal + pHook->StolenBytes.Amount;
+
+    /* Write JMP instruction after relocated instructions, to continue execution of Original, of the layout the Hook selects */
+    if (pHook->Flags & HOOK_FLAG_ABSOLUTE_EXIT)
+        return Emitter::JmpAbsolute(pEmitter, ipAfterStolen);
+
+    if (pHook->Flags & HOOK_FLAG_PUSH_RET_EXIT)
+        return Emitter::JmpPushRet(pEmitter, ipAfterStolen);
+
+    return Emitter::Jmp(pEmitter, ipAfterStolen, BRANCH_SIZE_AUTO);
 }
 
 /*
-Write JMP instruction from Trampoline to Original, following the replicated instructions in Trampoline.
+Write the relay to Hook, following the JMP to Original in Trampoline (64-bit only).
+Whenever Hook is too far for a relative-JMP from Original, Original jumps to the relay instead.
+@param pEmitter the emitter Trampoline is built with.
 @param pHook the Hook's descriptor.
-@param pTrampoline the Trampoline function pointer.
+@return TRUE if the function succeeds, FALSE if it fails.
 */
-void WriteJmpToOriginal(PHOOK_DESCRIPTOR pHook, PBYTE pTrampoline, SIZE_T replicatedAmount)
+BOOL WriteRelayToHook(PEMITTER pEmitter, PHOOK_DESCRIPTOR pHook)
 {
-    /* IP in Trampoline after executing replicated bytes */
-    PBYTE ipAfterReplicated = pTrampoline + replicatedAmount;
-    /* IP in Trampoline after executing replicated bytes & after JMP to Original */
-    PBYTE ipAfterJmp = ipAfterReplicated + sizeof(INSTR_SINGLE_OP);
-    /* IP in Original after stolen bytes, where the rest of the function exists */
-    PBYTE ipAfterStolen = (PBYTE) pHook->pOriginal + pHook->StolenBytes.Amount;
-    /* Offset from Trampoline to Original, used to continue execution of Original */
-    DWORD offsetToOriginal = ipAfterStolen - ipAfterJmp;
-    /* Write JMP instruction after replicated bytes */
-    *(PINSTR_SINGLE_OP) ipAfterReplicated = { JMP_OPCODE, offsetToOriginal };
+#ifdef TRAMPY_X64
+    /* The relay is placed after the relocated instructions & the JMP to Original */
+    pHook->pRelay = Emitter::Position(pEmitter);
+    /* Write absolute JMP to Hook */
+    return Emitter::JmpAbsolute(pEmitter, pHook->pHooked);
+#else
+    return TRUE;
+#endif
 }
 
 /*
@@ -211,40 +263,73 @@ Creates Trampoline function.
 */
 LPVOID CreateTrampoline(PHOOK_DESCRIPTOR pHook)
 {
-    /* Allocate memory for Trampoline Function */
-    SIZE_T trampolineSize = MAX_INSTR_SIZE + sizeof(INSTR_SINGLE_OP);
-    LPVOID pTrampoline = VirtualAlloc(NULL, trampolineSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    /*
+    Plan the relocation of the instructions that'll be stolen, ensure enough bytes are covered for a JMP instruction.
+    If Relocator::Plan fails, CreateTrampoline fails.
+    */
+    RELOCATION_PLAN plan;
+    if (!Relocator::Plan((PBYTE) pHook->pOriginal, JMP_REL32_SIZE, &plan))
+        return NULL;
+
+    pHook->StolenBytes.Amount = plan.SourceSize;
+
+    /* Map the stolen instructions to their relocated copies */
+    pHook->Instructions.Amount = plan.InstructionAmount;
+    pHook->Instructions.RelocatedSize = plan.RelocatedSize;
+    for (SIZE_T i = 0; i < plan.InstructionAmount; i++)
+    {
+        pHook->Instructions.SourceOffsets[i] = (BYTE) plan.Instructions[i].Instruction.Offset;
+        pHook->Instructions.RelocatedOffsets[i] = (BYTE) plan.Instructions[i].RelocatedOffset;
+    }
+
+    /*
+    Allocate Trampoline Function from the Trampoline Arena, within reach of Original.
+    It's sized to fit the relocated instructions exactly, so most Trampolines fit a single slot (unless it's unaligned).
+    */
+    SIZE_T offset = (pHook->Flags & HOOK_FLAG_UNALIGNED_TRAMPOLINE) ? UNALIGNED_TRAMPOLINE_OFFSET : 0;
+    SIZE_T trampolineSize = plan.RelocatedSize + TrampolineTailSize(pHook);
+    PBYTE pSlot = (PBYTE) TrampolineArena::Allocate(pHook->pOriginal, offset + trampolineSize);
 
     /* If failed to allocate Trampoline Function, throw error */
-    if (!pTrampoline)
+    if (!pSlot)
     {
-        printf("CreateTrampoline failed: VirtualAlloc returned NULL.\n");
+        printf("CreateTrampoline failed: couldn't allocate Trampoline.\n");
         return NULL;
     }
 
-    /* Disassemble Original & replicate instructions into Trampoline */
-    SIZE_T replicatedAmount = DisassembleAndReplicate(pHook, (PBYTE) pTrampoline);
+    LPVOID pTrampoline = pSlot + offset;
 
-    /* Write JMP instruction to Original from Trampoline, after replicated bytes */
-    WriteJmpToOriginal(pHook, (PBYTE) pTrampoline, replicatedAmount);
+    /* Build Trampoline Function in a buffer, as the arena is read-only */
+    BYTE code[RELOCATION_MAX_RELOCATED_SIZE + TRAMPOLINE_TAIL_SIZE];
+    EMITTER emitter;
+    Emitter::Initialize(&emitter, code, sizeof(code), pTrampoline);
+
+    /* Relocate the stolen instructions to the beginning of Trampoline */
+    PBYTE pRelocated = Emitter::Reserve(&emitter, plan.RelocatedSize);
 
     /*
-    Make Trampoline Function executable & read-only.
-    If VirtualProtect returns FALSE, it failed.
+    Write JMP instruction to Original from Trampoline after relocated instructions,
+    and the relay to Hook, in case Hook is too far from Original.
+    If any of them fails, CreateTrampoline fails.
     */
-    DWORD oldProtect;
-    if (!VirtualProtect(
-        /* Start at Trampoline's base */
-        pTrampoline,
-        /* Protect entire Trampoline function */
-        trampolineSize,
-        /* Make Trampoline executable & read-only (read-only is good practice for functions) */
-        PAGE_EXECUTE_READ,
-        /* Save old protection to variable (required) */
-        &oldProtect
-    ))
+    SIZE_T codeSize;
+    if (!pRelocated ||
+        !Relocator::Emit(&plan, (PBYTE) pTrampoline, pRelocated, plan.RelocatedSize) ||
+        !WriteJmpToOriginal(&emitter, pHook) ||
+        !WriteRelayToHook(&emitter, pHook) ||
+        !Emitter::Finish(&emitter, &codeSize))
     {
-        printf("CreateTrampoline failed: VirtualProtect returned FALSE.\n");
+        TrampolineArena::Free(pTrampoline);
+        return NULL;
+    }
+
+    /*
+    Write the built Trampoline Function to the arena.
+    If TrampolineArena::Write fails, CreateTrampoline fails.
+    */
+    if (!TrampolineArena::Write(pTrampoline, code, codeSize))
+    {
+        TrampolineArena::Free(pTrampoline);
         return NULL;
     }
 
@@ -266,7 +351,7 @@ BOOL BackupStolenBytes(PHOOK_DESCRIPTOR pHook)
         /* Copy into Stolen Bytes buffer */
         pHook->StolenBytes.Buffer,
         /* The size of the Stolen Bytes buffer */
-        sizeof(pHook->StolenBytes.Buffer) /* MAX_INSTR_SIZE */,
+        sizeof(pHook->StolenBytes.Buffer) /* RELOCATION_MAX_SOURCE_SIZE */,
         /* Copy bytes from the Original function */
         pHook->pOriginal,
         /* Copy only the required amount of bytes */
@@ -275,67 +360,627 @@ BOOL BackupStolenBytes(PHOOK_DESCRIPTOR pHook)
 }
 
 /*
-Write JMP instruction from base of Original to Hook.
+Create the relay to Hook on its own, within reach of Original (64-bit only).
+A relay is usually part of Trampoline, but a hot-patched Hook has no Trampoline to place it in.
+@param pHook, the Hook's descriptor.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL CreateRelay(PHOOK_DESCRIPTOR pHook)
+{
+    /* Allocate the relay from the Trampoline Arena, it's freed along with the Hook as if it were its Trampoline */
+    pHook->pTrampoline = TrampolineArena::Allocate(pHook->pOriginal, JMP_ABSOLUTE_SIZE);
+    if (!pHook->pTrampoline)
+    {
+        printf("CreateRelay failed: couldn't allocate relay.\n");
+        return FALSE;
+    }
+
+    BYTE code[JMP_ABSOLUTE_SIZE];
+    EMITTER emitter;
+    Emitter::Initialize(&emitter, code, sizeof(code), pHook->pTrampoline);
+
+    SIZE_T codeSize;
+    if (!WriteRelayToHook(&emitter, pHook) ||
+        !Emitter::Finish(&emitter, &codeSize) ||
+        !TrampolineArena::Write(pHook->pTrampoline, code, codeSize))
+    {
+        TrampolineArena::Free(pHook->pTrampoline);
+        pHook->pTrampoline = NULL;
+        pHook->pRelay = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+Build JMP instruction to Hook, which is written at the base of Original (or within Original's hot-patch padding).
 @param pHook, the Hook's descriptor.
+@param pJmp, where the JMP instruction is executed from.
+@param pBuffer, receives the JMP instruction (JMP_REL32_SIZE bytes).
 @return TRUE if the function succeeds, FALSE if it fails.
 */
-BOOL WriteJmpToHook(PHOOK_DESCRIPTOR pHook)
+BOOL BuildJmpToHook(PHOOK_DESCRIPTOR pHook, PBYTE pJmp, OUT PBYTE pBuffer)
 {
-    /* IP in Original after this JMP instruction */
-    PBYTE ipAfterJmp = (PBYTE) pHook->pOriginal + sizeof(INSTR_SINGLE_OP);
-    /* Offset from Original to Hooked function */
-    DWORD offsetToHook = (PBYTE) pHook->pHooked - ipAfterJmp;
-    /* JMP from Original to Hook */
-    INSTR_SINGLE_OP jmpToHook = { JMP_OPCODE, offsetToHook };
+    /* IP after this JMP instruction */
+    PBYTE ipAfterJmp = pJmp + JMP_REL32_SIZE;
+    /* Jump straight to Hook, or through the relay if Hook is too far */
+    PBYTE pDestination = (PBYTE) pHook->pHooked;
+    if (pHook->pRelay && !Memory::IsRel32Reachable(ipAfterJmp, pDestination))
+        pDestination = (PBYTE) pHook->pRelay;
+
     /*
-    Write the JMP instruction to the beginning of Original, with proper protection.
-    If ProtectedWrite fails, WriteJmpToHook fails.
+    Build JMP to Hook, which must be a rel32 JMP as exactly its size is stolen.
+    If the emitter fails (e.g. Hook is out of reach), BuildJmpToHook fails.
     */
-    return ProtectedWrite(
-        /* Write to beginning of Original */
-        pHook->pOriginal,
-        /* Write the JMP instruction */
-        &jmpToHook,
-        /* The size of the JMP instruction */
-        sizeof(jmpToHook)
-    );
+    EMITTER emitter;
+    Emitter::Initialize(&emitter, pBuffer, JMP_REL32_SIZE, pJmp);
+    Emitter::Jmp(&emitter, pDestination, BRANCH_SIZE_NEAR);
+
+    SIZE_T jmpSize;
+    return Emitter::Finish(&emitter, &jmpSize);
 }
 
 /*
-Enable the Hook, i.e. make it functional.
+Prepare a Hook in Original's hot-patch area: a JMP to Hook is written to the padding before Original,
+and a short JMP to it is built, which replaces the NOPs at Original's entry once the Hook is enabled.
+No instructions are relocated, as Trampoline is simply Original's body, right after the NOPs.
 @param pHook, the Hook's descriptor.
 @return TRUE if the function succeeds, FALSE if it fails.
 */
-BOOL Trampy::EnableHook(PHOOK_DESCRIPTOR pHook)
+BOOL PrepareHotPatchHook(PHOOK_DESCRIPTOR pHook)
+{
+    PBYTE pPadding = pHook->HotPatch.pPadding;
+
+    /* Hook is reached through a relay if it's too far from the padding (64-bit only) */
+    if (!pHook->pRelay && !Memory::IsRel32Reachable(pPadding + JMP_REL32_SIZE, pHook->pHooked) && !CreateRelay(pHook))
+        return FALSE;
+
+    /*
+    Backup the NOPs at the beginning of Original.
+    If BackupStolenBytes fails, PrepareHotPatchHook fails.
+    */
+    pHook->StolenBytes.Amount = HOT_PATCH_ENTRY_SIZE;
+    if (!BackupStolenBytes(pHook))
+        return FALSE;
+
+    /*
+    Write JMP from the padding to Hook, the padding is never executed so it's written as-is, and kept once the Hook is disabled.
+    If BuildJmpToHook or Memory::WriteCode fails, PrepareHotPatchHook fails.
+    */
+    BYTE jmpToHook[JMP_REL32_SIZE];
+    if (!BuildJmpToHook(pHook, pPadding, jmpToHook))
+        return FALSE;
+
+    /* The padding precedes Original within the same alias, if Original is aliased (which isn't remapped meanwhile, see LivePatch::LockWrites) */
+    BOOL bWritten = TRUE;
+    LivePatch::LockWrites();
+
+    if (pHook->pAlias)
+    {
+        memcpy(pHook->pAlias - ((PBYTE) pHook->pOriginal - pPadding), jmpToHook, sizeof(jmpToHook));
+        Memory::FlushInstructions(pPadding, sizeof(jmpToHook));
+    }
+    else
+    {
+        bWritten = Memory::WriteCode(pPadding, jmpToHook, sizeof(jmpToHook));
+    }
+
+    LivePatch::UnlockWrites();
+    if (!bWritten)
+        return FALSE;
+
+    /*
+    Build short JMP from Original to the padding.
+    If the emitter fails, PrepareHotPatchHook fails.
+    */
+    EMITTER emitter;
+    Emitter::Initialize(&emitter, pHook->Patch.Buffer, sizeof(pHook->Patch.Buffer), pHook->pOriginal);
+    Emitter::Jmp(&emitter, pPadding, BRANCH_SIZE_SHORT);
+
+    if (!Emitter::Finish(&emitter, &pHook->Patch.Amount))
+        return FALSE;
+
+    /* Trampoline skips the NOPs that are replaced by the short JMP */
+    LivePatch::Publish(pHook->ppTrampoline, (PBYTE) pHook->pOriginal + pHook->HotPatch.EntrySize);
+
+    return TRUE;
+}
+
+/*
+Check that the stolen bytes of Original may be overwritten, i.e. that no branch of Original lands within them,
+and that Original's flow doesn't end within them.
+@param pHook, the Hook's descriptor.
+@return TRUE if the stolen bytes may be overwritten, FALSE otherwise.
+*/
+BOOL IsStolenRangeSafe(PHOOK_DESCRIPTOR pHook)
 {
-    /* Create Trampoline function, save pointer to it */
-    LPVOID pTrampoline = CreateTrampoline(pHook);
+    /* Original's flow is cached, so planning many Hooks only analyzes each function once */
+    FLOW_REFERENCE pFlow = FlowAnalysis::Analyze(pHook->pOriginal, FLOW_DEFAULT_MAX_SIZE);
 
-    /* If CreateTrampoline fails, EnableHook fails */
-    if (!pTrampoline)
+    /* If FlowAnalysis::Analyze fails, IsStolenRangeSafe fails */
+    if (!pFlow)
         return FALSE;
 
-    *pHook->ppTrampoline = pTrampoline;
+    SIZE_T conflictOffset;
+    if (!FlowAnalysis::IsHookable(pFlow, pHook->StolenBytes.Amount, &conflictOffset))
+    {
+        printf("Failed to hook function: Original's control-flow reaches its stolen bytes at offset %zu.\n", conflictOffset);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+Prepare a Hook over Original's first instructions: they're relocated to Trampoline,
+and a JMP to Hook is built, which replaces them once the Hook is enabled.
+@param pHook, the Hook's descriptor.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL PrepareTrampolineHook(PHOOK_DESCRIPTOR pHook)
+{
+    /* Create Trampoline function, unless it was created by a previous PrepareHook that failed afterwards */
+    if (!pHook->pTrampoline)
+        pHook->pTrampoline = CreateTrampoline(pHook);
+
+    /* If CreateTrampoline fails, PrepareTrampolineHook fails */
+    if (!pHook->pTrampoline)
+        return FALSE;
 
     /* If stolen byte amount is smaller than a JMP instruction, we can't patch */
-    if (pHook->StolenBytes.Amount < sizeof(INSTR_SINGLE_OP))
+    if (pHook->StolenBytes.Amount < JMP_REL32_SIZE)
     {
         printf("Failed to hook function: Original function was too small (5 bytes minimum).\n");
         return FALSE;
     }
 
+    /* If a branch lands within the stolen bytes, it would land within the JMP to Hook, so we can't patch */
+    if (!IsStolenRangeSafe(pHook))
+        return FALSE;
+
     /*
     Backup to-be-stolen bytes at the beginning of Original.
-    If BackupStolenBytes fails, EnableHook fails.
+    If BackupStolenBytes fails, PrepareTrampolineHook fails.
     */
     if (!BackupStolenBytes(pHook))
         return FALSE;
 
     /*
-    Write JMP from Original to Hook (overwrites first bytes in Original).
-    If WriteJmpToHook fails, EnableHook fails.
+    Build JMP from Original to Hook, which overwrites the first bytes in Original once the Hook is enabled.
+    If BuildJmpToHook fails, PrepareTrampolineHook fails.
     */
-    if (!WriteJmpToHook(pHook))
+    if (!BuildJmpToHook(pHook, (PBYTE) pHook->pOriginal, pHook->Patch.Buffer))
+        return FALSE;
+
+    pHook->Patch.Amount = JMP_REL32_SIZE;
+
+    /* Trampoline is published before the patch is written, so a thread that reaches Hook through the patch observes it */
+    LivePatch::Publish(pHook->ppTrampoline, pHook->pTrampoline);
+
+    return TRUE;
+}
+
+/*
+Remap the pages the Hook's patch is written to, so it's written through their writable alias (see HOOK_FLAG_WRITABLE_ALIAS).
+If they can't be remapped, the Hook falls back to changing their protection whenever the patch is written.
+@param pHook, the Hook's descriptor.
+*/
+void AliasPatchArea(PHOOK_DESCRIPTOR pHook)
+{
+    /* The patch is a JMP at most, and a hot-patched Hook's padding is written through the same alias */
+    PBYTE pStart = pHook->bHotPatch ? pHook->HotPatch.pPadding : (PBYTE) pHook->pOriginal;
+    PBYTE pEnd = (PBYTE) pHook->pOriginal + (pHook->bHotPatch ? pHook->HotPatch.EntrySize : JMP_REL32_SIZE);
+
+    /* Patches are held off while the pages are copied & remapped, so none of them is lost */
+    LivePatch::LockWrites();
+    PBYTE pAlias = (PBYTE) Memory::AliasCode(pStart, pEnd - pStart);
+    LivePatch::UnlockWrites();
+
+    if (pAlias)
+        pHook->pAlias = pAlias + ((PBYTE) pHook->pOriginal - pStart);
+}
+
+/*
+@return where the Hook's patch is written: the writable alias of Original's beginning, or Original itself (once it's made writable).
+*/
+PBYTE WritablePatchArea(PHOOK_DESCRIPTOR pHook)
+{
+    return pHook->pAlias ? pHook->pAlias : (PBYTE) pHook->pOriginal;
+}
+
+/*
+Prepare the Hook, i.e. build everything it requires once, so enabling & disabling it only writes its patch.
+Trampy::EnableHook prepares the Hook if it isn't prepared yet.
+@param pHook, the Hook's descriptor.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Trampy::PrepareHook(PHOOK_DESCRIPTOR pHook)
+{
+    /* A Hook is prepared once, until it's removed by Trampy::DisableAllHooks */
+    if (pHook->bPrepared)
+        return TRUE;
+
+    /* Original's pages are aliased at most once, they're kept aliased once the Hook is removed */
+    if ((pHook->Flags & HOOK_FLAG_WRITABLE_ALIAS) && !pHook->pAlias)
+        AliasPatchArea(pHook);
+
+    /* A hot-patched Hook has neither stolen instructions nor a Trampoline function */
+    BOOL bPrepared = pHook->bHotPatch ? PrepareHotPatchHook(pHook) : PrepareTrampolineHook(pHook);
+    if (!bPrepared)
+        return FALSE;
+
+    /* Mark the Hook as prepared */
+    pHook->bPrepared = TRUE;
+
+    return TRUE;
+}
+
+/*
+Struct describing a change to a Hook's state, which is applied along with other changes.
+*/
+typedef struct _PATCH_SITE
+{
+    /*
+    The Hook's descriptor.
+    */
+    PHOOK_DESCRIPTOR pHook;
+    /*
+    Is the Hook enabled, or disabled.
+    */
+    BOOL bEnable;
+}
+PATCH_SITE, *PPATCH_SITE;
+
+/*
+A hot-patched Hook whose entry is made of several NOPs may have a thread between them, which would execute the displacement
+of the short JMP if it were stored at once. Such a Hook is only enabled while every other thread is suspended,
+so threads between its NOPs are moved past them first (see MoveInstructionPointer). Storing the NOPs back is always safe.
+@param pSite, the change.
+@return whether the change must be written while every other thread is suspended.
+*/
+BOOL RequiresSuspension(const PATCH_SITE *pSite)
+{
+    return pSite->bEnable && pSite->pHook->bHotPatch && !pSite->pHook->HotPatch.bSingleInstruction;
+}
+
+/*
+Store the patches of Hooks (or the stolen bytes they replace) over the beginning of their Originals, which must be writable already
+(unless they're written through an alias).
+Other threads may be running the Originals meanwhile, so the bytes are written by LivePatch (or at once, for hot-patched Hooks).
+@param pSites, the changes.
+@param amount, the amount of changes.
+@return TRUE if the function succeeds, FALSE if it fails (in which case nothing was stored).
+*/
+BOOL StorePatchAreas(const PATCH_SITE *pSites, SIZE_T amount)
+{
+    /* If LivePatch::InstallTrapHandler fails, StorePatchAreas fails before anything is stored */
+    if (!LivePatch::InstallTrapHandler())
+        return FALSE;
+
+    std::vector<LIVE_PATCH> patches;
+    for (SIZE_T i = 0; i < amount; i++)
+    {
+        PHOOK_DESCRIPTOR pHook = pSites[i].pHook;
+        const BYTE *pCode = pSites[i].bEnable ? pHook->Patch.Buffer : pHook->StolenBytes.Buffer;
+
+        /*
+        The NOPs of a hot-patched Hook are stored at once, so threads running Original execute either them or the short JMP.
+        Changes that require suspension never get here (see RequiresSuspension).
+        */
+        if (pHook->bHotPatch)
+        {
+            WORD entryCode;
+            memcpy(&entryCode, pCode, sizeof(entryCode));
+            Memory::StoreCodeAtomic(WritablePatchArea(pHook), entryCode);
+            continue;
+        }
+
+        /* Only the bytes the patch covers are stored, a thread that reaches them while they're written is forwarded to Trampoline */
+        patches.push_back({ (PBYTE) pHook->pOriginal, WritablePatchArea(pHook), pCode, pHook->Patch.Amount, pHook->pTrampoline });
+    }
+
+    LivePatch::Write(patches.data(), patches.size());
+
+    return TRUE;
+}
+
+/*
+Write the Hook's patch (or the stolen bytes it replaces) over the beginning of Original.
+@param pHook, the Hook's descriptor.
+@param bEnable, whether the patch is written, or the stolen bytes.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL WritePatchArea(PHOOK_DESCRIPTOR pHook, BOOL bEnable)
+{
+    PATCH_SITE site = { pHook, bEnable };
+    BOOL bStored = FALSE;
+
+    /* Original's pages aren't remapped from the moment they're made writable until they're restored (see LivePatch::LockWrites) */
+    LivePatch::LockWrites();
+
+    /* An aliased patch is written without changing Original's protection */
+    DWORD oldProtection;
+    if (pHook->pAlias)
+    {
+        bStored = StorePatchAreas(&site, 1);
+        Memory::FlushInstructions(pHook->pOriginal, pHook->Patch.Amount);
+    }
+    else if (Memory::BeginCodeWrite(pHook->pOriginal, pHook->Patch.Amount, &oldProtection))
+    {
+        bStored = StorePatchAreas(&site, 1);
+        bStored = Memory::EndCodeWrite(pHook->pOriginal, pHook->Patch.Amount, oldProtection) && bStored;
+    }
+
+    LivePatch::UnlockWrites();
+    return bStored;
+}
+
+/*
+Struct describing a range of whole pages, which is made writable once for every patch site within it.
+*/
+typedef struct _PAGE_RANGE
+{
+    /*
+    The beginning of the range, and its size.
+    */
+    PBYTE pStart;
+    SIZE_T Size;
+    /*
+    The range's protection, as received from Memory::BeginCodeWrite.
+    */
+    DWORD OldProtection;
+}
+PAGE_RANGE, *PPAGE_RANGE;
+
+/*
+The queued changes of the current transaction, whether a transaction was begun, and its flags.
+*/
+std::vector<PATCH_SITE> g_Transaction;
+BOOL g_bTransaction = FALSE;
+BYTE g_TransactionFlags = 0;
+
+/*
+@return the nanoseconds that passed since given time, which is then moved to now (so consecutive phases are timed).
+*/
+DWORD64 ElapsedNanoseconds(std::chrono::steady_clock::time_point *pStart)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    DWORD64 elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - *pStart).count();
+    *pStart = now;
+    return elapsed;
+}
+
+/*
+Group the pages patch sites are written to into ranges, where overlapping & adjacent pages are a single range.
+Pages that are written through an alias are left out, as their protection isn't changed.
+@param sites, the patch sites.
+@return the page ranges, sorted by address.
+*/
+std::vector<PAGE_RANGE> GroupPages(const std::vector<PATCH_SITE> &sites)
+{
+    ULONG_PTR pageSize = Memory::PageSize();
+
+    std::vector<PAGE_RANGE> pages;
+    for (const PATCH_SITE &site : sites)
+    {
+        if (site.pHook->pAlias)
+            continue;
+
+        ULONG_PTR start = (ULONG_PTR) site.pHook->pOriginal;
+        ULONG_PTR end = start + site.pHook->Patch.Amount;
+        start -= start % pageSize;
+        end += (pageSize - end % pageSize) % pageSize;
+        pages.push_back({ (PBYTE) start, end - start, 0 });
+    }
+
+    std::sort(pages.begin(), pages.end(), [](const PAGE_RANGE &a, const PAGE_RANGE &b) { return a.pStart < b.pStart; });
+
+    std::vector<PAGE_RANGE> ranges;
+    for (const PAGE_RANGE &page : pages)
+    {
+        if (ranges.empty() || page.pStart > ranges.back().pStart + ranges.back().Size)
+        {
+            ranges.push_back(page);
+            continue;
+        }
+
+        /* The page overlaps (or directly follows) the last range, so the range is extended over it */
+        PBYTE pEnd = max(ranges.back().pStart + ranges.back().Size, page.pStart + page.Size);
+        ranges.back().Size = pEnd - ranges.back().pStart;
+    }
+
+    return ranges;
+}
+
+/*
+Move an instruction pointer out of the code a change overwrites, to the matching instruction of the code that replaces it:
+from Original's stolen bytes to Trampoline when a Hook is enabled, and from Trampoline back to Original when it's disabled.
+@param pSite, the change.
+@param pInstruction, the instruction pointer.
+@return the moved instruction pointer, or NULL if it isn't within the overwritten code (or isn't on an instruction's boundary).
+*/
+PBYTE MoveInstructionPointer(const PATCH_SITE *pSite, PBYTE pInstruction)
+{
+    PHOOK_DESCRIPTOR pHook = pSite->pHook;
+    PBYTE pOriginal = (PBYTE) pHook->pOriginal;
+
+    /* A thread at Original's beginning executes the patch, or the stolen bytes, as a whole */
+    if (pSite->bEnable && pInstruction > pOriginal && pInstruction < pOriginal + pHook->StolenBytes.Amount)
+    {
+        /* The NOPs of a hot-patched Hook are replaced by a short JMP, so a thread within them skips the rest of them */
+        if (pHook->bHotPatch)
+            return pOriginal + pHook->HotPatch.EntrySize;
+
+        for (SIZE_T i = 0; i < pHook->Instructions.Amount; i++)
+        {
+            if (pOriginal + pHook->Instructions.SourceOffsets[i] == pInstruction)
+                return (PBYTE) pHook->pTrampoline + pHook->Instructions.RelocatedOffsets[i];
+        }
+    }
+
+    /* A disabled Hook's Trampoline is kept, so this only matters once it's freed, threads within a widened branch are left in it */
+    PBYTE pTrampoline = (PBYTE) pHook->pTrampoline;
+    if (!pSite->bEnable && !pHook->bHotPatch &&
+        pInstruction >= pTrampoline && pInstruction < pTrampoline + pHook->Instructions.RelocatedSize)
+    {
+        for (SIZE_T i = 0; i < pHook->Instructions.Amount; i++)
+        {
+            if (pTrampoline + pHook->Instructions.RelocatedOffsets[i] == pInstruction)
+                return pOriginal + pHook->Instructions.SourceOffsets[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+Apply changes while every other thread is suspended: threads within the overwritten code are moved out of it,
+then the changes are written as-is, as no thread runs through them.
+Nothing is allocated while the threads are suspended, as a suspended thread may hold the heap's lock.
+@param sites, the changes.
+@param pTiming, receives how long the threads were suspended.
+@return TRUE if the function succeeds, FALSE if it fails (in which case nothing was written).
+*/
+BOOL StorePatchAreasSuspended(const std::vector<PATCH_SITE> &sites, OUT PTRANSACTION_TIMING pTiming)
+{
+    PTHREAD_SUSPENSION pSuspension = Threads::SuspendOthers();
+    if (!pSuspension)
+        return FALSE;
+
+    for (SIZE_T i = 0; i < Threads::Amount(pSuspension); i++)
+    {
+        PBYTE pInstruction = (PBYTE) Threads::GetInstructionPointer(pSuspension, i);
+        if (!pInstruction)
+            continue;
+
+        for (const PATCH_SITE &site : sites)
+        {
+            PBYTE pMoved = MoveInstructionPointer(&site, pInstruction);
+            if (pMoved)
+            {
+                Threads::SetInstructionPointer(pSuspension, i, pMoved);
+                break;
+            }
+        }
+    }
+
+    for (const PATCH_SITE &site : sites)
+    {
+        PHOOK_DESCRIPTOR pHook = site.pHook;
+        memcpy(WritablePatchArea(pHook), site.bEnable ? pHook->Patch.Buffer : pHook->StolenBytes.Buffer, pHook->Patch.Amount);
+    }
+
+    pTiming->Pause = Threads::Resume(pSuspension);
+
+    return TRUE;
+}
+
+/*
+Apply changes to prepared Hooks at once: the pages they're written to are made writable (unless they're written through an alias),
+then every change is written, then the pages' protection is restored, so each page's protection is changed once rather than once per Hook.
+@param sites, the changes.
+@param bSuspendThreads, whether every other thread is suspended while the changes are written (see TRANSACTION_FLAG_SUSPEND_THREADS),
+they're suspended anyway if any of the changes requires it (see RequiresSuspension).
+@param pTiming, receives how long the protection, write & restore phases took (and the pause, if threads are suspended).
+@return TRUE if every change was applied, FALSE if none was (e.g. a page couldn't be made writable).
+*/
+BOOL ApplyPatches(const std::vector<PATCH_SITE> &sites, BOOL bSuspendThreads, OUT PTRANSACTION_TIMING pTiming)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<PAGE_RANGE> ranges = GroupPages(sites);
+
+    /* Threads are suspended whenever any of the changes requires it */
+    for (const PATCH_SITE &site : sites)
+        bSuspendThreads = bSuspendThreads || RequiresSuspension(&site);
+
+    /*
+    The pages aren't remapped from the moment they're made writable until they're restored (see LivePatch::LockWrites),
+    and the lock is taken before threads are suspended, so none of them holds it meanwhile.
+    */
+    LivePatch::LockWrites();
+
+    /* If a range can't be made writable, the ranges that were already made writable are restored, and nothing is written */
+    for (SIZE_T i = 0; i < ranges.size(); i++)
+    {
+        if (Memory::BeginCodeWrite(ranges[i].pStart, ranges[i].Size, &ranges[i].OldProtection))
+            continue;
+
+        for (SIZE_T j = 0; j < i; j++)
+            Memory::EndCodeWrite(ranges[j].pStart, ranges[j].Size, ranges[j].OldProtection);
+
+        LivePatch::UnlockWrites();
+        return FALSE;
+    }
+
+    pTiming->Protect = ElapsedNanoseconds(&start);
+
+    /* If the changes can't be stored, nothing was written, so the ranges are restored */
+    BOOL bStored = bSuspendThreads ?
+        StorePatchAreasSuspended(sites, pTiming) :
+        StorePatchAreas(sites.data(), sites.size());
+
+    if (!bStored)
+    {
+        for (const PAGE_RANGE &range : ranges)
+            Memory::EndCodeWrite(range.pStart, range.Size, range.OldProtection);
+
+        LivePatch::UnlockWrites();
+        return FALSE;
+    }
+
+    for (const PATCH_SITE &site : sites)
+        site.pHook->bEnabled = site.bEnable;
+
+    pTiming->Write = ElapsedNanoseconds(&start);
+
+    /* The changes are already applied, so a range whose protection can't be restored is only reported (by Memory::EndCodeWrite) */
+    for (const PAGE_RANGE &range : ranges)
+        Memory::EndCodeWrite(range.pStart, range.Size, range.OldProtection);
+
+    /* Patches that were written through an alias have no range, so their stale instructions are flushed on their own */
+    for (const PATCH_SITE &site : sites)
+    {
+        if (site.pHook->pAlias)
+            Memory::FlushInstructions(site.pHook->pOriginal, site.pHook->Patch.Amount);
+    }
+
+    LivePatch::UnlockWrites();
+
+    pTiming->Restore = ElapsedNanoseconds(&start);
+
+    return TRUE;
+}
+
+/*
+Enable the Hook, i.e. make it functional.
+@param pHook, the Hook's descriptor.
+@return TRUE if the function succeeds, FALSE if it fails.
+*/
+BOOL Trampy::EnableHook(PHOOK_DESCRIPTOR pHook)
+{
+    /* If Hook is already enabled, there's nothing to do */
+    if (pHook->bEnabled)
+        return TRUE;
+
+    /*
+    Prepare the Hook, unless it was prepared by a previous EnableHook.
+    If PrepareHook fails, EnableHook fails.
+    */
+    if (!PrepareHook(pHook))
+        return FALSE;
+
+    /*
+    Write the patch over the beginning of Original, while every other thread is suspended if the patch requires it.
+    If WritePatchArea or ApplyPatches fails, EnableHook fails.
+    */
+    PATCH_SITE site = { pHook, TRUE };
+    TRANSACTION_TIMING timing;
+    BOOL bWritten = RequiresSuspension(&site) ?
+        ApplyPatches(std::vector<PATCH_SITE>(1, site), TRUE, &timing) :
+        WritePatchArea(pHook, TRUE);
+
+    if (!bWritten)
         return FALSE;
 
     /* Mark the Hook as enabled */
@@ -350,13 +995,27 @@ Enable all Hooks, i.e. make them all functional.
 */
 BOOL Trampy::EnableAllHooks()
 {
-    BOOL bEnabledAll = TRUE;
+    BOOL bPreparedAll = TRUE;
 
+    /* Prepare every disabled Hook, Hooks that can't be prepared are left disabled */
+    std::vector<PATCH_SITE> sites;
     for (HOOK_DESCRIPTOR &hook : g_Hooks)
-        if (!EnableHook(&hook))
-            bEnabledAll = FALSE;
+    {
+        if (hook.bEnabled)
+            continue;
+
+        if (!PrepareHook(&hook))
+        {
+            bPreparedAll = FALSE;
+            continue;
+        }
+
+        sites.push_back({ &hook, TRUE });
+    }
 
-    return bEnabledAll;
+    /* Write all patches at once, so the protection of each page is changed once */
+    TRANSACTION_TIMING timing;
+    return ApplyPatches(sites, FALSE, &timing) && bPreparedAll;
 }
 
 /*
@@ -371,17 +1030,11 @@ BOOL Trampy::DisableHook(PHOOK_DESCRIPTOR pHook)
         return FALSE;
 
     /*
-    Write stolen bytes to Original.
-    If ProtectedWrite fails, DisableHook fails.
+    Write stolen bytes to Original, over the patch.
+    If WritePatchArea fails, DisableHook fails.
     */
-    if (!ProtectedWrite(
-        pHook->pOriginal,
-        pHook->StolenBytes.Buffer,
-        pHook->StolenBytes.Amount
-    ))
-    {
+    if (!WritePatchArea(pHook, FALSE))
         return FALSE;
-    }
 
     /* Mark the Hook as disabled */
     pHook->bEnabled = FALSE;
@@ -395,19 +1048,142 @@ Disable all Hooks, i.e. revert to original state.
 */
 BOOL Trampy::DisableAllHooks()
 {
-    /* Erase from g_Hooks vector */
-    g_Hooks.erase(
-        /* Construct iterator for all Hooks we want to erase */
-        std::remove_if(
-            /* From the beginning to the end of the vector */
-            g_Hooks.begin(), g_Hooks.end(),
-            /* Erase all Hooks that were successfully disabled */
-            [](HOOK_DESCRIPTOR &hook) { return DisableHook(&hook); }
-        ),
-        /* Erase all Hooks in the newly constructed iterator */
-        g_Hooks.end()
+    /*
+    Erase all Hooks that were successfully disabled from g_Hooks.
+    Their Trampolines are never freed: a thread may still be running one (or be within Hook, about to call it),
+    and there's no telling when it's done. Only the pointers to them are cleared.
+    */
+    g_Hooks.remove_if(
+        [](HOOK_DESCRIPTOR &hook)
+        {
+            if (!DisableHook(&hook))
+                return false;
+
+            LivePatch::Publish(hook.ppTrampoline, NULL);
+            return true;
+        }
     );
 
     /* If g_Hooks is empty, all DisableHook calls were successful */
     return g_Hooks.empty();
 }
+
+/*
+Begin a transaction, which enables & disables many Hooks at once: either all of them are changed or none of them.
+The functions it touches are grouped by page, so the protection of each page is changed once rather than once per Hook.
+@param flags, the transaction's flags (TRANSACTION_FLAGS).
+@return TRUE if the function succeeds, FALSE if it fails (e.g. a transaction was already begun).
+*/
+BOOL Trampy::BeginTransaction(BYTE flags)
+{
+    if (g_bTransaction)
+    {
+        printf("Trampy::BeginTransaction failed: a transaction was already begun.\n");
+        return FALSE;
+    }
+
+    g_bTransaction = TRUE;
+    g_TransactionFlags = flags;
+    g_Transaction.clear();
+
+    return TRUE;
+}
+
+/*
+Queue a change to a Hook's state, to be applied once the transaction is committed.
+@param pHook, the Hook's descriptor.
+@param bEnable, is the Hook enabled, or disabled.
+@return TRUE if the function succeeds, FALSE if it fails (e.g. no transaction was begun).
+*/
+BOOL QueueChange(PHOOK_DESCRIPTOR pHook, BOOL bEnable)
+{
+    if (!g_bTransaction)
+    {
+        printf("Trampy::Queue%sHook failed: no transaction was begun.\n", bEnable ? "Enable" : "Disable");
+        return FALSE;
+    }
+
+    g_Transaction.push_back({ pHook, bEnable });
+
+    return TRUE;
+}
+
+/*
+Queue a Hook to be enabled or disabled once the transaction is committed.
+A Hook that's already in the queued state is left as is, and if a Hook is queued more than once, the last change applies.
+@param pHook, the Hook's descriptor.
+@return TRUE if the function succeeds, FALSE if it fails (e.g. no transaction was begun).
+*/
+BOOL Trampy::QueueEnableHook(PHOOK_DESCRIPTOR pHook)
+{
+    return QueueChange(pHook, TRUE);
+}
+
+BOOL Trampy::QueueDisableHook(PHOOK_DESCRIPTOR pHook)
+{
+    return QueueChange(pHook, FALSE);
+}
+
+/*
+Commit the transaction, i.e. apply every queued change, and end it.
+If any Hook can't be prepared, or any page can't be made writable, none of the changes is applied.
+@param pTiming, receives how long each phase of the commit took (optional).
+@return TRUE if every change was applied, FALSE if none was.
+*/
+BOOL Trampy::CommitTransaction(OUT PTRANSACTION_TIMING pTiming)
+{
+    if (!g_bTransaction)
+    {
+        printf("Trampy::CommitTransaction failed: no transaction was begun.\n");
+        return FALSE;
+    }
+
+    /* The transaction ends whether it's applied or not */
+    std::vector<PATCH_SITE> queue;
+    queue.swap(g_Transaction);
+    g_bTransaction = FALSE;
+
+    TRANSACTION_TIMING timing = { };
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    /* Only the last change queued for each Hook applies, and it's dropped if the Hook is already in that state */
+    std::vector<PATCH_SITE> sites;
+    std::unordered_set<PHOOK_DESCRIPTOR> queuedHooks;
+    for (auto it = queue.rbegin(); it != queue.rend(); it++)
+    {
+        if (queuedHooks.insert(it->pHook).second && it->pHook->bEnabled != it->bEnable)
+            sites.push_back(*it);
+    }
+
+    /*
+    Prepare every Hook that's enabled, before anything is written.
+    If PrepareHook fails, CommitTransaction fails.
+    */
+    for (const PATCH_SITE &site : sites)
+    {
+        if (site.bEnable && !PrepareHook(site.pHook))
+            return FALSE;
+    }
+
+    timing.Prepare = ElapsedNanoseconds(&start);
+
+    /*
+    Apply all changes at once.
+    If ApplyPatches fails, CommitTransaction fails.
+    */
+    BOOL bApplied = ApplyPatches(sites, g_TransactionFlags & TRANSACTION_FLAG_SUSPEND_THREADS, &timing);
+
+    if (pTiming)
+        *pTiming = timing;
+
+    return bApplied;
+}
+
+/*
+Abort the transaction, i.e. end it without applying any of the queued changes.
+*/
+void Trampy::AbortTransaction()
+{
+    g_Transaction.clear();
+    g_bTransaction = FALSE;
+}
\ No newline at end of file
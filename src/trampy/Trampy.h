@@ -1,5 +1,5 @@
 #pragma once
-#include <Windows.h>
+#include "TrampyDefs.h"
 
 /*
 Definition of the Hook's descriptor struct.
@@ -7,6 +7,85 @@ Definition of the Hook's descriptor struct.
 typedef struct _HOOK_DESCRIPTOR
 HOOK_DESCRIPTOR, *PHOOK_DESCRIPTOR;
 
+/*
+Flags that configure a Hook.
+*/
+enum HOOK_FLAGS : BYTE
+{
+	/*
+	Follow the jumps Original starts with (e.g. incremental-link thunks, import stubs & PLT entries),
+	and hook the function's body rather than the jump, so every caller is hooked, whichever way it reaches the body.
+	*/
+	HOOK_FLAG_FOLLOW_JUMPS = 1 << 0,
+	/*
+	Install the Hook in Original's hot-patch area if it has one (see HOT_PATCH_AREA), and over its first instructions otherwise.
+	A hot-patched Hook is enabled & disabled by a single atomic 2-byte write, and no instructions are relocated.
+	If the entry is made of several NOPs (see HOT_PATCH_AREA), the Hook is enabled while every other thread is suspended instead.
+	*/
+	HOOK_FLAG_HOT_PATCH = 1 << 1,
+	/*
+	Return from Trampoline to Original through an absolute JMP (JMP [RIP+0]), or a push/ret JMP, rather than a relative JMP.
+	Relative JMPs are the fastest & smallest, these are alternatives whose cost per call may be measured against them.
+	At most one of them may be set, and they don't apply to hot-patched Hooks (which have no Trampoline function).
+	*/
+	HOOK_FLAG_ABSOLUTE_EXIT = 1 << 2,
+	HOOK_FLAG_PUSH_RET_EXIT = 1 << 3,
+	/*
+	Remap the pages the Hook's patch is written to once it's prepared, so they're mapped twice (see Memory::AliasCode),
+	and write the patch through their writable alias, so they're never made writable & executable, and their protection is never changed.
+	Falls back to changing their protection if they can't be remapped (e.g. on Windows, where they belong to the module's image).
+	The Trampoline Arena is aliased separately (see ARENA_FLAG_WRITABLE_ALIAS).
+	*/
+	HOOK_FLAG_WRITABLE_ALIAS = 1 << 4,
+	/*
+	Start the Trampoline function near the end of its arena slot rather than at its beginning, so its first instruction crosses a cache line.
+	It's slower to fetch, this only exists so the cost of the layout may be measured against aligned Trampolines.
+	*/
+	HOOK_FLAG_UNALIGNED_TRAMPOLINE = 1 << 5,
+};
+
+/*
+Flags that configure a transaction (see Trampy::BeginTransaction).
+*/
+enum TRANSACTION_FLAGS : BYTE
+{
+	/*
+	Suspend every other thread while the changes are written, and move threads that are within the overwritten code
+	to the matching instruction of the code that replaces it (e.g. from Original's stolen bytes to Trampoline).
+	Without it, a thread that's within the stolen bytes (rather than at Original's beginning) may execute a partial instruction.
+	*/
+	TRANSACTION_FLAG_SUSPEND_THREADS = 1 << 0,
+};
+
+/*
+Struct describing how long each phase of a committed transaction took, in nanoseconds (see Trampy::CommitTransaction).
+*/
+typedef struct _TRANSACTION_TIMING
+{
+	/*
+	Preparing the Hooks that are enabled (see Trampy::PrepareHook), which is only done once per Hook.
+	*/
+	DWORD64 Prepare;
+	/*
+	Making the pages of every patched function writable (except pages that are written through an alias, see HOOK_FLAG_WRITABLE_ALIAS).
+	*/
+	DWORD64 Protect;
+	/*
+	Writing the patches & stolen bytes.
+	*/
+	DWORD64 Write;
+	/*
+	Restoring the protection of the pages, and flushing the stale instructions.
+	*/
+	DWORD64 Restore;
+	/*
+	How long the other threads were suspended, within the write phase
+	(0 unless TRANSACTION_FLAG_SUSPEND_THREADS is set, or a Hook whose hot-patch entry is made of several NOPs is enabled).
+	*/
+	DWORD64 Pause;
+}
+TRANSACTION_TIMING, *PTRANSACTION_TIMING;
+
 /*
 Keep all Trampy-related functions in their own namespace.
 This is convenient for the user.
@@ -18,9 +97,18 @@ namespace Trampy
 	@param pOriginal, pointer to the original function.
 	@param pHooked, pointer to the hooked function.
 	@param ppTrampoline, pointer to the destination trampoline function.
-	@return pointer to the newly created Hook within the Hook list.
+	@param flags, the Hook's flags (HOOK_FLAGS).
+	@return pointer to the newly created Hook within the Hook list, or NULL if the function failed.
 	*/
-	PHOOK_DESCRIPTOR CreateHook(LPVOID pOriginal, LPVOID pHooked, LPVOID *ppTrampoline);
+	PHOOK_DESCRIPTOR CreateHook(LPVOID pOriginal, LPVOID pHooked, LPVOID *ppTrampoline, BYTE flags = 0);
+
+	/*
+	Prepare the Hook, i.e. build everything it requires once (e.g. its Trampoline), so enabling & disabling it only writes its patch.
+	Trampy::EnableHook prepares the Hook if it isn't prepared yet.
+	@param pHook, the Hook's descriptor.
+	@return TRUE if the function succeeds, FALSE if it fails.
+	*/
+	BOOL PrepareHook(PHOOK_DESCRIPTOR pHook);
 
 	/*
 	Enable the Hook, i.e. make it functional.
@@ -42,7 +130,35 @@ namespace Trampy
 	BOOL DisableHook(PHOOK_DESCRIPTOR pHook);
 	/*
 	Disable all Hooks, i.e. revert to original state.
+	The Hooks are removed, and their Trampoline pointers are cleared (their Trampolines are kept, since threads may still be running them).
 	@return TRUE if all Hooks were disabled successfully, FALSE otherwise.
 	*/
 	BOOL DisableAllHooks();
+
+	/*
+	Begin a transaction, which enables & disables many Hooks at once: either all of them are changed or none of them.
+	The functions it touches are grouped by page, so the protection of each page is changed once rather than once per Hook.
+	@param flags, the transaction's flags (TRANSACTION_FLAGS).
+	@return TRUE if the function succeeds, FALSE if it fails (e.g. a transaction was already begun).
+	*/
+	BOOL BeginTransaction(BYTE flags = 0);
+	/*
+	Queue a Hook to be enabled or disabled once the transaction is committed.
+	A Hook that's already in the queued state is left as is, and if a Hook is queued more than once, the last change applies.
+	@param pHook, the Hook's descriptor.
+	@return TRUE if the function succeeds, FALSE if it fails (e.g. no transaction was begun).
+	*/
+	BOOL QueueEnableHook(PHOOK_DESCRIPTOR pHook);
+	BOOL QueueDisableHook(PHOOK_DESCRIPTOR pHook);
+	/*
+	Commit the transaction, i.e. apply every queued change, and end it.
+	If any Hook can't be prepared, or any page can't be made writable, none of the changes is applied.
+	@param pTiming, receives how long each phase of the commit took (optional).
+	@return TRUE if every change was applied, FALSE if none was.
+	*/
+	BOOL CommitTransaction(OUT PTRANSACTION_TIMING pTiming = NULL);
+	/*
+	Abort the transaction, i.e. end it without applying any of the queued changes.
+	*/
+	void AbortTransaction();
 }
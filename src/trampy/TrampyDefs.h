@@ -1,12 +1,68 @@
 #pragma once
-#include <Windows.h>
 #include <cstdint>
 
+/*
+The library is written against Win32 types, which are defined here on other platforms (e.g. Linux),
+along with the few Win32 helpers the platform-independent code uses.
+*/
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+typedef char CHAR;
+typedef uint8_t BYTE, *PBYTE;
+typedef uint16_t WORD, USHORT;
+typedef uint32_t DWORD;
+typedef uint64_t DWORD64;
+typedef int64_t INT64;
+typedef int BOOL;
+typedef size_t SIZE_T;
+typedef uintptr_t ULONG_PTR;
+typedef void *LPVOID, *PVOID;
+typedef const char *LPCSTR;
+/* A loaded module, identified by its base address (i.e. its ELF header, e.g. dladdr's dli_fbase) */
+typedef void *HMODULE;
+
+/* Max length of a path, including its null-terminator */
+#define MAX_PATH 4096
+
+#define TRUE 1
+#define FALSE 0
+
+using std::max;
+using std::min;
+
+/* Bounds-checked copy, as provided by the MSVC runtime */
+inline int memcpy_s(void *dest, size_t destSize, const void *src, size_t count)
+{
+	if (count > destSize)
+		return 1;
+
+	memcpy(dest, src, count);
+	return 0;
+}
+#endif
+
+/*
+Defined when building for x86-64, whatever the platform is (_WIN64 is only defined by Windows compilers),
+so everything that depends on the architecture (e.g. the native decoding mode) is keyed on it rather than on the OS.
+*/
+#if defined(_M_X64) || defined(__x86_64__)
+#define TRAMPY_X64
+#endif
+
 /* Sizes of different types, in bytes */
 #define BYTE_SIZE 1
 #define WORD_SIZE 2
 #define DWORD_SIZE 4
 #define	QWORD_SIZE 8
+#define XMMWORD_SIZE 16
+#define YMMWORD_SIZE 32
+#define ZMMWORD_SIZE 64
 
 #define IN
 #define OUT
@@ -3,273 +3,324 @@
 #include "instr/ModRegRM.h"
 #include "instr/SIB.h"
 #include "instr/OpcodeMaps.h"
+#include "instr/OpcodeTables.h"
+#include "instr/Vex.h"
 #include <stdio.h>
+#include <immintrin.h>
+#include <type_traits>
+#include <thread>
+#include <vector>
+
+/*
+Compiler-specific intrinsics.
+MSVC allows any instruction set's intrinsics, while GCC & Clang require functions to target the instruction set explicitly.
+*/
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
 
 /* Max amount of prefixes allowed per instruction */
 #define MAX_PREFIXES 4
 
-/* Value of operand-size-override prefix */
-#define OPERAND_SIZE_OVERRIDE_PREFIX 0x66
+/* Size of the windows the boundary scanner classifies at once, with each instruction set */
+#define SCAN_WINDOW_SIZE_SSSE3 16
+#define SCAN_WINDOW_SIZE_AVX2 32
+/* Size of the largest window */
+#define SCAN_WINDOW_SIZE SCAN_WINDOW_SIZE_AVX2
+
+/*
+Once fewer bytes than this remain, the boundary scanner continues from a padded copy of the code,
+so neither classifying a window nor decoding an instruction reads beyond the code range.
+*/
+#define SCAN_TAIL_SIZE (SCAN_WINDOW_SIZE + MAX_INSTRUCTION_SIZE)
 
-/* Cache of all prefix bytes */
-const BYTE g_PrefixCache[] = { 0xF0, 0xF2, 0xF3, 0x2E, 0x36, 0x3E, 0x26, 0x64, 0x65, OPERAND_SIZE_OVERRIDE_PREFIX, 0x67 };
+/*
+The parallel scanner splits code into chunks of at least this size, smaller ranges aren't worth the threads.
+Chunks are also aligned to this size, so no two threads ever write the same byte of the boundary bitmap.
+*/
+#define PARALLEL_SCAN_MIN_CHUNK 0x10000
 
-/* Cache of all Addressing Methods that use a ModRM byte */
-const ADDRESSING_METHOD g_UsesModRM[] = { E, G, M, S, C, D, N, P, Q, R, U, V, W };
+/* The CPUID feature bit of SSSE3 (leaf 1, ECX), which provides PSHUFB */
+#define CPUID_SSSE3 (1 << 9)
+/* The CPUID feature bits of OSXSAVE & AVX (leaf 1, ECX), which are required for the OS to save YMM registers */
+#define CPUID_OSXSAVE (1 << 27)
+#define CPUID_AVX (1 << 28)
+/* The CPUID feature bit of AVX2 (leaf 7, EBX), which provides 256-bit VPSHUFB */
+#define CPUID_AVX2 (1 << 5)
+/* The XCR0 bits of the XMM & YMM states, which the OS must save for AVX2 to be usable */
+#define XCR0_YMM_STATE 0b110
 
-/* Cache of all Addressing Methods that use immediate values */
-const ADDRESSING_METHOD g_UsesImm[] = { A, I, J, O };
+static_assert(std::is_trivially_copyable<DECODED_INSTRUCTION>::value, "DECODED_INSTRUCTION must be trivially copyable");
+static_assert(sizeof(DECODED_INSTRUCTION) <= 32, "DECODED_INSTRUCTION must be at most 32 bytes");
 
 /*
-Struct describing the state of the dissasembler.
-There's a single instance of this struct and it's global, as there's only a single dissasembler running at once.
-This means that disassembling cannot be multi-threaded.
+Default context of the calling thread, used by the context-less wrappers.
+Each thread gets its own instance, so even the wrappers share no state between threads.
 */
-struct _DISASSEMBLER_STATE
-{
-	/*
-	The machine code buffer.
-	This could be a pointer to a function or anything of the sorts.
-	*/
-	PBYTE Buffer;
-	/*
-	The disassembler's instruction pointer.
-	Points to the next byte to be read.
-	*/
-	PBYTE Ip;
-	/*
-	Amount of bytes that we need to disassemble.
-	*/
-	SIZE_T RequiredBytes;
+thread_local DISASSEMBLER_CONTEXT g_ThreadContext = { DISASM_MODE_NATIVE };
 
-	/*
-	Struct defining an instruction.
-	This instruction is the current instruction that's being disassembled.
-	*/
-	struct _INSTRUCTION
-	{
-		/*
-		Pointer to the beginning of the instruction.
-		*/
-		PBYTE Start;
-		/*
-		The current size of the instruction.
-		*/
-		USHORT Size;
-		/*
-		Describes whether the instruction uses a ModRM byte or not.
-		*/
-		BOOL bModRM;
-		/*
-		Describes whether the instruction uses a SIB byte or not.
-		*/
-		BOOL bSib;
-		/*
-		The amount of prefixes used by this instruction.
-		*/
-		USHORT PrefixAmount;
-		/*
-		Describes whether the instruction uses an operand-size-override prefix.
-		*/
-		BOOL bOperandSizeOverride;
-	} Instruction;
+/*
+Initialize a disassembler context.
+@param pContext is the context to be initialized.
+*/
+void Disassembler::InitializeContext(PDISASSEMBLER_CONTEXT pContext)
+{
+	*pContext = { DISASM_MODE_NATIVE };
 }
-g_Disasm;
 
 /*
-Struct defining the state of the replicator.
-The replicator is responsible for replicating the machine code, so it is valid & executable from its new location.
-By default, the replicator is disabled.
-There's a single instance of this struct and it's global.
+Initialize the disassembler.
 */
-struct _REPLICATOR_STATE
+void InitializeDisassembler(PDISASSEMBLER_CONTEXT pContext)
 {
-	BOOL bEnabled;
-	PBYTE Buffer;
-	SIZE_T BufferSize;
-	PBYTE Ip;
-	OUT SIZE_T *pReplicatedAmount;
+	pContext->Buffer = NULL;
+	pContext->Ip = NULL;
+	pContext->RequiredBytes = 0;
+	pContext->End = NULL;
+	pContext->Instruction = { NULL };
 }
-g_Rep = { FALSE };
 
 /*
-Enable replication of machine code.
-@param repBuffer is a byte-buffer which stores the replicated code.
-@param repBufferSize is the size of the replicated code's buffer.
-@param pReplicatedAmount is the amount of replicated bytes.
+Initialize the current instruction struct.
 */
-void Disassembler::EnableReplication(PBYTE repBuffer, SIZE_T repBufferSize, OUT SIZE_T *pReplicatedAmount)
+void InitializeInstruction(PDISASSEMBLER_CONTEXT pContext)
 {
-	g_Rep = { TRUE, repBuffer, repBufferSize, repBuffer, pReplicatedAmount };
+	pContext->Instruction = { pContext->Ip, 0, FALSE, FALSE, 0, FALSE };
+	pContext->Instruction.Disp8Scale = 1;
 }
 
 /*
-Disables the replication.
+Mark current instruction as truncated, i.e. crossing the end of a bounded buffer.
+@param neededEnd is the end of the bytes that were about to be read.
 */
-void Disassembler::DisableReplication()
+void Truncate(PDISASSEMBLER_CONTEXT pContext, PBYTE neededEnd)
 {
-	g_Rep.bEnabled = FALSE;
+	/* Only the first read beyond the end is reliable, later reads depend on the missing bytes */
+	if (pContext->Instruction.bTruncated)
+		return;
+
+	pContext->Instruction.bTruncated = TRUE;
+	pContext->Instruction.MissingBytes = (BYTE) (neededEnd - pContext->End);
 }
 
 /*
-Initialize the disassembler.
+@return whether given bytes lie beyond the end of a bounded buffer.
 */
-void InitializeDisassembler()
+bool IsBeyondEnd(PDISASSEMBLER_CONTEXT pContext, PBYTE pBytes, USHORT byteAmount)
 {
-	g_Disasm = { NULL };
+	return pContext->End &&
+		(pBytes >= pContext->End || (SIZE_T) (pContext->End - pBytes) < byteAmount);
 }
 
 /*
-Initialize the current instruction struct.
+Read a byte that follows the IP, without advancing.
+@param offset is the offset of the byte from the IP, or 0 by default.
+@return the byte, or 0 if it lies beyond the end of a bounded buffer.
 */
-void InitializeInstruction()
+BYTE Peek(PDISASSEMBLER_CONTEXT pContext, USHORT offset = 0)
 {
-	g_Disasm.Instruction = { g_Disasm.Ip, 0, FALSE, FALSE, 0, FALSE };
+	if (IsBeyondEnd(pContext, pContext->Ip + offset, 1))
+	{
+		Truncate(pContext, pContext->Ip + offset + 1);
+		return 0;
+	}
+
+	return pContext->Ip[offset];
 }
 
 /*
 Advance to the next X bytes.
 @param byteAmount is the amount of bytes to advance, or 1 by default.
-@return the IP before the advancement.
+@return the IP before the advancement, or zeros if the bytes lie beyond the end of a bounded buffer.
 */
-PBYTE Advance(USHORT byteAmount = 1)
+PBYTE Advance(PDISASSEMBLER_CONTEXT pContext, USHORT byteAmount = 1)
 {
 	/* Increment the instruction's size */
-	g_Disasm.Instruction.Size += byteAmount;
+	pContext->Instruction.Size += byteAmount;
 	/* Save current IP */
-	PBYTE ip = g_Disasm.Ip;
+	PBYTE ip = pContext->Ip;
 	/* Increment IP */
-	g_Disasm.Ip += byteAmount;
-	/* Return unincremented IP */
-	return ip;
-}
-
-/*
-Write given bytes to the replicate.
-@param pBytes is the buffer of bytes to be written.
-@param byteAmount is the amount of bytes to be written.
-*/
-void Replicate(PBYTE pBytes, USHORT byteAmount)
-{
-	/* Exit function if replication is disabled */
-	if (!g_Rep.bEnabled)
-		return;
+	pContext->Ip += byteAmount;
 
-	/* If buffer is too small for the bytes */
-	if (g_Rep.Ip + byteAmount > g_Rep.Buffer + g_Rep.BufferSize)
+	/* Bytes beyond the end of a bounded buffer are never read */
+	if (IsBeyondEnd(pContext, ip, byteAmount))
 	{
-		/* Extend buffer through reallocation */
-		g_Rep.BufferSize = max(g_Rep.BufferSize * 2, g_Rep.BufferSize + byteAmount * 2);
-
-		/* Temporarily save previous buffer */
-		PBYTE prevBuffer = g_Rep.Buffer;
-		/* Reallocate extended buffer */
-		do
-			g_Rep.Buffer = (PBYTE) realloc(prevBuffer, g_Rep.BufferSize);
-		while (!g_Rep.Buffer);
+		Truncate(pContext, pContext->Ip);
+		return pContext->Overflow;
 	}
 
-	/* Copy given bytes to the replicate buffer */
-	memcpy_s(g_Rep.Ip, byteAmount, pBytes, byteAmount);
-	/* Increment replicate's IP */
-	g_Rep.Ip += byteAmount;
-}
-
-/*
-Advance both the disassembler & the replicate.
-Copys the advanced bytes to the replicate.
-@param byteAmount is the amount of bytes to advance.
-@return the IP before the advancement.
-*/
-PBYTE AdvanceAndRep(USHORT byteAmount = 1)
-{
-	Replicate(g_Disasm.Ip, byteAmount);
-	return Advance(byteAmount);
+	/* Return unincremented IP */
+	return ip;
 }
 
 /*
 @return whether current byte is a prefix or not.
 */
-bool IsPrefix()
+bool IsPrefix(PDISASSEMBLER_CONTEXT pContext)
 {
-	BYTE current = *g_Disasm.Ip;
-
-	/* Iterate over all prefix bytes in cache */
-	for (BYTE prefix : g_PrefixCache)
-	{
-		/* If prefix matchs current byte, return true */
-		if (prefix == current)
-			return TRUE;
-	}
-
-	/* Return false, we found no prefix byte */
-	return FALSE;
+	return g_PrefixTable.Classes[Peek(pContext)] != PREFIX_NONE;
 }
 
 /*
 Parse all following prefixes, if there are any.
 */
-void ParsePrefixes()
+void ParsePrefixes(PDISASSEMBLER_CONTEXT pContext)
 {
 	USHORT maxPrefixes = MAX_PREFIXES;
 	/*
 	There can only be MAX_PREFIXES prefixes.
 	Once current byte isn't a prefix, the following bytes won't be prefixes as well.
 	*/
-	while (maxPrefixes-- && IsPrefix())
+	while (maxPrefixes-- && IsPrefix(pContext))
 	{
 		/* Get prefix & advance to next byte */
-		BYTE prefix = *AdvanceAndRep();
+		BYTE prefix = *Advance(pContext);
+
+		/* Record the prefix within the instruction's prefix flags */
+		switch (g_PrefixTable.Classes[prefix])
+		{
+		case PREFIX_LOCK_REP:
+			pContext->Instruction.Prefixes |= prefix == LOCK_PREFIX ? PREFIX_FLAG_LOCK : prefix == REPNE_PREFIX ? PREFIX_FLAG_REPNE : PREFIX_FLAG_REP;
+			break;
+		case PREFIX_SEGMENT:
+			pContext->Instruction.Prefixes |= PREFIX_FLAG_SEGMENT;
+			break;
+		case PREFIX_OPERAND_SIZE:
+			pContext->Instruction.Prefixes |= PREFIX_FLAG_OPERAND_SIZE;
+			break;
+		case PREFIX_ADDRESS_SIZE:
+			pContext->Instruction.Prefixes |= PREFIX_FLAG_ADDRESS_SIZE;
+			break;
+		case PREFIX_NONE:
+			/* Never reached, as only prefixes are consumed here */
+			break;
+		}
 
 		/* If current prefix byte is the opreand-size-override prefix */
 		if (prefix == OPERAND_SIZE_OVERRIDE_PREFIX /* 0x66 */)
 			/* Mark the instruction */
-			g_Disasm.Instruction.bOperandSizeOverride = TRUE;
+			pContext->Instruction.bOperandSizeOverride = TRUE;
+
+		/* If current prefix byte is the address-size-override prefix */
+		if (prefix == ADDRESS_SIZE_OVERRIDE_PREFIX /* 0x67 */)
+			/* Mark the instruction */
+			pContext->Instruction.bAddressSizeOverride = TRUE;
 
 		/* Increment instruction's prefix amount */
-		g_Disasm.Instruction.PrefixAmount++;
+		pContext->Instruction.PrefixAmount++;
+	}
+
+	/* In 64-bit mode, a REX prefix may follow the legacy prefixes, immediately preceding the opcode */
+	if (pContext->Mode == DISASM_MODE_64 &&
+		(Peek(pContext) & REX_PREFIX_MASK) == REX_PREFIX /* 0100WRXB */)
+	{
+		pContext->Instruction.Rex = *Advance(pContext);
+		pContext->Instruction.Prefixes |= PREFIX_FLAG_REX;
+		pContext->Instruction.PrefixAmount++;
 	}
 }
 
 /*
 Consume SIB byte if we haven't already.
 */
-void AddSIB()
+void AddSIB(PDISASSEMBLER_CONTEXT pContext)
 {
-	if (g_Disasm.Instruction.bSib)
+	if (pContext->Instruction.bSib)
 		return;
 
-	g_Disasm.Instruction.bSib = TRUE;
-	AdvanceAndRep();
+	pContext->Instruction.bSib = TRUE;
+	pContext->Instruction.Sib = *Advance(pContext);
+}
+
+/*
+Parse ModRM byte of current instruction, with 16-bit addressing (i.e. under the address-size-override prefix).
+16-bit addressing never uses a SIB byte, and its displacements are at most 16-bit.
+*/
+void ParseModRM16(PDISASSEMBLER_CONTEXT pContext)
+{
+	const PMOD_REG_RM pModRM = (const PMOD_REG_RM) &pContext->Instruction.ModRM;
+
+	switch (pModRM->Mod)
+	{
+	case MOD_DISP8:
+		/* If we're in 8-bit displacement mode, consume 1 byte (8 bits) */
+		pContext->Instruction.pDisplacement = Advance(pContext);
+		pContext->Instruction.DisplacementSize = BYTE_SIZE;
+		break;
+
+	case MOD_NODISP:
+		if (pModRM->Rm != RM_SI /* 110b */)
+			break;
+		/* If we're in no-displacement mode & RM specifies SI, we have a 16-bit displacement-only instruction */
+	case MOD_DISP32:
+		/* If we're in 16-bit displacement mode, consume 2 bytes (16 bits) */
+		pContext->Instruction.pDisplacement = Advance(pContext, WORD_SIZE);
+		pContext->Instruction.DisplacementSize = WORD_SIZE;
+		break;
+
+	case MOD_REG:
+		/* Reg-to-Reg instructions don't have a displacement */
+		break;
+	}
 }
 
 /*
 Parse ModRM byte of current instruction.
 */
-void ParseModRM()
+void ParseModRM(PDISASSEMBLER_CONTEXT pContext)
 {
-	/* Create pointer to MOD_REG_RM struct, which is the byte after the opcode (the opcode comes after all prefixes) */
-	const PMOD_REG_RM pModRM = (const PMOD_REG_RM) (g_Disasm.Instruction.Start + g_Disasm.Instruction.PrefixAmount + 1);
+	/* Create pointer to MOD_REG_RM struct, from the ModRM byte that was consumed after the opcode */
+	const PMOD_REG_RM pModRM = (const PMOD_REG_RM) &pContext->Instruction.ModRM;
+	/* Create pointer to SIB struct, which is only valid once the SIB byte is consumed */
+	const PSIB pSib = (const PSIB) &pContext->Instruction.Sib;
+
+	/* The address-size-override prefix switches to 16-bit addressing (in 64-bit mode, it switches to 32-bit addressing) */
+	if (pContext->Instruction.bAddressSizeOverride &&
+		pContext->Mode == DISASM_MODE_32)
+	{
+		ParseModRM16(pContext);
+		return;
+	}
 
 	/* If RM specifies the SP register, and the instruction isn't Reg-to-Reg, we have a SIB */
 	if (pModRM->Rm == RM_SP /* 100b */ &&
 		pModRM->Mod != MOD_REG)
-		AddSIB();
+		AddSIB(pContext);
 
 	switch (pModRM->Mod)
 	{
 	case MOD_DISP8:
 		/* If we're in 8-bit displacement mode, consume 1 byte (8 bits) */
-		AdvanceAndRep();
+		pContext->Instruction.pDisplacement = Advance(pContext);
+		pContext->Instruction.DisplacementSize = BYTE_SIZE;
 		break;
 
 	case MOD_NODISP:
-		if (pModRM->Rm != RM_BP /* 101b */)
+		if (pModRM->Rm != RM_BP /* 101b */ &&
+			!(pContext->Instruction.bSib && pSib->Base == BASE::BASE_BP /* 101b */))
 			break;
-		/* If we're in no-displacement mode & RM specifies BP, we have a 32-bit displacement-only instruction */
+		/*
+		If we're in no-displacement mode & RM specifies BP, we have a 32-bit displacement-only instruction.
+		If SIB's Base specifies BP instead, we have a SIB without a base register, but with a 32-bit displacement.
+		In 64-bit mode, a displacement-only instruction (without SIB) is RIP-relative instead.
+		*/
+		if (pContext->Mode == DISASM_MODE_64 &&
+			pModRM->Rm == RM_BP /* 101b */)
+			pContext->Instruction.bRipRelative = TRUE;
 	case MOD_DISP32:
 		/* If we're in 32-bit displacement mode, consume 4 bytes (32 bits) */
-		AdvanceAndRep(4);
+		pContext->Instruction.pDisplacement = Advance(pContext, DWORD_SIZE);
+		pContext->Instruction.DisplacementSize = DWORD_SIZE;
+		break;
+
+	case MOD_REG:
+		/* Reg-to-Reg instructions don't have a displacement */
 		break;
 	}
 }
@@ -277,234 +328,263 @@ void ParseModRM()
 /*
 Add ModRM byte, if it hasn't already been added.
 This function also makes sure the ModRM byte is parsed.
+@param bRegisterOnly describes whether the ModRM byte always specifies a register (e.g. MOV Rd, Cd), regardless of its Mod field.
 */
-void AddModRM()
+void AddModRM(PDISASSEMBLER_CONTEXT pContext, BOOL bRegisterOnly)
 {
-	if (g_Disasm.Instruction.bModRM)
+	if (pContext->Instruction.bModRM)
 		return;
 
-	g_Disasm.Instruction.bModRM = TRUE;
-	AdvanceAndRep();
+	pContext->Instruction.bModRM = TRUE;
+	pContext->Instruction.pModRM = Advance(pContext);
+	pContext->Instruction.ModRM = *pContext->Instruction.pModRM;
 
-	ParseModRM();
+	/* A register-only ModRM byte is never followed by a SIB byte or a displacement */
+	if (bRegisterOnly)
+		return;
+
+	ParseModRM(pContext);
 }
 
 /*
-Check if the operand descriptor specifies usage of a ModRM byte.
-@param pOperand is the operand to be checked.
-@return whether given operand uses ModRM or not.
+@return the operand-size of current instruction, considering its prefixes.
 */
-bool IsModRM(const OPERAND_DESCRIPTOR *pOperand)
+OPERAND_SIZE InstructionOperandSize(PDISASSEMBLER_CONTEXT pContext)
 {
-	/* Iterate over all Operand Addressing Methods that are known to use ModRM */
-	for (ADDRESSING_METHOD addrMethod : g_UsesModRM)
-		/* If operand's Addressing Method matches, it uses ModRM */
-		if (addrMethod == pOperand->AddressingMethod)
-			return TRUE;
+	/* REX.W takes precedence over the operand-size-override prefix */
+	if (pContext->Instruction.Rex & REX_W)
+		return OPSIZE_64;
 
-	return FALSE;
+	return pContext->Instruction.bOperandSizeOverride ? OPSIZE_16 : OPSIZE_32;
 }
 
 /*
-Check if the operand descriptor specifies usage of an immediate operand.
-@param pOperand is the operand to be checked.
-@return whether given operand is immediate or not.
+@return the size of a memory offset (moffs) within current instruction, which depends on the address-size.
 */
-bool IsImm(const OPERAND_DESCRIPTOR *pOperand)
+USHORT MoffsSize(PDISASSEMBLER_CONTEXT pContext)
 {
-	/* Iterate over all Operand Addressing Methods that are known to use immediates */
-	for (ADDRESSING_METHOD addrMethod : g_UsesImm)
-		/* If operand's Addressing Method matches, it is immediate */
-		if (addrMethod == pOperand->AddressingMethod)
-			return TRUE;
+	if (pContext->Mode == DISASM_MODE_64)
+		return pContext->Instruction.bAddressSizeOverride ? DWORD_SIZE : QWORD_SIZE;
 
-	return FALSE;
+	return pContext->Instruction.bAddressSizeOverride ? WORD_SIZE : DWORD_SIZE;
 }
 
 /*
-Calculates size of operand, considering prefixes as well.
-@param pOperad, the operand to be checked.
-@return size of given operand, in bytes.
+@return whether current byte is a VEX or EVEX prefix, rather than LES, LDS or BOUND.
 */
-USHORT OperandSize(const OPERAND_DESCRIPTOR *pOperand)
+bool IsVexPrefix(PDISASSEMBLER_CONTEXT pContext)
 {
-	bool operandSizeOverride = g_Disasm.Instruction.bOperandSizeOverride;
+	BYTE prefix = Peek(pContext);
 
-	/* Addressing Method of O disregards the Operand Type attribute */
-	if (pOperand->AddressingMethod == O)
-		return operandSizeOverride ? WORD_SIZE : DWORD_SIZE;
+	if (prefix != VEX2_PREFIX && prefix != VEX3_PREFIX && prefix != EVEX_PREFIX)
+		return false;
 
-	/*
-	Return size depending on the Operand Type.
-	Some types are affected by the operand-size-override prefix.
-	*/
-	switch (pOperand->OperandType)
-	{
-	case b:
-		return BYTE_SIZE;
-	case c:
-		return operandSizeOverride ? BYTE_SIZE : WORD_SIZE;
-	case d:
-		return DWORD_SIZE;
-	case p:
-		return WORD_SIZE /* pointer prefix */ + (operandSizeOverride ? WORD_SIZE : DWORD_SIZE) /* pointer suffix */;
-	case v:
-		return operandSizeOverride ? WORD_SIZE : DWORD_SIZE;
-	case w:
-		return WORD_SIZE;
-	case z:
-		return operandSizeOverride ? WORD_SIZE : DWORD_SIZE;
-	}
+	/* LES, LDS & BOUND don't exist in 64-bit mode */
+	if (pContext->Mode == DISASM_MODE_64)
+		return true;
 
-	/* If no match found, throw error */
-	printf("***Unrecognized Operand: %d***\n", pOperand->OperandType);
-	exit(1);
-	return 0;
+	/* In 32-bit mode, LES, LDS & BOUND only take a memory operand, so a Mod field of 11b can only be a VEX or EVEX payload */
+	return (Peek(pContext, 1) & VEX_MODE_MASK) == VEX_MODE_MASK;
 }
 
 /*
-Checks how many bytes are required to represent signed number.
-@return minimum amount of bytes required to represent number.
+Translates the opcode map implied by a VEX or EVEX prefix into an Opcode Map.
+@param vexMap, the map field of the prefix (VEX_MAP).
+@return the Opcode Map whose opcodes are used.
 */
-USHORT RequiredBytes(int64_t number)
+OPCODE_MAP VexOpcodeMap(BYTE vexMap)
 {
-	if (number == (int8_t) (number & 0xFF))
-		return BYTE_SIZE;
-
-	if (number == (int16_t) (number & 0xFFFF))
-		return WORD_SIZE;
-
-	if (number == (int32_t) (number & 0xFFFFFFFF))
-		return DWORD_SIZE;
-
-	return QWORD_SIZE;
+	switch (vexMap)
+	{
+	case VEX_MAP_0F:
+		return OPMAP_0F;
+	case VEX_MAP_0F3A:
+		return OPMAP_0F3A;
+	default:
+		/*
+		The 0F 38 map, as well as EVEX maps 5 & 6, have a ModRM byte & no immediate for every opcode.
+		Reserved maps are undefined, so they're decoded the same.
+		*/
+		return OPMAP_0F38;
+	}
 }
 
 /*
-Replicates a Relative Address & patches it, so it's valid and working from the replicated buffer.
-This function is called when the IP points at a Relative Address operand.
+Consume the VEX or EVEX prefix of current instruction.
+The prefix replaces the escape bytes, so it implies the opcode map of the instruction.
+@return the Opcode Map implied by the prefix.
 */
-void ReplicateRA(USHORT operandSize)
+OPCODE_MAP ParseVexPrefix(PDISASSEMBLER_CONTEXT pContext)
 {
-	/*
-	TODO: Before offsetting relative address, check if we're jumping outside replicated bytes.
-	If the address we're jumping to is also replicated, we shouldn't offset the address.
-	This is difficult right now, because we need to know the size of the entire instruction to calculate the address we're jumping to.
-	*/
-
-	if (!g_Rep.bEnabled)
-		return;
+	OPCODE_MAP map;
 
-	/* First, calculate the offset from the replicate's IP to the original IP */
-	int32_t fixedRa = g_Disasm.Ip - g_Rep.Ip;;
-
-	/* Add to the offset the actual Relative Address */
-	switch(operandSize)
+	switch (Peek(pContext))
 	{
-	case BYTE_SIZE:
-		fixedRa += *(int8_t *) g_Disasm.Ip;
+	case VEX2_PREFIX:
+	{
+		PBYTE pPrefix = Advance(pContext, VEX2_SIZE);
+		const PVEX2_PAYLOAD pPayload = (const PVEX2_PAYLOAD) &pPrefix[1];
+		pContext->Instruction.Encoding = ENCODING_VEX2;
+		/* The two-byte VEX prefix always implies the 0F map */
+		map = OPMAP_0F;
+		pContext->Instruction.VectorLength = pPayload->L ? YMMWORD_SIZE : XMMWORD_SIZE;
 		break;
+	}
 
-	case WORD_SIZE:
-		fixedRa += *(int16_t *) g_Disasm.Ip;
+	case VEX3_PREFIX:
+	{
+		PBYTE pPrefix = Advance(pContext, VEX3_SIZE);
+		const PVEX3_PAYLOAD0 pPayload0 = (const PVEX3_PAYLOAD0) &pPrefix[1];
+		const PVEX3_PAYLOAD1 pPayload1 = (const PVEX3_PAYLOAD1) &pPrefix[2];
+		pContext->Instruction.Encoding = ENCODING_VEX3;
+		map = VexOpcodeMap(pPayload0->Mmmmm);
+		pContext->Instruction.bVexW = pPayload1->W;
+		pContext->Instruction.VectorLength = pPayload1->L ? YMMWORD_SIZE : XMMWORD_SIZE;
 		break;
+	}
 
-	case DWORD_SIZE:
-		fixedRa += *(int32_t *) g_Disasm.Ip;
-		break;
+	default /* EVEX_PREFIX */:
+	{
+		PBYTE pPrefix = Advance(pContext, EVEX_SIZE);
+		const PEVEX_PAYLOAD0 pPayload0 = (const PEVEX_PAYLOAD0) &pPrefix[1];
+		const PEVEX_PAYLOAD1 pPayload1 = (const PEVEX_PAYLOAD1) &pPrefix[2];
+		const PEVEX_PAYLOAD2 pPayload2 = (const PEVEX_PAYLOAD2) &pPrefix[3];
+		pContext->Instruction.Encoding = ENCODING_EVEX;
+		map = VexOpcodeMap(pPayload0->Mmm);
+		pContext->Instruction.bVexW = pPayload1->W;
+		pContext->Instruction.VectorLength = XMMWORD_SIZE << pPayload2->LL;
 
-	default:
-		printf("Unsupported Relative-Address Operand Size: %d\n", operandSize);
-		exit(1);
+		/*
+		8-bit displacements are scaled by the size of the memory operand (disp8*N).
+		The exact N depends on the instruction's tuple type; we use the full-vector tuple, which covers most instructions:
+		the size of a broadcast element, or the entire vector otherwise.
+		*/
+		if (pPayload2->Broadcast)
+			pContext->Instruction.Disp8Scale = pPayload1->W ? QWORD_SIZE : DWORD_SIZE;
+		else
+			pContext->Instruction.Disp8Scale = pContext->Instruction.VectorLength;
 		break;
 	}
-
-	/*
-	If the amount of bytes required to represent the relative address are larger than the operand's size,
-	we are unable to save the relative offset. This will actually probably never happen, as assemblers
-	automatically use the E9 opcode (which takes a DWORD as parameter), rather than EB for example (which takes a BYTE as parameter).
-	*/
-	if (RequiredBytes(fixedRa) > operandSize)
-	{
-		printf("**** JMP is too large for given operand size. ****\n");
-		exit(1);
 	}
 
-	/* Write to the replicate the new offseted Relative Address */
-	Replicate((PBYTE) &fixedRa, operandSize);
+	/* The prefix counts as a single prefix */
+	pContext->Instruction.PrefixAmount++;
+	return map;
 }
 
 /*
-Parse an operand.
+Consume the opcode of current instruction, along with any escape bytes (or VEX & EVEX prefixes) that precede it.
 */
-void ParseOperand(const OPERAND_DESCRIPTOR *pOperand)
+void ParseOpcode(PDISASSEMBLER_CONTEXT pContext)
 {
-	/* If operand uses ModRM byte, parse it */
-	if (IsModRM(pOperand))
-		AddModRM();
+	/* VEX & EVEX prefixes imply the opcode map, and are directly followed by the opcode */
+	if (IsVexPrefix(pContext))
+	{
+		pContext->Instruction.Map = ParseVexPrefix(pContext);
+		pContext->Instruction.Opcode = *Advance(pContext);
+		return;
+	}
 
-	/* If operand is immediate, parse it */
-	if (IsImm(pOperand))
+	OPCODE_MAP map = OPMAP_1BYTE;
+	BYTE opcode = *Advance(pContext);
+
+	/* The 0F escape byte leads to the two-byte opcode map */
+	if (opcode == ESCAPE_0F)
 	{
-		USHORT operandSize = OperandSize(pOperand);
+		map = OPMAP_0F;
+		opcode = *Advance(pContext);
 
-		/* If operand is a Relative Address */
-		if (pOperand->AddressingMethod == J)
-		{
-			/* Replicate the Relative Address properly */
-			ReplicateRA(operandSize);
-			Advance(operandSize);
-		}
-		else
+		/* Within the two-byte opcode map, 38 & 3A lead to the three-byte opcode maps */
+		if (opcode == ESCAPE_0F38 || opcode == ESCAPE_0F3A)
 		{
-			AdvanceAndRep(operandSize);
+			map = opcode == ESCAPE_0F38 ? OPMAP_0F38 : OPMAP_0F3A;
+			opcode = *Advance(pContext);
 		}
 	}
+
+	pContext->Instruction.Map = map;
+	pContext->Instruction.Opcode = opcode;
 }
 
 /*
-Parse all operands of an opcode.
-@param opcode is the opcode to be parsed.
+Parse all operands of current instruction's opcode.
+Operands are parsed through the opcode's flat properties, rather than its Opcode Descriptor.
 */
-void ParseOperands(BYTE opcode)
+void ParseOperands(PDISASSEMBLER_CONTEXT pContext)
 {
-	/* Get Opcode Descriptor from the Opcode Map */
-	const OPCODE_DESCRIPTOR *pOpcodeEntry = &g_OpcodeMap[opcode];
-	/* Iterate over all operands in the descriptor */
-	for (USHORT i = 0; i < pOpcodeEntry->OperandAmount; i++)
-		/* Parse operand */
-		ParseOperand(&pOpcodeEntry->Operands[i]);
+	/* Get Opcode Properties from the Opcode Table of the opcode's map */
+	const OPCODE_PROPERTIES *pProperties = &g_OpcodeTables[pContext->Instruction.Map].Entries[pContext->Instruction.Opcode];
+
+	/* If opcode uses ModRM byte, parse it */
+	if (pProperties->Flags & OPF_MODRM)
+		AddModRM(pContext, pProperties->Flags & OPF_MODRM_REGISTER);
+
+	/* If opcode belongs to an Opcode Extension Group, its operands depend on the Reg field */
+	if (pProperties->Flags & OPF_GROUP)
+	{
+		const PMOD_REG_RM pModRM = (const PMOD_REG_RM) &pContext->Instruction.ModRM;
+		pProperties = &g_GroupTable.Entries[pProperties->Group][pModRM->Reg];
+	}
+
+	/* Size of all immediate operands, which depends on the operand-size */
+	OPERAND_SIZE operandSize = InstructionOperandSize(pContext);
+
+	/* In 64-bit mode, Relative Addresses are always 32-bit (or 8-bit), regardless of the operand-size-override prefix */
+	if (pContext->Mode == DISASM_MODE_64 &&
+		(pProperties->Flags & OPF_RELATIVE))
+		operandSize = OPSIZE_32;
+
+	USHORT immSize = pProperties->ImmSize[operandSize];
+
+	/* Size of a memory offset depends on the address-size */
+	if (pProperties->Flags & OPF_MOFFS)
+		immSize += MoffsSize(pContext);
+
+	/* If opcode has no immediate operands, we're done */
+	if (!immSize)
+		return;
+
+	pContext->Instruction.pImmediate = pContext->Ip;
+	pContext->Instruction.ImmediateSize = (BYTE) immSize;
+
+	/* If operand is a Relative Address */
+	if (pProperties->Flags & OPF_RELATIVE)
+		pContext->Instruction.bRelative = TRUE;
+
+	Advance(pContext, immSize);
 }
 
 /*
 Parse entire instruction.
 */
-void ParseInstruction()
+void ParseInstruction(PDISASSEMBLER_CONTEXT pContext)
 {
 	/* Initialize instruction struct */
-	InitializeInstruction();
+	InitializeInstruction(pContext);
 	/* Parse prefix bytes */
-	ParsePrefixes();
+	ParsePrefixes(pContext);
 	/* Consume opcode */
-	PBYTE pOpcode = AdvanceAndRep();
+	ParseOpcode(pContext);
 	/* Parse all opcode operands */
-	ParseOperands(*pOpcode);
+	ParseOperands(pContext);
 }
 
 /*
-Disassemble & replicate given bytes of machine code.
-@param buffer is the buffer of machine code that'll be disassembled & replicated.
+Disassemble given bytes of machine code.
+Relocating the instructions to another address is up to the Relocator (see Relocator.h).
+@param pContext is the disassembler context to run in.
+@param buffer is the buffer of machine code that'll be disassembled.
 @param requiredBytes is the amount of bytes we want.
 The disassembler will return the minimum size of complete instructions, which is greater than this value.
 @return minimum size of complete instructions, which is greater than the required amount of bytes.
 */
-SIZE_T Disassembler::Run(PBYTE buffer, SIZE_T requiredBytes)
+SIZE_T Disassembler::Run(PDISASSEMBLER_CONTEXT pContext, PBYTE buffer, SIZE_T requiredBytes)
 {
 	/* Initialize the disassembler */
-	InitializeDisassembler();
-	g_Disasm.Buffer = buffer;
-	g_Disasm.RequiredBytes = requiredBytes;
-	g_Disasm.Ip = buffer;
+	InitializeDisassembler(pContext);
+	pContext->Buffer = buffer;
+	pContext->RequiredBytes = requiredBytes;
+	pContext->Ip = buffer;
 
 	/* Initialize the instruction size */
 	SIZE_T instrBytes = 0;
@@ -512,15 +592,828 @@ SIZE_T Disassembler::Run(PBYTE buffer, SIZE_T requiredBytes)
 	while (instrBytes < requiredBytes)
 	{
 		/* Parse next instruction */
-		ParseInstruction();
+		ParseInstruction(pContext);
 		/* Add the parseed instruction's size */
-		instrBytes += g_Disasm.Instruction.Size;
+		instrBytes += pContext->Instruction.Size;
 	}
 
-	/* If replication is enabeld */
-	if (g_Rep.bEnabled)
-		/* Update amount of written bytes */
-		*g_Rep.pReplicatedAmount = g_Rep.Ip - g_Rep.Buffer;
-
 	return instrBytes;
 }
+
+/*
+Classifies the control transfer current instruction performs.
+@return the instruction's branch kind (BRANCH_KIND).
+*/
+BRANCH_KIND ClassifyBranch(PDISASSEMBLER_CONTEXT pContext)
+{
+	BYTE opcode = pContext->Instruction.Opcode;
+
+	/* Relative branches are identified by their Relative Address */
+	if (pContext->Instruction.bRelative)
+	{
+		if (pContext->Instruction.Map != OPMAP_1BYTE)
+			return BRANCH_JCC;
+
+		switch (opcode)
+		{
+		case 0xE8:
+			return BRANCH_CALL;
+		case 0xE9:
+		case 0xEB:
+			return BRANCH_JMP;
+		default:
+			/* Jcc, LOOPcc, JrCXZ & XBEGIN */
+			return BRANCH_JCC;
+		}
+	}
+
+	if (pContext->Instruction.Map != OPMAP_1BYTE ||
+		pContext->Instruction.Encoding != ENCODING_LEGACY)
+		return BRANCH_NONE;
+
+	const PMOD_REG_RM pModRM = (const PMOD_REG_RM) &pContext->Instruction.ModRM;
+
+	switch (opcode)
+	{
+	case 0xC2: /* RET Iw */
+	case 0xC3: /* RET */
+	case 0xCA: /* RETF Iw */
+	case 0xCB: /* RETF */
+	case 0xCF: /* IRET */
+		return BRANCH_RET;
+	case 0x9A: /* CALLF Ap */
+		return BRANCH_CALL_INDIRECT;
+	case 0xEA: /* JMPF Ap */
+		return BRANCH_JMP_INDIRECT;
+	case 0xFF:
+		/* Group 5, where Reg specifies the operation */
+		if (pModRM->Reg == REG_D /* CALL Ev */ || pModRM->Reg == REG_B /* CALLF Mp */)
+			return BRANCH_CALL_INDIRECT;
+		if (pModRM->Reg == REG_SP /* JMP Ev */ || pModRM->Reg == REG_BP /* JMPF Mp */)
+			return BRANCH_JMP_INDIRECT;
+		return BRANCH_NONE;
+	default:
+		return BRANCH_NONE;
+	}
+}
+
+/*
+Reads a signed value of given size.
+@param pValue, pointer to the value.
+@param size, the value's size, in bytes.
+@return the sign-extended value.
+*/
+int64_t ReadSigned(PBYTE pValue, USHORT size)
+{
+	switch (size)
+	{
+	case BYTE_SIZE:
+		return *(int8_t *) pValue;
+	case WORD_SIZE:
+		return *(int16_t *) pValue;
+	case DWORD_SIZE:
+		return *(int32_t *) pValue;
+	default:
+		return *(int64_t *) pValue;
+	}
+}
+
+/*
+Initialize an iterator over the instructions of a code range.
+@param pIterator is the iterator to be initialized.
+@param buffer is the code range to be iterated.
+@param size is the size of the code range, in bytes.
+@param mode is the mode the code is decoded in.
+*/
+void Disassembler::InitializeIterator(PINSTRUCTION_ITERATOR pIterator, PBYTE buffer, SIZE_T size, DISASSEMBLER_MODE mode)
+{
+	InitializeContext(&pIterator->Context);
+	pIterator->Context.Mode = mode;
+	pIterator->Buffer = buffer;
+	pIterator->Size = size;
+	pIterator->Offset = 0;
+}
+
+/*
+Describe current instruction through a decoded instruction struct.
+@param pContext is the context the instruction was decoded in.
+@param pAddress is the address the instruction is executed from, which branch targets are relative to.
+@param offset is the offset of the instruction from the beginning of the decoded code.
+@param pInstruction receives the decoded instruction.
+*/
+void DescribeInstruction(PDISASSEMBLER_CONTEXT pContext, PBYTE pAddress, SIZE_T offset, OUT PDECODED_INSTRUCTION pInstruction)
+{
+	const DISASSEMBLER_CONTEXT::_INSTRUCTION &instruction = pContext->Instruction;
+	PBYTE pStart = instruction.Start;
+
+	*pInstruction = { };
+	pInstruction->Offset = (DWORD) offset;
+	pInstruction->Size = (BYTE) instruction.Size;
+	pInstruction->Prefixes = instruction.Prefixes;
+	pInstruction->Rex = instruction.Rex;
+	pInstruction->Encoding = instruction.Encoding;
+	pInstruction->Map = instruction.Map;
+	pInstruction->Opcode = instruction.Opcode;
+	pInstruction->BranchKind = ClassifyBranch(pContext);
+	pInstruction->bRipRelative = (BYTE) instruction.bRipRelative;
+
+	if (instruction.bModRM)
+		pInstruction->ModRMOffset = (BYTE) (instruction.pModRM - pStart);
+
+	if (instruction.bSib)
+		pInstruction->SibOffset = pInstruction->ModRMOffset + 1;
+
+	if (instruction.DisplacementSize)
+	{
+		pInstruction->DisplacementOffset = (BYTE) (instruction.pDisplacement - pStart);
+		pInstruction->DisplacementSize = instruction.DisplacementSize;
+	}
+
+	if (instruction.ImmediateSize)
+	{
+		pInstruction->ImmediateOffset = (BYTE) (instruction.pImmediate - pStart);
+		pInstruction->ImmediateSize = instruction.ImmediateSize;
+	}
+
+	/* Relative branches & RIP-relative addresses are relative to the end of the instruction */
+	PBYTE pEnd = pAddress + instruction.Size;
+
+	if (instruction.bRelative)
+		pInstruction->Target = pEnd + ReadSigned(instruction.pImmediate, instruction.ImmediateSize);
+	else if (instruction.bRipRelative)
+		pInstruction->Target = pEnd + ReadSigned(instruction.pDisplacement, DWORD_SIZE);
+}
+
+/*
+Decode a single instruction from a bounded buffer.
+@param pContext is the context to decode in.
+@param ip is the beginning of the instruction.
+@param end is the end of the buffer.
+@return whether the instruction is complete, i.e. it isn't truncated by the end of the buffer.
+*/
+bool ParseBoundedInstruction(PDISASSEMBLER_CONTEXT pContext, PBYTE ip, PBYTE end)
+{
+	InitializeDisassembler(pContext);
+	pContext->Buffer = ip;
+	pContext->Ip = ip;
+	pContext->End = end;
+	ParseInstruction(pContext);
+
+	return !pContext->Instruction.bTruncated;
+}
+
+/*
+Decode the next instruction of the code range.
+@param pIterator is the iterator to advance.
+@param pInstruction receives the decoded instruction.
+@return TRUE if an instruction was decoded, FALSE once the code range ends (or its last instruction is truncated).
+*/
+BOOL Disassembler::NextInstruction(PINSTRUCTION_ITERATOR pIterator, OUT PDECODED_INSTRUCTION pInstruction)
+{
+	PDISASSEMBLER_CONTEXT pContext = &pIterator->Context;
+
+	if (pIterator->Offset >= pIterator->Size)
+		return FALSE;
+
+	/* A truncated instruction ends the code range */
+	PBYTE pStart = pIterator->Buffer + pIterator->Offset;
+	if (!ParseBoundedInstruction(pContext, pStart, pIterator->Buffer + pIterator->Size))
+		return FALSE;
+
+	DescribeInstruction(pContext, pStart, pIterator->Offset, pInstruction);
+	pIterator->Offset += pContext->Instruction.Size;
+	return TRUE;
+}
+
+/*
+Initialize a decoder of a code stream.
+@param pDecoder is the decoder to be initialized.
+@param mode is the mode the code is decoded in.
+@param baseAddress is the address the stream's first byte is executed from.
+*/
+void Disassembler::InitializeStream(PSTREAM_DECODER pDecoder, DISASSEMBLER_MODE mode, ULONG_PTR baseAddress)
+{
+	InitializeContext(&pDecoder->Context);
+	pDecoder->Context.Mode = mode;
+	pDecoder->BaseAddress = baseAddress;
+	pDecoder->StreamOffset = 0;
+	pDecoder->Chunk = NULL;
+	pDecoder->ChunkSize = 0;
+	pDecoder->ChunkOffset = 0;
+	pDecoder->CarryAmount = 0;
+	pDecoder->NeededBytes = 1;
+}
+
+/*
+Feed the next chunk of the stream, once the previous chunk is exhausted (i.e. STREAM_NEED_MORE was returned).
+The chunk must stay valid until it's exhausted as well.
+@param pDecoder is the decoder to feed.
+@param chunk is the next chunk of the stream.
+@param chunkSize is the size of the chunk, in bytes.
+*/
+void Disassembler::FeedStream(PSTREAM_DECODER pDecoder, PBYTE chunk, SIZE_T chunkSize)
+{
+	pDecoder->Chunk = chunk;
+	pDecoder->ChunkSize = chunkSize;
+	pDecoder->ChunkOffset = 0;
+}
+
+/*
+Decode the next instruction of the stream.
+@param pDecoder is the decoder to advance.
+@param pInstruction receives the decoded instruction, whose Offset is truncated to 32-bits (see the decoder's StreamOffset).
+@return STREAM_INSTRUCTION if an instruction was decoded, STREAM_NEED_MORE once the current chunk is exhausted.
+*/
+STREAM_STATUS Disassembler::NextStreamInstruction(PSTREAM_DECODER pDecoder, OUT PDECODED_INSTRUCTION pInstruction)
+{
+	PDISASSEMBLER_CONTEXT pContext = &pDecoder->Context;
+	PBYTE pAddress = (PBYTE) (pDecoder->BaseAddress + pDecoder->StreamOffset);
+	SIZE_T remaining = pDecoder->ChunkSize - pDecoder->ChunkOffset;
+
+	/*
+	If an instruction is split between chunks, complete it through the carry buffer.
+	Only the split instruction is decoded again, never the instructions before it.
+	*/
+	if (pDecoder->CarryAmount)
+	{
+		SIZE_T carriedAmount = pDecoder->CarryAmount;
+		SIZE_T appendedAmount = min(sizeof(pDecoder->Carry) - carriedAmount, remaining);
+		memcpy_s(pDecoder->Carry + carriedAmount, sizeof(pDecoder->Carry) - carriedAmount,
+			pDecoder->Chunk + pDecoder->ChunkOffset, appendedAmount);
+
+		/* If the instruction is still incomplete, the whole chunk is carried over */
+		if (!ParseBoundedInstruction(pContext, pDecoder->Carry, pDecoder->Carry + carriedAmount + appendedAmount))
+		{
+			pDecoder->CarryAmount += appendedAmount;
+			pDecoder->ChunkOffset += appendedAmount;
+			pDecoder->NeededBytes = pContext->Instruction.MissingBytes;
+			return STREAM_NEED_MORE;
+		}
+
+		/* Only the part of the instruction within the current chunk is consumed from it */
+		pDecoder->ChunkOffset += pContext->Instruction.Size - carriedAmount;
+		pDecoder->CarryAmount = 0;
+	}
+	else
+	{
+		PBYTE pStart = pDecoder->Chunk + pDecoder->ChunkOffset;
+
+		/* If the instruction crosses the end of the chunk, carry its beginning over to the next chunk */
+		if (!remaining || !ParseBoundedInstruction(pContext, pStart, pStart + remaining))
+		{
+			memcpy_s(pDecoder->Carry, sizeof(pDecoder->Carry), pStart, remaining);
+			pDecoder->CarryAmount = remaining;
+			pDecoder->ChunkOffset += remaining;
+			pDecoder->NeededBytes = remaining ? pContext->Instruction.MissingBytes : 1;
+			return STREAM_NEED_MORE;
+		}
+
+		pDecoder->ChunkOffset += pContext->Instruction.Size;
+	}
+
+	DescribeInstruction(pContext, pAddress, (SIZE_T) pDecoder->StreamOffset, pInstruction);
+	pDecoder->StreamOffset += pContext->Instruction.Size;
+	pDecoder->NeededBytes = 0;
+	return STREAM_INSTRUCTION;
+}
+
+/*
+@return the index of the lowest set bit of given non-zero value.
+*/
+unsigned long LowestSetBit(unsigned long value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return index;
+#else
+	return __builtin_ctzl(value);
+#endif
+}
+
+/*
+@return whether the processor supports SSSE3, which the boundary scanner classifies windows with.
+*/
+bool HasSsse3()
+{
+	static const bool bSsse3 = []()
+	{
+#ifdef _MSC_VER
+		int cpuInfo[4];
+		__cpuid(cpuInfo, 1);
+		return (cpuInfo[2] & CPUID_SSSE3) != 0;
+#else
+		unsigned int eax, ebx, ecx, edx;
+		return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & CPUID_SSSE3) != 0;
+#endif
+	}();
+
+	return bSsse3;
+}
+
+/*
+@return whether the processor (& the OS) supports AVX2, which the boundary scanner classifies windows with.
+*/
+bool HasAvx2()
+{
+	static const bool bAvx2 = []()
+	{
+#ifdef _MSC_VER
+		int cpuInfo[4];
+		__cpuid(cpuInfo, 1);
+		if ((cpuInfo[2] & (CPUID_OSXSAVE | CPUID_AVX)) != (CPUID_OSXSAVE | CPUID_AVX) || (_xgetbv(0) & XCR0_YMM_STATE) != XCR0_YMM_STATE)
+			return false;
+
+		__cpuidex(cpuInfo, 7, 0);
+		return (cpuInfo[1] & CPUID_AVX2) != 0;
+#else
+		/* GCC & Clang check the OS support (XCR0) as well */
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}();
+
+	return bAvx2;
+}
+
+/*
+Resolve the instruction set the boundary scanner uses.
+@param requested, the instruction set requested by the context.
+@return the requested instruction set, or the best supported one if it isn't supported (or SCAN_ISA_BEST was requested).
+*/
+SCAN_INSTRUCTION_SET ResolveScanInstructionSet(SCAN_INSTRUCTION_SET requested)
+{
+	SCAN_INSTRUCTION_SET best = HasAvx2() ? SCAN_ISA_AVX2 : HasSsse3() ? SCAN_ISA_SSSE3 : SCAN_ISA_SCALAR;
+	return requested == SCAN_ISA_BEST || requested > best ? best : requested;
+}
+
+/*
+@return whether given byte is an entire instruction on its own.
+*/
+bool IsSingleByteInstruction(const SCAN_TABLE *pTable, BYTE opcode)
+{
+	const SCAN_OPCODE &scanOpcode = pTable->Opcodes[OPMAP_1BYTE][opcode];
+	return scanOpcode.bFast && !scanOpcode.bModRM && !scanOpcode.ImmSize[OPSIZE_32] && !scanOpcode.ImmSize[OPSIZE_16] && !scanOpcode.ImmSize[OPSIZE_64];
+}
+
+/*
+Size the instruction at given IP through the scan table, without fully decoding it.
+Only instructions whose opcode is fast (see SCAN_OPCODE) are sized, along with their legacy & REX prefixes.
+@param pTable, the scan table of the decoded mode.
+@param bMode64, whether the instruction is decoded in 64-bit mode.
+@param ip, pointer to the instruction.
+@return the size of the instruction, or 0 if it must be fully decoded.
+*/
+USHORT FastInstructionSize(const SCAN_TABLE *pTable, bool bMode64, PBYTE ip)
+{
+	PBYTE pByte = ip;
+	OPERAND_SIZE operandSize = OPSIZE_32;
+
+	/*
+	Legacy prefixes, the same amount the decoder consumes (a prefix beyond it is the opcode, which is never fast).
+	Only the operand-size-override prefix affects the size of a fast opcode, except in 32-bit mode,
+	where the address-size-override prefix switches to 16-bit addressing, which is left to the decoder.
+	*/
+	for (SIZE_T i = 0; i < MAX_PREFIXES && g_PrefixTable.Classes[*pByte] != PREFIX_NONE; i++)
+	{
+		PREFIX_CLASS prefixClass = g_PrefixTable.Classes[*pByte++];
+
+		if (prefixClass == PREFIX_OPERAND_SIZE)
+			operandSize = OPSIZE_16;
+		else if (prefixClass == PREFIX_ADDRESS_SIZE && !bMode64)
+			return 0;
+	}
+
+	/* REX prefix, whose W bit takes precedence over the operand-size-override prefix */
+	if (bMode64 && (*pByte & REX_PREFIX_MASK) == REX_PREFIX)
+	{
+		if (*pByte & REX_W)
+			operandSize = OPSIZE_64;
+
+		pByte++;
+	}
+
+	OPCODE_MAP map = OPMAP_1BYTE;
+	if (*pByte == ESCAPE_0F)
+	{
+		map = OPMAP_0F;
+		pByte++;
+	}
+
+	const SCAN_OPCODE &scanOpcode = pTable->Opcodes[map][*pByte++];
+	if (!scanOpcode.bFast)
+		return 0;
+
+	if (scanOpcode.bModRM)
+	{
+		BYTE modRM = *pByte++;
+
+		/* A SIB without a base register (Mod 00b, RM 100b, Base 101b) is followed by a 32-bit displacement */
+		if ((modRM & 0b11000111) == 0b00000100 && (*pByte & 0b111) == 0b101)
+			pByte += DWORD_SIZE;
+
+		pByte += pTable->ModRMSizes[modRM];
+	}
+
+	pByte += scanOpcode.ImmSize[operandSize];
+	return (USHORT) (pByte - ip);
+}
+
+/*
+Classify the single-byte instructions of a 16-byte window, using SSSE3 shuffles.
+Every byte of the window is classified at once through the scan table's nibble masks.
+@param pTable, the scan table of the decoded mode.
+@param pWindow, pointer to a window of SCAN_WINDOW_SIZE_SSSE3 bytes.
+@return mask of the window's single-byte instructions, where bit X is set if byte X is one.
+*/
+TARGET_SSSE3 DWORD ClassifyWindowSsse3(const SCAN_TABLE *pTable, PBYTE pWindow)
+{
+	const __m128i nibbleMask = _mm_set1_epi8(0xF);
+	__m128i bytes = _mm_loadu_si128((const __m128i *) pWindow);
+	__m128i lowNibbles = _mm_and_si128(bytes, nibbleMask);
+	__m128i highNibbles = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibbleMask);
+
+	/* Look up both halves of the nibble masks, a byte is a single-byte instruction if either half intersects */
+	__m128i classes = _mm_or_si128(
+		_mm_and_si128(
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) pTable->LowNibbleMasks[0]), lowNibbles),
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) pTable->HighNibbleMasks[0]), highNibbles)),
+		_mm_and_si128(
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) pTable->LowNibbleMasks[1]), lowNibbles),
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) pTable->HighNibbleMasks[1]), highNibbles)));
+
+	return ~_mm_movemask_epi8(_mm_cmpeq_epi8(classes, _mm_setzero_si128())) & 0xFFFF;
+}
+
+/*
+Classify the single-byte instructions of a 32-byte window, using AVX2 shuffles.
+The nibble masks are broadcast to both 128-bit lanes, as VPSHUFB shuffles each lane on its own.
+@param pTable, the scan table of the decoded mode.
+@param pWindow, pointer to a window of SCAN_WINDOW_SIZE_AVX2 bytes.
+@return mask of the window's single-byte instructions, where bit X is set if byte X is one.
+*/
+TARGET_AVX2 DWORD ClassifyWindowAvx2(const SCAN_TABLE *pTable, PBYTE pWindow)
+{
+	const __m256i nibbleMask = _mm256_set1_epi8(0xF);
+	__m256i bytes = _mm256_loadu_si256((const __m256i *) pWindow);
+	__m256i lowNibbles = _mm256_and_si256(bytes, nibbleMask);
+	__m256i highNibbles = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibbleMask);
+
+	__m256i classes = _mm256_or_si256(
+		_mm256_and_si256(
+			_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) pTable->LowNibbleMasks[0])), lowNibbles),
+			_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) pTable->HighNibbleMasks[0])), highNibbles)),
+		_mm256_and_si256(
+			_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) pTable->LowNibbleMasks[1])), lowNibbles),
+			_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) pTable->HighNibbleMasks[1])), highNibbles)));
+
+	return ~(DWORD) _mm256_movemask_epi8(_mm256_cmpeq_epi8(classes, _mm256_setzero_si256()));
+}
+
+/*
+Classify the single-byte instructions at the beginning of a window, one byte at a time.
+Only the run of single-byte instructions at the beginning of the window is classified, rather than the whole window.
+@param pTable, the scan table of the decoded mode.
+@param pWindow, pointer to a window of SCAN_WINDOW_SIZE bytes.
+@param pWindowSize, receives the amount of classified bytes (the run, and the byte that ends it).
+@return mask of the run, where bit X is set if byte X is a single-byte instruction.
+*/
+DWORD ClassifyWindowScalar(const SCAN_TABLE *pTable, PBYTE pWindow, OUT SIZE_T *pWindowSize)
+{
+	SIZE_T runLength = 0;
+
+	while (runLength < SCAN_WINDOW_SIZE && IsSingleByteInstruction(pTable, pWindow[runLength]))
+		runLength++;
+
+	*pWindowSize = min(runLength + 1, (SIZE_T) SCAN_WINDOW_SIZE);
+	return runLength == SCAN_WINDOW_SIZE ? ~(DWORD) 0 : ((DWORD) 1 << runLength) - 1;
+}
+
+/*
+Classify the single-byte instructions of a window, through given instruction set.
+@param instructionSet, the instruction set (which must be resolved, see ResolveScanInstructionSet).
+@param pTable, the scan table of the decoded mode.
+@param pWindow, pointer to a window of SCAN_WINDOW_SIZE bytes.
+@param pWindowSize, receives the amount of classified bytes.
+@return mask of the classified bytes, where bit X is set if byte X is a single-byte instruction.
+*/
+DWORD ClassifyWindow(SCAN_INSTRUCTION_SET instructionSet, const SCAN_TABLE *pTable, PBYTE pWindow, OUT SIZE_T *pWindowSize)
+{
+	switch (instructionSet)
+	{
+	case SCAN_ISA_AVX2:
+		*pWindowSize = SCAN_WINDOW_SIZE_AVX2;
+		return ClassifyWindowAvx2(pTable, pWindow);
+	case SCAN_ISA_SSSE3:
+		*pWindowSize = SCAN_WINDOW_SIZE_SSSE3;
+		return ClassifyWindowSsse3(pTable, pWindow);
+	default:
+		return ClassifyWindowScalar(pTable, pWindow, pWindowSize);
+	}
+}
+
+/*
+Mark an instruction start within a boundary bitmap.
+*/
+void SetBoundary(PBYTE pBitmap, SIZE_T offset)
+{
+	pBitmap[offset / 8] |= 1 << (offset % 8);
+}
+
+/*
+@return whether an instruction starts at given offset, according to a boundary bitmap.
+*/
+bool TestBoundary(PBYTE pBitmap, SIZE_T offset)
+{
+	return (pBitmap[offset / 8] >> (offset % 8)) & 1;
+}
+
+/*
+Clear the instruction starts within part of a boundary bitmap.
+@param startOffset, the first offset to be cleared.
+@param endOffset, the offset after the last offset to be cleared.
+@return the amount of instruction starts that were cleared.
+*/
+SIZE_T ClearBoundaries(PBYTE pBitmap, SIZE_T startOffset, SIZE_T endOffset)
+{
+	SIZE_T clearedAmount = 0;
+
+	for (SIZE_T offset = startOffset; offset < endOffset; offset++)
+	{
+		clearedAmount += TestBoundary(pBitmap, offset);
+		pBitmap[offset / 8] &= ~(1 << (offset % 8));
+	}
+
+	return clearedAmount;
+}
+
+/*
+Find the start of every instruction within part of a code range.
+Decoding starts at given offset, assuming an instruction starts there, and continues until an instruction starts at or beyond the end offset.
+Instructions may extend beyond the end offset, in which case they're read from the rest of the code range.
+@param pContext is the disassembler context to run in, its Mode is used for decoding.
+@param buffer is the code range.
+@param size is the size of the code range, in bytes.
+@param startOffset is the offset decoding starts at.
+@param endOffset is the offset decoding ends at, only instructions starting before it are marked.
+@param pBitmap is the code range's boundary bitmap (see ScanBoundaries).
+@param pInstructionAmount receives the amount of instructions that were marked.
+@return the offset of the first instruction that starts at or beyond the end offset.
+*/
+SIZE_T ScanRange(PDISASSEMBLER_CONTEXT pContext, PBYTE buffer, SIZE_T size, SIZE_T startOffset, SIZE_T endOffset, PBYTE pBitmap, OUT SIZE_T *pInstructionAmount)
+{
+	const SCAN_TABLE *pTable = &g_ScanTables[pContext->Mode];
+	bool bMode64 = pContext->Mode == DISASM_MODE_64;
+	SCAN_INSTRUCTION_SET instructionSet = ResolveScanInstructionSet(pContext->ScanInstructionSet);
+
+	/*
+	The last classified window, and the mask of its single-byte instructions.
+	Single-byte instructions are often a few instructions apart (e.g. PUSH & POP sequences), so a window usually serves several runs.
+	*/
+	SIZE_T windowStart = 0;
+	SIZE_T windowEnd = 0;
+	DWORD windowMask = 0;
+
+	InitializeDisassembler(pContext);
+	pContext->Buffer = buffer;
+	pContext->RequiredBytes = size;
+
+	/*
+	The code is read from its original buffer, until the padded tail is reached.
+	The tail is zero-padded, so a truncated instruction at the end of the range is decoded the same as before.
+	*/
+	BYTE tail[SCAN_TAIL_SIZE + SCAN_TAIL_SIZE] = { };
+	PBYTE pCode = buffer;
+	SIZE_T codeOffset = 0;
+
+	SIZE_T instructionAmount = 0;
+	SIZE_T offset = startOffset;
+	while (offset < endOffset)
+	{
+		/* Switch to the padded tail once we're close enough to the end */
+		if (pCode == buffer && size - offset < SCAN_TAIL_SIZE)
+		{
+			memcpy_s(tail, sizeof(tail), buffer + offset, size - offset);
+			pCode = tail;
+			codeOffset = offset;
+		}
+
+		PBYTE ip = pCode + (offset - codeOffset);
+
+		/* A single-byte instruction is usually followed by more (e.g. padding, PUSH & POP sequences), so classify the whole window */
+		if (offset >= windowEnd && IsSingleByteInstruction(pTable, *ip))
+		{
+			SIZE_T windowSize;
+			windowMask = ClassifyWindow(instructionSet, pTable, ip, &windowSize);
+			windowStart = offset;
+			windowEnd = offset + windowSize;
+		}
+
+		if (offset < windowEnd && (windowMask >> (offset - windowStart)) & 1)
+		{
+			/* The run ends at the first byte that isn't a single-byte instruction, the bits beyond the window are clear so it ends there at the latest */
+			DWORD others = ~(windowMask >> (offset - windowStart));
+			SIZE_T runLength = others ? LowestSetBit(others) : SCAN_WINDOW_SIZE;
+			runLength = min(runLength, min(windowEnd, endOffset) - offset);
+
+			for (SIZE_T i = 0; i < runLength; i++)
+				SetBoundary(pBitmap, offset + i);
+
+			instructionAmount += runLength;
+			offset += runLength;
+			continue;
+		}
+
+		SetBoundary(pBitmap, offset);
+		instructionAmount++;
+
+		/* Most instructions are sized through the scan table alone */
+		USHORT instructionSize = FastInstructionSize(pTable, bMode64, ip);
+		if (instructionSize)
+		{
+			offset += instructionSize;
+			continue;
+		}
+
+		/* Otherwise, fully decode the instruction */
+		pContext->Ip = ip;
+		ParseInstruction(pContext);
+		offset += pContext->Instruction.Size;
+	}
+
+	*pInstructionAmount = instructionAmount;
+	return offset;
+}
+
+/*
+Find the start of every instruction within a code range, decoding it linearly from its beginning.
+Common instructions are sized through flat tables (and runs of single-byte instructions through SIMD), and only the rest are fully decoded, which makes it
+far faster than running the disassembler over the range. The code is never read beyond the range.
+@param pContext is the disassembler context to run in, its Mode is used for decoding.
+@param buffer is the code range to be scanned.
+@param size is the size of the code range, in bytes.
+@param pBitmap is a bitmap of at least (size + 7) / 8 bytes, where bit X is set if an instruction starts at offset X.
+@return the amount of instructions within the code range.
+*/
+SIZE_T Disassembler::ScanBoundaries(PDISASSEMBLER_CONTEXT pContext, PBYTE buffer, SIZE_T size, OUT PBYTE pBitmap)
+{
+	memset(pBitmap, 0, (size + 7) / 8);
+
+	SIZE_T instructionAmount;
+	ScanRange(pContext, buffer, size, 0, size, pBitmap, &instructionAmount);
+	return instructionAmount;
+}
+
+/*
+Find the start of every instruction within a code range, like ScanBoundaries, using multiple threads.
+The range is split into chunks, which are all scanned at once, each from a speculative start (i.e. assuming an instruction starts there).
+The chunks are then stitched in order: each chunk is decoded again from where the previous chunk's last instruction ends,
+until reaching an instruction its speculative scan found as well. Decoding is deterministic, so from that self-synchronization point on,
+the speculative scan matches a sequential one. Instruction streams synchronize within a few instructions, so stitching is cheap.
+@param pContext is the disassembler context to run in, its Mode is used for decoding.
+@param buffer is the code range to be scanned.
+@param size is the size of the code range, in bytes.
+@param pBitmap is a bitmap of at least (size + 7) / 8 bytes, where bit X is set if an instruction starts at offset X.
+@param threadAmount is the amount of threads to scan with, or 0 to use a thread per processor.
+@return the amount of instructions within the code range.
+*/
+SIZE_T Disassembler::ScanBoundariesParallel(PDISASSEMBLER_CONTEXT pContext, PBYTE buffer, SIZE_T size, OUT PBYTE pBitmap, SIZE_T threadAmount)
+{
+	if (!threadAmount)
+		threadAmount = max(std::thread::hardware_concurrency(), 1u);
+
+	/* Split the range into a chunk per thread, aligned so threads never share a byte of the bitmap */
+	SIZE_T chunkSize = (size / threadAmount + PARALLEL_SCAN_MIN_CHUNK - 1) / PARALLEL_SCAN_MIN_CHUNK * PARALLEL_SCAN_MIN_CHUNK;
+	chunkSize = max(chunkSize, (SIZE_T) PARALLEL_SCAN_MIN_CHUNK);
+	SIZE_T chunkAmount = (size + chunkSize - 1) / chunkSize;
+
+	if (chunkAmount <= 1)
+		return ScanBoundaries(pContext, buffer, size, pBitmap);
+
+	memset(pBitmap, 0, (size + 7) / 8);
+
+	/* The offset each chunk's scan ended at (i.e. where the next chunk truly starts), and the amount of instructions it found */
+	std::vector<SIZE_T> chunkExits(chunkAmount);
+	std::vector<SIZE_T> chunkInstructions(chunkAmount);
+
+	/* Scan every chunk but the first on its own thread, each with its own context */
+	DISASSEMBLER_MODE mode = pContext->Mode;
+	SCAN_INSTRUCTION_SET instructionSet = pContext->ScanInstructionSet;
+	std::vector<std::thread> workers;
+	for (SIZE_T i = 1; i < chunkAmount; i++)
+	{
+		workers.emplace_back([=, &chunkExits, &chunkInstructions]()
+		{
+			DISASSEMBLER_CONTEXT context;
+			InitializeContext(&context);
+			context.Mode = mode;
+			context.ScanInstructionSet = instructionSet;
+
+			SIZE_T chunkStart = i * chunkSize;
+			chunkExits[i] = ScanRange(&context, buffer, size, chunkStart, min(chunkStart + chunkSize, size), pBitmap, &chunkInstructions[i]);
+		});
+	}
+
+	/* The first chunk starts at an actual instruction, so its scan is exact */
+	chunkExits[0] = ScanRange(pContext, buffer, size, 0, chunkSize, pBitmap, &chunkInstructions[0]);
+
+	for (std::thread &worker : workers)
+		worker.join();
+
+	SIZE_T instructionAmount = chunkInstructions[0];
+	for (SIZE_T i = 1; i < chunkAmount; i++)
+	{
+		SIZE_T chunkStart = i * chunkSize;
+		SIZE_T chunkEnd = min(chunkStart + chunkSize, size);
+		SIZE_T offset = chunkExits[i - 1];
+
+		/* Instructions the speculative scan found before the chunk's actual start are bogus */
+		instructionAmount += chunkInstructions[i];
+		instructionAmount -= ClearBoundaries(pBitmap, chunkStart, min(offset, chunkEnd));
+
+		/* Decode from the actual start, until reaching an instruction the speculative scan found */
+		while (offset < chunkEnd && !TestBoundary(pBitmap, offset))
+		{
+			SIZE_T decodedAmount;
+			SIZE_T nextOffset = ScanRange(pContext, buffer, size, offset, offset + 1, pBitmap, &decodedAmount);
+
+			/* The speculative scan's instructions that overlap the decoded instruction are bogus */
+			instructionAmount += decodedAmount;
+			instructionAmount -= ClearBoundaries(pBitmap, offset + 1, min(nextOffset, chunkEnd));
+			offset = nextOffset;
+		}
+
+		/* If the chunk never synchronized, it ends where the decoding did, rather than where its speculative scan did */
+		if (offset >= chunkEnd)
+			chunkExits[i] = offset;
+	}
+
+	return instructionAmount;
+}
+
+/*
+Check that ScanBoundaries finds the exact same instructions as decoding a code range one instruction at a time.
+@param pContext is the disassembler context to run in, its Mode is used for decoding.
+@param buffer is the code range to be checked.
+@param size is the size of the code range, in bytes.
+@return whether both methods agree, or FALSE if the function failed.
+*/
+BOOL Disassembler::VerifyBoundaries(PDISASSEMBLER_CONTEXT pContext, PBYTE buffer, SIZE_T size)
+{
+	SIZE_T bitmapSize = (size + 7) / 8;
+	/* A zero-padded copy of the code, so decoding an instruction never reads beyond the code range */
+	PBYTE code = (PBYTE) calloc(size + MAX_INSTRUCTION_SIZE, 1);
+	PBYTE expectedBitmap = (PBYTE) calloc(bitmapSize, 1);
+	PBYTE scannedBitmap = (PBYTE) calloc(bitmapSize, 1);
+
+	if (!code || !expectedBitmap || !scannedBitmap)
+	{
+		printf("VerifyBoundaries failed: couldn't allocate buffers.\n");
+		free(code);
+		free(expectedBitmap);
+		free(scannedBitmap);
+		return FALSE;
+	}
+
+	memcpy_s(code, size, buffer, size);
+
+	/* Decode one instruction at a time */
+	InitializeDisassembler(pContext);
+	pContext->Ip = code;
+
+	while ((SIZE_T) (pContext->Ip - code) < size)
+	{
+		SetBoundary(expectedBitmap, pContext->Ip - code);
+		ParseInstruction(pContext);
+	}
+
+	ScanBoundaries(pContext, buffer, size, scannedBitmap);
+
+	/* Report the first instruction the methods disagree on */
+	BOOL bEqual = TRUE;
+	for (SIZE_T i = 0; i < bitmapSize && bEqual; i++)
+	{
+		if (expectedBitmap[i] == scannedBitmap[i])
+			continue;
+
+		unsigned long bit = LowestSetBit(expectedBitmap[i] ^ scannedBitmap[i]);
+		printf("VerifyBoundaries mismatch at offset 0x%zX.\n", i * 8 + bit);
+		bEqual = FALSE;
+	}
+
+	free(code);
+	free(expectedBitmap);
+	free(scannedBitmap);
+	return bEqual;
+}
+
+/*
+Disassemble given bytes of machine code, on the calling thread's default context.
+@param buffer is the buffer of machine code that'll be disassembled.
+@param requiredBytes is the amount of bytes we want.
+The disassembler will return the minimum size of complete instructions, which is greater than this value.
+@return minimum size of complete instructions, which is greater than the required amount of bytes.
+*/
+SIZE_T Disassembler::Run(PBYTE buffer, SIZE_T requiredBytes)
+{
+	return Run(&g_ThreadContext, buffer, requiredBytes);
+}
@@ -1,26 +1,475 @@
 #pragma once
 #include "../TrampyDefs.h"
 
+/*
+The processor mode machine code is decoded in.
+The mode affects prefixes (e.g. REX), operand & address sizes, and ModRM addressing (e.g. RIP-relative).
+*/
+enum DISASSEMBLER_MODE : BYTE
+{
+	/* 32-bit protected mode (IA-32) */
+	DISASM_MODE_32,
+	/* 64-bit long mode (x86-64) */
+	DISASM_MODE_64,
+};
+
+/*
+The instruction set the boundary scanner classifies windows of code with (see ScanBoundaries).
+Every instruction set finds the exact same boundaries, they only differ in speed.
+*/
+enum SCAN_INSTRUCTION_SET : BYTE
+{
+	/* The best instruction set the processor supports */
+	SCAN_ISA_BEST,
+	/* One byte at a time */
+	SCAN_ISA_SCALAR,
+	/* 16-byte windows, through SSSE3 */
+	SCAN_ISA_SSSE3,
+	/* 32-byte windows, through AVX2 */
+	SCAN_ISA_AVX2,
+};
+
+/* The mode of the code we're running in, which is the mode contexts are initialized with */
+#ifdef TRAMPY_X64
+#define DISASM_MODE_NATIVE DISASM_MODE_64
+#else
+#define DISASM_MODE_NATIVE DISASM_MODE_32
+#endif
+
+/* Max size of a single instruction, including prefixes, opcode, operands, e.t.c. */
+#define MAX_INSTRUCTION_SIZE 15
+
+/* Size of a text buffer that fits any formatted instruction (see FormatInstruction) */
+#define FORMAT_BUFFER_SIZE 128
+
+/*
+Flags describing the legacy & REX prefixes of an instruction.
+*/
+enum PREFIX_FLAGS : BYTE
+{
+	/* LOCK prefix (F0) */
+	PREFIX_FLAG_LOCK = 1 << 0,
+	/* REPNE prefix (F2) */
+	PREFIX_FLAG_REPNE = 1 << 1,
+	/* REP prefix (F3) */
+	PREFIX_FLAG_REP = 1 << 2,
+	/* Any segment-override prefix (2E, 36, 3E, 26, 64, 65) */
+	PREFIX_FLAG_SEGMENT = 1 << 3,
+	/* Operand-size-override prefix (66) */
+	PREFIX_FLAG_OPERAND_SIZE = 1 << 4,
+	/* Address-size-override prefix (67) */
+	PREFIX_FLAG_ADDRESS_SIZE = 1 << 5,
+	/* REX prefix (64-bit mode only) */
+	PREFIX_FLAG_REX = 1 << 6,
+};
+
+/*
+The kind of control transfer an instruction performs.
+*/
+enum BRANCH_KIND : BYTE
+{
+	/* The instruction isn't a branch */
+	BRANCH_NONE,
+	/* Unconditional relative JMP (EB, E9) */
+	BRANCH_JMP,
+	/* Conditional relative branch (Jcc, LOOPcc, JrCXZ, XBEGIN) */
+	BRANCH_JCC,
+	/* Relative CALL (E8) */
+	BRANCH_CALL,
+	/* JMP whose target isn't relative to the instruction (indirect JMP, far JMP) */
+	BRANCH_JMP_INDIRECT,
+	/* CALL whose target isn't relative to the instruction (indirect CALL, far CALL) */
+	BRANCH_CALL_INDIRECT,
+	/* Return (RET, RETF, IRET) */
+	BRANCH_RET,
+};
+
+/*
+Struct describing the state of a single dissasembler.
+Each caller owns its own context, so any amount of disassemblers may run at once (e.g. one per thread).
+A context must be initialized through Disassembler::InitializeContext before it is used.
+*/
+typedef struct _DISASSEMBLER_CONTEXT
+{
+	/*
+	The mode the machine code is decoded in.
+	Contexts are initialized with DISASM_MODE_NATIVE, but any mode may be decoded from any process.
+	*/
+	DISASSEMBLER_MODE Mode;
+	/*
+	The instruction set the boundary scanner classifies code with.
+	Contexts are initialized with SCAN_ISA_BEST, and an instruction set the processor doesn't support falls back to the best one it does.
+	*/
+	SCAN_INSTRUCTION_SET ScanInstructionSet;
+	/*
+	The machine code buffer.
+	This could be a pointer to a function or anything of the sorts.
+	*/
+	PBYTE Buffer;
+	/*
+	The disassembler's instruction pointer.
+	Points to the next byte to be read.
+	*/
+	PBYTE Ip;
+	/*
+	Amount of bytes that we need to disassemble.
+	*/
+	SIZE_T RequiredBytes;
+	/*
+	End of the machine code buffer, or NULL if the buffer is unbounded (i.e. the code is known to be readable).
+	Decoding never reads at or beyond the end, instructions that cross it are marked as truncated instead.
+	*/
+	PBYTE End;
+	/*
+	Zeros which replace the bytes beyond the end of a bounded buffer, so a truncated instruction is decoded harmlessly.
+	*/
+	BYTE Overflow[QWORD_SIZE];
+
+	/*
+	Struct defining an instruction.
+	This instruction is the current instruction that's being disassembled.
+	*/
+	struct _INSTRUCTION
+	{
+		/*
+		Pointer to the beginning of the instruction.
+		*/
+		PBYTE Start;
+		/*
+		The current size of the instruction.
+		*/
+		USHORT Size;
+		/*
+		Describes whether the instruction uses a ModRM byte or not.
+		*/
+		BOOL bModRM;
+		/*
+		Describes whether the instruction uses a SIB byte or not.
+		*/
+		BOOL bSib;
+		/*
+		The amount of prefixes used by this instruction.
+		*/
+		USHORT PrefixAmount;
+		/*
+		Describes whether the instruction uses an operand-size-override prefix.
+		*/
+		BOOL bOperandSizeOverride;
+		/*
+		Describes whether the instruction uses an address-size-override prefix.
+		*/
+		BOOL bAddressSizeOverride;
+		/*
+		The opcode map the instruction's opcode belongs to (OPCODE_MAP).
+		*/
+		BYTE Map;
+		/*
+		The instruction's opcode, within its opcode map.
+		*/
+		BYTE Opcode;
+		/*
+		The instruction's ModRM byte, if it uses one.
+		*/
+		BYTE ModRM;
+		/*
+		The instruction's SIB byte, if it uses one.
+		*/
+		BYTE Sib;
+		/*
+		The instruction's REX prefix, or 0 if it has none (64-bit mode only).
+		*/
+		BYTE Rex;
+		/*
+		The encoding of the instruction's prefix (VEX_ENCODING), i.e. whether it's VEX or EVEX encoded.
+		*/
+		BYTE Encoding;
+		/*
+		Describes whether the VEX or EVEX prefix has its W bit set.
+		*/
+		BOOL bVexW;
+		/*
+		The vector length specified by the VEX or EVEX prefix, in bytes (0 if the instruction has neither).
+		*/
+		BYTE VectorLength;
+		/*
+		The scale of an 8-bit ModRM displacement (i.e. disp8*N), which is 1 unless the instruction is EVEX encoded.
+		*/
+		BYTE Disp8Scale;
+		/*
+		Describes whether the instruction uses RIP-relative addressing (64-bit mode only).
+		*/
+		BOOL bRipRelative;
+		/*
+		Pointer to the instruction's ModRM displacement, if it has one.
+		*/
+		PBYTE pDisplacement;
+		/*
+		The instruction's legacy & REX prefixes (PREFIX_FLAGS).
+		*/
+		BYTE Prefixes;
+		/*
+		Pointer to the instruction's ModRM byte, if it uses one.
+		*/
+		PBYTE pModRM;
+		/*
+		The size of the instruction's ModRM displacement, or 0 if it has none.
+		*/
+		BYTE DisplacementSize;
+		/*
+		Pointer to the instruction's immediate operands (including Relative Addresses & memory offsets), if it has any.
+		*/
+		PBYTE pImmediate;
+		/*
+		The total size of the instruction's immediate operands, or 0 if it has none.
+		*/
+		BYTE ImmediateSize;
+		/*
+		Describes whether the instruction's immediate is a Relative Address (i.e. it's a relative branch).
+		*/
+		BOOL bRelative;
+		/*
+		Describes whether the instruction crosses the end of a bounded buffer, in which case the rest of its fields are invalid.
+		*/
+		BOOL bTruncated;
+		/*
+		The minimum amount of bytes beyond the end of the buffer the instruction needs, if it's truncated.
+		More bytes may be needed once these are known, as they may extend the instruction further (e.g. a ModRM byte).
+		*/
+		BYTE MissingBytes;
+	} Instruction;
+}
+DISASSEMBLER_CONTEXT, *PDISASSEMBLER_CONTEXT;
+
+/*
+Struct describing a single decoded instruction.
+Offsets are relative to the beginning of the instruction, and are 0 if the instruction doesn't have the field.
+The struct is trivially copyable & at most 32 bytes, so it may be freely stored & passed around.
+*/
+typedef struct _DECODED_INSTRUCTION
+{
+	/*
+	The target of a relative branch, or the address referenced by a RIP-relative operand
+	(e.g. the pointer a JMP [RIP+X] reads its target from), or NULL if the instruction has neither.
+	*/
+	PBYTE Target;
+	/* Offset of the instruction from the beginning of the decoded code range */
+	DWORD Offset;
+	/* Size of the entire instruction */
+	BYTE Size;
+	/* The instruction's legacy & REX prefixes (PREFIX_FLAGS) */
+	BYTE Prefixes;
+	/* The instruction's REX prefix, or 0 if it has none */
+	BYTE Rex;
+	/* The encoding of the instruction's prefix (VEX_ENCODING) */
+	BYTE Encoding;
+	/* The opcode map the instruction's opcode belongs to (OPCODE_MAP) */
+	BYTE Map;
+	/* The instruction's opcode, within its opcode map */
+	BYTE Opcode;
+	/* Offset of the ModRM byte */
+	BYTE ModRMOffset;
+	/* Offset of the SIB byte */
+	BYTE SibOffset;
+	/* Offset & size of the ModRM displacement */
+	BYTE DisplacementOffset;
+	BYTE DisplacementSize;
+	/* Offset & total size of the immediate operands (including Relative Addresses & memory offsets) */
+	BYTE ImmediateOffset;
+	BYTE ImmediateSize;
+	/* The kind of control transfer the instruction performs (BRANCH_KIND) */
+	BYTE BranchKind;
+	/* Describes whether the instruction uses RIP-relative addressing */
+	BYTE bRipRelative;
+}
+DECODED_INSTRUCTION, *PDECODED_INSTRUCTION;
+
+/*
+Struct describing an iterator over the instructions of a code range.
+The iterator owns its disassembler context, and decodes an instruction at a time, without any allocations.
+*/
+typedef struct _INSTRUCTION_ITERATOR
+{
+	/*
+	The disassembler context the instructions are decoded in.
+	*/
+	DISASSEMBLER_CONTEXT Context;
+	/*
+	The code range, and its size.
+	*/
+	PBYTE Buffer;
+	SIZE_T Size;
+	/*
+	Offset of the next instruction within the code range.
+	*/
+	SIZE_T Offset;
+}
+INSTRUCTION_ITERATOR, *PINSTRUCTION_ITERATOR;
+
+/*
+The result of decoding the next instruction of a stream.
+*/
+enum STREAM_STATUS : BYTE
+{
+	/* An instruction was decoded */
+	STREAM_INSTRUCTION,
+	/* The current chunk is exhausted, the next chunk must be fed to continue (see STREAM_DECODER's NeededBytes) */
+	STREAM_NEED_MORE,
+};
+
+/*
+Struct describing a decoder of a code stream, which arrives in chunks (e.g. a file read in pieces, or memory read from another process).
+Instructions are decoded straight from each chunk, and an instruction split between chunks is carried over to the next chunk,
+so the memory footprint is fixed regardless of the stream's size.
+*/
+typedef struct _STREAM_DECODER
+{
+	/*
+	The disassembler context the instructions are decoded in.
+	*/
+	DISASSEMBLER_CONTEXT Context;
+	/*
+	The address the stream's first byte is executed from, which branch targets are relative to.
+	*/
+	ULONG_PTR BaseAddress;
+	/*
+	Offset of the next instruction within the entire stream.
+	*/
+	DWORD64 StreamOffset;
+	/*
+	The current chunk, its size, and the offset of the next unread byte within it.
+	*/
+	PBYTE Chunk;
+	SIZE_T ChunkSize;
+	SIZE_T ChunkOffset;
+	/*
+	The beginning of an instruction that's split between chunks, carried over from the previous chunks.
+	Its capacity covers the longest byte sequence the decoder may read for a single instruction.
+	*/
+	BYTE Carry[MAX_INSTRUCTION_SIZE * 2];
+	SIZE_T CarryAmount;
+	/*
+	The minimum amount of bytes needed to complete the split instruction, once STREAM_NEED_MORE is returned.
+	*/
+	SIZE_T NeededBytes;
+}
+STREAM_DECODER, *PSTREAM_DECODER;
+
 namespace Disassembler
 {
 	/*
-	Enable replication of machine code.
-	@param repBuffer is a byte-buffer which stores the replicated code.
-	@param repBufferSize is the size of the replicated code's buffer.
+	Initialize a disassembler context.
+	The context decodes in DISASM_MODE_NATIVE, which may be changed through its Mode field.
+	@param pContext is the context to be initialized.
+	*/
+	void InitializeContext(PDISASSEMBLER_CONTEXT pContext);
+
+	/*
+	Disassemble given bytes of machine code.
+	Relocating the instructions to another address is up to the Relocator (see Relocator.h).
+	@param pContext is the disassembler context to run in.
+	@param buffer is the buffer of machine code that'll be disassembled.
+	@param requiredBytes is the amount of bytes we want.
+	The disassembler will return the minimum size of complete instructions, which is greater than this value.
+	@return minimum size of complete instructions, which is greater than the required amount of bytes.
+	*/
+	SIZE_T Run(PDISASSEMBLER_CONTEXT pContext, PBYTE buffer, SIZE_T requiredBytes);
+
+	/*
+	Find the start of every instruction within a code range, decoding it linearly from its beginning.
+	Common instructions are sized through flat tables (and runs of single-byte instructions through SIMD), and only the rest are fully decoded, which makes it
+	far faster than running the disassembler over the range. The code is never read beyond the range.
+	@param pContext is the disassembler context to run in, its Mode is used for decoding.
+	@param buffer is the code range to be scanned.
+	@param size is the size of the code range, in bytes.
+	@param pBitmap is a bitmap of at least (size + 7) / 8 bytes, where bit X is set if an instruction starts at offset X.
+	@return the amount of instructions within the code range.
+	*/
+	SIZE_T ScanBoundaries(PDISASSEMBLER_CONTEXT pContext, PBYTE buffer, SIZE_T size, OUT PBYTE pBitmap);
+	/*
+	Find the start of every instruction within a code range, like ScanBoundaries, using multiple threads.
+	Chunks of the range are scanned at once from speculative starts, and stitched at their self-synchronization points,
+	so the result is identical to ScanBoundaries.
+	@param pContext is the disassembler context to run in, its Mode is used for decoding.
+	@param buffer is the code range to be scanned.
+	@param size is the size of the code range, in bytes.
+	@param pBitmap is a bitmap of at least (size + 7) / 8 bytes, where bit X is set if an instruction starts at offset X.
+	@param threadAmount is the amount of threads to scan with, or 0 to use a thread per processor.
+	@return the amount of instructions within the code range.
+	*/
+	SIZE_T ScanBoundariesParallel(PDISASSEMBLER_CONTEXT pContext, PBYTE buffer, SIZE_T size, OUT PBYTE pBitmap, SIZE_T threadAmount);
+	/*
+	Check that ScanBoundaries finds the exact same instructions as decoding a code range one instruction at a time.
+	@param pContext is the disassembler context to run in, its Mode is used for decoding.
+	@param buffer is the code range to be checked.
+	@param size is the size of the code range, in bytes.
+	@return whether both methods agree, or FALSE if the function failed.
+	*/
+	BOOL VerifyBoundaries(PDISASSEMBLER_CONTEXT pContext, PBYTE buffer, SIZE_T size);
+
+	/*
+	Initialize an iterator over the instructions of a code range.
+	@param pIterator is the iterator to be initialized.
+	@param buffer is the code range to be iterated.
+	@param size is the size of the code range, in bytes.
+	@param mode is the mode the code is decoded in.
+	*/
+	void InitializeIterator(PINSTRUCTION_ITERATOR pIterator, PBYTE buffer, SIZE_T size, DISASSEMBLER_MODE mode);
+	/*
+	Decode the next instruction of the code range.
+	@param pIterator is the iterator to advance.
+	@param pInstruction receives the decoded instruction.
+	@return TRUE if an instruction was decoded, FALSE once the code range ends (or its last instruction is truncated).
+	*/
+	BOOL NextInstruction(PINSTRUCTION_ITERATOR pIterator, OUT PDECODED_INSTRUCTION pInstruction);
+
+	/*
+	Initialize a decoder of a code stream.
+	@param pDecoder is the decoder to be initialized.
+	@param mode is the mode the code is decoded in.
+	@param baseAddress is the address the stream's first byte is executed from.
+	*/
+	void InitializeStream(PSTREAM_DECODER pDecoder, DISASSEMBLER_MODE mode, ULONG_PTR baseAddress);
+	/*
+	Feed the next chunk of the stream, once the previous chunk is exhausted (i.e. STREAM_NEED_MORE was returned).
+	The chunk must stay valid until it's exhausted as well.
+	@param pDecoder is the decoder to feed.
+	@param chunk is the next chunk of the stream.
+	@param chunkSize is the size of the chunk, in bytes.
+	*/
+	void FeedStream(PSTREAM_DECODER pDecoder, PBYTE chunk, SIZE_T chunkSize);
+	/*
+	Decode the next instruction of the stream.
+	@param pDecoder is the decoder to advance.
+	@param pInstruction receives the decoded instruction, whose Offset is truncated to 32-bits (see the decoder's StreamOffset).
+	@return STREAM_INSTRUCTION if an instruction was decoded, STREAM_NEED_MORE once the current chunk is exhausted.
+	*/
+	STREAM_STATUS NextStreamInstruction(PSTREAM_DECODER pDecoder, OUT PDECODED_INSTRUCTION pInstruction);
+
+	/*
+	Format a decoded instruction as Intel-syntax text (e.g. "mov qword ptr [rsp+0x8], rbx").
+	The text is written straight into the given buffer, without any allocations or stdio, so it's safe to call from within hooked code.
+	Instructions without a known mnemonic (e.g. x87, VEX & EVEX encoded) are formatted as their raw bytes (e.g. "db 0xc5, 0xf8, 0x77").
+	@param pInstruction is the decoded instruction.
+	@param pCode is the instruction's bytes.
+	@param mode is the mode the instruction was decoded in.
+	@param text is the buffer receiving the null-terminated text.
+	@param textSize is the size of the buffer, FORMAT_BUFFER_SIZE always suffices.
+	@return the length of the text, or 0 if the buffer is too small (in which case the text is truncated).
 	*/
-	void EnableReplication(
-		PBYTE repBuffer,
-		SIZE_T repBufferSize,
-		OUT SIZE_T *pReplicatedAmount
-	);
+	SIZE_T FormatInstruction(PDECODED_INSTRUCTION pInstruction, const BYTE *pCode, DISASSEMBLER_MODE mode, OUT CHAR *text, SIZE_T textSize);
 	/*
-	Disables the replication.
+	Format bytes as hexadecimal text (e.g. "48 89 5c 24 08"), without any allocations or stdio.
+	@param pBytes is the bytes to be formatted.
+	@param size is the amount of bytes.
+	@param text is the buffer receiving the null-terminated text.
+	@param textSize is the size of the buffer, 3 characters per byte always suffice.
+	@return the length of the text, or 0 if the buffer is too small (in which case the text is truncated).
 	*/
-	void DisableReplication();
+	SIZE_T FormatBytes(const BYTE *pBytes, SIZE_T size, OUT CHAR *text, SIZE_T textSize);
 
 	/*
-	Disassemble & replicate given bytes of machine code.
-	@param buffer is the buffer of machine code that'll be disassembled & replicated.
+	Disassemble given bytes of machine code, on the calling thread's default context.
+	@param buffer is the buffer of machine code that'll be disassembled.
 	@param requiredBytes is the amount of bytes we want.
 	The disassembler will return the minimum size of complete instructions, which is greater than this value.
 	@return minimum size of complete instructions, which is greater than the required amount of bytes.
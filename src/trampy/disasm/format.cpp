@@ -0,0 +1,921 @@
+#include "disasm.h"
+#include "instr/OpcodeTables.h"
+#include "instr/Mnemonics.h"
+#include "instr/Vex.h"
+
+/*
+The formatter renders decoded instructions as Intel-syntax text, straight into caller-provided buffers.
+It never allocates memory, nor uses stdio, so it may be called from within hooked code paths.
+*/
+
+/* The REX.R, REX.X & REX.B bits, which extend the ModRM & SIB fields */
+#define REX_R 0b0100
+#define REX_X 0b0010
+#define REX_B 0b0001
+
+/* Names of the general-purpose registers, by size */
+constexpr const char *g_Registers8[16] = { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" };
+constexpr const char *g_Registers8Legacy[8] = { "al", "cl", "dl", "bl", "ah", "ch", "dh", "bh" };
+constexpr const char *g_Registers16[16] = { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w" };
+constexpr const char *g_Registers32[16] = { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" };
+constexpr const char *g_Registers64[16] = { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" };
+
+/* Names of the segment registers, by the Reg field */
+constexpr const char *g_SegmentRegisters[8] = { "es", "cs", "ss", "ds", "fs", "gs", "?", "?" };
+
+/* Base & index registers of 16-bit ModRM addressing, by the R/M field */
+constexpr const char *g_Addressing16[8] = { "bx+si", "bx+di", "bp+si", "bp+di", "si", "di", "bp", "bx" };
+
+/*
+Struct describing the text being written into a caller-provided buffer.
+The text is always null-terminated, and once it overflows the buffer, further writes are dropped.
+*/
+typedef struct _TEXT_WRITER
+{
+	CHAR *Text;
+	SIZE_T Size;
+	SIZE_T Length;
+	bool bOverflow;
+}
+TEXT_WRITER, *PTEXT_WRITER;
+
+/*
+Struct describing the instruction being formatted.
+*/
+typedef struct _FORMAT_STATE
+{
+	PDECODED_INSTRUCTION pInstruction;
+	const BYTE *pCode;
+	bool bMode64;
+	/* The instruction's operand & address sizes, in bytes */
+	BYTE OperandSize;
+	BYTE AddressSize;
+	/* The instruction's segment override, or NULL if it has none */
+	const char *Segment;
+	/* The fields of the ModRM byte */
+	BYTE Mod;
+	BYTE Reg;
+	BYTE Rm;
+	/* Describes whether the 66 prefix selects XMM registers rather than MMX registers (e.g. PXOR) */
+	bool bXmm;
+	/* Offset of the next immediate operand */
+	BYTE ImmediateOffset;
+	/* The amount of operands written so far */
+	BYTE OperandAmount;
+	TEXT_WRITER Writer;
+}
+FORMAT_STATE, *PFORMAT_STATE;
+
+/*
+Append a string to the text.
+*/
+void Write(PTEXT_WRITER pWriter, const char *string)
+{
+	for (; *string; string++)
+	{
+		if (pWriter->Length + 1 >= pWriter->Size)
+		{
+			pWriter->bOverflow = true;
+			return;
+		}
+
+		pWriter->Text[pWriter->Length++] = *string;
+		pWriter->Text[pWriter->Length] = '\0';
+	}
+}
+
+/*
+Append a string to the text, up to a given delimiter.
+*/
+void WriteUntil(PTEXT_WRITER pWriter, const char *string, char delimiter)
+{
+	CHAR character[2] = { };
+	for (; *string && *string != delimiter; string++)
+	{
+		character[0] = *string;
+		Write(pWriter, character);
+	}
+}
+
+/*
+Append a number to the text, in hexadecimal (e.g. 0x1f).
+*/
+void WriteHex(PTEXT_WRITER pWriter, DWORD64 value)
+{
+	CHAR digits[2 + QWORD_SIZE * 2 + 1] = { };
+	SIZE_T digitAmount = 0;
+
+	do
+	{
+		digits[sizeof(digits) - 2 - digitAmount++] = "0123456789abcdef"[value & 0xF];
+		value >>= 4;
+	}
+	while (value);
+
+	Write(pWriter, "0x");
+	Write(pWriter, &digits[sizeof(digits) - 1 - digitAmount]);
+}
+
+/*
+Append a number to the text, in decimal.
+*/
+void WriteDecimal(PTEXT_WRITER pWriter, BYTE value)
+{
+	CHAR digits[4] = { };
+	SIZE_T digitAmount = 0;
+
+	do
+	{
+		digits[sizeof(digits) - 2 - digitAmount++] = '0' + value % 10;
+		value /= 10;
+	}
+	while (value);
+
+	Write(pWriter, &digits[sizeof(digits) - 1 - digitAmount]);
+}
+
+/*
+Read a little-endian, unsigned value.
+*/
+DWORD64 ReadUnsigned(const BYTE *pValue, BYTE size)
+{
+	DWORD64 value = 0;
+	for (BYTE i = 0; i < size; i++)
+		value |= (DWORD64) pValue[i] << (i * 8);
+
+	return value;
+}
+
+/*
+Sign-extend a value of given size, then truncate it to another size.
+*/
+DWORD64 SignExtend(DWORD64 value, BYTE size, BYTE extendedSize)
+{
+	if (size < QWORD_SIZE && (value >> (size * 8 - 1)) & 1)
+		value |= ~0ULL << (size * 8);
+
+	if (extendedSize < QWORD_SIZE)
+		value &= (1ULL << (extendedSize * 8)) - 1;
+
+	return value;
+}
+
+/*
+@return the name of a general-purpose register.
+@param index, the register's index (including REX extensions).
+@param size, the register's size in bytes.
+*/
+const char *RegisterName(PFORMAT_STATE pState, BYTE index, BYTE size)
+{
+	switch (size)
+	{
+	case BYTE_SIZE:
+		return pState->pInstruction->Rex ? g_Registers8[index] : g_Registers8Legacy[index & 7];
+	case WORD_SIZE:
+		return g_Registers16[index];
+	case QWORD_SIZE:
+		return g_Registers64[index];
+	default:
+		return g_Registers32[index];
+	}
+}
+
+/*
+@return whether the opcode's operand-size is 64-bit by default in 64-bit mode (e.g. PUSH, near indirect CALL & JMP).
+*/
+bool IsDefaultOperandSize64(PDECODED_INSTRUCTION pInstruction, BYTE reg)
+{
+	if (pInstruction->Map == OPMAP_0F)
+		return pInstruction->Opcode >= 0x80 && pInstruction->Opcode <= 0x8F;
+
+	BYTE opcode = pInstruction->Opcode;
+	return (opcode >= 0x50 && opcode <= 0x5F) || opcode == 0x68 || opcode == 0x6A || opcode == 0x8F ||
+		opcode == 0x9C || opcode == 0x9D || (opcode == 0xFF && (reg == 2 || reg == 4 || reg == 6));
+}
+
+/*
+@return whether the opcode's immediate is sign-extended to its operand-size (e.g. ADD Ev, Ib).
+*/
+bool IsImmediateSignExtended(PDECODED_INSTRUCTION pInstruction)
+{
+	if (pInstruction->Map != OPMAP_1BYTE)
+		return false;
+
+	BYTE opcode = pInstruction->Opcode;
+	return (opcode < 0x40 && (opcode & 7) == 5) || opcode == 0x68 || opcode == 0x69 || opcode == 0x6A || opcode == 0x6B ||
+		opcode == 0x81 || opcode == 0x83 || opcode == 0xA9 || opcode == 0xC7 || opcode == 0xF7;
+}
+
+/*
+@return the size of an operand in bytes, or 0 if it has no particular size (e.g. LEA's memory operand).
+*/
+BYTE OperandTypeSize(PFORMAT_STATE pState, OPERAND_DESCRIPTOR operand)
+{
+	switch (operand.OperandType)
+	{
+	case b:
+		return BYTE_SIZE;
+	case w:
+		return WORD_SIZE;
+	case d:
+	case ss:
+	case si:
+		return DWORD_SIZE;
+	case q:
+		return pState->bXmm && operand.AddressingMethod == Q ? XMMWORD_SIZE : QWORD_SIZE;
+	case sd:
+	case pi:
+		return QWORD_SIZE;
+	case dq:
+	case x:
+	case ps:
+	case pd:
+		return XMMWORD_SIZE;
+	case qq:
+		return YMMWORD_SIZE;
+	case v:
+		return pState->OperandSize;
+	case y:
+		return pState->pInstruction->Rex & REX_W ? QWORD_SIZE : DWORD_SIZE;
+	case z:
+		return pState->OperandSize == WORD_SIZE ? WORD_SIZE : DWORD_SIZE;
+	case p:
+		/* Far pointers are a 16-bit selector, following the offset */
+		return pState->OperandSize + WORD_SIZE;
+	default:
+		return 0;
+	}
+}
+
+/*
+Append the size of a memory operand (e.g. "dword ptr ").
+*/
+void WriteSizeKeyword(PTEXT_WRITER pWriter, BYTE size)
+{
+	switch (size)
+	{
+	case 1: Write(pWriter, "byte ptr "); break;
+	case 2: Write(pWriter, "word ptr "); break;
+	case 4: Write(pWriter, "dword ptr "); break;
+	case 6: Write(pWriter, "fword ptr "); break;
+	case 8: Write(pWriter, "qword ptr "); break;
+	case 10: Write(pWriter, "tbyte ptr "); break;
+	case 16: Write(pWriter, "xmmword ptr "); break;
+	case 32: Write(pWriter, "ymmword ptr "); break;
+	}
+}
+
+/*
+Append a vector register (e.g. "xmm3" or "mm3").
+*/
+void WriteVectorRegister(PFORMAT_STATE pState, BYTE index, bool bXmm)
+{
+	Write(&pState->Writer, bXmm ? "xmm" : "mm");
+	WriteDecimal(&pState->Writer, bXmm ? index : index & 7);
+}
+
+/*
+Append a signed displacement, following a base or index register (e.g. "+0x10" or "-0x10").
+*/
+void WriteDisplacement(PTEXT_WRITER pWriter, DWORD64 displacement, BYTE size)
+{
+	DWORD64 value = SignExtend(displacement, size, QWORD_SIZE);
+
+	if ((INT64) value < 0)
+	{
+		Write(pWriter, "-");
+		WriteHex(pWriter, 0 - value);
+	}
+	else
+	{
+		Write(pWriter, "+");
+		WriteHex(pWriter, value);
+	}
+}
+
+/*
+Append the memory operand specified by the ModRM byte (e.g. "qword ptr [rsp+0x8]").
+*/
+void WriteMemory(PFORMAT_STATE pState, BYTE size)
+{
+	PDECODED_INSTRUCTION pInstruction = pState->pInstruction;
+	PTEXT_WRITER pWriter = &pState->Writer;
+	DWORD64 displacement = ReadUnsigned(pState->pCode + pInstruction->DisplacementOffset, pInstruction->DisplacementSize);
+
+	WriteSizeKeyword(pWriter, size);
+	if (pState->Segment)
+	{
+		Write(pWriter, pState->Segment);
+		Write(pWriter, ":");
+	}
+	Write(pWriter, "[");
+
+	/* 16-bit addressing uses fixed base & index pairs */
+	if (pState->AddressSize == WORD_SIZE)
+	{
+		if (pState->Mod == 0 && pState->Rm == 6)
+		{
+			WriteHex(pWriter, displacement);
+		}
+		else
+		{
+			Write(pWriter, g_Addressing16[pState->Rm]);
+			if (pInstruction->DisplacementSize)
+				WriteDisplacement(pWriter, displacement, pInstruction->DisplacementSize);
+		}
+
+		Write(pWriter, "]");
+		return;
+	}
+
+	const char *const *registers = pState->AddressSize == QWORD_SIZE ? g_Registers64 : g_Registers32;
+	BYTE rex = pInstruction->Rex;
+
+	if (pInstruction->bRipRelative)
+	{
+		Write(pWriter, pState->AddressSize == QWORD_SIZE ? "rip" : "eip");
+		WriteDisplacement(pWriter, displacement, pInstruction->DisplacementSize);
+		Write(pWriter, "]");
+		return;
+	}
+
+	bool bRegister = false;
+	if (pInstruction->SibOffset)
+	{
+		BYTE sib = pState->pCode[pInstruction->SibOffset];
+		BYTE base = sib & 7;
+		BYTE index = ((sib >> 3) & 7) | (rex & REX_X ? 8 : 0);
+
+		/* A base of 101b without a displacement-less Mod means there's no base, only a 32-bit displacement */
+		if (!(base == 5 && pState->Mod == 0))
+		{
+			Write(pWriter, registers[base | (rex & REX_B ? 8 : 0)]);
+			bRegister = true;
+		}
+
+		/* An index of 100b (without REX.X) means there's no index */
+		if (index != 4)
+		{
+			if (bRegister)
+				Write(pWriter, "+");
+
+			Write(pWriter, registers[index]);
+			Write(pWriter, "*");
+			WriteDecimal(pWriter, 1 << (sib >> 6));
+			bRegister = true;
+		}
+	}
+	else if (!(pState->Mod == 0 && pState->Rm == 5))
+	{
+		Write(pWriter, registers[pState->Rm | (rex & REX_B ? 8 : 0)]);
+		bRegister = true;
+	}
+
+	if (!bRegister)
+		WriteHex(pWriter, displacement);
+	else if (pInstruction->DisplacementSize)
+		WriteDisplacement(pWriter, displacement, pInstruction->DisplacementSize);
+
+	Write(pWriter, "]");
+}
+
+/*
+Read the next immediate operand of given size.
+*/
+DWORD64 ReadImmediate(PFORMAT_STATE pState, BYTE size)
+{
+	DWORD64 value = ReadUnsigned(pState->pCode + pState->ImmediateOffset, size);
+	pState->ImmediateOffset += size;
+
+	return value;
+}
+
+/*
+Append the separator that precedes an operand.
+*/
+void WriteSeparator(PFORMAT_STATE pState)
+{
+	Write(&pState->Writer, pState->OperandAmount++ ? ", " : " ");
+}
+
+/*
+@param size: The size implied by the operand's type.
+@return the size of a memory operand, for the few opcodes whose memory form differs from their register form.
+*/
+BYTE MemoryOperandSize(PFORMAT_STATE pState, BYTE size)
+{
+	PDECODED_INSTRUCTION pInstruction = pState->pInstruction;
+	if (pInstruction->Map != OPMAP_1BYTE)
+		return size;
+
+	/* Segment registers are always stored to memory as a word (MOV Ev, Sw) */
+	if (pInstruction->Opcode == 0x8C)
+		return WORD_SIZE;
+
+	/* BOUND compares against a pair of bounds (62 outside of 64-bit mode) */
+	if (pInstruction->Opcode == 0x62)
+		return pState->OperandSize * 2;
+
+	/* Indirect far calls & jumps load a far pointer (FF /3 & FF /5) */
+	if (pInstruction->Opcode == 0xFF && (pState->Reg == 3 || pState->Reg == 5))
+		return size + WORD_SIZE;
+
+	return size;
+}
+
+/*
+Append an operand described by the Opcode Maps.
+*/
+void WriteOperand(PFORMAT_STATE pState, OPERAND_DESCRIPTOR operand)
+{
+	PDECODED_INSTRUCTION pInstruction = pState->pInstruction;
+	PTEXT_WRITER pWriter = &pState->Writer;
+	BYTE rex = pInstruction->Rex;
+	BYTE reg = pState->Reg | (rex & REX_R ? 8 : 0);
+	BYTE rm = pState->Rm | (rex & REX_B ? 8 : 0);
+	BYTE size = OperandTypeSize(pState, operand);
+
+	/* The flags register is implied (PUSHF & POPF) */
+	if (operand.AddressingMethod == F)
+		return;
+
+	WriteSeparator(pState);
+
+	switch (operand.AddressingMethod)
+	{
+	case E:
+	case M:
+	case Q:
+	case W:
+		if (pState->Mod != 3)
+			WriteMemory(pState, MemoryOperandSize(pState, size));
+		else if (operand.AddressingMethod == M && pInstruction->Map == OPMAP_0F)
+			/* Only MOVHLPS & MOVLHPS have register forms of memory operands */
+			WriteVectorRegister(pState, rm, true);
+		else if (operand.AddressingMethod == Q)
+			WriteVectorRegister(pState, rm, pState->bXmm);
+		else if (operand.AddressingMethod == W)
+			WriteVectorRegister(pState, rm, true);
+		else
+			Write(pWriter, RegisterName(pState, rm, size));
+		break;
+
+	case G:
+		Write(pWriter, RegisterName(pState, reg, size));
+		break;
+
+	case R:
+		/* Control & debug registers are moved to & from full-sized registers */
+		Write(pWriter, RegisterName(pState, rm, pState->bMode64 ? QWORD_SIZE : DWORD_SIZE));
+		break;
+
+	case C:
+		Write(pWriter, "cr");
+		WriteDecimal(pWriter, reg);
+		break;
+
+	case D:
+		Write(pWriter, "dr");
+		WriteDecimal(pWriter, reg);
+		break;
+
+	case S:
+		Write(pWriter, g_SegmentRegisters[pState->Reg]);
+		break;
+
+	case N:
+		WriteVectorRegister(pState, rm, pState->bXmm);
+		break;
+
+	case P:
+		WriteVectorRegister(pState, reg, pState->bXmm);
+		break;
+
+	case U:
+		WriteVectorRegister(pState, rm, true);
+		break;
+
+	case V:
+		WriteVectorRegister(pState, reg, true);
+		break;
+
+	case I:
+	{
+		/* Immediates are at most 32-bit, unless they're the entire operand-size (MOV r64, imm64) */
+		BYTE immediateSize = operand.OperandType == v ? pState->OperandSize : min(size, (BYTE) DWORD_SIZE);
+		BYTE extendedSize = IsImmediateSignExtended(pInstruction) ? pState->OperandSize : immediateSize;
+		WriteHex(pWriter, SignExtend(ReadImmediate(pState, immediateSize), immediateSize, extendedSize));
+		break;
+	}
+
+	case J:
+		/* The instruction pointer wraps around at 32 bits outside of 64-bit mode */
+		WriteHex(pWriter, pState->bMode64 ? (DWORD64) (ULONG_PTR) pInstruction->Target : (DWORD) (ULONG_PTR) pInstruction->Target);
+		break;
+
+	case A:
+	{
+		/* Far pointers are the offset, followed by the selector */
+		DWORD64 offset = ReadImmediate(pState, size - WORD_SIZE);
+		WriteHex(pWriter, ReadImmediate(pState, WORD_SIZE));
+		Write(pWriter, ":");
+		WriteHex(pWriter, offset);
+		break;
+	}
+
+	case O:
+		WriteSizeKeyword(pWriter, size);
+		if (pState->Segment)
+		{
+			Write(pWriter, pState->Segment);
+			Write(pWriter, ":");
+		}
+		Write(pWriter, "[");
+		WriteHex(pWriter, ReadImmediate(pState, pState->AddressSize));
+		Write(pWriter, "]");
+		break;
+
+	default:
+		Write(pWriter, "?");
+		break;
+	}
+}
+
+/*
+Append an implied register operand.
+*/
+void WriteRegisterOperand(PFORMAT_STATE pState, const char *name)
+{
+	WriteSeparator(pState);
+	Write(&pState->Writer, name);
+}
+
+/*
+Find the segment override of an instruction, i.e. the last segment prefix among its legacy prefixes.
+@return the segment register's name, or NULL if the instruction has no segment override.
+*/
+const char *FindSegmentOverride(PDECODED_INSTRUCTION pInstruction, const BYTE *pCode)
+{
+	if (!(pInstruction->Prefixes & PREFIX_FLAG_SEGMENT))
+		return NULL;
+
+	const char *segment = NULL;
+	for (BYTE i = 0; i < pInstruction->Size; i++)
+	{
+		switch (pCode[i])
+		{
+		case 0x26: segment = "es"; break;
+		case 0x2E: segment = "cs"; break;
+		case 0x36: segment = "ss"; break;
+		case 0x3E: segment = "ds"; break;
+		case 0x64: segment = "fs"; break;
+		case 0x65: segment = "gs"; break;
+		case LOCK_PREFIX:
+		case REPNE_PREFIX:
+		case REP_PREFIX:
+		case OPERAND_SIZE_OVERRIDE_PREFIX:
+		case ADDRESS_SIZE_OVERRIDE_PREFIX:
+			break;
+		default:
+			return segment;
+		}
+	}
+
+	return segment;
+}
+
+/*
+Find the mnemonic & operands of a decoded instruction.
+@param pState, the instruction being formatted.
+@param pDescriptor, receives the instruction's explicit operands.
+@param pForm, receives the mnemonic's form.
+@param pbBare, receives whether the instruction's operands aren't rendered.
+@return the instruction's mnemonic, or NULL if it isn't rendered.
+*/
+const char *FindMnemonic(PFORMAT_STATE pState, OUT OPCODE_DESCRIPTOR *pDescriptor, OUT MNEMONIC_FORM *pForm, OUT bool *pbBare)
+{
+	PDECODED_INSTRUCTION pInstruction = pState->pInstruction;
+	BYTE opcode = pInstruction->Opcode;
+	BYTE prefixes = pInstruction->Prefixes;
+	*pbBare = false;
+
+	if (pInstruction->Map == OPMAP_1BYTE)
+	{
+		*pDescriptor = g_OpcodeMap[opcode];
+		*pForm = g_Mnemonics[opcode].Form;
+
+		/* NOP is XCHG eAX, eAX, unless REX.B selects another register */
+		if (opcode == 0x90 && !(pInstruction->Rex & REX_B))
+		{
+			*pbBare = true;
+			return prefixes & PREFIX_FLAG_REP ? "pause" : "nop";
+		}
+
+		if (opcode == 0x90)
+			*pForm = FORM_OPCODE_REG_ACC;
+
+		/* ARPL is replaced by MOVSXD in 64-bit mode */
+		if (opcode == 0x63 && pState->bMode64)
+		{
+			*pDescriptor = {2, G,v, E,d};
+			return "movsxd";
+		}
+	}
+	else if (pInstruction->Map == OPMAP_0F)
+	{
+		*pDescriptor = g_OpcodeMap0F[opcode];
+		*pForm = g_Mnemonics0F[opcode].Form;
+
+		/* Indirect branch tracking markers (a hint NOP, under a mandatory F3) */
+		if (opcode == 0x1E && (prefixes & PREFIX_FLAG_REP) && (pState->Mod == 3) && (pState->Reg == 7) && pState->Rm >= 2 && pState->Rm <= 3)
+		{
+			*pbBare = true;
+			return pState->Rm == 2 ? "endbr64" : "endbr32";
+		}
+
+		/* Select the mnemonic by the mandatory prefix, if there's one (F2 & F3 take precedence over 66) */
+		BYTE mandatoryPrefix = prefixes & PREFIX_FLAG_REP ? REP_PREFIX :
+			prefixes & PREFIX_FLAG_REPNE ? REPNE_PREFIX :
+			prefixes & PREFIX_FLAG_OPERAND_SIZE ? OPERAND_SIZE_OVERRIDE_PREFIX : 0;
+
+		for (const PREFIXED_MNEMONIC &mnemonic : g_PrefixedMnemonics)
+		{
+			if (mnemonic.Opcode != opcode || mnemonic.Prefix != mandatoryPrefix)
+				continue;
+
+			if (mnemonic.Operands.OperandAmount)
+				*pDescriptor = mnemonic.Operands;
+
+			/* The 66 prefix is mandatory, rather than an operand-size override */
+			if (mandatoryPrefix == OPERAND_SIZE_OVERRIDE_PREFIX)
+				pState->OperandSize = pState->bMode64 && (pInstruction->Rex & REX_W) ? QWORD_SIZE : DWORD_SIZE;
+
+			return mnemonic.Name;
+		}
+
+		/* Under the 66 prefix, MMX instructions operate on XMM registers instead */
+		for (BYTE i = 0; i < pDescriptor->OperandAmount; i++)
+		{
+			ADDRESSING_METHOD method = pDescriptor->Operands[i].AddressingMethod;
+			if (method == P || method == Q || method == N)
+				pState->bXmm = mandatoryPrefix == OPERAND_SIZE_OVERRIDE_PREFIX;
+		}
+
+		/* MOVD becomes MOVQ under REX.W */
+		if ((opcode == 0x6E || opcode == 0x7E) && (pInstruction->Rex & REX_W))
+			return "movq";
+
+		/* Group 7's register forms are separate instructions, selected by the entire ModRM byte */
+		if (opcode == 0x01 && pState->Mod == 3)
+		{
+			BYTE modRM = pState->pCode[pInstruction->ModRMOffset];
+			*pbBare = true;
+
+			for (const MODRM_MNEMONIC &mnemonic : g_Group7Mnemonics)
+				if (mnemonic.ModRM == modRM)
+					return mnemonic.Name;
+
+			return NULL;
+		}
+
+		/* RDRAND & RDSEED take a full-sized register */
+		if (opcode == 0xC7 && pState->Mod == 3)
+			*pDescriptor = {1, E,v};
+
+		/* CMPXCHG8B becomes CMPXCHG16B under REX.W */
+		if (opcode == 0xC7 && pState->Reg == 1 && (pInstruction->Rex & REX_W))
+		{
+			*pDescriptor = {1, M,dq};
+			return "cmpxchg16b";
+		}
+	}
+	else
+	{
+		return NULL;
+	}
+
+	/* Select the mnemonic of an Opcode Extension Group by the Reg field */
+	for (const MNEMONIC_GROUP &group : g_MnemonicGroups)
+	{
+		if (group.Map != pInstruction->Map || group.Opcode != opcode)
+			continue;
+
+		/* Some groups' operands depend on the Reg field as well */
+		for (const OPCODE_GROUP_ENTRY &entry : g_GroupOpcodes)
+			if (entry.Map == group.Map && entry.Opcode == opcode)
+				*pDescriptor = g_GroupMap[entry.Group][pState->Reg];
+
+		*pForm = group.Form;
+
+		if (pState->Mod == 3 && group.RegisterNames[pState->Reg])
+		{
+			*pbBare = group.bBareRegisterForms;
+			return group.RegisterNames[pState->Reg];
+		}
+
+		return pState->Mod == 3 && group.bBareRegisterForms ? NULL : group.Names[pState->Reg];
+	}
+
+	return pInstruction->Map == OPMAP_1BYTE ? g_Mnemonics[opcode].Name : g_Mnemonics0F[opcode].Name;
+}
+
+/*
+Append the raw bytes of an instruction that has no mnemonic (e.g. "db 0xc5, 0xf8, 0x77").
+*/
+void WriteRawBytes(PTEXT_WRITER pWriter, const BYTE *pCode, SIZE_T size)
+{
+	Write(pWriter, "db");
+	for (SIZE_T i = 0; i < size; i++)
+	{
+		Write(pWriter, i ? ", " : " ");
+		WriteHex(pWriter, pCode[i]);
+	}
+}
+
+/*
+Format a decoded instruction as Intel-syntax text (e.g. "mov qword ptr [rsp+0x8], rbx").
+@param pInstruction is the decoded instruction.
+@param pCode is the instruction's bytes.
+@param mode is the mode the instruction was decoded in.
+@param text is the buffer receiving the null-terminated text.
+@param textSize is the size of the buffer, FORMAT_BUFFER_SIZE always suffices.
+@return the length of the text, or 0 if the buffer is too small (in which case the text is truncated).
+*/
+SIZE_T Disassembler::FormatInstruction(PDECODED_INSTRUCTION pInstruction, const BYTE *pCode, DISASSEMBLER_MODE mode, OUT CHAR *text, SIZE_T textSize)
+{
+	if (!textSize)
+		return 0;
+
+	FORMAT_STATE state = { };
+	state.pInstruction = pInstruction;
+	state.pCode = pCode;
+	state.bMode64 = mode == DISASM_MODE_64;
+	state.Writer = { text, textSize };
+	text[0] = '\0';
+
+	if (pInstruction->ModRMOffset)
+	{
+		BYTE modRM = pCode[pInstruction->ModRMOffset];
+		state.Mod = modRM >> 6;
+		state.Reg = (modRM >> 3) & 7;
+		state.Rm = modRM & 7;
+	}
+
+	/* Compute the operand & address sizes, from the mode & the size-override prefixes */
+	bool bOperandSizeOverride = pInstruction->Prefixes & PREFIX_FLAG_OPERAND_SIZE;
+	bool bAddressSizeOverride = pInstruction->Prefixes & PREFIX_FLAG_ADDRESS_SIZE;
+	if (state.bMode64 && ((pInstruction->Rex & REX_W) || (IsDefaultOperandSize64(pInstruction, state.Reg) && !bOperandSizeOverride)))
+		state.OperandSize = QWORD_SIZE;
+	else
+		state.OperandSize = bOperandSizeOverride ? WORD_SIZE : DWORD_SIZE;
+
+	if (state.bMode64)
+		state.AddressSize = bAddressSizeOverride ? DWORD_SIZE : QWORD_SIZE;
+	else
+		state.AddressSize = bAddressSizeOverride ? WORD_SIZE : DWORD_SIZE;
+
+	state.Segment = FindSegmentOverride(pInstruction, pCode);
+	state.ImmediateOffset = pInstruction->ImmediateOffset;
+
+	OPCODE_DESCRIPTOR descriptor = { };
+	MNEMONIC_FORM form = FORM_PLAIN;
+	bool bBare = false;
+	const char *mnemonic = pInstruction->Encoding == ENCODING_LEGACY ? FindMnemonic(&state, &descriptor, &form, &bBare) : NULL;
+	PTEXT_WRITER pWriter = &state.Writer;
+
+	/* Instructions without a mnemonic (e.g. x87, VEX & EVEX encoded) are rendered as raw bytes */
+	if (!mnemonic)
+	{
+		WriteRawBytes(pWriter, pCode, pInstruction->Size);
+		return pWriter->bOverflow ? 0 : pWriter->Length;
+	}
+
+	if (pInstruction->Prefixes & PREFIX_FLAG_LOCK)
+		Write(pWriter, "lock ");
+
+	/* The accumulator is AL for even opcodes, and rAX for odd opcodes (XCHG is always rAX, IN & OUT are at most 32-bit) */
+	BYTE opcode = pInstruction->Opcode;
+	BYTE accumulatorSize = opcode & 1 || form == FORM_OPCODE_REG_ACC ? state.OperandSize : BYTE_SIZE;
+	if ((opcode & 0xF4) == 0xE4)
+		accumulatorSize = min(accumulatorSize, (BYTE) DWORD_SIZE);
+
+	const char *accumulator = RegisterName(&state, 0, accumulatorSize);
+
+	switch (form)
+	{
+	case FORM_STRING:
+	{
+		/* REP is REPE for comparing string instructions */
+		bool bCompares = opcode == 0xA6 || opcode == 0xA7 || opcode == 0xAE || opcode == 0xAF;
+		if (pInstruction->Prefixes & PREFIX_FLAG_REP)
+			Write(pWriter, bCompares ? "repe " : "rep ");
+		else if (pInstruction->Prefixes & PREFIX_FLAG_REPNE)
+			Write(pWriter, "repne ");
+
+		Write(pWriter, mnemonic);
+		Write(pWriter, accumulatorSize == BYTE_SIZE ? "b" : accumulatorSize == WORD_SIZE ? "w" : accumulatorSize == DWORD_SIZE ? "d" : "q");
+		return pWriter->bOverflow ? 0 : pWriter->Length;
+	}
+
+	case FORM_OPERAND_SIZED:
+	case FORM_ADDRESS_SIZED:
+	{
+		/* Skip to the mnemonic of the instruction's size */
+		BYTE size = form == FORM_OPERAND_SIZED ? state.OperandSize : state.AddressSize;
+		for (BYTE skipped = WORD_SIZE; skipped < size; skipped *= 2)
+			while (*mnemonic++ != '/');
+
+		WriteUntil(pWriter, mnemonic, '/');
+		break;
+	}
+
+	default:
+		Write(pWriter, mnemonic);
+		break;
+	}
+
+	if (bBare)
+		return pWriter->bOverflow ? 0 : pWriter->Length;
+
+	/* Write the implied operands that precede the explicit operands */
+	switch (form)
+	{
+	case FORM_ACC:
+	case FORM_ACC_DX:
+		WriteRegisterOperand(&state, accumulator);
+		break;
+
+	case FORM_DX_ACC:
+		WriteRegisterOperand(&state, "dx");
+		break;
+
+	case FORM_OPCODE_REG:
+	case FORM_OPCODE_REG_ACC:
+	{
+		/* The register is sized by the explicit operand, if there's one (MOV r8, Ib) */
+		BYTE size = descriptor.OperandAmount ? OperandTypeSize(&state, descriptor.Operands[0]) : state.OperandSize;
+		WriteRegisterOperand(&state, RegisterName(&state, (opcode & 7) | (pInstruction->Rex & REX_B ? 8 : 0), size));
+		break;
+	}
+
+	default:
+		/* The rest of the forms have no implied operands, or only ones that follow the explicit operands */
+		break;
+	}
+
+	for (BYTE i = 0; i < descriptor.OperandAmount; i++)
+		WriteOperand(&state, descriptor.Operands[i]);
+
+	/* Write the implied operands that follow the explicit operands */
+	switch (form)
+	{
+	case FORM_ACC_LAST:
+	case FORM_DX_ACC:
+	case FORM_OPCODE_REG_ACC:
+		WriteRegisterOperand(&state, accumulator);
+		break;
+
+	case FORM_ACC_DX:
+		WriteRegisterOperand(&state, "dx");
+		break;
+
+	case FORM_ONE:
+		WriteRegisterOperand(&state, "1");
+		break;
+
+	case FORM_CL:
+		WriteRegisterOperand(&state, "cl");
+		break;
+
+	default:
+		/* The rest of the forms have no implied operands, or only ones that precede the explicit operands */
+		break;
+	}
+
+	return pWriter->bOverflow ? 0 : pWriter->Length;
+}
+
+/*
+Format bytes as hexadecimal text (e.g. "48 89 5c 24 08").
+@param pBytes is the bytes to be formatted.
+@param size is the amount of bytes.
+@param text is the buffer receiving the null-terminated text.
+@param textSize is the size of the buffer, 3 characters per byte always suffice.
+@return the length of the text, or 0 if the buffer is too small (in which case the text is truncated).
+*/
+SIZE_T Disassembler::FormatBytes(const BYTE *pBytes, SIZE_T size, OUT CHAR *text, SIZE_T textSize)
+{
+	if (!textSize)
+		return 0;
+
+	TEXT_WRITER writer = { text, textSize };
+	text[0] = '\0';
+
+	for (SIZE_T i = 0; i < size; i++)
+	{
+		CHAR digits[4] = { ' ', "0123456789abcdef"[pBytes[i] >> 4], "0123456789abcdef"[pBytes[i] & 0xF] };
+		Write(&writer, i ? digits : digits + 1);
+	}
+
+	return writer.bOverflow ? 0 : writer.Length;
+}
@@ -0,0 +1,395 @@
+#pragma once
+#include "OpcodeMaps.h"
+
+/*
+Mnemonics of the opcodes the formatter renders as text.
+Explicit operands are described by the Opcode Maps, so only the operands an opcode implies are described here.
+Opcodes without a mnemonic (e.g. x87 escapes) are rendered as raw bytes.
+*/
+
+/*
+The form of a mnemonic, i.e. which operands the opcode implies, or how the mnemonic is chosen.
+*/
+enum MNEMONIC_FORM : BYTE
+{
+	/* The opcode only has explicit operands */
+	FORM_PLAIN,
+	/* The accumulator (AL for even opcodes, rAX for odd opcodes) precedes the explicit operands */
+	FORM_ACC,
+	/* The accumulator follows the explicit operands */
+	FORM_ACC_LAST,
+	/* The accumulator, followed by DX (IN) */
+	FORM_ACC_DX,
+	/* DX, followed by the accumulator (OUT) */
+	FORM_DX_ACC,
+	/* A register encoded by the opcode's 3 least-significant bits precedes the explicit operands */
+	FORM_OPCODE_REG,
+	/* A register encoded by the opcode's 3 least-significant bits, followed by the accumulator (XCHG) */
+	FORM_OPCODE_REG_ACC,
+	/* The constant 1 follows the explicit operands (shifts & rotates) */
+	FORM_ONE,
+	/* CL follows the explicit operands (shifts & rotates) */
+	FORM_CL,
+	/* String instruction, suffixed by its operand size (e.g. MOVSB, STOSQ), whose operands aren't rendered */
+	FORM_STRING,
+	/* The mnemonic is one of three, separated by '/', chosen by the operand size (16, 32 or 64-bit) */
+	FORM_OPERAND_SIZED,
+	/* The mnemonic is one of three, separated by '/', chosen by the address size (16, 32 or 64-bit) */
+	FORM_ADDRESS_SIZED,
+};
+
+/*
+Struct describing the mnemonic of an opcode.
+*/
+typedef struct _MNEMONIC_DESCRIPTOR
+{
+	/* The mnemonic itself, or NULL if the opcode isn't rendered */
+	const char *Name;
+	/* The mnemonic's form (MNEMONIC_FORM) */
+	MNEMONIC_FORM Form;
+}
+MNEMONIC_DESCRIPTOR, *PMNEMONIC_DESCRIPTOR;
+
+/*
+Mnemonics of all one-byte opcodes.
+Opcodes that belong to an Opcode Extension Group are named by g_MnemonicGroups instead.
+*/
+constexpr MNEMONIC_DESCRIPTOR g_Mnemonics[0x100] =
+{
+/*	00				01				02				03				04						05						06				07 */
+	{"add"},		{"add"},		{"add"},		{"add"},		{"add", FORM_ACC},		{"add", FORM_ACC},		{"push es"},	{"pop es"},
+/*	08				09				0A				0B				0C						0D						0E				0F */
+	{"or"},			{"or"},			{"or"},			{"or"},			{"or", FORM_ACC},		{"or", FORM_ACC},		{"push cs"},	{},
+
+/*	10				11				12				13				14						15						16				17 */
+	{"adc"},		{"adc"},		{"adc"},		{"adc"},		{"adc", FORM_ACC},		{"adc", FORM_ACC},		{"push ss"},	{"pop ss"},
+/*	18				19				1A				1B				1C						1D						1E				1F */
+	{"sbb"},		{"sbb"},		{"sbb"},		{"sbb"},		{"sbb", FORM_ACC},		{"sbb", FORM_ACC},		{"push ds"},	{"pop ds"},
+
+/*	20				21				22				23				24						25						26				27 */
+	{"and"},		{"and"},		{"and"},		{"and"},		{"and", FORM_ACC},		{"and", FORM_ACC},		{},				{"daa"},
+/*	28				29				2A				2B				2C						2D						2E				2F */
+	{"sub"},		{"sub"},		{"sub"},		{"sub"},		{"sub", FORM_ACC},		{"sub", FORM_ACC},		{},				{"das"},
+
+/*	30				31				32				33				34						35						36				37 */
+	{"xor"},		{"xor"},		{"xor"},		{"xor"},		{"xor", FORM_ACC},		{"xor", FORM_ACC},		{},				{"aaa"},
+/*	38				39				3A				3B				3C						3D						3E				3F */
+	{"cmp"},		{"cmp"},		{"cmp"},		{"cmp"},		{"cmp", FORM_ACC},		{"cmp", FORM_ACC},		{},				{"aas"},
+
+/*	40						41						42						43						44						45						46						47 */
+	{"inc", FORM_OPCODE_REG},	{"inc", FORM_OPCODE_REG},	{"inc", FORM_OPCODE_REG},	{"inc", FORM_OPCODE_REG},	{"inc", FORM_OPCODE_REG},	{"inc", FORM_OPCODE_REG},	{"inc", FORM_OPCODE_REG},	{"inc", FORM_OPCODE_REG},
+/*	48						49						4A						4B						4C						4D						4E						4F */
+	{"dec", FORM_OPCODE_REG},	{"dec", FORM_OPCODE_REG},	{"dec", FORM_OPCODE_REG},	{"dec", FORM_OPCODE_REG},	{"dec", FORM_OPCODE_REG},	{"dec", FORM_OPCODE_REG},	{"dec", FORM_OPCODE_REG},	{"dec", FORM_OPCODE_REG},
+
+/*	50						51						52						53						54						55						56						57 */
+	{"push", FORM_OPCODE_REG},	{"push", FORM_OPCODE_REG},	{"push", FORM_OPCODE_REG},	{"push", FORM_OPCODE_REG},	{"push", FORM_OPCODE_REG},	{"push", FORM_OPCODE_REG},	{"push", FORM_OPCODE_REG},	{"push", FORM_OPCODE_REG},
+/*	58						59						5A						5B						5C						5D						5E						5F */
+	{"pop", FORM_OPCODE_REG},	{"pop", FORM_OPCODE_REG},	{"pop", FORM_OPCODE_REG},	{"pop", FORM_OPCODE_REG},	{"pop", FORM_OPCODE_REG},	{"pop", FORM_OPCODE_REG},	{"pop", FORM_OPCODE_REG},	{"pop", FORM_OPCODE_REG},
+
+/*	60										61										62				63				64				65				66				67 */
+	{"pusha/pushad/pushad", FORM_OPERAND_SIZED},	{"popa/popad/popad", FORM_OPERAND_SIZED},	{"bound"},		{"arpl"},		{},				{},				{},				{},
+/*	68				69				6A				6B				6C						6D						6E						6F */
+	{"push"},		{"imul"},		{"push"},		{"imul"},		{"ins", FORM_STRING},	{"ins", FORM_STRING},	{"outs", FORM_STRING},	{"outs", FORM_STRING},
+
+/*	70				71				72				73				74				75				76				77 */
+	{"jo"},			{"jno"},		{"jb"},			{"jae"},		{"je"},			{"jne"},		{"jbe"},		{"ja"},
+/*	78				79				7A				7B				7C				7D				7E				7F */
+	{"js"},			{"jns"},		{"jp"},			{"jnp"},		{"jl"},			{"jge"},		{"jle"},		{"jg"},
+
+/*	80				81				82				83				84				85				86				87 */
+	{},				{},				{},				{},				{"test"},		{"test"},		{"xchg"},		{"xchg"},
+/*	88				89				8A				8B				8C				8D				8E				8F */
+	{"mov"},		{"mov"},		{"mov"},		{"mov"},		{"mov"},		{"lea"},		{"mov"},		{},
+
+/*	90				91								92								93								94								95								96								97 */
+	{"nop"},		{"xchg", FORM_OPCODE_REG_ACC},	{"xchg", FORM_OPCODE_REG_ACC},	{"xchg", FORM_OPCODE_REG_ACC},	{"xchg", FORM_OPCODE_REG_ACC},	{"xchg", FORM_OPCODE_REG_ACC},	{"xchg", FORM_OPCODE_REG_ACC},	{"xchg", FORM_OPCODE_REG_ACC},
+/*	98										99										9A				9B				9C											9D										9E				9F */
+	{"cbw/cwde/cdqe", FORM_OPERAND_SIZED},	{"cwd/cdq/cqo", FORM_OPERAND_SIZED},	{"call"},		{"fwait"},		{"pushf/pushfd/pushfq", FORM_OPERAND_SIZED},	{"popf/popfd/popfq", FORM_OPERAND_SIZED},	{"sahf"},		{"lahf"},
+
+/*	A0						A1						A2							A3							A4						A5						A6						A7 */
+	{"mov", FORM_ACC},		{"mov", FORM_ACC},		{"mov", FORM_ACC_LAST},		{"mov", FORM_ACC_LAST},		{"movs", FORM_STRING},	{"movs", FORM_STRING},	{"cmps", FORM_STRING},	{"cmps", FORM_STRING},
+/*	A8						A9						AA							AB							AC						AD						AE						AF */
+	{"test", FORM_ACC},		{"test", FORM_ACC},		{"stos", FORM_STRING},		{"stos", FORM_STRING},		{"lods", FORM_STRING},	{"lods", FORM_STRING},	{"scas", FORM_STRING},	{"scas", FORM_STRING},
+
+/*	B0						B1						B2						B3						B4						B5						B6						B7 */
+	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},
+/*	B8						B9						BA						BB						BC						BD						BE						BF */
+	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},	{"mov", FORM_OPCODE_REG},
+
+/*	C0				C1				C2				C3				C4				C5				C6				C7 */
+	{},				{},				{"ret"},		{"ret"},		{"les"},		{"lds"},		{},				{},
+/*	C8				C9				CA				CB				CC				CD				CE				CF */
+	{"enter"},		{"leave"},		{"retf"},		{"retf"},		{"int3"},		{"int"},		{"into"},		{"iret/iretd/iretq", FORM_OPERAND_SIZED},
+
+/*	D0				D1				D2				D3				D4				D5				D6				D7 */
+	{},				{},				{},				{},				{"aam"},		{"aad"},		{},				{"xlat"},
+/*	D8				D9				DA				DB				DC				DD				DE				DF */
+	{},				{},				{},				{},				{},				{},				{},				{},
+
+/*	E0				E1				E2				E3										E4						E5						E6							E7 */
+	{"loopne"},		{"loope"},		{"loop"},		{"jcxz/jecxz/jrcxz", FORM_ADDRESS_SIZED},	{"in", FORM_ACC},		{"in", FORM_ACC},		{"out", FORM_ACC_LAST},		{"out", FORM_ACC_LAST},
+/*	E8				E9				EA				EB				EC						ED						EE							EF */
+	{"call"},		{"jmp"},		{"jmp"},		{"jmp"},		{"in", FORM_ACC_DX},	{"in", FORM_ACC_DX},	{"out", FORM_DX_ACC},		{"out", FORM_DX_ACC},
+
+/*	F0				F1				F2				F3				F4				F5				F6				F7 */
+	{},				{"int1"},		{},				{},				{"hlt"},		{"cmc"},		{},				{},
+/*	F8				F9				FA				FB				FC				FD				FE				FF */
+	{"clc"},		{"stc"},		{"cli"},		{"sti"},		{"cld"},		{"std"},		{},				{},
+};
+
+/*
+Mnemonics of all two-byte opcodes (i.e. opcodes escaped by 0F), without a mandatory prefix.
+Opcodes that belong to an Opcode Extension Group are named by g_MnemonicGroups instead,
+and opcodes whose mnemonic depends on a mandatory prefix are also named by g_PrefixedMnemonics.
+*/
+constexpr MNEMONIC_DESCRIPTOR g_Mnemonics0F[0x100] =
+{
+/*	00				01				02				03				04				05				06				07 */
+	{},				{},				{"lar"},		{"lsl"},		{},				{"syscall"},	{"clts"},		{"sysret"},
+/*	08				09				0A				0B				0C				0D				0E				0F */
+	{"invd"},		{"wbinvd"},		{},				{"ud2"},		{},				{},				{},				{},
+
+/*	10				11				12				13				14				15				16				17 */
+	{"movups"},		{"movups"},		{},				{"movlps"},		{"unpcklps"},	{"unpckhps"},	{},				{"movhps"},
+/*	18				19				1A				1B				1C				1D				1E				1F */
+	{},				{"nop"},		{"nop"},		{"nop"},		{"nop"},		{"nop"},		{"nop"},		{"nop"},
+
+/*	20				21				22				23				24				25				26				27 */
+	{"mov"},		{"mov"},		{"mov"},		{"mov"},		{},				{},				{},				{},
+/*	28				29				2A				2B				2C				2D				2E				2F */
+	{"movaps"},		{"movaps"},		{"cvtpi2ps"},	{"movntps"},	{"cvttps2pi"},	{"cvtps2pi"},	{"ucomiss"},	{"comiss"},
+
+/*	30				31				32				33				34				35				36				37 */
+	{"wrmsr"},		{"rdtsc"},		{"rdmsr"},		{"rdpmc"},		{"sysenter"},	{"sysexit"},	{},				{"getsec"},
+/*	38				39				3A				3B				3C				3D				3E				3F */
+	{},				{},				{},				{},				{},				{},				{},				{},
+
+/*	40				41				42				43				44				45				46				47 */
+	{"cmovo"},		{"cmovno"},		{"cmovb"},		{"cmovae"},		{"cmove"},		{"cmovne"},		{"cmovbe"},		{"cmova"},
+/*	48				49				4A				4B				4C				4D				4E				4F */
+	{"cmovs"},		{"cmovns"},		{"cmovp"},		{"cmovnp"},		{"cmovl"},		{"cmovge"},		{"cmovle"},		{"cmovg"},
+
+/*	50				51				52				53				54				55				56				57 */
+	{"movmskps"},	{"sqrtps"},		{"rsqrtps"},	{"rcpps"},		{"andps"},		{"andnps"},		{"orps"},		{"xorps"},
+/*	58				59				5A				5B				5C				5D				5E				5F */
+	{"addps"},		{"mulps"},		{"cvtps2pd"},	{"cvtdq2ps"},	{"subps"},		{"minps"},		{"divps"},		{"maxps"},
+
+/*	60				61				62				63				64				65				66				67 */
+	{"punpcklbw"},	{"punpcklwd"},	{"punpckldq"},	{"packsswb"},	{"pcmpgtb"},	{"pcmpgtw"},	{"pcmpgtd"},	{"packuswb"},
+/*	68				69				6A				6B				6C				6D				6E				6F */
+	{"punpckhbw"},	{"punpckhwd"},	{"punpckhdq"},	{"packssdw"},	{},				{},				{"movd"},		{"movq"},
+
+/*	70				71				72				73				74				75				76				77 */
+	{"pshufw"},		{},				{},				{},				{"pcmpeqb"},	{"pcmpeqw"},	{"pcmpeqd"},	{"emms"},
+/*	78				79				7A				7B				7C				7D				7E				7F */
+	{"vmread"},		{"vmwrite"},	{},				{},				{},				{},				{"movd"},		{"movq"},
+
+/*	80				81				82				83				84				85				86				87 */
+	{"jo"},			{"jno"},		{"jb"},			{"jae"},		{"je"},			{"jne"},		{"jbe"},		{"ja"},
+/*	88				89				8A				8B				8C				8D				8E				8F */
+	{"js"},			{"jns"},		{"jp"},			{"jnp"},		{"jl"},			{"jge"},		{"jle"},		{"jg"},
+
+/*	90				91				92				93				94				95				96				97 */
+	{"seto"},		{"setno"},		{"setb"},		{"setae"},		{"sete"},		{"setne"},		{"setbe"},		{"seta"},
+/*	98				99				9A				9B				9C				9D				9E				9F */
+	{"sets"},		{"setns"},		{"setp"},		{"setnp"},		{"setl"},		{"setge"},		{"setle"},		{"setg"},
+
+/*	A0				A1				A2				A3				A4				A5						A6				A7 */
+	{"push fs"},	{"pop fs"},		{"cpuid"},		{"bt"},			{"shld"},		{"shld", FORM_CL},		{},				{},
+/*	A8				A9				AA				AB				AC				AD						AE				AF */
+	{"push gs"},	{"pop gs"},		{"rsm"},		{"bts"},		{"shrd"},		{"shrd", FORM_CL},		{},				{"imul"},
+
+/*	B0				B1				B2				B3				B4				B5				B6				B7 */
+	{"cmpxchg"},	{"cmpxchg"},	{"lss"},		{"btr"},		{"lfs"},		{"lgs"},		{"movzx"},		{"movzx"},
+/*	B8				B9				BA				BB				BC				BD				BE				BF */
+	{},				{"ud1"},		{},				{"btc"},		{"bsf"},		{"bsr"},		{"movsx"},		{"movsx"},
+
+/*	C0				C1				C2				C3				C4				C5				C6				C7 */
+	{"xadd"},		{"xadd"},		{"cmpps"},		{"movnti"},		{"pinsrw"},		{"pextrw"},		{"shufps"},		{},
+/*	C8						C9						CA						CB						CC						CD						CE						CF */
+	{"bswap", FORM_OPCODE_REG},	{"bswap", FORM_OPCODE_REG},	{"bswap", FORM_OPCODE_REG},	{"bswap", FORM_OPCODE_REG},	{"bswap", FORM_OPCODE_REG},	{"bswap", FORM_OPCODE_REG},	{"bswap", FORM_OPCODE_REG},	{"bswap", FORM_OPCODE_REG},
+
+/*	D0				D1				D2				D3				D4				D5				D6				D7 */
+	{},				{"psrlw"},		{"psrld"},		{"psrlq"},		{"paddq"},		{"pmullw"},		{},				{"pmovmskb"},
+/*	D8				D9				DA				DB				DC				DD				DE				DF */
+	{"psubusb"},	{"psubusw"},	{"pminub"},		{"pand"},		{"paddusb"},	{"paddusw"},	{"pmaxub"},		{"pandn"},
+
+/*	E0				E1				E2				E3				E4				E5				E6				E7 */
+	{"pavgb"},		{"psraw"},		{"psrad"},		{"pavgw"},		{"pmulhuw"},	{"pmulhw"},		{},				{"movntq"},
+/*	E8				E9				EA				EB				EC				ED				EE				EF */
+	{"psubsb"},		{"psubsw"},		{"pminsw"},		{"por"},		{"paddsb"},		{"paddsw"},		{"pmaxsw"},		{"pxor"},
+
+/*	F0				F1				F2				F3				F4				F5				F6				F7 */
+	{},				{"psllw"},		{"pslld"},		{"psllq"},		{"pmuludq"},	{"pmaddwd"},	{"psadbw"},		{"maskmovq"},
+/*	F8				F9				FA				FB				FC				FD				FE				FF */
+	{"psubb"},		{"psubw"},		{"psubd"},		{"psubq"},		{"paddb"},		{"paddw"},		{"paddd"},		{"ud0"},
+};
+
+/*
+Struct describing the mnemonics of an Opcode Extension Group, i.e. opcodes whose mnemonic is selected by the Reg field of the ModRM byte.
+*/
+typedef struct _MNEMONIC_GROUP
+{
+	OPCODE_MAP Map;
+	BYTE Opcode;
+	/* The implied operands of every member of the group */
+	MNEMONIC_FORM Form;
+	/* The mnemonic of every Reg value, when the ModRM byte specifies memory */
+	const char *Names[8];
+	/*
+	The mnemonic of every Reg value, when the ModRM byte specifies a register (i.e. its Mod field is 11b).
+	If none are given, the memory mnemonics are used for registers as well.
+	*/
+	const char *RegisterNames[8];
+	/* Describes whether the register forms take no operands (e.g. LFENCE) */
+	bool bBareRegisterForms;
+}
+MNEMONIC_GROUP, *PMNEMONIC_GROUP;
+
+/*
+The mnemonics of all Opcode Extension Groups.
+*/
+constexpr MNEMONIC_GROUP g_MnemonicGroups[] =
+{
+	/* Group 1 */
+	{ OPMAP_1BYTE, 0x80, FORM_PLAIN, { "add", "or", "adc", "sbb", "and", "sub", "xor", "cmp" } },
+	{ OPMAP_1BYTE, 0x81, FORM_PLAIN, { "add", "or", "adc", "sbb", "and", "sub", "xor", "cmp" } },
+	{ OPMAP_1BYTE, 0x82, FORM_PLAIN, { "add", "or", "adc", "sbb", "and", "sub", "xor", "cmp" } },
+	{ OPMAP_1BYTE, 0x83, FORM_PLAIN, { "add", "or", "adc", "sbb", "and", "sub", "xor", "cmp" } },
+	/* Group 1A */
+	{ OPMAP_1BYTE, 0x8F, FORM_PLAIN, { "pop" } },
+	/* Group 2 */
+	{ OPMAP_1BYTE, 0xC0, FORM_PLAIN, { "rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar" } },
+	{ OPMAP_1BYTE, 0xC1, FORM_PLAIN, { "rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar" } },
+	{ OPMAP_1BYTE, 0xD0, FORM_ONE, { "rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar" } },
+	{ OPMAP_1BYTE, 0xD1, FORM_ONE, { "rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar" } },
+	{ OPMAP_1BYTE, 0xD2, FORM_CL, { "rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar" } },
+	{ OPMAP_1BYTE, 0xD3, FORM_CL, { "rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar" } },
+	/* Group 11 */
+	{ OPMAP_1BYTE, 0xC6, FORM_PLAIN, { "mov" } },
+	{ OPMAP_1BYTE, 0xC7, FORM_PLAIN, { "mov", NULL, NULL, NULL, NULL, NULL, NULL, "xbegin" } },
+	/* Group 3 */
+	{ OPMAP_1BYTE, 0xF6, FORM_PLAIN, { "test", "test", "not", "neg", "mul", "imul", "div", "idiv" } },
+	{ OPMAP_1BYTE, 0xF7, FORM_PLAIN, { "test", "test", "not", "neg", "mul", "imul", "div", "idiv" } },
+	/* Group 4 */
+	{ OPMAP_1BYTE, 0xFE, FORM_PLAIN, { "inc", "dec" } },
+	/* Group 5 */
+	{ OPMAP_1BYTE, 0xFF, FORM_PLAIN, { "inc", "dec", "call", "call", "jmp", "jmp", "push" } },
+	/* Group 6 */
+	{ OPMAP_0F, 0x00, FORM_PLAIN, { "sldt", "str", "lldt", "ltr", "verr", "verw" } },
+	/* Group 7 (register forms are selected by the entire ModRM byte, see g_Group7Mnemonics) */
+	{ OPMAP_0F, 0x01, FORM_PLAIN, { "sgdt", "sidt", "lgdt", "lidt", "smsw", NULL, "lmsw", "invlpg" } },
+	/* Group P */
+	{ OPMAP_0F, 0x0D, FORM_PLAIN, { "prefetch", "prefetchw", "prefetchwt1", "prefetch", "prefetch", "prefetch", "prefetch", "prefetch" } },
+	/* MOVLPS & MOVHPS become MOVHLPS & MOVLHPS between registers */
+	{ OPMAP_0F, 0x12, FORM_PLAIN, { "movlps", "movlps", "movlps", "movlps", "movlps", "movlps", "movlps", "movlps" },
+		{ "movhlps", "movhlps", "movhlps", "movhlps", "movhlps", "movhlps", "movhlps", "movhlps" } },
+	{ OPMAP_0F, 0x16, FORM_PLAIN, { "movhps", "movhps", "movhps", "movhps", "movhps", "movhps", "movhps", "movhps" },
+		{ "movlhps", "movlhps", "movlhps", "movlhps", "movlhps", "movlhps", "movlhps", "movlhps" } },
+	/* Group 16 */
+	{ OPMAP_0F, 0x18, FORM_PLAIN, { "prefetchnta", "prefetcht0", "prefetcht1", "prefetcht2", "nop", "nop", "nop", "nop" } },
+	/* Groups 12, 13 & 14 */
+	{ OPMAP_0F, 0x71, FORM_PLAIN, { NULL, NULL, "psrlw", NULL, "psraw", NULL, "psllw" } },
+	{ OPMAP_0F, 0x72, FORM_PLAIN, { NULL, NULL, "psrld", NULL, "psrad", NULL, "pslld" } },
+	{ OPMAP_0F, 0x73, FORM_PLAIN, { NULL, NULL, "psrlq", "psrldq", NULL, NULL, "psllq", "pslldq" } },
+	/* Group 15 */
+	{ OPMAP_0F, 0xAE, FORM_PLAIN, { "fxsave", "fxrstor", "ldmxcsr", "stmxcsr", "xsave", "xrstor", "xsaveopt", "clflush" },
+		{ NULL, NULL, NULL, NULL, NULL, "lfence", "mfence", "sfence" }, true },
+	/* Group 8 */
+	{ OPMAP_0F, 0xBA, FORM_PLAIN, { NULL, NULL, NULL, NULL, "bt", "bts", "btr", "btc" } },
+	/* Group 9 */
+	{ OPMAP_0F, 0xC7, FORM_PLAIN, { NULL, "cmpxchg8b", NULL, "xrstors", "xsavec", "xsaves", "vmptrld", "vmptrst" },
+		{ NULL, NULL, NULL, NULL, NULL, NULL, "rdrand", "rdseed" } },
+};
+
+/*
+Struct linking an entire ModRM byte to a mnemonic, for opcodes whose register forms are separate instructions.
+*/
+typedef struct _MODRM_MNEMONIC
+{
+	BYTE ModRM;
+	const char *Name;
+}
+MODRM_MNEMONIC, *PMODRM_MNEMONIC;
+
+/*
+The register forms of Group 7 (0F 01), which take no operands.
+*/
+constexpr MODRM_MNEMONIC g_Group7Mnemonics[] =
+{
+	{ 0xC8, "monitor" }, { 0xC9, "mwait" }, { 0xCA, "clac" }, { 0xCB, "stac" },
+	{ 0xD0, "xgetbv" }, { 0xD1, "xsetbv" }, { 0xD5, "xend" }, { 0xD6, "xtest" },
+	{ 0xF8, "swapgs" }, { 0xF9, "rdtscp" },
+};
+
+/*
+Struct describing the mnemonic of a two-byte opcode under a mandatory prefix (66, F2 or F3).
+Mandatory prefixes may change the type of the operands as well (e.g. scalar rather than packed), in which case they're given.
+*/
+typedef struct _PREFIXED_MNEMONIC
+{
+	BYTE Opcode;
+	/* The mandatory prefix */
+	BYTE Prefix;
+	const char *Name;
+	/* The opcode's operands under the prefix, or none if they're the same as without it */
+	OPCODE_DESCRIPTOR Operands;
+}
+PREFIXED_MNEMONIC, *PPREFIXED_MNEMONIC;
+
+/*
+The mnemonics of all two-byte opcodes under their mandatory prefixes.
+*/
+constexpr PREFIXED_MNEMONIC g_PrefixedMnemonics[] =
+{
+	{ 0x10, 0x66, "movupd" },			{ 0x10, 0xF3, "movss", {2, V,ss, W,ss} },			{ 0x10, 0xF2, "movsd", {2, V,sd, W,sd} },
+	{ 0x11, 0x66, "movupd" },			{ 0x11, 0xF3, "movss", {2, W,ss, V,ss} },			{ 0x11, 0xF2, "movsd", {2, W,sd, V,sd} },
+	{ 0x12, 0x66, "movlpd" },			{ 0x12, 0xF3, "movsldup", {2, V,x, W,x} },			{ 0x12, 0xF2, "movddup", {2, V,x, W,sd} },
+	{ 0x13, 0x66, "movlpd" },
+	{ 0x14, 0x66, "unpcklpd" },
+	{ 0x15, 0x66, "unpckhpd" },
+	{ 0x16, 0x66, "movhpd" },			{ 0x16, 0xF3, "movshdup", {2, V,x, W,x} },
+	{ 0x17, 0x66, "movhpd" },
+	{ 0x28, 0x66, "movapd" },
+	{ 0x29, 0x66, "movapd" },
+	{ 0x2A, 0x66, "cvtpi2pd" },			{ 0x2A, 0xF3, "cvtsi2ss", {2, V,ss, E,y} },			{ 0x2A, 0xF2, "cvtsi2sd", {2, V,sd, E,y} },
+	{ 0x2B, 0x66, "movntpd" },
+	{ 0x2C, 0x66, "cvttpd2pi" },		{ 0x2C, 0xF3, "cvttss2si", {2, G,y, W,ss} },		{ 0x2C, 0xF2, "cvttsd2si", {2, G,y, W,sd} },
+	{ 0x2D, 0x66, "cvtpd2pi" },			{ 0x2D, 0xF3, "cvtss2si", {2, G,y, W,ss} },			{ 0x2D, 0xF2, "cvtsd2si", {2, G,y, W,sd} },
+	{ 0x2E, 0x66, "ucomisd", {2, V,sd, W,sd} },
+	{ 0x2F, 0x66, "comisd", {2, V,sd, W,sd} },
+	{ 0x50, 0x66, "movmskpd" },
+	{ 0x51, 0x66, "sqrtpd" },			{ 0x51, 0xF3, "sqrtss", {2, V,ss, W,ss} },			{ 0x51, 0xF2, "sqrtsd", {2, V,sd, W,sd} },
+	{ 0x52, 0xF3, "rsqrtss", {2, V,ss, W,ss} },
+	{ 0x53, 0xF3, "rcpss", {2, V,ss, W,ss} },
+	{ 0x54, 0x66, "andpd" },
+	{ 0x55, 0x66, "andnpd" },
+	{ 0x56, 0x66, "orpd" },
+	{ 0x57, 0x66, "xorpd" },
+	{ 0x58, 0x66, "addpd" },			{ 0x58, 0xF3, "addss", {2, V,ss, W,ss} },			{ 0x58, 0xF2, "addsd", {2, V,sd, W,sd} },
+	{ 0x59, 0x66, "mulpd" },			{ 0x59, 0xF3, "mulss", {2, V,ss, W,ss} },			{ 0x59, 0xF2, "mulsd", {2, V,sd, W,sd} },
+	{ 0x5A, 0x66, "cvtpd2ps" },			{ 0x5A, 0xF3, "cvtss2sd", {2, V,sd, W,ss} },		{ 0x5A, 0xF2, "cvtsd2ss", {2, V,ss, W,sd} },
+	{ 0x5B, 0x66, "cvtps2dq" },			{ 0x5B, 0xF3, "cvttps2dq" },
+	{ 0x5C, 0x66, "subpd" },			{ 0x5C, 0xF3, "subss", {2, V,ss, W,ss} },			{ 0x5C, 0xF2, "subsd", {2, V,sd, W,sd} },
+	{ 0x5D, 0x66, "minpd" },			{ 0x5D, 0xF3, "minss", {2, V,ss, W,ss} },			{ 0x5D, 0xF2, "minsd", {2, V,sd, W,sd} },
+	{ 0x5E, 0x66, "divpd" },			{ 0x5E, 0xF3, "divss", {2, V,ss, W,ss} },			{ 0x5E, 0xF2, "divsd", {2, V,sd, W,sd} },
+	{ 0x5F, 0x66, "maxpd" },			{ 0x5F, 0xF3, "maxss", {2, V,ss, W,ss} },			{ 0x5F, 0xF2, "maxsd", {2, V,sd, W,sd} },
+	{ 0x6C, 0x66, "punpcklqdq", {2, V,x, W,x} },
+	{ 0x6D, 0x66, "punpckhqdq", {2, V,x, W,x} },
+	{ 0x6F, 0x66, "movdqa", {2, V,x, W,x} },	{ 0x6F, 0xF3, "movdqu", {2, V,x, W,x} },
+	{ 0x70, 0x66, "pshufd", {3, V,x, W,x, I,b} },	{ 0x70, 0xF3, "pshufhw", {3, V,x, W,x, I,b} },	{ 0x70, 0xF2, "pshuflw", {3, V,x, W,x, I,b} },
+	{ 0x7C, 0x66, "haddpd" },			{ 0x7C, 0xF2, "haddps" },
+	{ 0x7D, 0x66, "hsubpd" },			{ 0x7D, 0xF2, "hsubps" },
+	{ 0x7E, 0xF3, "movq", {2, V,q, W,q} },
+	{ 0x7F, 0x66, "movdqa", {2, W,x, V,x} },	{ 0x7F, 0xF3, "movdqu", {2, W,x, V,x} },
+	{ 0xB8, 0xF3, "popcnt", {2, G,v, E,v} },
+	{ 0xBC, 0xF3, "tzcnt" },
+	{ 0xBD, 0xF3, "lzcnt" },
+	{ 0xC2, 0x66, "cmppd" },			{ 0xC2, 0xF3, "cmpss", {3, V,ss, W,ss, I,b} },		{ 0xC2, 0xF2, "cmpsd", {3, V,sd, W,sd, I,b} },
+	{ 0xC6, 0x66, "shufpd" },
+	{ 0xD0, 0x66, "addsubpd", {2, V,pd, W,pd} },	{ 0xD0, 0xF2, "addsubps", {2, V,ps, W,ps} },
+	{ 0xD6, 0x66, "movq", {2, W,q, V,q} },
+	{ 0xE6, 0x66, "cvttpd2dq" },		{ 0xE6, 0xF3, "cvtdq2pd", {2, V,x, W,q} },			{ 0xE6, 0xF2, "cvtpd2dq" },
+	{ 0xE7, 0x66, "movntdq", {2, M,x, V,x} },
+	{ 0xF0, 0xF2, "lddqu", {2, V,x, M,x} },
+};
@@ -1,11 +1,35 @@
 #pragma once
 #include "Opcode.h"
 
+/*
+The opcode maps an opcode may belong to.
+Opcodes outside the one-byte map are reached through escape bytes (0F, 0F 38 & 0F 3A).
+*/
+enum OPCODE_MAP : BYTE
+{
+	/* One-byte opcodes (e.g. E9 for JMP) */
+	OPMAP_1BYTE,
+	/* Two-byte opcodes, escaped by 0F (e.g. 0F 84 for JZ) */
+	OPMAP_0F,
+	/* Three-byte opcodes, escaped by 0F 38 (e.g. 0F 38 00 for PSHUFB) */
+	OPMAP_0F38,
+	/* Three-byte opcodes, escaped by 0F 3A (e.g. 0F 3A 0F for PALIGNR) */
+	OPMAP_0F3A,
+	OPMAP_AMOUNT
+};
+
+/* The escape byte of the two-byte opcode map */
+#define ESCAPE_0F 0x0F
+/* The escape bytes of the three-byte opcode maps, which follow ESCAPE_0F */
+#define ESCAPE_0F38 0x38
+#define ESCAPE_0F3A 0x3A
+
 /*
 A map of all supported opcodes.
 To access a descriptor, access the cell that matches the opcode (e.g. g_OpcodeMap[0xE9] for the JMP instruction, e.t.c).
+0F is the escape byte to the two-byte opcode map, D8-DF are x87 escapes (whose instruction is described by the ModRM byte).
 */
-const OPCODE_DESCRIPTOR g_OpcodeMap[0x100] =
+constexpr OPCODE_DESCRIPTOR g_OpcodeMap[0x100] =
 {
 /*	00				01				02				03				04				05				06				07 */
 	{2, E,b, G,b},	{2, E,v, G,v},	{2, G,b, E,b},	{2, G,v, E,v},	{1, I,b},		{1, I,z},		{0},			{0},
@@ -38,7 +62,7 @@ const OPCODE_DESCRIPTOR g_OpcodeMap[0x100] =
 	{0},			{0},			{0},			{0},			{0},			{0},			{0},			{0},
 
 /*	60				61				62				63				64				65				66				67 */
-	{0},			{0},			{2, G,v, M,a},	{},				{},				{},				{},				{},
+	{0},			{0},			{2, G,v, M,a},	{2, E,w, G,w},	{},				{},				{},				{},
 /*	68				69						6A				6B							6C		6D		6E		6F  */
 	{1, I,z},		{3, G,v, E,v, I,z},		{1, I,b},		{3, G,v, E,v, I,b},			{0},	{0},	{0},	{0},
 
@@ -75,7 +99,7 @@ const OPCODE_DESCRIPTOR g_OpcodeMap[0x100] =
 /*	D0				D1				D2				D3				D4				D5				D6				D7 */
 	{1, E,b},		{1, E,v},		{1, E,b},		{1, E,v},		{1, I,b},		{1, I,b},		{0},			{0},
 /*	D8				D9				DA				DB				DC				DD				DE				DF */
-	{0},			{0},			{0},			{0},			{0},			{0},			{0},			{0},
+	{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},
 
 /*	E0				E1				E2				E3				E4				E5				E6				E7 */
 	{1, J,b},		{1, J,b},		{1, J,b},		{1, J,b},		{1, I,b},		{1, I,b},		{1, I,b},		{1, I,b},
@@ -85,5 +109,155 @@ const OPCODE_DESCRIPTOR g_OpcodeMap[0x100] =
 /*	F0				F1				F2				F3				F4				F5				F6				F7 */
 	{0},			{0},			{0},			{0},			{0},			{0},			{1, E,b},		{1, E,v},
 /*	F8				F9				FA				FB				FC				FD				FE				FF */
-	{0},			{0},			{0},			{0},			{0},			{0},			{},				{},
+	{0},			{0},			{0},			{0},			{0},			{0},			{1, E,b},		{1, E,v},
+};
+
+/*
+A map of all two-byte opcodes (i.e. opcodes escaped by 0F).
+To access a descriptor, access the cell that matches the second opcode byte (e.g. g_OpcodeMap0F[0x84] for the JZ instruction, e.t.c).
+Mandatory prefixes (66, F2 & F3) select between instructions that share an opcode, but never change their operands' encoding.
+38 & 3A are escape bytes to the three-byte opcode maps.
+*/
+constexpr OPCODE_DESCRIPTOR g_OpcodeMap0F[0x100] =
+{
+/*	00				01				02				03				04				05				06				07 */
+	{1, E,w},		{1, E,v},		{2, G,v, E,w},	{2, G,v, E,w},	{},				{0},			{0},			{0},
+/*	08					09					0A					0B					0C					0D					0E					0F */
+	{0},				{0},				{},					{0},				{},					{1, E,v},			{0},				{3, P,q, Q,q, I,b},
+
+/*	10					11					12					13					14					15					16					17 */
+	{2, V,ps, W,ps},	{2, W,ps, V,ps},	{2, V,q, M,q},		{2, M,q, V,q},		{2, V,x, W,x},		{2, V,x, W,x},		{2, V,dq, M,q},		{2, M,q, V,q},
+/*	18				19				1A				1B				1C				1D				1E				1F */
+	{1, M},			{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},
+
+/*	20				21				22				23				24				25				26				27 */
+	{2, R,d, C,d},	{2, R,d, D,d},	{2, C,d, R,d},	{2, D,d, R,d},	{},				{},				{},				{},
+/*	28					29					2A					2B					2C					2D					2E					2F */
+	{2, V,ps, W,ps},	{2, W,ps, V,ps},	{2, V,ps, Q,pi},	{2, M,ps, V,ps},	{2, P,pi, W,ps},	{2, P,pi, W,ps},	{2, V,ss, W,ss},	{2, V,ss, W,ss},
+
+/*	30				31				32				33				34				35				36				37 */
+	{0},			{0},			{0},			{0},			{0},			{0},			{},				{0},
+/*	38				39				3A				3B				3C				3D				3E				3F */
+	{},				{},				{},				{},				{},				{},				{},				{},
+
+/*	40				41				42				43				44				45				46				47 */
+	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},
+/*	48				49				4A				4B				4C				4D				4E				4F */
+	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,v},
+
+/*	50					51					52					53					54					55					56					57 */
+	{2, G,d, U,ps},		{2, V,ps, W,ps},	{2, V,ps, W,ps},	{2, V,ps, W,ps},	{2, V,ps, W,ps},	{2, V,ps, W,ps},	{2, V,ps, W,ps},	{2, V,ps, W,ps},
+/*	58					59					5A					5B					5C					5D					5E					5F */
+	{2, V,ps, W,ps},	{2, V,ps, W,ps},	{2, V,pd, W,ps},	{2, V,ps, W,dq},	{2, V,ps, W,ps},	{2, V,ps, W,ps},	{2, V,ps, W,ps},	{2, V,ps, W,ps},
+
+/*	60				61				62				63				64				65				66				67 */
+	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},
+/*	68				69				6A				6B				6C				6D				6E				6F */
+	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, V,x, W,x},	{2, V,x, W,x},	{2, P,d, E,y},	{2, P,q, Q,q},
+
+/*	70					71					72					73					74					75					76					77 */
+	{3, P,q, Q,q, I,b},	{2, N,q, I,b},		{2, N,q, I,b},		{2, N,q, I,b},		{2, P,q, Q,q},		{2, P,q, Q,q},		{2, P,q, Q,q},		{0},
+/*	78					79					7A					7B					7C					7D					7E					7F */
+	{2, E,y, G,y},		{2, G,y, E,y},		{},					{},					{2, V,pd, W,pd},	{2, V,pd, W,pd},	{2, E,y, P,d},		{2, Q,q, P,q},
+
+/*	80				81				82				83				84				85				86				87 */
+	{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},
+/*	88				89				8A				8B				8C				8D				8E				8F */
+	{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},		{1, J,z},
+
+/*	90				91				92				93				94				95				96				97 */
+	{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},
+/*	98				99				9A				9B				9C				9D				9E				9F */
+	{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},
+
+/*	A0					A1					A2					A3					A4					A5					A6					A7 */
+	{0},				{0},				{0},				{2, E,v, G,v},		{3, E,v, G,v, I,b},	{2, E,v, G,v},		{},					{},
+/*	A8					A9					AA					AB					AC					AD					AE					AF */
+	{0},				{0},				{0},				{2, E,v, G,v},		{3, E,v, G,v, I,b},	{2, E,v, G,v},		{1, E,v},			{2, G,v, E,v},
+
+/*	B0				B1				B2				B3				B4				B5				B6				B7 */
+	{2, E,b, G,b},	{2, E,v, G,v},	{2, G,v, M,p},	{2, E,v, G,v},	{2, G,v, M,p},	{2, G,v, M,p},	{2, G,v, E,b},	{2, G,v, E,w},
+/*	B8				B9				BA				BB				BC				BD				BE				BF */
+	{2, G,v, E,v},	{2, G,v, E,v},	{2, E,v, I,b},	{2, E,v, G,v},	{2, G,v, E,v},	{2, G,v, E,v},	{2, G,v, E,b},	{2, G,v, E,w},
+
+/*	C0						C1						C2						C3						C4						C5						C6						C7 */
+	{2, E,b, G,b},			{2, E,v, G,v},			{3, V,ps, W,ps, I,b},	{2, M,y, G,y},			{3, P,q, E,d, I,b},		{3, G,d, N,q, I,b},		{3, V,ps, W,ps, I,b},	{1, M,q},
+/*	C8				C9				CA				CB				CC				CD				CE				CF */
+	{0},			{0},			{0},			{0},			{0},			{0},			{0},			{0},
+
+/*	D0					D1					D2					D3					D4					D5					D6					D7 */
+	{2, V,pd, W,pd},	{2, P,q, Q,q},		{2, P,q, Q,q},		{2, P,q, Q,q},		{2, P,q, Q,q},		{2, P,q, Q,q},		{2, W,q, V,q},		{2, G,d, N,q},
+/*	D8				D9				DA				DB				DC				DD				DE				DF */
+	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},
+
+/*	E0				E1				E2				E3				E4				E5				E6				E7 */
+	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, V,x, W,pd},	{2, M,q, P,q},
+/*	E8				E9				EA				EB				EC				ED				EE				EF */
+	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},
+
+/*	F0				F1				F2				F3				F4				F5				F6				F7 */
+	{2, V,x, M,x},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, N,q},
+/*	F8				F9				FA				FB				FC				FD				FE				FF */
+	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, P,q, Q,q},	{2, G,v, E,v},
+};
+
+/*
+The three-byte opcode maps are uniform, as far as operand encoding is concerned.
+Every 0F 38 opcode takes a ModRM byte (e.g. PSHUFB Vx, Wx).
+Every 0F 3A opcode takes a ModRM byte & an 8-bit immediate (e.g. PALIGNR Vx, Wx, Ib).
+*/
+constexpr OPCODE_DESCRIPTOR g_OpcodeDescriptor0F38 = {2, V,x, W,x};
+constexpr OPCODE_DESCRIPTOR g_OpcodeDescriptor0F3A = {3, V,x, W,x, I,b};
+
+/*
+Opcode Extension Groups whose operands depend on the Reg field of the ModRM byte.
+Groups whose operands are the same for every Reg value (e.g. Group 5, FF) aren't listed.
+*/
+enum OPCODE_GROUP : BYTE
+{
+	GROUP_NONE,
+	/* Group 3, F6 (TEST Eb, Ib takes an immediate, NOT/NEG/MUL/DIV Eb don't) */
+	GROUP_3_EB,
+	/* Group 3, F7 (TEST Ev, Iz takes an immediate, NOT/NEG/MUL/DIV Ev don't) */
+	GROUP_3_EV,
+	/* Group 11, C7 (MOV Ev, Iz, or XBEGIN Jz which takes a Relative Address) */
+	GROUP_11_EV,
+	GROUP_AMOUNT
+};
+
+/*
+A map of all Opcode Extension Groups.
+To access a descriptor, access the cell that matches the group & the Reg field (e.g. g_GroupMap[GROUP_3_EV][REG_A] for TEST Ev, Iz).
+*/
+constexpr OPCODE_DESCRIPTOR g_GroupMap[GROUP_AMOUNT][8] =
+{
+	/* GROUP_NONE */
+	{ },
+	/* GROUP_3_EB:	/0				/1				/2				/3				/4				/5				/6				/7 */
+	{				{2, E,b, I,b},	{2, E,b, I,b},	{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b},		{1, E,b} },
+	/* GROUP_3_EV:	/0				/1				/2				/3				/4				/5				/6				/7 */
+	{				{2, E,v, I,z},	{2, E,v, I,z},	{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v},		{1, E,v} },
+	/* GROUP_11_EV:	/0				/1				/2				/3				/4				/5				/6				/7 */
+	{				{2, E,v, I,z},	{2, E,v, I,z},	{2, E,v, I,z},	{2, E,v, I,z},	{2, E,v, I,z},	{2, E,v, I,z},	{2, E,v, I,z},	{1, J,z} },
+};
+
+/*
+Struct linking an opcode to its Opcode Extension Group.
+*/
+typedef struct _OPCODE_GROUP_ENTRY
+{
+	OPCODE_MAP Map;
+	BYTE Opcode;
+	OPCODE_GROUP Group;
+}
+OPCODE_GROUP_ENTRY, *POPCODE_GROUP_ENTRY;
+
+/*
+All opcodes that belong to an Opcode Extension Group.
+*/
+constexpr OPCODE_GROUP_ENTRY g_GroupOpcodes[] =
+{
+	{ OPMAP_1BYTE, 0xF6, GROUP_3_EB },
+	{ OPMAP_1BYTE, 0xF7, GROUP_3_EV },
+	{ OPMAP_1BYTE, 0xC7, GROUP_11_EV },
 };
@@ -0,0 +1,491 @@
+#pragma once
+#include "OpcodeMaps.h"
+
+/*
+Flat property tables, generated at compile-time from the Opcode Maps.
+Classifying a byte is a single table load, rather than a scan over the Opcode Map's operands.
+*/
+
+/* Value of operand-size-override prefix */
+#define OPERAND_SIZE_OVERRIDE_PREFIX 0x66
+
+/* Value of address-size-override prefix */
+#define ADDRESS_SIZE_OVERRIDE_PREFIX 0x67
+
+/* Values of the LOCK, REPNE & REP prefixes */
+#define LOCK_PREFIX 0xF0
+#define REPNE_PREFIX 0xF2
+#define REP_PREFIX 0xF3
+
+/* REX prefixes (64-bit mode only) are 0100WRXB, i.e. 40-4F */
+#define REX_PREFIX_MASK 0xF0
+#define REX_PREFIX 0x40
+/* The REX.W bit, which promotes the operand-size to 64-bit */
+#define REX_W 0b1000
+
+/*
+VEX & EVEX prefixes, which replace the legacy prefixes & escape bytes of vector instructions.
+In 32-bit mode they overlap LES (C4), LDS (C5) & BOUND (62), and are only VEX/EVEX if the following byte's Mod field is 11b,
+as those instructions only take a memory operand.
+*/
+#define VEX2_PREFIX 0xC5
+#define VEX3_PREFIX 0xC4
+#define EVEX_PREFIX 0x62
+#define VEX_MODE_MASK 0xC0
+
+/* Cache of all prefix bytes */
+constexpr BYTE g_PrefixCache[] = { LOCK_PREFIX, REPNE_PREFIX, REP_PREFIX, 0x2E, 0x36, 0x3E, 0x26, 0x64, 0x65, OPERAND_SIZE_OVERRIDE_PREFIX, ADDRESS_SIZE_OVERRIDE_PREFIX };
+
+/* Cache of all Addressing Methods that use a ModRM byte */
+constexpr ADDRESSING_METHOD g_UsesModRM[] = { E, G, M, S, C, D, N, P, Q, R, U, V, W };
+
+/* Cache of all Addressing Methods that use immediate values */
+constexpr ADDRESSING_METHOD g_UsesImm[] = { A, I, J, O };
+
+/* Cache of all Addressing Methods whose ModRM byte always specifies a register, regardless of the Mod field */
+constexpr ADDRESSING_METHOD g_ForcesRegister[] = { R };
+
+/*
+The class of a prefix byte.
+Prefixes of the same class are mutually exclusive, as they belong to the same prefix group.
+*/
+enum PREFIX_CLASS : BYTE
+{
+	/* The byte isn't a prefix */
+	PREFIX_NONE,
+	/* LOCK, REPNE & REP prefixes (F0, F2, F3) */
+	PREFIX_LOCK_REP,
+	/* Segment-override prefixes (2E, 36, 3E, 26, 64, 65) */
+	PREFIX_SEGMENT,
+	/* Operand-size-override prefix (66) */
+	PREFIX_OPERAND_SIZE,
+	/* Address-size-override prefix (67) */
+	PREFIX_ADDRESS_SIZE,
+};
+
+/*
+Flags describing an opcode.
+*/
+enum OPCODE_FLAGS : BYTE
+{
+	/* The opcode is followed by a ModRM byte */
+	OPF_MODRM = 1 << 0,
+	/* The opcode's immediate is a Relative Address (i.e. it's a relative branch) */
+	OPF_RELATIVE = 1 << 1,
+	/* The opcode's operands depend on the Reg field of the ModRM byte (see OPCODE_GROUP) */
+	OPF_GROUP = 1 << 2,
+	/* The opcode's ModRM byte always specifies a register, so it's never followed by a SIB or displacement */
+	OPF_MODRM_REGISTER = 1 << 3,
+	/* The opcode takes a memory offset (moffs), whose size depends on the address-size rather than the operand-size */
+	OPF_MOFFS = 1 << 4,
+};
+
+/*
+The operand-size an instruction is decoded with.
+Used to index the immediate sizes of an opcode.
+*/
+enum OPERAND_SIZE : BYTE
+{
+	/* Default operand-size, no override */
+	OPSIZE_32,
+	/* Operand-size-override prefix is in use */
+	OPSIZE_16,
+	/* REX.W prefix is in use (64-bit mode only) */
+	OPSIZE_64,
+	OPSIZE_AMOUNT
+};
+
+/*
+Struct describing the properties of an opcode.
+*/
+typedef struct _OPCODE_PROPERTIES
+{
+	/* The opcode's flags (OPCODE_FLAGS) */
+	BYTE Flags;
+	/* Total size of the opcode's immediate operands, in bytes, for each operand-size */
+	BYTE ImmSize[OPSIZE_AMOUNT];
+	/* The opcode's Opcode Extension Group, if it has the OPF_GROUP flag */
+	OPCODE_GROUP Group;
+}
+OPCODE_PROPERTIES, *POPCODE_PROPERTIES;
+
+/*
+Struct wrapping the per-byte tables, so they can be built & returned by constexpr functions.
+*/
+typedef struct _PREFIX_TABLE
+{
+	PREFIX_CLASS Classes[0x100];
+}
+PREFIX_TABLE;
+
+typedef struct _OPCODE_TABLE
+{
+	OPCODE_PROPERTIES Entries[0x100];
+}
+OPCODE_TABLE;
+
+typedef struct _GROUP_TABLE
+{
+	OPCODE_PROPERTIES Entries[GROUP_AMOUNT][8];
+}
+GROUP_TABLE;
+
+/*
+Struct describing how the boundary scanner sizes an opcode.
+A fast opcode is one the scanner sizes by itself, rather than fully decoding it:
+it isn't a prefix or an escape byte, its operands don't depend on the address-size,
+and if it belongs to an Opcode Extension Group, its operands don't depend on the Reg field either.
+*/
+typedef struct _SCAN_OPCODE
+{
+	/* Whether the opcode is fast */
+	BYTE bFast;
+	/* Whether the opcode is followed by a ModRM byte */
+	BYTE bModRM;
+	/* Total size of the opcode's immediate operands, in bytes, for each operand-size */
+	BYTE ImmSize[OPSIZE_AMOUNT];
+}
+SCAN_OPCODE;
+
+/*
+Struct describing the opcodes of the one-byte & two-byte opcode maps, as the boundary scanner sizes them.
+*/
+typedef struct _SCAN_TABLE
+{
+	/* How every opcode is sized, indexed by the opcode map (OPMAP_1BYTE or OPMAP_0F) & opcode */
+	SCAN_OPCODE Opcodes[2][0x100];
+	/*
+	Size of the bytes that follow every ModRM byte, with 32-bit or 64-bit addressing: the SIB byte & the displacement.
+	The only exception is a SIB without a base register, whose 32-bit displacement depends on the SIB byte itself.
+	*/
+	BYTE ModRMSizes[0x100];
+	/*
+	Nibble masks classifying single-byte instructions (fast one-byte opcodes without operands), so a whole window may be classified with SIMD shuffles.
+	A byte is a single-byte instruction if LowNibbleMasks[i][low nibble] & HighNibbleMasks[i][high nibble] is non-zero, for either i.
+	The first masks cover high nibbles 0-7, and the second cover high nibbles 8-F, so every high nibble gets its own bit.
+	*/
+	BYTE LowNibbleMasks[2][0x10];
+	BYTE HighNibbleMasks[2][0x10];
+}
+SCAN_TABLE;
+
+/*
+@return the prefix class of given prefix byte.
+*/
+constexpr PREFIX_CLASS ClassifyPrefix(BYTE prefix)
+{
+	switch (prefix)
+	{
+	case LOCK_PREFIX:
+	case REPNE_PREFIX:
+	case REP_PREFIX:
+		return PREFIX_LOCK_REP;
+	case OPERAND_SIZE_OVERRIDE_PREFIX:
+		return PREFIX_OPERAND_SIZE;
+	case ADDRESS_SIZE_OVERRIDE_PREFIX:
+		return PREFIX_ADDRESS_SIZE;
+	default:
+		return PREFIX_SEGMENT;
+	}
+}
+
+/*
+@return whether given Addressing Method is within given cache.
+*/
+template <SIZE_T N>
+constexpr bool IsInCache(const ADDRESSING_METHOD (&cache)[N], ADDRESSING_METHOD addrMethod)
+{
+	for (SIZE_T i = 0; i < N; i++)
+		if (cache[i] == addrMethod)
+			return true;
+
+	return false;
+}
+
+/*
+Calculates size of an immediate operand, for given operand-size.
+@param operand, the operand to be checked.
+@param operandSize, the operand-size the instruction is decoded with.
+@return size of given operand, in bytes.
+*/
+constexpr BYTE ImmOperandSize(OPERAND_DESCRIPTOR operand, OPERAND_SIZE operandSize)
+{
+	bool operandSizeOverride = operandSize == OPSIZE_16;
+	bool operandSize64 = operandSize == OPSIZE_64;
+
+	/* Addressing Method of O depends on the address-size, see OPF_MOFFS */
+	if (operand.AddressingMethod == O)
+		return 0;
+
+	/*
+	Return size depending on the Operand Type.
+	Some types are affected by the operand-size-override prefix.
+	*/
+	switch (operand.OperandType)
+	{
+	case b:
+		return BYTE_SIZE;
+	case c:
+		return operandSizeOverride ? BYTE_SIZE : WORD_SIZE;
+	case d:
+		return DWORD_SIZE;
+	case p:
+		return WORD_SIZE /* pointer prefix */ + (operandSizeOverride ? WORD_SIZE : DWORD_SIZE) /* pointer suffix */;
+	case v:
+		/* Only MOV r64, imm64 (B8+r) takes a 64-bit immediate, every other 64-bit operand takes a 32-bit immediate (z) */
+		return operandSize64 ? QWORD_SIZE : operandSizeOverride ? WORD_SIZE : DWORD_SIZE;
+	case w:
+		return WORD_SIZE;
+	case z:
+		return operandSizeOverride ? WORD_SIZE : DWORD_SIZE;
+	default:
+		return 0;
+	}
+}
+
+/*
+Builds the prefix class of every byte from the prefix cache.
+*/
+constexpr PREFIX_TABLE BuildPrefixTable()
+{
+	PREFIX_TABLE table = { };
+
+	for (BYTE prefix : g_PrefixCache)
+		table.Classes[prefix] = ClassifyPrefix(prefix);
+
+	return table;
+}
+
+/*
+Builds the properties of a single opcode from its Opcode Descriptor.
+*/
+constexpr OPCODE_PROPERTIES BuildOpcodeProperties(const OPCODE_DESCRIPTOR &descriptor)
+{
+	OPCODE_PROPERTIES properties = { };
+
+	for (USHORT i = 0; i < descriptor.OperandAmount; i++)
+	{
+		const OPERAND_DESCRIPTOR &operand = descriptor.Operands[i];
+
+		if (IsInCache(g_UsesModRM, operand.AddressingMethod))
+			properties.Flags |= OPF_MODRM;
+
+		if (IsInCache(g_ForcesRegister, operand.AddressingMethod))
+			properties.Flags |= OPF_MODRM | OPF_MODRM_REGISTER;
+
+		if (!IsInCache(g_UsesImm, operand.AddressingMethod))
+			continue;
+
+		if (operand.AddressingMethod == J)
+			properties.Flags |= OPF_RELATIVE;
+
+		if (operand.AddressingMethod == O)
+			properties.Flags |= OPF_MOFFS;
+
+		/* Sum all immediates, as some opcodes have more than one (e.g. ENTER Iw, Ib) */
+		for (BYTE operandSize = 0; operandSize < OPSIZE_AMOUNT; operandSize++)
+			properties.ImmSize[operandSize] += ImmOperandSize(operand, (OPERAND_SIZE) operandSize);
+	}
+
+	return properties;
+}
+
+/*
+Builds the properties of every opcode within given Opcode Map.
+Opcodes that belong to an Opcode Extension Group are linked to it.
+*/
+constexpr OPCODE_TABLE BuildOpcodeTable(const OPCODE_DESCRIPTOR (&opcodeMap)[0x100], OPCODE_MAP map)
+{
+	OPCODE_TABLE table = { };
+
+	for (SIZE_T opcode = 0; opcode < 0x100; opcode++)
+		table.Entries[opcode] = BuildOpcodeProperties(opcodeMap[opcode]);
+
+	for (const OPCODE_GROUP_ENTRY &entry : g_GroupOpcodes)
+	{
+		if (entry.Map != map)
+			continue;
+
+		table.Entries[entry.Opcode].Flags |= OPF_GROUP;
+		table.Entries[entry.Opcode].Group = entry.Group;
+	}
+
+	return table;
+}
+
+/*
+Builds the properties of an opcode map whose opcodes all share the same Opcode Descriptor.
+*/
+constexpr OPCODE_TABLE BuildUniformOpcodeTable(const OPCODE_DESCRIPTOR &descriptor)
+{
+	OPCODE_TABLE table = { };
+
+	for (SIZE_T opcode = 0; opcode < 0x100; opcode++)
+		table.Entries[opcode] = BuildOpcodeProperties(descriptor);
+
+	return table;
+}
+
+/*
+Builds the properties of every Opcode Extension Group, for every Reg value.
+*/
+constexpr GROUP_TABLE BuildGroupTable()
+{
+	GROUP_TABLE table = { };
+
+	for (SIZE_T group = 0; group < GROUP_AMOUNT; group++)
+		for (SIZE_T reg = 0; reg < 8; reg++)
+			table.Entries[group][reg] = BuildOpcodeProperties(g_GroupMap[group][reg]);
+
+	return table;
+}
+
+
+/* Prefix class of every byte */
+constexpr PREFIX_TABLE g_PrefixTable = BuildPrefixTable();
+
+/* Properties of every opcode, in every opcode map (indexed by OPCODE_MAP) */
+constexpr OPCODE_TABLE g_OpcodeTables[OPMAP_AMOUNT] =
+{
+	BuildOpcodeTable(g_OpcodeMap, OPMAP_1BYTE),
+	BuildOpcodeTable(g_OpcodeMap0F, OPMAP_0F),
+	BuildUniformOpcodeTable(g_OpcodeDescriptor0F38),
+	BuildUniformOpcodeTable(g_OpcodeDescriptor0F3A),
+};
+
+/* Properties of every Opcode Extension Group, indexed by OPCODE_GROUP & the Reg field */
+constexpr GROUP_TABLE g_GroupTable = BuildGroupTable();
+
+/*
+@return whether every member of an Opcode Extension Group is sized the same, regardless of the Reg field.
+*/
+constexpr bool IsUniformGroup(OPCODE_GROUP group)
+{
+	const OPCODE_PROPERTIES &first = g_GroupTable.Entries[group][0];
+
+	for (SIZE_T reg = 0; reg < 8; reg++)
+	{
+		const OPCODE_PROPERTIES &member = g_GroupTable.Entries[group][reg];
+
+		if ((member.Flags & (OPF_RELATIVE | OPF_MOFFS)) != (first.Flags & (OPF_RELATIVE | OPF_MOFFS)))
+			return false;
+
+		for (BYTE operandSize = 0; operandSize < OPSIZE_AMOUNT; operandSize++)
+			if (member.ImmSize[operandSize] != first.ImmSize[operandSize])
+				return false;
+	}
+
+	return (first.Flags & OPF_MOFFS) == 0;
+}
+
+/*
+Builds how the boundary scanner sizes an opcode.
+@param map, the opcode's map.
+@param opcode, the opcode itself.
+@param bMode64, whether the opcode is decoded in 64-bit mode.
+*/
+constexpr SCAN_OPCODE BuildScanOpcode(OPCODE_MAP map, SIZE_T opcode, bool bMode64)
+{
+	const OPCODE_PROPERTIES &properties = g_OpcodeTables[map].Entries[opcode];
+	SCAN_OPCODE scanOpcode = { };
+
+	if (map == OPMAP_1BYTE)
+	{
+		if (g_PrefixTable.Classes[opcode] != PREFIX_NONE || opcode == ESCAPE_0F)
+			return scanOpcode;
+
+		/* In 64-bit mode, 40-4F are REX prefixes rather than INC & DEC */
+		if (bMode64 && (opcode & REX_PREFIX_MASK) == REX_PREFIX)
+			return scanOpcode;
+
+		/* VEX & EVEX prefixes overlap LES, LDS & BOUND */
+		if (opcode == VEX2_PREFIX || opcode == VEX3_PREFIX || opcode == EVEX_PREFIX)
+			return scanOpcode;
+	}
+	else if (opcode == ESCAPE_0F38 || opcode == ESCAPE_0F3A)
+	{
+		return scanOpcode;
+	}
+
+	if (properties.Flags & (OPF_MOFFS | OPF_MODRM_REGISTER))
+		return scanOpcode;
+
+	/* An Opcode Extension Group is sized by its first member, if all of its members are sized the same */
+	const OPCODE_PROPERTIES *pSized = &properties;
+	if (properties.Flags & OPF_GROUP)
+	{
+		if (!IsUniformGroup(properties.Group))
+			return scanOpcode;
+
+		pSized = &g_GroupTable.Entries[properties.Group][0];
+	}
+
+	scanOpcode.bFast = TRUE;
+	scanOpcode.bModRM = (properties.Flags & OPF_MODRM) != 0;
+
+	/* In 64-bit mode, Relative Addresses are always 32-bit (or 8-bit), regardless of the operand-size-override prefix */
+	for (BYTE operandSize = 0; operandSize < OPSIZE_AMOUNT; operandSize++)
+		scanOpcode.ImmSize[operandSize] = pSized->ImmSize[bMode64 && (pSized->Flags & OPF_RELATIVE) ? OPSIZE_32 : operandSize];
+
+	return scanOpcode;
+}
+
+/*
+@return the size of the bytes that follow given ModRM byte, with 32-bit or 64-bit addressing (see SCAN_TABLE).
+*/
+constexpr BYTE ModRMSize(BYTE modRM)
+{
+	BYTE mod = modRM >> 6;
+	BYTE rm = modRM & 0b111;
+
+	/* Register operand */
+	if (mod == 0b11)
+		return 0;
+
+	/* SIB byte, only followed by an 8-bit or 32-bit displacement depending on the Mod field (or the SIB's Base) */
+	BYTE sibSize = rm == 0b100 ? 1 : 0;
+
+	if (mod == 0b01)
+		return sibSize + BYTE_SIZE;
+
+	if (mod == 0b10 || rm == 0b101)
+		return sibSize + DWORD_SIZE;
+
+	return sibSize;
+}
+
+/*
+Builds the opcodes of the boundary scanner.
+@param bMode64, whether the opcodes are decoded in 64-bit mode.
+*/
+constexpr SCAN_TABLE BuildScanTable(bool bMode64)
+{
+	SCAN_TABLE table = { };
+
+	for (SIZE_T opcode = 0; opcode < 0x100; opcode++)
+	{
+		table.Opcodes[OPMAP_1BYTE][opcode] = BuildScanOpcode(OPMAP_1BYTE, opcode, bMode64);
+		table.Opcodes[OPMAP_0F][opcode] = BuildScanOpcode(OPMAP_0F, opcode, bMode64);
+		table.ModRMSizes[opcode] = ModRMSize((BYTE) opcode);
+
+		const SCAN_OPCODE &scanOpcode = table.Opcodes[OPMAP_1BYTE][opcode];
+		if (!scanOpcode.bFast || scanOpcode.bModRM || scanOpcode.ImmSize[OPSIZE_32] || scanOpcode.ImmSize[OPSIZE_16] || scanOpcode.ImmSize[OPSIZE_64])
+			continue;
+
+		BYTE high = (BYTE) (opcode >> 4);
+		BYTE low = (BYTE) (opcode & 0xF);
+		table.LowNibbleMasks[high / 8][low] |= 1 << (high % 8);
+	}
+
+	for (BYTE high = 0; high < 0x10; high++)
+		table.HighNibbleMasks[high / 8][high] = 1 << (high % 8);
+
+	return table;
+}
+
+/* Opcodes of the boundary scanner, indexed by DISASSEMBLER_MODE (32-bit, then 64-bit) */
+constexpr SCAN_TABLE g_ScanTables[] =
+{
+	BuildScanTable(false),
+	BuildScanTable(true),
+};
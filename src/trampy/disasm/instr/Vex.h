@@ -0,0 +1,156 @@
+#pragma once
+#include "../../TrampyDefs.h"
+
+/* Size of each prefix, including its leading byte */
+#define VEX2_SIZE 2
+#define VEX3_SIZE 3
+#define EVEX_SIZE 4
+
+/*
+The encoding of an instruction's prefix.
+Vector instructions may replace their legacy prefixes & escape bytes with a single VEX or EVEX prefix.
+*/
+enum VEX_ENCODING : BYTE
+{
+	/* Legacy encoding, no VEX or EVEX prefix */
+	ENCODING_LEGACY,
+	/* Two-byte VEX prefix (C5) */
+	ENCODING_VEX2,
+	/* Three-byte VEX prefix (C4) */
+	ENCODING_VEX3,
+	/* Four-byte EVEX prefix (62) */
+	ENCODING_EVEX,
+};
+
+/*
+Specifies the opcode map implied by a VEX or EVEX prefix, replacing the escape bytes.
+EVEX only uses the 3 least-significant bits (mmm).
+*/
+enum VEX_MAP : BYTE
+{
+	/* Implied 0F escape byte */
+	VEX_MAP_0F = 0b00001,
+	/* Implied 0F 38 escape bytes */
+	VEX_MAP_0F38 = 0b00010,
+	/* Implied 0F 3A escape bytes */
+	VEX_MAP_0F3A = 0b00011,
+	/* EVEX map 5 (AVX512-FP16), every opcode takes a ModRM byte & no immediate */
+	EVEX_MAP_5 = 0b00101,
+	/* EVEX map 6 (AVX512-FP16), every opcode takes a ModRM byte & no immediate */
+	EVEX_MAP_6 = 0b00110,
+};
+
+/*
+Specifies the legacy prefix implied by a VEX or EVEX prefix.
+*/
+enum VEX_PP : BYTE
+{
+	VEX_PP_NONE = 0b00,
+	VEX_PP_66 = 0b01,
+	VEX_PP_F3 = 0b10,
+	VEX_PP_F2 = 0b11,
+};
+
+/*
+The payload of the two-byte VEX prefix (C5), which implies the 0F map.
+The R & vvvv fields are stored inverted.
+*/
+typedef struct _VEX2_PAYLOAD
+{
+	/* Least-significant 2 bits specify the implied legacy prefix (VEX_PP) */
+	VEX_PP Pp : 2;
+	/* Next bit specifies the vector length (0 for 128-bit, 1 for 256-bit) */
+	BYTE L : 1;
+	/* Next 4 bits specify an additional source register */
+	BYTE Vvvv : 4;
+	/* Most-significant bit extends the Reg field of the ModRM byte (like REX.R) */
+	BYTE R : 1;
+}
+VEX2_PAYLOAD, *PVEX2_PAYLOAD;
+
+/*
+The first byte of the three-byte VEX prefix (C4).
+The R, X & B fields are stored inverted.
+*/
+typedef struct _VEX3_PAYLOAD0
+{
+	/* Least-significant 5 bits specify the implied opcode map (VEX_MAP) */
+	BYTE Mmmmm : 5;
+	/* Next 3 bits extend the ModRM & SIB fields (like REX.B, REX.X & REX.R) */
+	BYTE B : 1;
+	BYTE X : 1;
+	BYTE R : 1;
+}
+VEX3_PAYLOAD0, *PVEX3_PAYLOAD0;
+
+/*
+The second byte of the three-byte VEX prefix (C4).
+The vvvv field is stored inverted.
+*/
+typedef struct _VEX3_PAYLOAD1
+{
+	/* Least-significant 2 bits specify the implied legacy prefix (VEX_PP) */
+	VEX_PP Pp : 2;
+	/* Next bit specifies the vector length (0 for 128-bit, 1 for 256-bit) */
+	BYTE L : 1;
+	/* Next 4 bits specify an additional source register */
+	BYTE Vvvv : 4;
+	/* Most-significant bit promotes the operand-size or selects an opcode (like REX.W) */
+	BYTE W : 1;
+}
+VEX3_PAYLOAD1, *PVEX3_PAYLOAD1;
+
+/*
+The first byte of the EVEX prefix (62).
+The R, X, B & R' fields are stored inverted.
+*/
+typedef struct _EVEX_PAYLOAD0
+{
+	/* Least-significant 3 bits specify the implied opcode map (VEX_MAP) */
+	BYTE Mmm : 3;
+	/* Reserved, must be 0 */
+	BYTE Reserved : 1;
+	/* Next bit extends the Reg field of the ModRM byte to 32 registers */
+	BYTE RPrime : 1;
+	/* Next 3 bits extend the ModRM & SIB fields (like REX.B, REX.X & REX.R) */
+	BYTE B : 1;
+	BYTE X : 1;
+	BYTE R : 1;
+}
+EVEX_PAYLOAD0, *PEVEX_PAYLOAD0;
+
+/*
+The second byte of the EVEX prefix (62).
+The vvvv field is stored inverted.
+*/
+typedef struct _EVEX_PAYLOAD1
+{
+	/* Least-significant 2 bits specify the implied legacy prefix (VEX_PP) */
+	VEX_PP Pp : 2;
+	/* Reserved, must be 1 */
+	BYTE Reserved : 1;
+	/* Next 4 bits specify an additional source register */
+	BYTE Vvvv : 4;
+	/* Most-significant bit promotes the operand-size or selects an opcode (like REX.W) */
+	BYTE W : 1;
+}
+EVEX_PAYLOAD1, *PEVEX_PAYLOAD1;
+
+/*
+The third byte of the EVEX prefix (62).
+The V' field is stored inverted.
+*/
+typedef struct _EVEX_PAYLOAD2
+{
+	/* Least-significant 3 bits specify the opmask register (k0-k7) */
+	BYTE Aaa : 3;
+	/* Next bit extends the vvvv field to 32 registers */
+	BYTE VPrime : 1;
+	/* Next bit specifies broadcast (memory operand), or rounding control (register operand) */
+	BYTE Broadcast : 1;
+	/* Next 2 bits specify the vector length (00b for 128-bit, 01b for 256-bit, 10b for 512-bit) */
+	BYTE LL : 2;
+	/* Most-significant bit specifies zeroing-masking, rather than merging-masking */
+	BYTE Z : 1;
+}
+EVEX_PAYLOAD2, *PEVEX_PAYLOAD2;
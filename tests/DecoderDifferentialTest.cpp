@@ -0,0 +1,255 @@
+#include "TestCommon.h"
+#include "disasm/disasm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+Cross-checks the length of every decoded instruction against a reference disassembly produced by objdump,
+over the text sections of local binaries & a corpus of synthetic edge cases.
+*/
+
+/*
+Struct describing an instruction of the reference disassembly.
+*/
+typedef struct _REFERENCE_INSTRUCTION
+{
+	/* The address of the instruction */
+	ULONG_PTR Address;
+	/* The size of the instruction */
+	BYTE Size;
+	/* Describes whether objdump couldn't decode the instruction */
+	BOOL bBad;
+}
+REFERENCE_INSTRUCTION, *PREFERENCE_INSTRUCTION;
+
+/*
+Struct describing a synthetic edge case.
+*/
+typedef struct _EDGE_CASE
+{
+	const char *Name;
+	DISASSEMBLER_MODE Mode;
+	BYTE Bytes[MAX_INSTRUCTION_SIZE];
+	BYTE Size;
+}
+EDGE_CASE, *PEDGE_CASE;
+
+/* The opcode of FWAIT */
+#define FWAIT_OPCODE 0x9B
+
+/* The maximum amount of mismatches that are printed per binary */
+#define MAX_PRINTED_MISMATCHES 10
+
+EDGE_CASE g_EdgeCases[] =
+{
+	{ "operand-size override with imm16", DISASM_MODE_64, { 0x66, 0x81, 0xC0, 0x34, 0x12 }, 5 },
+	{ "operand-size override ignored by REX.W", DISASM_MODE_64, { 0x66, 0x48, 0x81, 0xC0, 0x78, 0x56, 0x34, 0x12 }, 8 },
+	{ "movabs imm64", DISASM_MODE_64, { 0x48, 0xB8, 1, 2, 3, 4, 5, 6, 7, 8 }, 10 },
+	{ "moffs64", DISASM_MODE_64, { 0xA1, 1, 2, 3, 4, 5, 6, 7, 8 }, 9 },
+	{ "moffs32 through address-size override", DISASM_MODE_64, { 0x67, 0xA1, 1, 2, 3, 4 }, 6 },
+	{ "rip-relative with imm32", DISASM_MODE_64, { 0x48, 0xC7, 0x05, 1, 2, 3, 4, 5, 6, 7, 8 }, 11 },
+	{ "sib with disp32 & no base", DISASM_MODE_64, { 0x8B, 0x04, 0x25, 1, 2, 3, 4 }, 7 },
+	{ "rbp base with disp8", DISASM_MODE_64, { 0x8B, 0x45, 0xF8 }, 3 },
+	{ "r13 base through sib", DISASM_MODE_64, { 0x43, 0x8B, 0x44, 0x25, 0x08 }, 5 },
+	{ "jcc rel32", DISASM_MODE_64, { 0x0F, 0x84, 1, 2, 3, 4 }, 6 },
+	{ "call rel32", DISASM_MODE_64, { 0xE8, 1, 2, 3, 4 }, 5 },
+	{ "enter", DISASM_MODE_64, { 0xC8, 0x10, 0x00, 0x01 }, 4 },
+	{ "ret imm16", DISASM_MODE_64, { 0xC2, 0x08, 0x00 }, 3 },
+	{ "test with imm8 through group 3", DISASM_MODE_64, { 0xF6, 0x40, 0x08, 0x01 }, 4 },
+	{ "test with imm32 through group 3", DISASM_MODE_64, { 0xF7, 0x00, 1, 2, 3, 4 }, 6 },
+	{ "long nop", DISASM_MODE_64, { 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 }, 10 },
+	{ "endbr64", DISASM_MODE_64, { 0xF3, 0x0F, 0x1E, 0xFA }, 4 },
+	{ "0F 38 map", DISASM_MODE_64, { 0x66, 0x0F, 0x38, 0x00, 0xC1 }, 5 },
+	{ "0F 3A map with imm8", DISASM_MODE_64, { 0x66, 0x0F, 0x3A, 0x0F, 0xC1, 0x08 }, 6 },
+	{ "vex2", DISASM_MODE_64, { 0xC5, 0xF8, 0x77 }, 3 },
+	{ "vex3 with imm8", DISASM_MODE_64, { 0xC4, 0xE3, 0x7D, 0x18, 0xC1, 0x01 }, 6 },
+	{ "vex3 with sib & disp32", DISASM_MODE_64, { 0xC4, 0xC1, 0x7E, 0x6F, 0x84, 0x24, 1, 2, 3, 4 }, 10 },
+	{ "evex with disp8", DISASM_MODE_64, { 0x62, 0xF1, 0x7C, 0x48, 0x10, 0x47, 0x01 }, 7 },
+	{ "longest instruction", DISASM_MODE_64, { 0x2E, 0x36, 0xF0, 0x48, 0x81, 0x84, 0x24, 1, 2, 3, 4, 5, 6, 7, 8 }, 15 },
+	{ "moffs32", DISASM_MODE_32, { 0xA1, 1, 2, 3, 4 }, 5 },
+	{ "moffs16 through address-size override", DISASM_MODE_32, { 0x67, 0xA1, 1, 2 }, 4 },
+	{ "16-bit addressing with disp16", DISASM_MODE_32, { 0x67, 0x8B, 0x86, 1, 2 }, 5 },
+	{ "16-bit addressing with no base", DISASM_MODE_32, { 0x67, 0x8B, 0x06, 1, 2 }, 5 },
+	{ "far jmp", DISASM_MODE_32, { 0xEA, 1, 2, 3, 4, 5, 6 }, 7 },
+	{ "far call through operand-size override", DISASM_MODE_32, { 0x66, 0x9A, 1, 2, 3, 4 }, 6 },
+	{ "les", DISASM_MODE_32, { 0xC4, 0x06 }, 2 },
+	{ "bound", DISASM_MODE_32, { 0x62, 0x06 }, 2 },
+	{ "push imm32", DISASM_MODE_32, { 0x68, 1, 2, 3, 4 }, 5 },
+	{ "inc through its single-byte opcode", DISASM_MODE_32, { 0x40 }, 1 },
+};
+
+/*
+Run objdump, and parse its disassembly.
+@param command, the objdump command line.
+@param pInstructions, receives the disassembled instructions.
+@return whether objdump ran.
+*/
+BOOL RunObjdump(const char *command, OUT std::vector<REFERENCE_INSTRUCTION> *pInstructions)
+{
+	FILE *output = popen(command, "r");
+	if (!output)
+		return FALSE;
+
+	char line[0x400];
+	while (fgets(line, sizeof(line), output))
+	{
+		/* Instruction lines look like "  401000:\t48 83 ec 08    \tsub    $0x8,%rsp" */
+		char *end;
+		ULONG_PTR address = strtoull(line, &end, 16);
+		if (end == line || end[0] != ':' || end[1] != '\t')
+			continue;
+
+		REFERENCE_INSTRUCTION instruction = { address, 0, FALSE };
+		char *bytes = end + 2;
+		while (bytes[0] && bytes[0] != '\t' && bytes[0] != '\n')
+		{
+			if (bytes[0] != ' ')
+			{
+				instruction.Size++;
+				bytes += 2;
+			}
+			else
+				bytes++;
+		}
+
+		if (!instruction.Size)
+			continue;
+
+		instruction.bBad = strstr(bytes, "(bad)") != NULL;
+		pInstructions->push_back(instruction);
+	}
+
+	return pclose(output) == 0 && !pInstructions->empty();
+}
+
+/*
+Decode a single instruction.
+@param buffer, the code the instruction is in.
+@param size, the size of the code, from the instruction onwards.
+@param mode, the mode the instruction is decoded in.
+@return the size of the instruction, or 0 if it couldn't be decoded.
+*/
+SIZE_T DecodeLength(PBYTE buffer, SIZE_T size, DISASSEMBLER_MODE mode)
+{
+	INSTRUCTION_ITERATOR iterator;
+	DECODED_INSTRUCTION instruction;
+
+	Disassembler::InitializeIterator(&iterator, buffer, size, mode);
+	if (!Disassembler::NextInstruction(&iterator, &instruction))
+		return 0;
+
+	return instruction.Size;
+}
+
+/*
+Cross-check every instruction of a binary's text section against objdump's disassembly of it.
+@param path, the path of the binary.
+*/
+void TestBinary(const char *path)
+{
+	TEXT_SECTION section;
+	if (!ReadTextSection(path, &section))
+	{
+		printf("%s: skipped, no .text section\n", path);
+		return;
+	}
+
+	char command[0x1100];
+	snprintf(command, sizeof(command), "objdump -d -z --insn-width=15 -j .text '%s'", path);
+
+	std::vector<REFERENCE_INSTRUCTION> reference;
+	if (!CHECK(RunObjdump(command, &reference)))
+		return;
+
+	SIZE_T compared = 0;
+	SIZE_T mismatches = 0;
+	for (REFERENCE_INSTRUCTION &instruction : reference)
+	{
+		SIZE_T offset = instruction.Address - section.Address;
+		if (instruction.bBad || offset >= section.Code.size())
+			continue;
+
+		compared++;
+		SIZE_T size = DecodeLength(section.Code.data() + offset, section.Code.size() - offset, DISASM_MODE_64);
+		if (size == instruction.Size)
+			continue;
+
+		/* objdump shows FWAIT & the x87 instruction after it as a single instruction (e.g. FSTCW is FWAIT; FNSTCW), though they're separate */
+		if (section.Code[offset] == FWAIT_OPCODE && size == 1 &&
+			size + DecodeLength(section.Code.data() + offset + 1, section.Code.size() - offset - 1, DISASM_MODE_64) == instruction.Size)
+			continue;
+
+		if (++mismatches <= MAX_PRINTED_MISMATCHES)
+		{
+			printf("%s+%#zx: decoded %zu bytes, objdump decoded %u:", path, offset, size, instruction.Size);
+			for (SIZE_T i = 0; i < instruction.Size; i++)
+				printf(" %02x", section.Code[offset + i]);
+			printf("\n");
+		}
+	}
+
+	printf("%s: %zu instructions, %zu mismatches\n", path, compared, mismatches);
+	CHECK(compared);
+	CHECK_EQUAL(mismatches, 0);
+}
+
+/*
+Check the edge cases against their known sizes, and against objdump's disassembly of them.
+@param mode, the mode of the edge cases to check.
+@param machine, objdump's name of the mode.
+*/
+void TestEdgeCases(DISASSEMBLER_MODE mode, const char *machine)
+{
+	char path[] = "/tmp/trampy-edge-cases-XXXXXX";
+	int file = mkstemp(path);
+	if (!CHECK(file != -1))
+		return;
+
+	std::vector<PEDGE_CASE> cases;
+	for (EDGE_CASE &edgeCase : g_EdgeCases)
+	{
+		if (edgeCase.Mode != mode)
+			continue;
+
+		cases.push_back(&edgeCase);
+		CHECK(write(file, edgeCase.Bytes, edgeCase.Size) == edgeCase.Size);
+
+		SIZE_T size = DecodeLength(edgeCase.Bytes, edgeCase.Size, mode);
+		if (!CHECK_EQUAL(size, edgeCase.Size))
+			printf("edge case: %s\n", edgeCase.Name);
+	}
+	close(file);
+
+	char command[0x200];
+	snprintf(command, sizeof(command), "objdump -D -z --insn-width=15 -b binary -m %s '%s'", machine, path);
+
+	std::vector<REFERENCE_INSTRUCTION> reference;
+	BOOL bRan = RunObjdump(command, &reference);
+	unlink(path);
+	if (!CHECK(bRan) || !CHECK_EQUAL(reference.size(), cases.size()))
+		return;
+
+	for (SIZE_T i = 0; i < cases.size(); i++)
+	{
+		if (!CHECK_EQUAL(reference[i].Size, cases[i]->Size) || !CHECK(!reference[i].bBad))
+			printf("edge case: %s\n", cases[i]->Name);
+	}
+}
+
+int main()
+{
+	if (system("objdump --version > /dev/null 2>&1"))
+	{
+		printf("objdump isn't available, skipped\n");
+		return 0;
+	}
+
+	TestEdgeCases(DISASM_MODE_64, "i386:x86-64");
+	TestEdgeCases(DISASM_MODE_32, "i386");
+
+	for (const char *path : FindCorpusBinaries())
+		TestBinary(path);
+
+	return FinishTest();
+}
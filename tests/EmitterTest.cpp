@@ -0,0 +1,212 @@
+#include "TestCommon.h"
+#include "Emitter.h"
+#include "disasm/disasm.h"
+#include <string.h>
+
+/*
+Checks the stubs the emitter writes, by decoding them back: every branch's opcode, size & target,
+the addresses absolute JMPs & CALLs read their target from, the halves of a push/ret JMP's target,
+and the Relative Addresses of label references, which are fixed once the code is finished.
+The code is built in a staging buffer, for a runtime address elsewhere, so targets must be relative to the runtime address.
+*/
+
+static_assert(DISASM_MODE_NATIVE == DISASM_MODE_64, "the emitted code is x86-64");
+
+/* The address the code is executed from, and a target within reach of it, and a target that's out of reach */
+#define RUNTIME_ADDRESS ((PBYTE) 0x10000000)
+#define NEAR_TARGET ((PBYTE) 0x10001000)
+#define FAR_TARGET ((PBYTE) 0x1122334455667788)
+
+/* Size of the staging buffer */
+#define STAGING_SIZE 64
+
+/*
+Struct describing an expected instruction of an emitted stub.
+*/
+typedef struct _EXPECTED_INSTRUCTION
+{
+	BYTE Opcode;
+	BYTE Size;
+	/* The target of the instruction (where a RIP-relative operand points, for absolute branches), or NULL if it has none */
+	PBYTE pTarget;
+}
+EXPECTED_INSTRUCTION, *PEXPECTED_INSTRUCTION;
+
+/*
+Decode an emitted stub, and check its instructions.
+@param name, the name of the stub.
+@param pBuffer, the staging buffer the stub was emitted to.
+@param size, the size of the stub.
+@param expected, the expected instructions.
+*/
+void CheckStub(const char *name, PBYTE pBuffer, SIZE_T size, const std::vector<EXPECTED_INSTRUCTION> &expected)
+{
+	printf("%s\n", name);
+
+	INSTRUCTION_ITERATOR iterator;
+	Disassembler::InitializeIterator(&iterator, pBuffer, size, DISASM_MODE_64);
+
+	SIZE_T amount = 0;
+	DECODED_INSTRUCTION instruction;
+	while (amount < expected.size() && Disassembler::NextInstruction(&iterator, &instruction))
+	{
+		const EXPECTED_INSTRUCTION &expectedInstruction = expected[amount++];
+		PBYTE pTarget = instruction.Target ? RUNTIME_ADDRESS + (instruction.Target - pBuffer) : NULL;
+
+		if (!CHECK_EQUAL(instruction.Opcode, expectedInstruction.Opcode) || !CHECK_EQUAL(instruction.Size, expectedInstruction.Size) ||
+			!CHECK(pTarget == expectedInstruction.pTarget))
+		{
+			printf("%s: instruction %zu\n", name, amount - 1);
+		}
+	}
+
+	CHECK_EQUAL(amount, expected.size());
+	CHECK_EQUAL(iterator.Offset, size);
+}
+
+/*
+@return the pointer stored at an offset of the staging buffer.
+*/
+PBYTE ReadPointer(PBYTE pBuffer, SIZE_T offset)
+{
+	PBYTE pPointer;
+	memcpy(&pPointer, pBuffer + offset, sizeof(pPointer));
+	return pPointer;
+}
+
+/*
+Check the relative branches, and the branch sizes the emitter chooses for them.
+*/
+void TestRelativeBranches()
+{
+	BYTE buffer[STAGING_SIZE];
+	EMITTER emitter;
+	SIZE_T size;
+
+	Emitter::Initialize(&emitter, buffer, sizeof(buffer), RUNTIME_ADDRESS);
+	Emitter::Jmp(&emitter, RUNTIME_ADDRESS + 0x40, BRANCH_SIZE_AUTO);
+	Emitter::Jmp(&emitter, NEAR_TARGET, BRANCH_SIZE_AUTO);
+	Emitter::Jmp(&emitter, RUNTIME_ADDRESS, BRANCH_SIZE_NEAR);
+	Emitter::Jcc(&emitter, CONDITION_E, RUNTIME_ADDRESS, BRANCH_SIZE_SHORT);
+	Emitter::Jcc(&emitter, CONDITION_NE, NEAR_TARGET, BRANCH_SIZE_AUTO);
+	Emitter::Call(&emitter, NEAR_TARGET);
+	if (!CHECK(Emitter::Finish(&emitter, &size)))
+		return;
+
+	CHECK_EQUAL(size, JMP_REL8_SIZE + JMP_REL32_SIZE * 2 + JMP_REL8_SIZE + JCC_REL32_SIZE + CALL_REL32_SIZE);
+	CheckStub("relative branches", buffer, size,
+	{
+		{ 0xEB, JMP_REL8_SIZE, RUNTIME_ADDRESS + 0x40 },
+		{ 0xE9, JMP_REL32_SIZE, NEAR_TARGET },
+		{ 0xE9, JMP_REL32_SIZE, RUNTIME_ADDRESS },
+		{ 0x74, JMP_REL8_SIZE, RUNTIME_ADDRESS },
+		{ 0x85, JCC_REL32_SIZE, NEAR_TARGET },
+		{ 0xE8, CALL_REL32_SIZE, NEAR_TARGET },
+	});
+
+	/* A short branch, or a relative CALL, that can't reach its target fails the emitter */
+	Emitter::Initialize(&emitter, buffer, sizeof(buffer), RUNTIME_ADDRESS);
+	CHECK(!Emitter::Jmp(&emitter, NEAR_TARGET, BRANCH_SIZE_SHORT));
+	CHECK(!Emitter::Finish(&emitter, &size));
+
+	Emitter::Initialize(&emitter, buffer, sizeof(buffer), RUNTIME_ADDRESS);
+	CHECK(!Emitter::Call(&emitter, FAR_TARGET));
+	CHECK(!Emitter::Finish(&emitter, &size));
+}
+
+/*
+Check the absolute branches, which reach any address.
+*/
+void TestAbsoluteBranches()
+{
+	BYTE buffer[STAGING_SIZE];
+	EMITTER emitter;
+	SIZE_T size;
+
+	/* JMP [RIP+0], followed by the target */
+	Emitter::Initialize(&emitter, buffer, sizeof(buffer), RUNTIME_ADDRESS);
+	Emitter::JmpAbsolute(&emitter, FAR_TARGET);
+	if (CHECK(Emitter::Finish(&emitter, &size)) && CHECK_EQUAL(size, JMP_ABSOLUTE_SIZE))
+	{
+		CheckStub("absolute jmp", buffer, 6, { { 0xFF, 6, RUNTIME_ADDRESS + 6 } });
+		CHECK_EQUAL((buffer[1] >> 3) & 7, 4);
+		CHECK(ReadPointer(buffer, 6) == FAR_TARGET);
+	}
+
+	/* PUSH low half; MOV DWORD PTR [RSP+4], high half; RET */
+	Emitter::Initialize(&emitter, buffer, sizeof(buffer), RUNTIME_ADDRESS);
+	Emitter::JmpPushRet(&emitter, FAR_TARGET);
+	if (CHECK(Emitter::Finish(&emitter, &size)) && CHECK_EQUAL(size, JMP_PUSH_RET_SIZE))
+	{
+		CheckStub("push/ret jmp", buffer, size, { { 0x68, 5, NULL }, { 0xC7, 8, NULL }, { 0xC3, 1, NULL } });
+
+		DWORD low, high;
+		memcpy(&low, buffer + 1, DWORD_SIZE);
+		memcpy(&high, buffer + 5 + 4, DWORD_SIZE);
+		CHECK(!memcmp(buffer + 5, "\xC7\x44\x24\x04", 4));
+		CHECK_EQUAL(((DWORD64) high << 32) | low, (DWORD64) (ULONG_PTR) FAR_TARGET);
+	}
+
+	/* CALL [RIP+2]; JMP over the target; the target */
+	Emitter::Initialize(&emitter, buffer, sizeof(buffer), RUNTIME_ADDRESS);
+	Emitter::CallAbsolute(&emitter, FAR_TARGET);
+	if (CHECK(Emitter::Finish(&emitter, &size)) && CHECK_EQUAL(size, 6 + JMP_REL8_SIZE + sizeof(LPVOID)))
+	{
+		CheckStub("absolute call", buffer, 6 + JMP_REL8_SIZE, { { 0xFF, 6, RUNTIME_ADDRESS + 8 }, { 0xEB, JMP_REL8_SIZE, RUNTIME_ADDRESS + size } });
+		CHECK_EQUAL((buffer[1] >> 3) & 7, 2);
+		CHECK(ReadPointer(buffer, 8) == FAR_TARGET);
+	}
+}
+
+/*
+Check references to labels, before & after they're bound, which are fixed once the code is finished.
+*/
+void TestLabels()
+{
+	BYTE buffer[STAGING_SIZE];
+	EMITTER emitter;
+	SIZE_T size;
+
+	/* JMP forward (rel32, as the label isn't bound yet), RET, then JNE & JMP backward (rel8, as the label is bound) */
+	Emitter::Initialize(&emitter, buffer, sizeof(buffer), RUNTIME_ADDRESS);
+	LABEL forward = Emitter::NewLabel(&emitter);
+	LABEL start = Emitter::NewLabel(&emitter);
+	Emitter::Bind(&emitter, start);
+	Emitter::JmpLabel(&emitter, forward, BRANCH_SIZE_AUTO);
+	Emitter::JccLabel(&emitter, CONDITION_E, forward, BRANCH_SIZE_NEAR);
+	Emitter::Ret(&emitter);
+	Emitter::Bind(&emitter, forward);
+	Emitter::JccLabel(&emitter, CONDITION_NE, forward, BRANCH_SIZE_AUTO);
+	Emitter::JmpLabel(&emitter, start, BRANCH_SIZE_AUTO);
+	if (!CHECK(Emitter::Finish(&emitter, &size)))
+		return;
+
+	PBYTE pForward = RUNTIME_ADDRESS + JMP_REL32_SIZE + JCC_REL32_SIZE + 1;
+	CheckStub("labels", buffer, size,
+	{
+		{ 0xE9, JMP_REL32_SIZE, pForward },
+		{ 0x84, JCC_REL32_SIZE, pForward },
+		{ 0xC3, 1, NULL },
+		{ 0x75, JMP_REL8_SIZE, pForward },
+		{ 0xEB, JMP_REL8_SIZE, RUNTIME_ADDRESS },
+	});
+
+	/* A label that's never bound fails the code */
+	Emitter::Initialize(&emitter, buffer, sizeof(buffer), RUNTIME_ADDRESS);
+	Emitter::JmpLabel(&emitter, Emitter::NewLabel(&emitter), BRANCH_SIZE_AUTO);
+	CHECK(!Emitter::Finish(&emitter, &size));
+
+	/* So does running out of the buffer */
+	Emitter::Initialize(&emitter, buffer, JMP_ABSOLUTE_SIZE - 1, RUNTIME_ADDRESS);
+	CHECK(!Emitter::JmpAbsolute(&emitter, FAR_TARGET));
+	CHECK(!Emitter::Finish(&emitter, &size));
+}
+
+int main()
+{
+	TestRelativeBranches();
+	TestAbsoluteBranches();
+	TestLabels();
+
+	return FinishTest();
+}
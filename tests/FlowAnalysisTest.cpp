@@ -0,0 +1,315 @@
+#include "TestCommon.h"
+#include "FlowAnalysis.h"
+#include "Trampy.h"
+#include "disasm/disasm.h"
+#include <atomic>
+#include <thread>
+
+/*
+Checks which first bytes of a function may be stolen by a hook: a straight-line prologue may be,
+while a loop that branches back into them, or a flow that ends within them, makes them unsafe.
+Also checks that flows are analyzed from many threads at once, while others evict them & analyze them within more bytes,
+and that every flow a thread holds stays valid meanwhile.
+Also checks the jumps that are followed to a function's body: thunks, stubs through a pointer, lazily-bound PLT entries
+(which aren't followed), cycles & chains that are too long.
+*/
+
+/* The amount of bytes a hook steals, i.e. the size of a JMP rel32 */
+#define STOLEN_SIZE 5
+
+/* The amount of threads that analyze the same function at once, and how many times each of them does */
+#define ANALYZER_AMOUNT 4
+#define ANALYSIS_AMOUNT 2000
+
+/*
+The analyzed functions, whose instructions are written by hand, so they're the same whatever the compiler is.
+*/
+extern "C" void StraightLineFunction();
+extern "C" void LoopFunction();
+extern "C" void TinyFunction();
+
+/*
+The jumps that are followed, and their bodies.
+*/
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+extern "C" INT64 ThunkEntry(INT64 x);
+extern "C" INT64 ThunkBody(INT64 x);
+extern "C" void StubEntry();
+extern "C" void IbtPltEntry();
+extern "C" void ClassicPltEntry();
+extern "C" void CycleEntry();
+extern "C" void ChainEntry();
+extern "C" void ChainBody();
+
+/* The amount of JMP rel32s ChainEntry goes through to reach ChainBody (the .rept below) */
+#define CHAIN_JUMPS 8
+
+asm(R"(
+	.intel_syntax noprefix
+	.text
+
+	.globl StraightLineFunction
+	.p2align 4
+StraightLineFunction:
+	push rbp
+	mov rbp, rsp
+	sub rsp, 0x10
+	lea rax, [rdi + rdi * 2]
+	leave
+	ret
+
+	.globl LoopFunction
+	.p2align 4
+LoopFunction:
+	xor eax, eax
+LoopFunctionBody:
+	add rax, rdi
+	dec rdi
+	jnz LoopFunctionBody
+	ret
+
+	.globl TinyFunction
+	.p2align 4
+TinyFunction:
+	xor eax, eax
+	ret
+	int3
+	int3
+	int3
+
+	/* JMP rel32 to the body */
+	.globl ThunkEntry
+	.p2align 4
+ThunkEntry:
+	.byte 0xE9
+	.long ThunkBody - . - 4
+
+	.globl ThunkBody
+	.p2align 4
+ThunkBody:
+	lea rax, [rdi + 1]
+	nop dword ptr [rax]
+	ret
+
+	/* JMP [RIP+X], through a pointer to the thunk */
+	.globl StubEntry
+	.p2align 4
+StubEntry:
+	jmp qword ptr [rip + StubPointer]
+
+	/* An IBT .plt.sec entry, whose GOT entry still points at its .plt entry, which binds it: PUSH index (Iz); BND JMP PLT0 */
+	.globl IbtPltEntry
+	.p2align 4
+IbtPltEntry:
+	endbr64
+	bnd jmp qword ptr [rip + IbtGotEntry]
+	nop dword ptr [rax + rax]
+IbtPltBinder:
+	endbr64
+	.byte 0x68
+	.long 0
+	.byte 0xF2, 0xE9
+	.long PltZero - . - 4
+
+	/* A classic .plt entry, whose GOT entry still points right past its JMP */
+	.globl ClassicPltEntry
+	.p2align 4
+ClassicPltEntry:
+	jmp qword ptr [rip + ClassicGotEntry]
+ClassicPltBinder:
+	.byte 0x68
+	.long 1
+	.byte 0xE9
+	.long PltZero - . - 4
+
+	.p2align 4
+PltZero:
+	ud2
+
+	/* Two JMPs to each other */
+	.globl CycleEntry
+	.p2align 4
+CycleEntry:
+	jmp CycleOther
+CycleOther:
+	jmp CycleEntry
+
+	/* CHAIN_JUMPS JMP rel32s, each to the next instruction */
+	.globl ChainEntry
+	.p2align 4
+ChainEntry:
+	.rept 8
+	.byte 0xE9
+	.long 0
+	.endr
+	.globl ChainBody
+ChainBody:
+	ret
+
+	.data
+	.p2align 3
+StubPointer:
+	.quad ThunkEntry
+IbtGotEntry:
+	.quad IbtPltBinder
+ClassicGotEntry:
+	.quad ClassicPltBinder
+
+	.text
+
+	.att_syntax prefix
+)");
+
+/*
+Check whether a function's first bytes may be stolen, and where its flow reaches them if they may not.
+@param name, the name of the function.
+@param pFunction, the function.
+@param bHookable, whether its first bytes may be stolen.
+@param expectedConflict, the offset its flow reaches them at, if they may not.
+*/
+void TestHookable(const char *name, LPVOID pFunction, BOOL bHookable, SIZE_T expectedConflict)
+{
+	printf("%s\n", name);
+
+	FLOW_REFERENCE pFlow = FlowAnalysis::Analyze(pFunction, FLOW_DEFAULT_MAX_SIZE);
+	if (!CHECK(pFlow))
+		return;
+
+	SIZE_T conflictOffset;
+	CHECK_EQUAL(FlowAnalysis::IsHookable(pFlow, STOLEN_SIZE, &conflictOffset), bHookable);
+	if (!bHookable)
+		CHECK_EQUAL(conflictOffset, expectedConflict);
+}
+
+/*
+Check the blocks & branch targets of the loop: XOR; (ADD; DEC; JNZ back to ADD); RET.
+*/
+void TestLoopBlocks()
+{
+	FLOW_REFERENCE pFlow = FlowAnalysis::Analyze((LPVOID) LoopFunction, FLOW_DEFAULT_MAX_SIZE);
+	if (!CHECK(pFlow))
+		return;
+
+	SIZE_T blockAmount;
+	const BASIC_BLOCK *pBlocks = FlowAnalysis::GetBlocks(pFlow, &blockAmount);
+	if (!CHECK_EQUAL(blockAmount, 3))
+		return;
+
+	CHECK_EQUAL(pBlocks[0].Offset, 0);
+	CHECK_EQUAL(pBlocks[1].Offset, 2);
+	CHECK_EQUAL(pBlocks[1].BranchKind, BRANCH_JCC);
+	CHECK_EQUAL(pBlocks[2].BranchKind, BRANCH_RET);
+	CHECK(!pBlocks[2].bFallsThrough);
+
+	CHECK(FlowAnalysis::IsBranchTarget(pFlow, (PBYTE) LoopFunction + 2));
+	CHECK(!FlowAnalysis::IsBranchTarget(pFlow, (PBYTE) LoopFunction + 1));
+}
+
+/*
+Keep analyzing a function within growing amounts of bytes, and evicting it, while checking every flow that's held.
+@param index, the analyzer's index, odd analyzers evict the function as well.
+@param pFailureAmount, counts the flows that were found changed while they were held.
+*/
+void AnalyzeConcurrently(SIZE_T index, std::atomic<SIZE_T> *pFailureAmount)
+{
+	for (SIZE_T i = 0; i < ANALYSIS_AMOUNT; i++)
+	{
+		FLOW_REFERENCE pFlow = FlowAnalysis::Analyze((LPVOID) LoopFunction, FLOW_DEFAULT_MAX_SIZE + i % 64);
+		if (!pFlow)
+		{
+			(*pFailureAmount)++;
+			continue;
+		}
+
+		if (index % 2)
+			i % 3 ? FlowAnalysis::Evict((LPVOID) LoopFunction) : FlowAnalysis::EvictAll();
+
+		/* The flow is held, so it's intact whatever the other analyzers do to the cache */
+		SIZE_T blockAmount;
+		const BASIC_BLOCK *pBlocks = FlowAnalysis::GetBlocks(pFlow, &blockAmount);
+		if (blockAmount != 3 || pBlocks[1].Offset != 2 || !FlowAnalysis::IsBranchTarget(pFlow, (PBYTE) LoopFunction + 2))
+			(*pFailureAmount)++;
+	}
+}
+
+/*
+Check that a held flow stays valid once it's evicted, and once the function is analyzed again within more bytes.
+*/
+void TestHeldFlows()
+{
+	printf("held flows\n");
+
+	FLOW_REFERENCE pFlow = FlowAnalysis::Analyze((LPVOID) LoopFunction, FLOW_DEFAULT_MAX_SIZE);
+	if (!CHECK(pFlow))
+		return;
+
+	/* A larger analysis replaces the cached flow, while a smaller one reuses it */
+	FLOW_REFERENCE pLarger = FlowAnalysis::Analyze((LPVOID) LoopFunction, FLOW_DEFAULT_MAX_SIZE * 2);
+	CHECK(pLarger && pLarger != pFlow);
+	CHECK(FlowAnalysis::Analyze((LPVOID) LoopFunction, FLOW_DEFAULT_MAX_SIZE) == pLarger);
+
+	FlowAnalysis::EvictAll();
+	CHECK(FlowAnalysis::IsHookable(pFlow, 2, NULL));
+	CHECK(FlowAnalysis::IsBranchTarget(pFlow, (PBYTE) LoopFunction + 2));
+
+	std::atomic<SIZE_T> failureAmount(0);
+	std::vector<std::thread> analyzers;
+	for (SIZE_T i = 0; i < ANALYZER_AMOUNT; i++)
+		analyzers.emplace_back(AnalyzeConcurrently, i, &failureAmount);
+
+	for (std::thread &analyzer : analyzers)
+		analyzer.join();
+
+	CHECK_EQUAL(failureAmount, 0);
+}
+
+TARGET_FUNCTION g_ThunkTrampoline;
+
+INT64 ThunkHook(INT64 x) { return g_ThunkTrampoline(x) + 1000; }
+
+/*
+Check the jumps that are followed from a function's entry.
+*/
+void TestFollowJumps()
+{
+	printf("follow jumps\n");
+
+	CHECK(FlowAnalysis::FollowJumps((LPVOID) ThunkEntry, FLOW_DEFAULT_MAX_JUMPS) == (LPVOID) ThunkBody);
+	CHECK(FlowAnalysis::FollowJumps((LPVOID) ThunkBody, FLOW_DEFAULT_MAX_JUMPS) == (LPVOID) ThunkBody);
+	CHECK(FlowAnalysis::FollowJumps((LPVOID) StubEntry, FLOW_DEFAULT_MAX_JUMPS) == (LPVOID) ThunkBody);
+
+	/* Lazily-bound PLT entries are hooked at the entry itself, rather than at the code that binds them */
+	CHECK(FlowAnalysis::FollowJumps((LPVOID) IbtPltEntry, FLOW_DEFAULT_MAX_JUMPS) == (LPVOID) IbtPltEntry);
+	CHECK(FlowAnalysis::FollowJumps((LPVOID) ClassicPltEntry, FLOW_DEFAULT_MAX_JUMPS) == (LPVOID) ClassicPltEntry);
+
+	CHECK(!FlowAnalysis::FollowJumps((LPVOID) CycleEntry, FLOW_DEFAULT_MAX_JUMPS));
+
+	CHECK(FlowAnalysis::FollowJumps((LPVOID) ChainEntry, CHAIN_JUMPS) == (LPVOID) ChainBody);
+	CHECK(!FlowAnalysis::FollowJumps((LPVOID) ChainEntry, CHAIN_JUMPS - 1));
+	CHECK(!FlowAnalysis::FollowJumps((LPVOID) ChainEntry, FLOW_MAX_JUMPS + 1));
+
+	/* A Hook created at the thunk is installed at the body, so calls to either of them are hooked */
+	PHOOK_DESCRIPTOR pHook = Trampy::CreateHook((LPVOID) ThunkEntry, (LPVOID) ThunkHook, (LPVOID *) &g_ThunkTrampoline, HOOK_FLAG_FOLLOW_JUMPS);
+	if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)))
+		return;
+
+	CHECK_EQUAL(ThunkEntry(1), 1002);
+	CHECK_EQUAL(ThunkBody(1), 1002);
+	CHECK_EQUAL(g_ThunkTrampoline(1), 2);
+
+	CHECK(Trampy::DisableHook(pHook));
+	CHECK_EQUAL(ThunkEntry(1), 2);
+}
+
+int main()
+{
+	TestHookable("straight-line prologue", (LPVOID) StraightLineFunction, TRUE, 0);
+	TestHookable("loop into the stolen bytes", (LPVOID) LoopFunction, FALSE, 2);
+	TestHookable("flow ends within the stolen bytes", (LPVOID) TinyFunction, FALSE, 3);
+	TestLoopBlocks();
+	TestHeldFlows();
+	TestFollowJumps();
+
+	return FinishTest();
+}
@@ -0,0 +1,146 @@
+#include "TestCommon.h"
+#include "disasm/disasm.h"
+#include <string.h>
+
+/*
+Checks the Intel-syntax text of decoded instructions, from a table of bytes & their expected text,
+and that a buffer that's too small returns 0 along with the truncated (yet null-terminated) text.
+*/
+
+/*
+Struct describing an instruction, the mode it's decoded in, and its expected text.
+*/
+typedef struct _FORMAT_CASE
+{
+	BYTE Code[MAX_INSTRUCTION_SIZE];
+	SIZE_T Size;
+	DISASSEMBLER_MODE Mode;
+	const char *Expected;
+}
+FORMAT_CASE, *PFORMAT_CASE;
+
+const FORMAT_CASE g_Cases[] =
+{
+	{ { 0x48, 0x89, 0x5C, 0x24, 0x08 }, 5, DISASM_MODE_64, "mov qword ptr [rsp+0x8], rbx" },
+	{ { 0x55 }, 1, DISASM_MODE_64, "push rbp" },
+	{ { 0x41, 0x54 }, 2, DISASM_MODE_64, "push r12" },
+	{ { 0x48, 0x83, 0xEC, 0x08 }, 4, DISASM_MODE_64, "sub rsp, 0x8" },
+	{ { 0x48, 0xB8, 1, 2, 3, 4, 5, 6, 7, 8 }, 10, DISASM_MODE_64, "mov rax, 0x807060504030201" },
+	{ { 0xC3 }, 1, DISASM_MODE_64, "ret" },
+	{ { 0x66, 0x90 }, 2, DISASM_MODE_64, "nop" },
+	{ { 0x0F, 0x1F, 0x44, 0x00, 0x00 }, 5, DISASM_MODE_64, "nop dword ptr [rax+rax*1+0x0]" },
+	{ { 0xF0, 0x48, 0x0F, 0xB1, 0x0F }, 5, DISASM_MODE_64, "lock cmpxchg qword ptr [rdi], rcx" },
+	/* RIP-relative operands are shown relative to RIP, whatever the instruction's address is */
+	{ { 0x48, 0x8D, 0x05, 0x10, 0x00, 0x00, 0x00 }, 7, DISASM_MODE_64, "lea rax, [rip+0x10]" },
+	{ { 0x48, 0x8D, 0x05, 0xF0, 0xFF, 0xFF, 0xFF }, 7, DISASM_MODE_64, "lea rax, [rip-0x10]" },
+	{ { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 }, 6, DISASM_MODE_64, "jmp qword ptr [rip+0x0]" },
+	/* Segment overrides */
+	{ { 0x64, 0x48, 0x8B, 0x04, 0x25, 0x28, 0x00, 0x00, 0x00 }, 9, DISASM_MODE_64, "mov rax, qword ptr fs:[0x28]" },
+	{ { 0x64, 0xA1, 0x30, 0x00, 0x00, 0x00 }, 6, DISASM_MODE_32, "mov eax, dword ptr fs:[0x30]" },
+	/* 32-bit mode, with 16-bit addressing */
+	{ { 0x8B, 0x44, 0x8E, 0xFC }, 4, DISASM_MODE_32, "mov eax, dword ptr [esi+ecx*4-0x4]" },
+	{ { 0x67, 0x8B, 0x40, 0x08 }, 4, DISASM_MODE_32, "mov eax, dword ptr [bx+si+0x8]" },
+	{ { 0x67, 0x8B, 0x06, 0x34, 0x12 }, 5, DISASM_MODE_32, "mov eax, dword ptr [0x1234]" },
+	/* Instructions without a mnemonic are shown as their raw bytes: VEX (VZEROUPPER) & x87 (FLDZ) */
+	{ { 0xC5, 0xF8, 0x77 }, 3, DISASM_MODE_64, "db 0xc5, 0xf8, 0x77" },
+	{ { 0xD9, 0xEE }, 2, DISASM_MODE_64, "db 0xd9, 0xee" },
+};
+
+/*
+Decode the single instruction of a code range.
+@param code, the code range.
+@param size, the size of the code range.
+@param mode, the mode the code is decoded in.
+@param pInstruction, receives the instruction.
+@return whether the code range is exactly a single instruction.
+*/
+BOOL DecodeSingle(const BYTE *code, SIZE_T size, DISASSEMBLER_MODE mode, OUT PDECODED_INSTRUCTION pInstruction)
+{
+	INSTRUCTION_ITERATOR iterator;
+	Disassembler::InitializeIterator(&iterator, (PBYTE) code, size, mode);
+
+	return Disassembler::NextInstruction(&iterator, pInstruction) && pInstruction->Size == size;
+}
+
+/*
+Check the text of every instruction in the table.
+*/
+void TestCases()
+{
+	for (const FORMAT_CASE &formatCase : g_Cases)
+	{
+		DECODED_INSTRUCTION instruction;
+		if (!CHECK(DecodeSingle(formatCase.Code, formatCase.Size, formatCase.Mode, &instruction)))
+		{
+			printf("couldn't decode: %s\n", formatCase.Expected);
+			continue;
+		}
+
+		CHAR text[FORMAT_BUFFER_SIZE];
+		SIZE_T length = Disassembler::FormatInstruction(&instruction, formatCase.Code, formatCase.Mode, text, sizeof(text));
+
+		if (!CHECK_EQUAL(length, strlen(formatCase.Expected)) || !CHECK(!strcmp(text, formatCase.Expected)))
+			printf("expected \"%s\", got \"%s\"\n", formatCase.Expected, text);
+	}
+}
+
+/*
+Check that relative branches are shown with their absolute target.
+*/
+void TestRelativeBranch()
+{
+	static const BYTE call[] = { 0xE8, 0x10, 0x00, 0x00, 0x00 };
+
+	DECODED_INSTRUCTION instruction;
+	if (!CHECK(DecodeSingle(call, sizeof(call), DISASM_MODE_64, &instruction)))
+		return;
+
+	CHAR expected[FORMAT_BUFFER_SIZE];
+	snprintf(expected, sizeof(expected), "call 0x%llx", (unsigned long long) (ULONG_PTR) (call + sizeof(call) + 0x10));
+
+	CHAR text[FORMAT_BUFFER_SIZE];
+	Disassembler::FormatInstruction(&instruction, call, DISASM_MODE_64, text, sizeof(text));
+	if (!CHECK(!strcmp(text, expected)))
+		printf("expected \"%s\", got \"%s\"\n", expected, text);
+}
+
+/*
+Check that a buffer that's too small for the text (including its null-terminator) returns 0, and is truncated.
+*/
+void TestTruncation()
+{
+	const FORMAT_CASE &formatCase = g_Cases[0];
+
+	DECODED_INSTRUCTION instruction;
+	if (!CHECK(DecodeSingle(formatCase.Code, formatCase.Size, formatCase.Mode, &instruction)))
+		return;
+
+	SIZE_T expectedLength = strlen(formatCase.Expected);
+
+	CHAR text[FORMAT_BUFFER_SIZE];
+	CHECK_EQUAL(Disassembler::FormatInstruction(&instruction, formatCase.Code, formatCase.Mode, text, 8), 0);
+	CHECK(!strncmp(text, formatCase.Expected, 7) && !text[7]);
+
+	/* The text fits once there's room for its null-terminator as well */
+	CHECK_EQUAL(Disassembler::FormatInstruction(&instruction, formatCase.Code, formatCase.Mode, text, expectedLength), 0);
+	CHECK_EQUAL(Disassembler::FormatInstruction(&instruction, formatCase.Code, formatCase.Mode, text, expectedLength + 1), expectedLength);
+	CHECK(!strcmp(text, formatCase.Expected));
+
+	/* The raw bytes are truncated the same way */
+	DECODED_INSTRUCTION vzeroupper;
+	static const BYTE vex[] = { 0xC5, 0xF8, 0x77 };
+	if (CHECK(DecodeSingle(vex, sizeof(vex), DISASM_MODE_64, &vzeroupper)))
+	{
+		CHECK_EQUAL(Disassembler::FormatInstruction(&vzeroupper, vex, DISASM_MODE_64, text, 8), 0);
+		CHECK(!strcmp(text, "db 0xc5"));
+	}
+}
+
+int main()
+{
+	TestCases();
+	TestRelativeBranch();
+	TestTruncation();
+
+	return FinishTest();
+}
@@ -0,0 +1,377 @@
+#include "TestCommon.h"
+#include "Trampy.h"
+#include "Emitter.h"
+#include "disasm/disasm.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+Hooks functions whose first instructions are x86-64 only (RIP-relative & REX.W), so they're only relocated correctly
+if the native mode is 64-bit, and hooks a function from a Hook that's too far for a relative-JMP, so it's reached through a relay.
+Also hooks a function that's the last code of its mapping, so its flow mustn't be followed past the mapping,
+and hooks functions with every layout of the JMP from the Trampoline back to the function.
+*/
+
+static_assert(DISASM_MODE_NATIVE == DISASM_MODE_64, "x86-64 code must be decoded in 64-bit mode");
+
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+/*
+The targets, whose first instructions are written by hand, so they're the same whatever the compiler is.
+*/
+extern "C" INT64 RipLoadTarget(INT64 x);
+extern "C" INT64 RipLeaTarget(INT64 x);
+extern "C" INT64 MovabsTarget(INT64 x);
+extern "C" INT64 FramePrologueTarget(INT64 x);
+extern "C" INT64 ExtendedRegisterTarget(INT64 x);
+extern "C" INT64 RelayTarget(INT64 x);
+extern "C" INT64 RemovedTarget(INT64 x);
+extern "C" INT64 ReplacementTarget(INT64 x);
+
+asm(R"(
+	.intel_syntax noprefix
+	.text
+
+	.globl RipLoadTarget
+	.p2align 4
+RipLoadTarget:
+	mov rax, qword ptr [rip + RipLoadValue]
+	add rax, rdi
+	ret
+
+	.globl RipLeaTarget
+	.p2align 4
+RipLeaTarget:
+	lea rax, [rip + RipLeaTable]
+	mov rax, qword ptr [rax + rdi * 8]
+	ret
+
+	.globl MovabsTarget
+	.p2align 4
+MovabsTarget:
+	movabs rax, 0x123456789
+	add rax, rdi
+	ret
+
+	.globl FramePrologueTarget
+	.p2align 4
+FramePrologueTarget:
+	push rbp
+	mov rbp, rsp
+	sub rsp, 0x10
+	lea rax, [rdi + rdi * 2]
+	leave
+	ret
+
+	.globl ExtendedRegisterTarget
+	.p2align 4
+ExtendedRegisterTarget:
+	push r12
+	mov r12, rdi
+	lea rax, [r12 + 7]
+	pop r12
+	ret
+
+	.globl RelayTarget
+	.p2align 4
+RelayTarget:
+	lea rax, [rdi + 1]
+	nop dword ptr [rax]
+	ret
+
+	.globl RemovedTarget
+	.p2align 4
+RemovedTarget:
+	lea rax, [rdi + 3]
+	nop dword ptr [rax]
+	ret
+
+	.globl ReplacementTarget
+	.p2align 4
+ReplacementTarget:
+	lea rax, [rdi + 5]
+	nop dword ptr [rax]
+	ret
+
+	.data
+	.p2align 3
+RipLoadValue:
+	.quad 1236
+RipLeaTable:
+	.quad 100, 101, 102, 103
+
+	.text
+	.att_syntax prefix
+)");
+
+/*
+Struct describing a hooked target, what it returns, and its first bytes (so the assembler's encoding is checked as well).
+*/
+typedef struct _HOOK_CASE
+{
+	const char *Name;
+	TARGET_FUNCTION pTarget;
+	TARGET_FUNCTION pHooked;
+	TARGET_FUNCTION *ppTrampoline;
+	INT64 Argument;
+	INT64 Expected;
+	BYTE Prologue[4];
+	SIZE_T PrologueSize;
+}
+HOOK_CASE, *PHOOK_CASE;
+
+/* Hooks add HOOKED_OFFSET to what their Trampoline returns */
+#define HOOKED_OFFSET 1000000
+
+TARGET_FUNCTION g_RipLoadTrampoline;
+TARGET_FUNCTION g_RipLeaTrampoline;
+TARGET_FUNCTION g_MovabsTrampoline;
+TARGET_FUNCTION g_FramePrologueTrampoline;
+TARGET_FUNCTION g_ExtendedRegisterTrampoline;
+
+INT64 RipLoadHook(INT64 x) { return g_RipLoadTrampoline(x) + HOOKED_OFFSET; }
+INT64 RipLeaHook(INT64 x) { return g_RipLeaTrampoline(x) + HOOKED_OFFSET; }
+INT64 MovabsHook(INT64 x) { return g_MovabsTrampoline(x) + HOOKED_OFFSET; }
+INT64 FramePrologueHook(INT64 x) { return g_FramePrologueTrampoline(x) + HOOKED_OFFSET; }
+INT64 ExtendedRegisterHook(INT64 x) { return g_ExtendedRegisterTrampoline(x) + HOOKED_OFFSET; }
+
+HOOK_CASE g_Cases[] =
+{
+	{ "rip-relative load", RipLoadTarget, RipLoadHook, &g_RipLoadTrampoline, 5, 1241, { 0x48, 0x8B, 0x05 }, 3 },
+	{ "rip-relative lea", RipLeaTarget, RipLeaHook, &g_RipLeaTrampoline, 2, 102, { 0x48, 0x8D, 0x05 }, 3 },
+	{ "movabs", MovabsTarget, MovabsHook, &g_MovabsTrampoline, 1, 0x12345678A, { 0x48, 0xB8 }, 2 },
+	{ "frame prologue", FramePrologueTarget, FramePrologueHook, &g_FramePrologueTrampoline, 7, 21, { 0x55, 0x48, 0x89, 0xE5 }, 4 },
+	{ "extended registers", ExtendedRegisterTarget, ExtendedRegisterHook, &g_ExtendedRegisterTrampoline, 3, 10, { 0x41, 0x54, 0x49, 0x89 }, 4 },
+};
+
+/*
+Hook a target, and check it while the Hook is enabled & once it's disabled.
+@param pCase, the target.
+*/
+void TestHookCase(PHOOK_CASE pCase)
+{
+	printf("%s\n", pCase->Name);
+
+	CHECK(!memcmp((LPVOID) pCase->pTarget, pCase->Prologue, pCase->PrologueSize));
+	CHECK_EQUAL(pCase->pTarget(pCase->Argument), pCase->Expected);
+
+	PHOOK_DESCRIPTOR pHook = Trampy::CreateHook((LPVOID) pCase->pTarget, (LPVOID) pCase->pHooked, (LPVOID *) pCase->ppTrampoline);
+	if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)))
+		return;
+
+	CHECK_EQUAL(pCase->pTarget(pCase->Argument), pCase->Expected + HOOKED_OFFSET);
+	CHECK_EQUAL((*pCase->ppTrampoline)(pCase->Argument), pCase->Expected);
+
+	CHECK(Trampy::DisableHook(pHook));
+	CHECK_EQUAL(pCase->pTarget(pCase->Argument), pCase->Expected);
+}
+
+/*
+Allocate a Hook more than 2 GB away from a target, so it can only be reached through a relay: LEA RAX, [RDI+42]; RET.
+@param pTarget, the target.
+@return pointer to the Hook, or NULL if no free address was found.
+*/
+TARGET_FUNCTION AllocateFarHook(LPVOID pTarget)
+{
+	static const BYTE code[] = { 0x48, 0x8D, 0x47, 0x2A, 0xC3 };
+
+	for (ULONG_PTR distance = 0x100000000; distance <= 0x1000000000; distance *= 2)
+	{
+		ULONG_PTR address = ((ULONG_PTR) pTarget + distance) & ~(ULONG_PTR) 0xFFFF;
+		LPVOID pMemory = mmap((LPVOID) address, 0x1000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (pMemory == MAP_FAILED)
+			continue;
+
+		if ((ULONG_PTR) pMemory - (ULONG_PTR) pTarget <= 0x80000000)
+		{
+			munmap(pMemory, 0x1000);
+			continue;
+		}
+
+		memcpy(pMemory, code, sizeof(code));
+		mprotect(pMemory, 0x1000, PROT_READ | PROT_EXEC);
+		return (TARGET_FUNCTION) pMemory;
+	}
+
+	return NULL;
+}
+
+/*
+Hook a target from a Hook that's too far for a relative-JMP.
+*/
+void TestRelay()
+{
+	printf("relay\n");
+
+	TARGET_FUNCTION pFarHook = AllocateFarHook((LPVOID) RelayTarget);
+	if (!CHECK(pFarHook))
+		return;
+
+	TARGET_FUNCTION pTrampoline = NULL;
+	PHOOK_DESCRIPTOR pHook = Trampy::CreateHook((LPVOID) RelayTarget, (LPVOID) pFarHook, (LPVOID *) &pTrampoline);
+	if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)))
+		return;
+
+	CHECK_EQUAL(RelayTarget(1), 43);
+	CHECK_EQUAL(pTrampoline(1), 2);
+
+	CHECK(Trampy::DisableHook(pHook));
+	CHECK_EQUAL(RelayTarget(1), 2);
+}
+
+TARGET_FUNCTION g_RemovedTrampoline;
+TARGET_FUNCTION g_ReplacementTrampoline;
+
+INT64 RemovedHook(INT64 x) { return g_RemovedTrampoline(x) + HOOKED_OFFSET; }
+INT64 ReplacementHook(INT64 x) { return g_ReplacementTrampoline(x) + HOOKED_OFFSET; }
+
+/*
+Remove every Hook at once. A thread may still be running a removed Hook's Trampoline, so it must stay intact
+(even once other Hooks are created), while the pointer to it is cleared.
+*/
+void TestDisableAllHooks()
+{
+	printf("disable all hooks\n");
+
+	PHOOK_DESCRIPTOR pHook = Trampy::CreateHook((LPVOID) RemovedTarget, (LPVOID) RemovedHook, (LPVOID *) &g_RemovedTrampoline);
+	if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)))
+		return;
+
+	TARGET_FUNCTION pRemovedTrampoline = g_RemovedTrampoline;
+	CHECK_EQUAL(RemovedTarget(1), 4 + HOOKED_OFFSET);
+
+	Trampy::DisableAllHooks();
+	CHECK(!g_RemovedTrampoline);
+	CHECK_EQUAL(RemovedTarget(1), 4);
+	CHECK_EQUAL(pRemovedTrampoline(1), 4);
+
+	/* The new Hook's Trampoline doesn't take the removed one's place */
+	pHook = Trampy::CreateHook((LPVOID) ReplacementTarget, (LPVOID) ReplacementHook, (LPVOID *) &g_ReplacementTrampoline);
+	if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)))
+		return;
+
+	CHECK(g_ReplacementTrampoline != pRemovedTrampoline);
+	CHECK_EQUAL(ReplacementTarget(1), 6 + HOOKED_OFFSET);
+	CHECK_EQUAL(pRemovedTrampoline(1), 4);
+}
+
+INT64 LastCodeHook(INT64 x) { return x + HOOKED_OFFSET; }
+
+/*
+Hook a function that ends with a call that never returns, right before an unmapped page:
+PUSH RBP; MOV RBP, RSP; SUB RSP, 8; CALL (to a UD2 at the beginning of its page).
+Its flow falls through the call, so it's only followed within the mapping.
+*/
+void TestLastCode()
+{
+	printf("last code of its mapping\n");
+
+	static const BYTE code[] = { 0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x08, 0xE8 };
+	static const BYTE ud2[] = { 0x0F, 0x0B };
+
+	SIZE_T pageSize = (SIZE_T) sysconf(_SC_PAGESIZE);
+	PBYTE pPage = (PBYTE) mmap(NULL, pageSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (!CHECK(pPage != MAP_FAILED))
+		return;
+
+	munmap(pPage + pageSize, pageSize);
+
+	PBYTE pTarget = pPage + pageSize - sizeof(code) - DWORD_SIZE;
+	int displacement = (int) (pPage - (pTarget + sizeof(code) + DWORD_SIZE));
+	memcpy(pPage, ud2, sizeof(ud2));
+	memcpy(pTarget, code, sizeof(code));
+	memcpy(pTarget + sizeof(code), &displacement, DWORD_SIZE);
+	mprotect(pPage, pageSize, PROT_READ | PROT_EXEC);
+
+	TARGET_FUNCTION pTrampoline = NULL;
+	PHOOK_DESCRIPTOR pHook = Trampy::CreateHook(pTarget, (LPVOID) LastCodeHook, (LPVOID *) &pTrampoline);
+	if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)))
+		return;
+
+	CHECK_EQUAL(((TARGET_FUNCTION) pTarget)(1), 1 + HOOKED_OFFSET);
+	CHECK(Trampy::DisableHook(pHook));
+	CHECK(!memcmp(pTarget, code, sizeof(code)));
+}
+
+/*
+Struct describing a layout of the JMP from a Trampoline back to its function, and the first instruction it's written as.
+*/
+typedef struct _EXIT_CASE
+{
+	const char *Name;
+	BYTE Flags;
+	BYTE Opcode;
+	BYTE Size;
+}
+EXIT_CASE, *PEXIT_CASE;
+
+const EXIT_CASE g_ExitCases[] =
+{
+	{ "relative exit", 0, 0xE9, JMP_REL32_SIZE },
+	{ "absolute exit", HOOK_FLAG_ABSOLUTE_EXIT, 0xFF, 6 },
+	{ "push/ret exit", HOOK_FLAG_PUSH_RET_EXIT, 0x68, 5 },
+};
+
+TARGET_FUNCTION g_ExitTrampolines[sizeof(g_ExitCases) / sizeof(g_ExitCases[0])];
+
+template <SIZE_T index>
+INT64 ExitHook(INT64 x) { return g_ExitTrampolines[index](x) + HOOKED_OFFSET; }
+
+const TARGET_FUNCTION g_ExitHooks[] = { ExitHook<0>, ExitHook<1>, ExitHook<2> };
+
+/*
+Hook a generated function with every exit layout, and check the JMP that follows its relocated LEA in the Trampoline.
+*/
+void TestExitLayouts()
+{
+	PBYTE pTargets = GenerateTargets(sizeof(g_ExitCases) / sizeof(g_ExitCases[0]));
+	if (!CHECK(pTargets))
+		return;
+
+	for (SIZE_T i = 0; i < sizeof(g_ExitCases) / sizeof(g_ExitCases[0]); i++)
+	{
+		const EXIT_CASE &exitCase = g_ExitCases[i];
+		printf("%s\n", exitCase.Name);
+
+		PBYTE pTarget = pTargets + i * GENERATED_TARGET_SIZE;
+		PHOOK_DESCRIPTOR pHook = Trampy::CreateHook(pTarget, (LPVOID) g_ExitHooks[i], (LPVOID *) &g_ExitTrampolines[i], exitCase.Flags);
+		if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)))
+			continue;
+
+		CHECK_EQUAL(((TARGET_FUNCTION) pTarget)(1), 1 + i + HOOKED_OFFSET);
+		CHECK_EQUAL(g_ExitTrampolines[i](1), 1 + i);
+
+		/* The LEA is copied as is, and is followed by the exit */
+		INSTRUCTION_ITERATOR iterator;
+		DECODED_INSTRUCTION instruction;
+		Disassembler::InitializeIterator(&iterator, (PBYTE) g_ExitTrampolines[i], JMP_ABSOLUTE_SIZE * 2, DISASM_MODE_64);
+		if (CHECK(Disassembler::NextInstruction(&iterator, &instruction)) && CHECK_EQUAL(instruction.Size, 7) &&
+			CHECK(Disassembler::NextInstruction(&iterator, &instruction)))
+		{
+			CHECK_EQUAL(instruction.Opcode, exitCase.Opcode);
+			CHECK_EQUAL(instruction.Size, exitCase.Size);
+		}
+
+		CHECK(Trampy::DisableHook(pHook));
+		CHECK_EQUAL(((TARGET_FUNCTION) pTarget)(1), 1 + i);
+	}
+
+	/* A Trampoline has a single exit */
+	TARGET_FUNCTION pTrampoline = NULL;
+	CHECK(!Trampy::CreateHook(pTargets, (LPVOID) g_ExitHooks[0], (LPVOID *) &pTrampoline, HOOK_FLAG_ABSOLUTE_EXIT | HOOK_FLAG_PUSH_RET_EXIT));
+}
+
+int main()
+{
+	for (HOOK_CASE &hookCase : g_Cases)
+		TestHookCase(&hookCase);
+
+	TestRelay();
+	TestDisableAllHooks();
+	TestLastCode();
+	TestExitLayouts();
+
+	Trampy::DisableAllHooks();
+	return FinishTest();
+}
@@ -0,0 +1,229 @@
+#include "TestCommon.h"
+#include "Trampy.h"
+#include "FlowAnalysis.h"
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <thread>
+
+/*
+Checks hot-patch areas: functions built with -fpatchable-function-entry (whose entry is made of several single-byte NOPs),
+and functions whose entry is a single NOP, which are the only ones whose short JMP is stored at once.
+A thread that's between the NOPs of an entry while its short JMP is stored would execute the JMP's displacement,
+so such entries are only patched while every other thread is suspended, and threads between the NOPs are moved past them.
+*/
+
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+/* The Hooks' results, which the targets never return */
+#define HOOKED_RESULT 1000000
+
+/* The amount of times the racing target's Hook is enabled & disabled, enough for the caller to be found between the NOPs a few times */
+#define TOGGLE_AMOUNT 2000
+
+/*
+The same function as GCC & Clang build it with -fpatchable-function-entry=7,5: 5 NOPs before it, and 2 NOPs at its entry.
+*/
+extern "C" __attribute__((patchable_function_entry(7, 5), noinline)) INT64 PatchableTarget(INT64 x)
+{
+	return x * 3;
+}
+
+/*
+Targets whose entry is a single NOP (66 90, and 0F 1F 00), preceded by 5 bytes of padding,
+and a target whose entry is made of 2 NOPs, which returns whether the carry flag was set on entry.
+The short JMP from the entry to the padding is EB F9, and F9 is STC, so a thread that executes its displacement sets the carry flag.
+CallCarryTarget keeps calling it with the carry flag clear until it's stopped, and counts the calls that returned 1,
+i.e. the calls where the displacement was executed. It single-steps its loop (it sets the trap flag), so a suspension
+(which is only delivered once the step's SIGTRAP handler returns) finds it at any instruction boundary, between the NOPs as often as anywhere else.
+*/
+extern "C" INT64 XchgNopTarget(INT64 x);
+extern "C" INT64 LongNopTarget(INT64 x);
+extern "C" INT64 CarryTarget(INT64 x);
+extern "C" SIZE_T CallCarryTarget(volatile BYTE *pbStop);
+
+asm(R"(
+	.intel_syntax noprefix
+	.text
+
+	.p2align 4
+	.byte 0x90, 0x90, 0x90, 0x90, 0x90
+	.globl XchgNopTarget
+XchgNopTarget:
+	xchg ax, ax
+	lea rax, [rdi + 1]
+	ret
+
+	.p2align 4
+	.byte 0xCC, 0xCC, 0xCC, 0xCC, 0xCC
+	.globl LongNopTarget
+LongNopTarget:
+	nop dword ptr [rax]
+	lea rax, [rdi + 2]
+	ret
+
+	.p2align 4
+	.byte 0x90, 0x90, 0x90, 0x90, 0x90
+	.globl CarryTarget
+CarryTarget:
+	nop
+	nop
+	setc al
+	movzx eax, al
+	ret
+
+	.p2align 4
+	.globl CallCarryTarget
+CallCarryTarget:
+	push rbx
+	push r12
+	xor ebx, ebx
+	mov r12, rdi
+	pushfq
+	or qword ptr [rsp], 0x100
+	popfq
+1:
+	clc
+	call CarryTarget
+	cmp rax, 1
+	jne 2f
+	inc rbx
+2:
+	cmp byte ptr [r12], 0
+	je 1b
+	pushfq
+	and qword ptr [rsp], ~0x100
+	popfq
+	mov rax, rbx
+	pop r12
+	pop rbx
+	ret
+
+	.att_syntax prefix
+)");
+
+TARGET_FUNCTION g_PatchableTrampoline;
+TARGET_FUNCTION g_XchgNopTrampoline;
+TARGET_FUNCTION g_CarryTrampoline;
+
+INT64 PatchableHook(INT64 x) { return g_PatchableTrampoline(x) + HOOKED_RESULT; }
+INT64 XchgNopHook(INT64 x) { return g_XchgNopTrampoline(x) + HOOKED_RESULT; }
+INT64 CarryHook(INT64 x) { return HOOKED_RESULT; }
+
+/*
+SIGTRAP handler, which lets CallCarryTarget single-step. It blocks every other signal, including the suspension's.
+*/
+void StepHandler(int signalNumber, siginfo_t *pInfo, void *pContext)
+{
+}
+
+/*
+Check the hot-patch areas that are found, and whether their entries may be patched at once.
+*/
+void TestAreas()
+{
+	printf("areas\n");
+
+	static const BYTE patchableEntry[] = { 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90 };
+	CHECK(!memcmp((PBYTE) PatchableTarget - HOT_PATCH_PADDING_SIZE, patchableEntry, sizeof(patchableEntry)));
+
+	HOT_PATCH_AREA area;
+	if (CHECK(FlowAnalysis::FindHotPatchArea((LPVOID) PatchableTarget, &area)))
+	{
+		CHECK(area.pPadding == (PBYTE) PatchableTarget - HOT_PATCH_PADDING_SIZE);
+		CHECK_EQUAL(area.EntrySize, 2);
+		CHECK(!area.bSingleInstruction);
+	}
+
+	if (CHECK(FlowAnalysis::FindHotPatchArea((LPVOID) XchgNopTarget, &area)))
+	{
+		CHECK_EQUAL(area.EntrySize, 2);
+		CHECK(area.bSingleInstruction);
+	}
+
+	if (CHECK(FlowAnalysis::FindHotPatchArea((LPVOID) LongNopTarget, &area)))
+	{
+		CHECK_EQUAL(area.EntrySize, 3);
+		CHECK(area.bSingleInstruction);
+	}
+
+	/* A function without padding has no hot-patch area */
+	CHECK(!FlowAnalysis::FindHotPatchArea((LPVOID) CallCarryTarget, &area));
+}
+
+/*
+Hook a target in its hot-patch area, and check it while the Hook is enabled & once it's disabled.
+@param name, the name of the target.
+@param pTarget, the target.
+@param pHooked, the Hook.
+@param ppTrampoline, receives the Trampoline.
+@param argument, the argument the target is called with.
+@param expected, what the target returns.
+*/
+void TestHook(const char *name, TARGET_FUNCTION pTarget, TARGET_FUNCTION pHooked, TARGET_FUNCTION *ppTrampoline, INT64 argument, INT64 expected)
+{
+	printf("%s\n", name);
+
+	PHOOK_DESCRIPTOR pHook = Trampy::CreateHook((LPVOID) pTarget, (LPVOID) pHooked, (LPVOID *) ppTrampoline, HOOK_FLAG_HOT_PATCH);
+	if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)))
+		return;
+
+	/* The entry is replaced by a short JMP to the padding, and Trampoline is the body right after the entry */
+	CHECK_EQUAL(*(PBYTE) pTarget, 0xEB);
+	CHECK_EQUAL(pTarget(argument), expected + HOOKED_RESULT);
+	CHECK_EQUAL((*ppTrampoline)(argument), expected);
+
+	CHECK(Trampy::DisableHook(pHook));
+	CHECK_EQUAL(pTarget(argument), expected);
+}
+
+/*
+Enable & disable the Hook of a target whose entry is made of 2 NOPs, while another thread keeps calling it.
+Whenever the Hook is enabled, the other thread may be between the NOPs, so it must be moved past them rather than execute the short JMP's displacement.
+*/
+void TestRace()
+{
+	printf("race\n");
+
+	PHOOK_DESCRIPTOR pHook = Trampy::CreateHook((LPVOID) CarryTarget, (LPVOID) CarryHook, (LPVOID *) &g_CarryTrampoline, HOOK_FLAG_HOT_PATCH);
+	if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)) || !CHECK(Trampy::DisableHook(pHook)))
+		return;
+
+	struct sigaction action = { };
+	action.sa_sigaction = StepHandler;
+	action.sa_flags = SA_SIGINFO;
+	sigfillset(&action.sa_mask);
+	if (!CHECK(!sigaction(SIGTRAP, &action, NULL)))
+		return;
+
+	volatile BYTE bStop = FALSE;
+	SIZE_T displacementAmount = 0;
+	std::thread caller([&]() { displacementAmount = CallCarryTarget(&bStop); });
+
+	/* Yielding lets the caller run until it's preempted, wherever it is */
+	SIZE_T failureAmount = 0;
+	for (SIZE_T i = 0; i < TOGGLE_AMOUNT; i++)
+	{
+		failureAmount += !Trampy::EnableHook(pHook);
+		sched_yield();
+		failureAmount += !Trampy::DisableHook(pHook);
+		sched_yield();
+	}
+
+	bStop = TRUE;
+	caller.join();
+
+	CHECK_EQUAL(failureAmount, 0);
+	CHECK_EQUAL(displacementAmount, 0);
+}
+
+int main()
+{
+	TestAreas();
+	TestHook("patchable function entry", PatchableTarget, PatchableHook, &g_PatchableTrampoline, 5, 15);
+	TestHook("xchg nop", XchgNopTarget, XchgNopHook, &g_XchgNopTrampoline, 5, 6);
+	TestRace();
+
+	Trampy::DisableAllHooks();
+	return FinishTest();
+}
@@ -0,0 +1,185 @@
+#include "TestCommon.h"
+#include "Trampy.h"
+#include <atomic>
+#include <chrono>
+#include <sched.h>
+#include <thread>
+#include <utility>
+
+/*
+Checks that Hooks are enabled & disabled safely while many threads keep calling their targets, without suspending them:
+every call returns either the target's result or the Hook's, never anything else (nor crashes).
+Half of the targets are within an aligned QWORD, so they're patched at once, and the patches of the other half cross one,
+so they're trapped while they're written (see LivePatch). Their first instruction covers the patch, so threads only ever reach it from its beginning.
+The callers only reach a trapped patch while it's written if they run on other processors than the writer.
+*/
+
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+/* The Hooks add it to the targets' results */
+#define HOOKED_OFFSET 1000000
+
+/* The amount of targets of each kind (within an aligned QWORD, and crossing one) */
+#define TARGET_AMOUNT 32
+
+/* The offset of the targets whose patch crosses an aligned QWORD */
+#define CROSSING_OFFSET 5
+
+/* The amount of threads that call the targets */
+#define CALLER_AMOUNT 8
+
+/* How long the Hooks are enabled & disabled for */
+#define STRESS_DURATION std::chrono::seconds(3)
+
+/* The argument the targets are called with */
+#define ARGUMENT 7
+
+TARGET_FUNCTION g_Targets[TARGET_AMOUNT * 2];
+TARGET_FUNCTION g_Trampolines[TARGET_AMOUNT * 2];
+
+/*
+The Hook of a target, which calls its Trampoline (so the Trampoline must be published before a thread reaches the Hook).
+*/
+template <SIZE_T index>
+INT64 StressHook(INT64 x)
+{
+	return g_Trampolines[index](x) + HOOKED_OFFSET;
+}
+
+/*
+@return the Hooks of every target.
+*/
+template <SIZE_T... indexes>
+std::vector<LPVOID> StressHooks(std::index_sequence<indexes...>)
+{
+	return { (LPVOID) &StressHook<indexes>... };
+}
+
+/*
+Struct counting the results a caller has observed.
+*/
+typedef struct _CALL_RESULTS
+{
+	SIZE_T OriginalAmount;
+	SIZE_T HookedAmount;
+	SIZE_T WrongAmount;
+}
+CALL_RESULTS, *PCALL_RESULTS;
+
+/*
+Keep calling every target until stopped, and count their results.
+@param pbStop, set once the callers should stop.
+@param pResults, receives the counts of the results.
+*/
+void CallTargets(const std::atomic<bool> *pbStop, OUT PCALL_RESULTS pResults)
+{
+	*pResults = { };
+	while (!pbStop->load(std::memory_order_relaxed))
+	{
+		for (SIZE_T i = 0; i < TARGET_AMOUNT * 2; i++)
+		{
+			INT64 original = ARGUMENT + i % TARGET_AMOUNT;
+			INT64 result = g_Targets[i](ARGUMENT);
+
+			if (result == original)
+				pResults->OriginalAmount++;
+			else if (result == original + HOOKED_OFFSET)
+				pResults->HookedAmount++;
+			else
+				pResults->WrongAmount++;
+		}
+	}
+}
+
+/*
+Enable or disable every Hook, one at a time or in a transaction.
+@param hooks, the Hooks.
+@param bEnable, whether they're enabled or disabled.
+@param bTransaction, whether they're changed in a transaction.
+@return whether every change succeeded.
+*/
+BOOL ChangeHooks(const std::vector<PHOOK_DESCRIPTOR> &hooks, BOOL bEnable, BOOL bTransaction)
+{
+	if (!bTransaction)
+	{
+		for (PHOOK_DESCRIPTOR pHook : hooks)
+			if (!(bEnable ? Trampy::EnableHook(pHook) : Trampy::DisableHook(pHook)))
+				return FALSE;
+
+		return TRUE;
+	}
+
+	if (!Trampy::BeginTransaction())
+		return FALSE;
+
+	for (PHOOK_DESCRIPTOR pHook : hooks)
+		bEnable ? Trampy::QueueEnableHook(pHook) : Trampy::QueueDisableHook(pHook);
+
+	return Trampy::CommitTransaction();
+}
+
+int main()
+{
+	PBYTE pAligned = GenerateTargets(TARGET_AMOUNT);
+	PBYTE pCrossing = GenerateTargets(TARGET_AMOUNT, CROSSING_OFFSET);
+	if (!CHECK(pAligned) || !CHECK(pCrossing))
+		return FinishTest();
+
+	std::vector<LPVOID> hookFunctions = StressHooks(std::make_index_sequence<TARGET_AMOUNT * 2>());
+	std::vector<PHOOK_DESCRIPTOR> hooks;
+	for (SIZE_T i = 0; i < TARGET_AMOUNT * 2; i++)
+	{
+		PBYTE pTarget = (i < TARGET_AMOUNT ? pAligned : pCrossing) + (i % TARGET_AMOUNT) * GENERATED_TARGET_SIZE;
+		g_Targets[i] = (TARGET_FUNCTION) pTarget;
+
+		hooks.push_back(Trampy::CreateHook(pTarget, hookFunctions[i], (LPVOID *) &g_Trampolines[i]));
+		if (!CHECK(hooks.back()))
+			return FinishTest();
+	}
+
+	std::atomic<bool> bStop(false);
+	std::vector<CALL_RESULTS> results(CALLER_AMOUNT);
+	std::vector<std::thread> callers;
+	for (SIZE_T i = 0; i < CALLER_AMOUNT; i++)
+		callers.emplace_back(CallTargets, &bStop, &results[i]);
+
+	/* Alternate between changing the Hooks one at a time and in transactions, yielding so the callers observe both states */
+	SIZE_T cycleAmount = 0;
+	SIZE_T failureAmount = 0;
+	auto end = std::chrono::steady_clock::now() + STRESS_DURATION;
+	while (std::chrono::steady_clock::now() < end)
+	{
+		BOOL bTransaction = cycleAmount++ % 2;
+		failureAmount += !ChangeHooks(hooks, TRUE, bTransaction);
+		sched_yield();
+		failureAmount += !ChangeHooks(hooks, FALSE, bTransaction);
+		sched_yield();
+	}
+
+	bStop = true;
+	for (std::thread &caller : callers)
+		caller.join();
+
+	CALL_RESULTS total = { };
+	for (const CALL_RESULTS &result : results)
+	{
+		total.OriginalAmount += result.OriginalAmount;
+		total.HookedAmount += result.HookedAmount;
+		total.WrongAmount += result.WrongAmount;
+	}
+
+	printf("%u processors, %zu cycles, %zu original calls, %zu hooked calls\n",
+		std::thread::hardware_concurrency(), cycleAmount, total.OriginalAmount, total.HookedAmount);
+
+	CHECK_EQUAL(failureAmount, 0);
+	CHECK_EQUAL(total.WrongAmount, 0);
+	CHECK(total.OriginalAmount);
+	CHECK(total.HookedAmount);
+
+	/* Every target is restored once the Hooks are disabled */
+	for (SIZE_T i = 0; i < TARGET_AMOUNT * 2; i++)
+		CHECK_EQUAL(g_Targets[i](ARGUMENT), ARGUMENT + i % TARGET_AMOUNT);
+
+	Trampy::DisableAllHooks();
+	return FinishTest();
+}
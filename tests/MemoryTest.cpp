@@ -0,0 +1,172 @@
+#include "TestCommon.h"
+#include "Memory.h"
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+Checks that memory allocated near a target is within its reach, and that the search skips over the regions in use around it,
+so it finds the nearest free memory (and only tries to allocate free addresses, which keeps crowded address spaces fast).
+Also checks that aliases of code keep writing to it once they're replaced by larger aliases, and that a forked child writes to its own copy.
+*/
+
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+/* The offset of a generated target's index within its first instruction (see GenerateTargets) */
+#define TARGET_INDEX_OFFSET 3
+
+/* Size of the region reserved around the targets of the crowded searches, thousands of granules */
+#define RESERVED_SIZE 0x10000000
+
+/*
+Allocate memory near a target, and check it's within reach.
+@param name, the name of the target.
+@param pTarget, the target.
+@return pointer to the allocated memory, or NULL if the function failed.
+*/
+PBYTE TestAllocateNear(const char *name, LPVOID pTarget)
+{
+	SIZE_T size = Memory::AllocationGranularity();
+
+	auto start = std::chrono::steady_clock::now();
+	PBYTE pMemory = (PBYTE) Memory::AllocateNear(pTarget, size, FALSE);
+	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	printf("%s: %lld us\n", name, (long long) duration.count());
+
+	if (!CHECK(pMemory))
+		return NULL;
+
+	CHECK((ULONG_PTR) pMemory % size == 0);
+	CHECK(Memory::IsRel32Reachable(pTarget, pMemory));
+	CHECK(Memory::IsRel32Reachable(pMemory + size, pTarget));
+
+	return pMemory;
+}
+
+/*
+Allocate memory near code, data & the heap.
+*/
+void TestTargets()
+{
+	static BYTE data[0x100];
+	LPVOID pHeap = malloc(0x100);
+
+	LPVOID targets[] = { (LPVOID) &TestTargets, data, (LPVOID) &printf, pHeap };
+	for (LPVOID pTarget : targets)
+	{
+		PBYTE pMemory = TestAllocateNear("target", pTarget);
+		if (pMemory)
+			Memory::Free(pMemory, Memory::AllocationGranularity());
+	}
+
+	free(pHeap);
+}
+
+/*
+Allocate memory near a target in the middle of a reserved region, which has a single free granule below the target.
+The search must skip over the reservation, down to the free granule.
+*/
+void TestCrowded()
+{
+	SIZE_T granularity = Memory::AllocationGranularity();
+
+	PBYTE pReserved = (PBYTE) mmap(NULL, RESERVED_SIZE + granularity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (!CHECK(pReserved != MAP_FAILED))
+		return;
+
+	/* Align the reservation, and free a granule in its first quarter */
+	PBYTE pAligned = pReserved + (granularity - (ULONG_PTR) pReserved % granularity) % granularity;
+	PBYTE pHole = pAligned + RESERVED_SIZE / 4;
+	munmap(pHole, granularity);
+
+	PBYTE pMemory = TestAllocateNear("crowded", pAligned + RESERVED_SIZE / 2);
+	CHECK(pMemory == pHole);
+
+	if (pMemory && pMemory != pHole)
+		Memory::Free(pMemory, granularity);
+
+	munmap(pReserved, RESERVED_SIZE + granularity);
+
+	/* Without a hole, the search continues below the whole reservation */
+	pReserved = (PBYTE) mmap(NULL, RESERVED_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (!CHECK(pReserved != MAP_FAILED))
+		return;
+
+	pMemory = TestAllocateNear("reserved", pReserved + RESERVED_SIZE / 2);
+	CHECK(pMemory && (pMemory + granularity <= pReserved || pMemory >= pReserved + RESERVED_SIZE));
+
+	if (pMemory)
+		Memory::Free(pMemory, granularity);
+
+	munmap(pReserved, RESERVED_SIZE);
+}
+
+/*
+Change the index of a generated target, through a writable alias of its beginning.
+@param pAlias, the alias.
+@param pTarget, the target.
+@param index, the new index.
+@return what the target returns for 0, i.e. its index.
+*/
+INT64 WriteTargetIndex(PBYTE pAlias, PBYTE pTarget, DWORD index)
+{
+	memcpy(pAlias + TARGET_INDEX_OFFSET, &index, sizeof(index));
+	Memory::FlushInstructions(pTarget, GENERATED_TARGET_SIZE);
+
+	return ((TARGET_FUNCTION) pTarget)(0);
+}
+
+/*
+Alias the pages of generated targets one at a time, then over larger ranges, which replace the aliases before them,
+then fork: the child's writes through the aliases must reach its own code, and never the parent's.
+*/
+void TestAliases()
+{
+	SIZE_T pageSize = Memory::PageSize();
+	PBYTE pTargets = GenerateTargets(pageSize * 4 / GENERATED_TARGET_SIZE);
+	if (!CHECK(pTargets))
+		return;
+
+	PBYTE pFirst = pTargets;
+	PBYTE pSecond = pTargets + pageSize;
+	PBYTE pFirstAlias = (PBYTE) Memory::AliasCode(pFirst, 1);
+	PBYTE pSecondAlias = (PBYTE) Memory::AliasCode(pSecond, 1);
+
+	/* The second range replaces both aliases, and the third one replaces the second, so the first aliases are replaced twice */
+	PBYTE pRangeAlias = (PBYTE) Memory::AliasCode(pTargets, pageSize * 3);
+	PBYTE pWholeAlias = (PBYTE) Memory::AliasCode(pTargets, pageSize * 4);
+	if (!CHECK(pFirstAlias) || !CHECK(pSecondAlias) || !CHECK(pRangeAlias) || !CHECK(pWholeAlias))
+		return;
+
+	CHECK_EQUAL(WriteTargetIndex(pFirstAlias, pFirst, 100), 100);
+	CHECK_EQUAL(WriteTargetIndex(pSecondAlias, pSecond, 200), 200);
+	CHECK_EQUAL(WriteTargetIndex(pRangeAlias, pFirst, 300), 300);
+	CHECK_EQUAL(WriteTargetIndex(pWholeAlias + pageSize, pSecond, 400), 400);
+
+	fflush(stdout);
+	pid_t child = fork();
+	if (!child)
+	{
+		BOOL bWritten = WriteTargetIndex(pFirstAlias, pFirst, 500) == 500 && WriteTargetIndex(pWholeAlias + pageSize, pSecond, 600) == 600;
+		_exit(bWritten ? 0 : 1);
+	}
+
+	int status = -1;
+	if (CHECK(child > 0) && CHECK(waitpid(child, &status, 0) == child))
+		CHECK(WIFEXITED(status) && !WEXITSTATUS(status));
+
+	CHECK_EQUAL(((TARGET_FUNCTION) pFirst)(0), 300);
+	CHECK_EQUAL(((TARGET_FUNCTION) pSecond)(0), 400);
+}
+
+int main()
+{
+	TestTargets();
+	TestCrowded();
+	TestAliases();
+
+	return FinishTest();
+}
@@ -0,0 +1,268 @@
+#include "TestCommon.h"
+#include "ModuleIndex.h"
+#include "disasm/disasm.h"
+#include <dirent.h>
+#include <dlfcn.h>
+#include <exception>
+#include <link.h>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+Checks the ELF path of the Module Index against the decoder, over the test itself & the libraries it's linked with,
+and checks that cached indexes round trip through their files (and that broken cache files are rebuilt).
+*/
+
+/* The amount of bytes CoveringSize is checked with, as many as a hook's jump takes */
+#define COVERED_BYTES 5
+
+/*
+Struct describing an executable segment of a loaded module.
+*/
+typedef struct _CODE_SEGMENT
+{
+	PBYTE Start;
+	SIZE_T Size;
+}
+CODE_SEGMENT, *PCODE_SEGMENT;
+
+/*
+Struct passed to FindSegmentsCallback.
+*/
+typedef struct _SEGMENT_SEARCH
+{
+	PBYTE ImageBase;
+	std::vector<CODE_SEGMENT> *pSegments;
+}
+SEGMENT_SEARCH, *PSEGMENT_SEARCH;
+
+/*
+dl_iterate_phdr callback, which collects the executable segments of the searched module.
+*/
+int FindSegmentsCallback(struct dl_phdr_info *pInfo, size_t infoSize, void *pContext)
+{
+	PSEGMENT_SEARCH pSearch = (PSEGMENT_SEARCH) pContext;
+	Dl_info info;
+
+	if (!dladdr((LPVOID) (pInfo->dlpi_addr + pInfo->dlpi_phdr[0].p_vaddr), &info) || info.dli_fbase != pSearch->ImageBase)
+		return 0;
+
+	for (ElfW(Half) i = 0; i < pInfo->dlpi_phnum; i++)
+		if (pInfo->dlpi_phdr[i].p_type == PT_LOAD && (pInfo->dlpi_phdr[i].p_flags & PF_X))
+			pSearch->pSegments->push_back({ (PBYTE) (pInfo->dlpi_addr + pInfo->dlpi_phdr[i].p_vaddr), pInfo->dlpi_phdr[i].p_memsz });
+
+	return 1;
+}
+
+/*
+@return the executable segments of a loaded module.
+*/
+std::vector<CODE_SEGMENT> GetCodeSegments(HMODULE hModule)
+{
+	std::vector<CODE_SEGMENT> segments;
+	SEGMENT_SEARCH search = { (PBYTE) hModule, &segments };
+	dl_iterate_phdr(FindSegmentsCallback, &search);
+
+	return segments;
+}
+
+/*
+@return the module an address lies within.
+*/
+HMODULE GetModule(const void *pAddress)
+{
+	Dl_info info = { };
+	dladdr(pAddress, &info);
+
+	return (HMODULE) info.dli_fbase;
+}
+
+/*
+Check an index against the decoder: every instruction start & branch target, and the covering size of every instruction.
+@param name, the name of the module.
+@param hModule, the module.
+@param pIndex, the module's index.
+*/
+void TestIndex(const char *name, HMODULE hModule, PMODULE_INDEX pIndex)
+{
+	std::vector<CODE_SEGMENT> segments = GetCodeSegments(hModule);
+	if (!CHECK(!segments.empty()))
+		return;
+
+	/* Decode every segment, gathering the targets of relative branches */
+	std::set<PBYTE> starts;
+	std::set<PBYTE> targets;
+	for (const CODE_SEGMENT &segment : segments)
+	{
+		INSTRUCTION_ITERATOR iterator;
+		DECODED_INSTRUCTION instruction;
+		Disassembler::InitializeIterator(&iterator, segment.Start, segment.Size, DISASM_MODE_NATIVE);
+
+		while (Disassembler::NextInstruction(&iterator, &instruction))
+		{
+			starts.insert(segment.Start + instruction.Offset);
+
+			if (instruction.BranchKind == BRANCH_JMP || instruction.BranchKind == BRANCH_JCC || instruction.BranchKind == BRANCH_CALL)
+				targets.insert(instruction.Target);
+		}
+	}
+
+	SIZE_T failureAmount = 0;
+	for (const CODE_SEGMENT &segment : segments)
+	{
+		for (PBYTE pAddress = segment.Start; pAddress < segment.Start + segment.Size; pAddress++)
+		{
+			bool bStart = starts.count(pAddress) != 0;
+			bool bTarget = targets.count(pAddress) != 0;
+
+			if (!!ModuleIndex::IsInstructionStart(pIndex, pAddress) != bStart ||
+				!!ModuleIndex::IsBranchTarget(pIndex, pAddress) != bTarget)
+			{
+				failureAmount++;
+				continue;
+			}
+
+			/* The disassembler may read past the end of the segment, where the index stops */
+			if (!bStart || pAddress + MAX_INSTRUCTION_SIZE * 2 > segment.Start + segment.Size)
+				continue;
+
+			if (ModuleIndex::CoveringSize(pIndex, pAddress, COVERED_BYTES, NULL) != Disassembler::Run(pAddress, COVERED_BYTES))
+				failureAmount++;
+		}
+	}
+
+	if (!CHECK_EQUAL(failureAmount, 0))
+		printf("%s: %zu addresses differ from the decoder\n", name, failureAmount);
+
+	/* Addresses outside of the executable segments aren't indexed */
+	CHECK(!ModuleIndex::IsInstructionStart(pIndex, hModule));
+	CHECK_EQUAL(ModuleIndex::CoveringSize(pIndex, hModule, COVERED_BYTES, NULL), 0);
+	CHECK(!ModuleIndex::IsInstructionStart(pIndex, &failureAmount));
+}
+
+/*
+Check that an index loaded from the cache answers the same as a built one.
+@param hModule, the module.
+@param pBuilt, the built index of the module.
+@param pLoaded, the loaded index of the module.
+*/
+void TestSameIndex(HMODULE hModule, PMODULE_INDEX pBuilt, PMODULE_INDEX pLoaded)
+{
+	SIZE_T differenceAmount = 0;
+	for (const CODE_SEGMENT &segment : GetCodeSegments(hModule))
+	{
+		for (PBYTE pAddress = segment.Start; pAddress < segment.Start + segment.Size; pAddress++)
+		{
+			if (ModuleIndex::IsInstructionStart(pBuilt, pAddress) != ModuleIndex::IsInstructionStart(pLoaded, pAddress) ||
+				ModuleIndex::IsBranchTarget(pBuilt, pAddress) != ModuleIndex::IsBranchTarget(pLoaded, pAddress))
+				differenceAmount++;
+		}
+	}
+
+	CHECK_EQUAL(differenceAmount, 0);
+}
+
+/*
+@return the path of the only cache file within a directory, or an empty path if there isn't exactly one.
+*/
+std::string FindCacheFile(const char *cacheDirectory)
+{
+	DIR *pDirectory = opendir(cacheDirectory);
+	std::vector<std::string> names;
+
+	while (struct dirent *pEntry = pDirectory ? readdir(pDirectory) : NULL)
+		if (strcmp(pEntry->d_name, ".") && strcmp(pEntry->d_name, ".."))
+			names.push_back(pEntry->d_name);
+
+	if (pDirectory)
+		closedir(pDirectory);
+
+	return names.size() == 1 ? std::string(cacheDirectory) + "/" + names[0] : std::string();
+}
+
+/*
+Check that an index is cached on its first load, mapped from its cache file on the next loads,
+and rebuilt if its cache file is truncated.
+@param hModule, the module.
+@param pBuilt, the built index of the module.
+*/
+void TestCache(HMODULE hModule, PMODULE_INDEX pBuilt)
+{
+	CHAR cacheDirectory[] = "/tmp/ModuleIndexTest.XXXXXX";
+	if (!CHECK(mkdtemp(cacheDirectory)))
+		return;
+
+	/* The first load builds the index, and caches it */
+	PMODULE_INDEX pLoaded = ModuleIndex::Load(hModule, cacheDirectory);
+	std::string cachePath = FindCacheFile(cacheDirectory);
+
+	if (CHECK(pLoaded) && CHECK(!cachePath.empty()))
+	{
+		TestSameIndex(hModule, pBuilt, pLoaded);
+		ModuleIndex::Free(pLoaded);
+
+		struct stat cacheStatus = { };
+		stat(cachePath.c_str(), &cacheStatus);
+
+		/* The next load maps the cache file */
+		pLoaded = ModuleIndex::Load(hModule, cacheDirectory);
+		if (CHECK(pLoaded))
+		{
+			TestSameIndex(hModule, pBuilt, pLoaded);
+			ModuleIndex::Free(pLoaded);
+		}
+
+		/* A truncated cache file is rebuilt, rather than trusted */
+		CHECK(!truncate(cachePath.c_str(), cacheStatus.st_size / 2));
+
+		pLoaded = ModuleIndex::Load(hModule, cacheDirectory);
+		if (CHECK(pLoaded))
+		{
+			TestSameIndex(hModule, pBuilt, pLoaded);
+			ModuleIndex::Free(pLoaded);
+		}
+
+		struct stat rebuiltStatus = { };
+		stat(cachePath.c_str(), &rebuiltStatus);
+		CHECK_EQUAL(rebuiltStatus.st_size, cacheStatus.st_size);
+		CHECK(FindCacheFile(cacheDirectory) == cachePath);
+	}
+
+	unlink(cachePath.c_str());
+	rmdir(cacheDirectory);
+}
+
+/*
+Check the index of a loaded module.
+@param name, the name of the module.
+@param hModule, the module.
+*/
+void TestModule(const char *name, HMODULE hModule)
+{
+	if (!CHECK(hModule))
+		return;
+
+	PMODULE_INDEX pIndex = ModuleIndex::Build(hModule);
+	if (!CHECK(pIndex))
+		return;
+
+	TestIndex(name, hModule, pIndex);
+	TestCache(hModule, pIndex);
+	ModuleIndex::Free(pIndex);
+}
+
+int main()
+{
+	TestModule("test", GetModule((const void *) &main));
+	TestModule("libc", GetModule((const void *) &printf));
+	TestModule("libstdc++", GetModule((const void *) &std::terminate));
+
+	/* An address that isn't the base of a loaded module isn't indexed */
+	CHECK(!ModuleIndex::Build((HMODULE) ((PBYTE) GetModule((const void *) &main) + 0x1000)));
+
+	return FinishTest();
+}
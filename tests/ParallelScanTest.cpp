@@ -0,0 +1,106 @@
+#include "TestCommon.h"
+#include "disasm/disasm.h"
+#include <random>
+#include <string.h>
+
+/*
+Checks that the parallel boundary scanner finds the exact same instructions as the sequential one,
+with any amount of threads, so chunks are stitched at every kind of boundary.
+*/
+
+/* The amounts of threads the parallel scanner is checked with */
+const SIZE_T g_ThreadAmounts[] = { 1, 2, 3, 4, 7, 16, 64 };
+
+/*
+Check the parallel scanner over a code range, with every amount of threads.
+@param name, the name of the code range.
+@param code, the code range.
+@param size, the size of the code range.
+@param mode, the mode the code is decoded in.
+*/
+void TestRange(const char *name, PBYTE code, SIZE_T size, DISASSEMBLER_MODE mode)
+{
+	DISASSEMBLER_CONTEXT context;
+	Disassembler::InitializeContext(&context);
+	context.Mode = mode;
+
+	std::vector<BYTE> expected((size + 7) / 8);
+	SIZE_T expectedAmount = Disassembler::ScanBoundaries(&context, code, size, expected.data());
+
+	for (SIZE_T threadAmount : g_ThreadAmounts)
+	{
+		std::vector<BYTE> scanned((size + 7) / 8);
+		SIZE_T amount = Disassembler::ScanBoundariesParallel(&context, code, size, scanned.data(), threadAmount);
+
+		if (!CHECK_EQUAL(amount, expectedAmount) || !CHECK(!memcmp(scanned.data(), expected.data(), expected.size())))
+			printf("%s: mode %d, %zu threads\n", name, mode, threadAmount);
+	}
+}
+
+/*
+Check the parallel scanner over random bytes, whose chunks rarely start at an actual instruction.
+*/
+void TestRandom()
+{
+	std::mt19937 random(1);
+	std::vector<BYTE> code(0x100000 + 0x1234);
+	for (BYTE &value : code)
+		value = (BYTE) random();
+
+	TestRange("random", code.data(), code.size(), DISASM_MODE_64);
+	TestRange("random", code.data(), code.size(), DISASM_MODE_32);
+}
+
+/*
+Check the parallel scanner over code with long instructions only (MOV RAX, Iq), so stitching has to skip several of each chunk's speculative instructions.
+*/
+void TestLongInstructions()
+{
+	static const BYTE instruction[] = { 0x48, 0xB8, 0x48, 0xB8, 0x48, 0xB8, 0x48, 0xB8, 0x48, 0xB8 };
+
+	std::vector<BYTE> code;
+	while (code.size() < 0x50000)
+		code.insert(code.end(), instruction, instruction + sizeof(instruction));
+
+	TestRange("long instructions", code.data(), code.size(), DISASM_MODE_64);
+}
+
+/*
+Check the parallel scanner over small code ranges, which are scanned by a single thread.
+*/
+void TestSmallRanges()
+{
+	static const BYTE code[] = { 0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x10, 0xC9, 0xC3 };
+
+	for (SIZE_T size = 0; size <= sizeof(code); size++)
+		TestRange("small range", (PBYTE) code, size, DISASM_MODE_64);
+}
+
+/*
+Check the parallel scanner over the text sections of local binaries, and over all of them at once.
+*/
+void TestBinaries()
+{
+	std::vector<BYTE> all;
+	for (const char *path : FindCorpusBinaries())
+	{
+		TEXT_SECTION section;
+		if (!ReadTextSection(path, &section))
+			continue;
+
+		TestRange(path, section.Code.data(), section.Code.size(), DISASM_MODE_64);
+		all.insert(all.end(), section.Code.begin(), section.Code.end());
+	}
+
+	TestRange("all binaries", all.data(), all.size(), DISASM_MODE_64);
+}
+
+int main()
+{
+	TestRandom();
+	TestLongInstructions();
+	TestSmallRanges();
+	TestBinaries();
+
+	return FinishTest();
+}
@@ -0,0 +1,259 @@
+#include "TestCommon.h"
+#include "Relocator.h"
+#include "disasm/instr/OpcodeMaps.h"
+#include <string.h>
+
+/*
+Checks the relocated code of every kind of instruction, by decoding it back: short JMPs & Jccs are widened to rel32,
+LOOPcc & JrCXZ are rewritten as a branch over a JMP rel32, branch hints are kept, and RIP-relative & rel32 instructions
+keep addressing the same memory. Branches into the relocated range land on the relocated copy of their target,
+while a branch into the middle of a relocated instruction can't be relocated.
+The code is relocated within reach of its source, and more than 2 GB away from it, where only code that doesn't reach
+outside of the range may be relocated.
+*/
+
+static_assert(DISASM_MODE_NATIVE == DISASM_MODE_64, "the relocated code is x86-64");
+
+/* The distances the code is relocated to, within & out of 32-bit reach */
+#define NEAR_DISTANCE 0x40000000
+#define FAR_DISTANCE 0x100000000
+
+/* Size of the source buffer, which covers the most bytes the Relocator may decode */
+#define SOURCE_BUFFER_SIZE 0x40
+
+/*
+Where an instruction's target is expected.
+*/
+enum TARGET_KIND : BYTE
+{
+	/* The instruction has no target */
+	TARGET_NONE,
+	/* The target is at an offset within the relocated code */
+	TARGET_RELOCATED,
+	/* The target is at an offset from the source (e.g. the original target of a branch out of the range) */
+	TARGET_SOURCE,
+};
+
+/*
+Struct describing an expected instruction of the relocated code.
+*/
+typedef struct _EXPECTED_INSTRUCTION
+{
+	BYTE Map;
+	BYTE Opcode;
+	BYTE Size;
+	BYTE TargetKind;
+	INT64 TargetOffset;
+}
+EXPECTED_INSTRUCTION, *PEXPECTED_INSTRUCTION;
+
+/* The most instructions a case is relocated to */
+#define MAX_EXPECTED_INSTRUCTIONS 4
+
+/*
+Struct describing code that's relocated, and the instructions it's expected to be relocated to.
+*/
+typedef struct _RELOCATION_CASE
+{
+	const char *Name;
+	BYTE Code[MAX_INSTRUCTION_SIZE];
+	SIZE_T CodeSize;
+	SIZE_T RequiredBytes;
+	/* Whether the code only reaches within itself, so it may be relocated anywhere */
+	BOOL bWithinRange;
+	SIZE_T ExpectedAmount;
+	EXPECTED_INSTRUCTION Expected[MAX_EXPECTED_INSTRUCTIONS];
+}
+RELOCATION_CASE, *PRELOCATION_CASE;
+
+const RELOCATION_CASE g_Cases[] =
+{
+	{
+		/* JE +2, to the NOP, which is relocated as well: JE rel32 lands on the relocated NOP */
+		"jcc into the range", { 0x74, 0x02, 0x31, 0xC0, 0x90 }, 5, 5, TRUE, 3,
+		{
+			{ OPMAP_0F, 0x84, 6, TARGET_RELOCATED, 8 },
+			{ OPMAP_1BYTE, 0x31, 2, TARGET_NONE, 0 },
+			{ OPMAP_1BYTE, 0x90, 1, TARGET_NONE, 0 },
+		}
+	},
+	{
+		/* JMP -2, to itself */
+		"jmp to itself", { 0xEB, 0xFE }, 2, 2, TRUE, 1,
+		{
+			{ OPMAP_1BYTE, 0xE9, 5, TARGET_RELOCATED, 0 },
+		}
+	},
+	{
+		/* JMP +0x10, out of the range */
+		"jmp out of the range", { 0xEB, 0x10, 0x90, 0x90, 0x90 }, 5, 5, FALSE, 4,
+		{
+			{ OPMAP_1BYTE, 0xE9, 5, TARGET_SOURCE, 0x12 },
+			{ OPMAP_1BYTE, 0x90, 1, TARGET_NONE, 0 },
+			{ OPMAP_1BYTE, 0x90, 1, TARGET_NONE, 0 },
+			{ OPMAP_1BYTE, 0x90, 1, TARGET_NONE, 0 },
+		}
+	},
+	{
+		/* JNE +0x20, out of the range */
+		"jcc out of the range", { 0x75, 0x20, 0x48, 0x89, 0xE5 }, 5, 5, FALSE, 2,
+		{
+			{ OPMAP_0F, 0x85, 6, TARGET_SOURCE, 0x22 },
+			{ OPMAP_1BYTE, 0x89, 3, TARGET_NONE, 0 },
+		}
+	},
+	{
+		/* A taken hint (DS) before JE, which is kept before the widened JE */
+		"branch hint", { 0x3E, 0x74, 0x10, 0x90, 0x90 }, 5, 5, FALSE, 3,
+		{
+			{ OPMAP_0F, 0x84, 7, TARGET_SOURCE, 0x13 },
+			{ OPMAP_1BYTE, 0x90, 1, TARGET_NONE, 0 },
+			{ OPMAP_1BYTE, 0x90, 1, TARGET_NONE, 0 },
+		}
+	},
+	{
+		/* LOOP -3, before the range: LOOP +2, JMP +5, JMP rel32 */
+		"loop", { 0xE2, 0xFD }, 2, 2, FALSE, 3,
+		{
+			{ OPMAP_1BYTE, 0xE2, 2, TARGET_RELOCATED, 4 },
+			{ OPMAP_1BYTE, 0xEB, 2, TARGET_RELOCATED, 9 },
+			{ OPMAP_1BYTE, 0xE9, 5, TARGET_SOURCE, -1 },
+		}
+	},
+	{
+		/* JRCXZ to itself */
+		"jrcxz", { 0xE3, 0xFE }, 2, 2, TRUE, 3,
+		{
+			{ OPMAP_1BYTE, 0xE3, 2, TARGET_RELOCATED, 4 },
+			{ OPMAP_1BYTE, 0xEB, 2, TARGET_RELOCATED, 9 },
+			{ OPMAP_1BYTE, 0xE9, 5, TARGET_RELOCATED, 0 },
+		}
+	},
+	{
+		/* CALL rel32 +0x100 */
+		"call rel32", { 0xE8, 0x00, 0x01, 0x00, 0x00 }, 5, 5, FALSE, 1,
+		{
+			{ OPMAP_1BYTE, 0xE8, 5, TARGET_SOURCE, 0x105 },
+		}
+	},
+	{
+		/* MOV RAX, [RIP+0x10] */
+		"rip-relative", { 0x48, 0x8B, 0x05, 0x10, 0x00, 0x00, 0x00 }, 7, 5, FALSE, 1,
+		{
+			{ OPMAP_1BYTE, 0x8B, 7, TARGET_SOURCE, 0x17 },
+		}
+	},
+	{
+		/* PUSH RBP; MOV RBP, RSP; SUB RSP, 8 */
+		"copied", { 0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x08 }, 8, 5, TRUE, 3,
+		{
+			{ OPMAP_1BYTE, 0x55, 1, TARGET_NONE, 0 },
+			{ OPMAP_1BYTE, 0x89, 3, TARGET_NONE, 0 },
+			{ OPMAP_1BYTE, 0x83, 4, TARGET_NONE, 0 },
+		}
+	},
+};
+
+/*
+Relocate a case's code to a destination, and check the relocated code.
+@param pCase, the case.
+@param pSource, the code's source.
+@param pDestination, the address the code is relocated to.
+@param bReachable, whether the code's targets are within reach of the destination.
+*/
+void TestRelocation(const RELOCATION_CASE *pCase, PBYTE pSource, PBYTE pDestination, BOOL bReachable)
+{
+	RELOCATION_PLAN plan;
+	if (!CHECK(Relocator::Plan(pSource, pCase->RequiredBytes, &plan)))
+		return;
+
+	CHECK_EQUAL(plan.SourceSize, pCase->CodeSize);
+
+	BYTE buffer[RELOCATION_MAX_RELOCATED_SIZE];
+	if (!bReachable)
+	{
+		CHECK(!Relocator::Emit(&plan, pDestination, buffer, sizeof(buffer)));
+		return;
+	}
+
+	if (!CHECK(Relocator::Emit(&plan, pDestination, buffer, sizeof(buffer))))
+		return;
+
+	/* The relocated code is decoded from the buffer, so its targets are moved to where it's executed from */
+	INSTRUCTION_ITERATOR iterator;
+	Disassembler::InitializeIterator(&iterator, buffer, plan.RelocatedSize, DISASM_MODE_64);
+
+	SIZE_T amount = 0;
+	DECODED_INSTRUCTION instruction;
+	while (Disassembler::NextInstruction(&iterator, &instruction) && amount < pCase->ExpectedAmount)
+	{
+		const EXPECTED_INSTRUCTION *pExpected = &pCase->Expected[amount++];
+		PBYTE pTarget = instruction.Target ? pDestination + (instruction.Target - buffer) : NULL;
+
+		PBYTE pExpectedTarget = NULL;
+		if (pExpected->TargetKind == TARGET_RELOCATED)
+			pExpectedTarget = pDestination + pExpected->TargetOffset;
+		else if (pExpected->TargetKind == TARGET_SOURCE)
+			pExpectedTarget = pSource + pExpected->TargetOffset;
+
+		if (!CHECK_EQUAL(instruction.Map, pExpected->Map) || !CHECK_EQUAL(instruction.Opcode, pExpected->Opcode) ||
+			!CHECK_EQUAL(instruction.Size, pExpected->Size) || !CHECK(pTarget == pExpectedTarget))
+		{
+			printf("%s: instruction %zu\n", pCase->Name, amount - 1);
+		}
+	}
+
+	CHECK_EQUAL(amount, pCase->ExpectedAmount);
+	CHECK_EQUAL(iterator.Offset, plan.RelocatedSize);
+}
+
+/*
+Relocate every case near its source and far from it.
+*/
+void TestCases()
+{
+	for (const RELOCATION_CASE &relocationCase : g_Cases)
+	{
+		printf("%s\n", relocationCase.Name);
+
+		BYTE source[SOURCE_BUFFER_SIZE];
+		memset(source, 0xCC, sizeof(source));
+		memcpy(source, relocationCase.Code, relocationCase.CodeSize);
+
+		TestRelocation(&relocationCase, source, source + NEAR_DISTANCE, TRUE);
+		TestRelocation(&relocationCase, source, source + FAR_DISTANCE, relocationCase.bWithinRange);
+	}
+}
+
+/*
+Check the code that can't be relocated.
+*/
+void TestRejected()
+{
+	printf("rejected\n");
+
+	BYTE source[SOURCE_BUFFER_SIZE];
+	RELOCATION_PLAN plan;
+
+	/* JMP +1, into the middle of MOV EAX, Iz */
+	static const BYTE intoInstruction[] = { 0xEB, 0x01, 0xB8, 0x00, 0x00, 0x00, 0x00 };
+	memset(source, 0xCC, sizeof(source));
+	memcpy(source, intoInstruction, sizeof(intoInstruction));
+	CHECK(!Relocator::Plan(source, 5, &plan));
+
+	/* The operand-size override truncates the target of a short branch */
+	static const BYTE truncated[] = { 0x66, 0x74, 0x10, 0x90, 0x90 };
+	memset(source, 0xCC, sizeof(source));
+	memcpy(source, truncated, sizeof(truncated));
+	CHECK(!Relocator::Plan(source, 5, &plan));
+
+	CHECK(!Relocator::Plan(source, RELOCATION_MAX_REQUIRED_SIZE + 1, &plan));
+}
+
+int main()
+{
+	TestCases();
+	TestRejected();
+
+	return FinishTest();
+}
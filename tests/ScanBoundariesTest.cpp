@@ -0,0 +1,126 @@
+#include "TestCommon.h"
+#include "disasm/disasm.h"
+#include <random>
+
+/*
+Checks that the boundary scanner finds the exact same instructions as decoding one instruction at a time, with every instruction set,
+over the text sections of local binaries, random bytes, and runs of single-byte instructions that cross window boundaries.
+*/
+
+/* The instruction sets the scanner is checked with */
+const SCAN_INSTRUCTION_SET g_InstructionSets[] = { SCAN_ISA_SCALAR, SCAN_ISA_SSSE3, SCAN_ISA_AVX2 };
+
+/*
+Check the scanner over a code range, in both modes, with every instruction set.
+@param name, the name of the code range.
+@param code, the code range.
+@param size, the size of the code range.
+*/
+void TestRange(const char *name, PBYTE code, SIZE_T size)
+{
+	for (DISASSEMBLER_MODE mode : { DISASM_MODE_32, DISASM_MODE_64 })
+	{
+		for (SCAN_INSTRUCTION_SET instructionSet : g_InstructionSets)
+		{
+			DISASSEMBLER_CONTEXT context;
+			Disassembler::InitializeContext(&context);
+			context.Mode = mode;
+			context.ScanInstructionSet = instructionSet;
+
+			if (!CHECK(Disassembler::VerifyBoundaries(&context, code, size)))
+				printf("%s: mode %d, instruction set %d\n", name, mode, instructionSet);
+		}
+	}
+}
+
+/*
+Check the scanner over random bytes, which are mostly decoded through the slow path.
+*/
+void TestRandom()
+{
+	std::mt19937 random(1);
+	std::vector<BYTE> code(0x10000);
+	for (BYTE &value : code)
+		value = (BYTE) random();
+
+	TestRange("random", code.data(), code.size());
+}
+
+/*
+Check the scanner over runs of single-byte instructions (NOP, PUSH, POP & RET), separated by multi-byte instructions,
+of every length & at every alignment, so runs cross window boundaries & the end of the code range.
+*/
+void TestSingleByteRuns()
+{
+	static const BYTE singleBytes[] = { 0x90, 0x55, 0x5D, 0xC3 };
+	static const BYTE separator[] = { 0x48, 0x89, 0xE5 };
+
+	for (SIZE_T runLength = 0; runLength <= 70; runLength++)
+	{
+		for (SIZE_T alignment = 0; alignment < 4; alignment++)
+		{
+			std::vector<BYTE> code(alignment, 0x90);
+			for (SIZE_T i = 0; i < 3; i++)
+			{
+				for (SIZE_T j = 0; j < runLength; j++)
+					code.push_back(singleBytes[j % sizeof(singleBytes)]);
+				code.insert(code.end(), separator, separator + sizeof(separator));
+			}
+			for (SIZE_T j = 0; j < runLength; j++)
+				code.push_back(0x90);
+
+			TestRange("single-byte runs", code.data(), code.size());
+		}
+	}
+}
+
+/*
+Check the scanner over prefixed instructions, whose size depends on the operand-size & address-size.
+*/
+void TestPrefixes()
+{
+	static const BYTE code[] =
+	{
+		0x66, 0x81, 0xC0, 0x34, 0x12,                         /* ADD AX, Iw */
+		0x66, 0x48, 0x81, 0xC0, 0x78, 0x56, 0x34, 0x12,       /* ADD RAX, Id (REX.W takes precedence) */
+		0x48, 0x66, 0x81, 0xC0, 0x34, 0x12,                   /* REX is ignored once a legacy prefix follows it */
+		0x66, 0xB8, 0x34, 0x12,                               /* MOV AX, Iw */
+		0x48, 0xB8, 1, 2, 3, 4, 5, 6, 7, 8,                   /* MOV RAX, Iq */
+		0x67, 0x8B, 0x06, 1, 2,                               /* 16-bit addressing in 32-bit mode */
+		0x66, 0xE9, 1, 2, 3, 4,                               /* JMP rel16 in 32-bit mode, rel32 in 64-bit mode */
+		0x66, 0x66, 0x66, 0x66, 0x66, 0x90,                   /* more prefixes than the decoder consumes */
+		0xF3, 0x0F, 0x1E, 0xFA,                               /* ENDBR64 */
+		0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0, 0, 0, 0,       /* NOP with prefixes */
+		0xC7, 0x45, 0xF8, 1, 2, 3, 4,                         /* MOV Ev, Iz */
+		0x66, 0xC7, 0x45, 0xF8, 1, 2,                         /* MOV Ev, Iw */
+		0xF7, 0xC0, 1, 2, 3, 4,                               /* TEST Ev, Iz (a group whose members are sized differently) */
+		0xF7, 0xD0,                                           /* NOT Ev */
+		0x66, 0x83, 0xC4, 0x08,                               /* ADD Ev, Ib */
+		0xA1, 1, 2, 3, 4, 5, 6, 7, 8,                         /* MOV EAX, moffs */
+	};
+
+	TestRange("prefixes", (PBYTE) code, sizeof(code));
+}
+
+/*
+Check the scanner over the text sections of local binaries.
+*/
+void TestBinaries()
+{
+	for (const char *path : FindCorpusBinaries())
+	{
+		TEXT_SECTION section;
+		if (ReadTextSection(path, &section))
+			TestRange(path, section.Code.data(), section.Code.size());
+	}
+}
+
+int main()
+{
+	TestRandom();
+	TestSingleByteRuns();
+	TestPrefixes();
+	TestBinaries();
+
+	return FinishTest();
+}
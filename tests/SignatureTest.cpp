@@ -0,0 +1,167 @@
+#include "TestCommon.h"
+#include "Signature.h"
+#include <dlfcn.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Checks signatures over ELF modules: the test itself, whose functions are known down to their bytes,
+and libc, whose functions must be found again from their generated signatures.
+*/
+
+extern "C"
+{
+	/* The same function in two "builds", whose addresses & relative branches differ */
+	void SignatureFirstBuild();
+	void SignatureSecondBuild();
+	/* A function that only shares its first instructions with the two builds */
+	void SignatureOtherFunction();
+	int g_SignatureGlobal;
+}
+
+asm(R"(
+	.intel_syntax noprefix
+	.text
+	.globl SignatureFirstBuild
+	.globl SignatureSecondBuild
+	.globl SignatureOtherFunction
+
+SignatureFirstBuild:
+	mov eax, 0x5A17E0D1
+	lea rcx, [rip + g_SignatureGlobal]
+	call SignatureOtherFunction
+	mov dword ptr [rcx + 0x10], 0x3C0FFEE5
+	ret
+
+	.byte 0xCC, 0xCC, 0xCC
+SignatureSecondBuild:
+	mov eax, 0x5A17E0D1
+	lea rcx, [rip + g_SignatureGlobal + 0x40]
+	call SignatureFirstBuild
+	mov dword ptr [rcx + 0x10], 0x3C0FFEE5
+	ret
+
+	.byte 0xCC, 0xCC, 0xCC
+SignatureOtherFunction:
+	mov eax, 0x5A17E0D1
+	lea rcx, [rip + g_SignatureGlobal]
+	xor eax, eax
+	ret
+	.att_syntax prefix
+)");
+
+/*
+@return the module an address lies within.
+*/
+HMODULE GetModule(const void *pAddress)
+{
+	Dl_info info = { };
+	dladdr(pAddress, &info);
+
+	return (HMODULE) info.dli_fbase;
+}
+
+/*
+Check the signatures generated for the test's functions, which wildcard RIP-relative displacements & call targets only.
+*/
+void TestGeneratedSignature()
+{
+	HMODULE hModule = GetModule((const void *) &SignatureFirstBuild);
+	CHAR text[SIGNATURE_TEXT_SIZE];
+
+	/* Both builds match the first instructions of the function, once the fields that change between builds are wildcarded */
+	SIGNATURE signature;
+	const CHAR buildText[] = "b8 d1 e0 17 5a 48 8d 0d ?? ?? ?? ?? e8 ?? ?? ?? ?? c7 41 10 e5 fe 0f 3c c3";
+	if (CHECK(Signature::Parse(buildText, &signature)))
+	{
+		CHECK(Signature::Find(hModule, &signature) == (LPVOID) &SignatureFirstBuild);
+		CHECK_EQUAL(Signature::Count(hModule, &signature, 10), 2);
+	}
+
+	/* So the generated signature starts the same, and grows beyond the function until it tells the builds apart */
+	if (CHECK(Signature::Generate(hModule, (LPVOID) &SignatureFirstBuild, 0, &signature)))
+	{
+		Signature::Format(&signature, text, sizeof(text));
+		if (!CHECK(!strncmp(text, buildText, sizeof(buildText) - 1)))
+			printf("Generated signature: %s\n", text);
+
+		CHECK(Signature::Find(hModule, &signature) == (LPVOID) &SignatureFirstBuild);
+		CHECK_EQUAL(Signature::Count(hModule, &signature, 10), 1);
+	}
+
+	/* The other function is unique as soon as it differs from the builds */
+	if (CHECK(Signature::Generate(hModule, (LPVOID) &SignatureOtherFunction, 0, &signature)))
+	{
+		Signature::Format(&signature, text, sizeof(text));
+		if (!CHECK(!strcmp(text, "b8 d1 e0 17 5a 48 8d 0d ?? ?? ?? ?? 31 c0")))
+			printf("Generated signature: %s\n", text);
+	}
+
+	/* Wildcarding the displacements & immediates as well still finds it */
+	if (CHECK(Signature::Generate(hModule, (LPVOID) &SignatureOtherFunction, SIGNATURE_FLAG_DISPLACEMENTS | SIGNATURE_FLAG_IMMEDIATES, &signature)))
+	{
+		CHECK_EQUAL(signature.Mask[1], 0);
+		CHECK(Signature::Find(hModule, &signature) == (LPVOID) &SignatureOtherFunction);
+	}
+}
+
+/*
+Check that parsing a formatted signature gives back the same signature.
+*/
+void TestFormatParse()
+{
+	SIGNATURE signature;
+	CHECK(Signature::Parse("48 8b 05 ?? ?? ?? ?? c3", &signature));
+	CHECK_EQUAL(signature.Size, 8);
+	CHECK_EQUAL(signature.Mask[3], 0);
+	CHECK_EQUAL(signature.Bytes[7], 0xC3);
+
+	CHAR text[SIGNATURE_TEXT_SIZE];
+	CHECK_EQUAL(Signature::Format(&signature, text, sizeof(text)), 23);
+	CHECK(!strcmp(text, "48 8b 05 ?? ?? ?? ?? c3"));
+
+	CHECK(!Signature::Parse("48 8g", &signature));
+}
+
+/*
+Check that signatures generated for libc's functions find them again.
+Wrappers (e.g. printf, qsort & strtol) aren't among them: they only differ from their siblings by their wildcarded branch targets, so they're never unique.
+*/
+void TestLibc()
+{
+	const void *functions[] = { (const void *) &fclose, (const void *) &setlocale, (const void *) &fopen, (const void *) &getenv };
+	HMODULE hModule = GetModule(functions[0]);
+
+	for (const void *pFunction : functions)
+	{
+		SIGNATURE signature;
+		if (CHECK(Signature::Generate(hModule, (LPVOID) pFunction, 0, &signature)))
+		{
+			CHECK(Signature::Find(hModule, &signature) == pFunction);
+			CHECK_EQUAL(Signature::Count(hModule, &signature, 2), 1);
+		}
+	}
+}
+
+/*
+Check that addresses which aren't the base of a loaded module, or aren't within its executable segments, are refused.
+*/
+void TestInvalid()
+{
+	HMODULE hModule = GetModule((const void *) &SignatureFirstBuild);
+	SIGNATURE signature;
+
+	CHECK(!Signature::Generate((HMODULE) ((PBYTE) hModule + 0x1000), (LPVOID) &SignatureFirstBuild, 0, &signature));
+	CHECK(!Signature::Generate(hModule, &g_SignatureGlobal, 0, &signature));
+}
+
+int main()
+{
+	TestGeneratedSignature();
+	TestFormatParse();
+	TestLibc();
+	TestInvalid();
+
+	return FinishTest();
+}
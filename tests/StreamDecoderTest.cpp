@@ -0,0 +1,140 @@
+#include "TestCommon.h"
+#include "disasm/disasm.h"
+#include <random>
+#include <string.h>
+
+/*
+Checks that decoding a code stream chunk by chunk yields the exact same instructions as decoding the whole code range at once,
+with every chunk size, so instructions are split between chunks at every possible byte, and resumed through the carry buffer.
+Every chunk is overwritten once it's exhausted, so the decoder must never read a previous chunk.
+*/
+
+/* The chunk sizes the stream is checked with */
+const SIZE_T g_ChunkSizes[] = { 1, 2, 3, 7, 16, 4096 };
+
+/* The largest amount of each binary's code that's checked */
+#define MAX_CODE_SIZE 0x40000
+
+/*
+Compare an instruction decoded from a stream to the same instruction decoded from the whole code range.
+@return whether they're equal.
+*/
+BOOL CompareInstructions(const DECODED_INSTRUCTION &streamed, const DECODED_INSTRUCTION &expected)
+{
+	return streamed.Target == expected.Target && streamed.Offset == expected.Offset && streamed.Size == expected.Size &&
+		streamed.Prefixes == expected.Prefixes && streamed.Rex == expected.Rex && streamed.Encoding == expected.Encoding &&
+		streamed.Map == expected.Map && streamed.Opcode == expected.Opcode && streamed.ModRMOffset == expected.ModRMOffset &&
+		streamed.SibOffset == expected.SibOffset && streamed.DisplacementOffset == expected.DisplacementOffset &&
+		streamed.DisplacementSize == expected.DisplacementSize && streamed.ImmediateOffset == expected.ImmediateOffset &&
+		streamed.ImmediateSize == expected.ImmediateSize && streamed.BranchKind == expected.BranchKind &&
+		streamed.bRipRelative == expected.bRipRelative;
+}
+
+/*
+Decode a code stream, and check it against the instructions of the whole code range.
+@param name, the name of the code range.
+@param code, the code range.
+@param size, the size of the code range.
+@param expected, the instructions of the whole code range.
+@param mode, the mode the code is decoded in.
+@param chunkSize, the size of every chunk, or 0 to feed exactly the amount of bytes the decoder needs whenever it needs more.
+*/
+void TestStream(const char *name, PBYTE code, SIZE_T size, const std::vector<DECODED_INSTRUCTION> &expected, DISASSEMBLER_MODE mode, SIZE_T chunkSize)
+{
+	STREAM_DECODER decoder;
+	Disassembler::InitializeStream(&decoder, mode, (ULONG_PTR) code);
+
+	std::vector<BYTE> chunk(max(chunkSize, sizeof(decoder.Carry)));
+	SIZE_T fedSize = 0;
+	SIZE_T index = 0;
+	BOOL bMatches = TRUE;
+	while (bMatches)
+	{
+		DECODED_INSTRUCTION instruction;
+		STREAM_STATUS status = Disassembler::NextStreamInstruction(&decoder, &instruction);
+		if (status == STREAM_INSTRUCTION)
+		{
+			bMatches = index < expected.size() && CompareInstructions(instruction, expected[index]) &&
+				decoder.StreamOffset == expected[index].Offset + expected[index].Size;
+			index++;
+			continue;
+		}
+
+		if (fedSize == size)
+			break;
+
+		/* The decoder always needs at least a byte to continue */
+		bMatches = decoder.NeededBytes != 0;
+
+		/* The previous chunk is exhausted, so its buffer is overwritten by the next one */
+		SIZE_T nextSize = min(chunkSize ? chunkSize : decoder.NeededBytes, size - fedSize);
+		memset(chunk.data(), 0xCC, chunk.size());
+		memcpy(chunk.data(), code + fedSize, nextSize);
+		Disassembler::FeedStream(&decoder, chunk.data(), nextSize);
+		fedSize += nextSize;
+	}
+
+	/* The last instruction may be truncated, and is left in the carry buffer by both methods */
+	if (!CHECK(bMatches) || !CHECK_EQUAL(index, expected.size()))
+		printf("%s: mode %d, chunk size %zu, instruction %zu\n", name, mode, chunkSize, index);
+}
+
+/*
+Check the stream over a code range, with every chunk size.
+@param name, the name of the code range.
+@param code, the code range.
+@param size, the size of the code range.
+@param mode, the mode the code is decoded in.
+*/
+void TestRange(const char *name, PBYTE code, SIZE_T size, DISASSEMBLER_MODE mode)
+{
+	INSTRUCTION_ITERATOR iterator;
+	Disassembler::InitializeIterator(&iterator, code, size, mode);
+
+	std::vector<DECODED_INSTRUCTION> expected;
+	DECODED_INSTRUCTION instruction;
+	while (Disassembler::NextInstruction(&iterator, &instruction))
+		expected.push_back(instruction);
+
+	for (SIZE_T chunkSize : g_ChunkSizes)
+		TestStream(name, code, size, expected, mode, chunkSize);
+
+	TestStream(name, code, size, expected, mode, 0);
+}
+
+/*
+Check the stream over random bytes, which have plenty of long & prefixed instructions.
+*/
+void TestRandom()
+{
+	std::mt19937 random(1);
+	std::vector<BYTE> code(0x10000 + 0x123);
+	for (BYTE &value : code)
+		value = (BYTE) random();
+
+	TestRange("random", code.data(), code.size(), DISASM_MODE_64);
+	TestRange("random", code.data(), code.size(), DISASM_MODE_32);
+}
+
+/*
+Check the stream over the beginning of the text sections of local binaries.
+*/
+void TestBinaries()
+{
+	for (const char *path : FindCorpusBinaries())
+	{
+		TEXT_SECTION section;
+		if (!ReadTextSection(path, &section))
+			continue;
+
+		TestRange(path, section.Code.data(), min(section.Code.size(), (SIZE_T) MAX_CODE_SIZE), DISASM_MODE_64);
+	}
+}
+
+int main()
+{
+	TestRandom();
+	TestBinaries();
+
+	return FinishTest();
+}
@@ -0,0 +1,185 @@
+#include "TestCommon.h"
+#include <elf.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+The amount of checks, and the amount of checks that failed.
+*/
+SIZE_T g_CheckAmount = 0;
+SIZE_T g_FailureAmount = 0;
+
+/*
+Report a check, and count it if it failed.
+@param bCondition, whether the check holds.
+@param expression, the checked expression.
+@param file, the file the check is in.
+@param line, the line the check is in.
+@return whether the check holds.
+*/
+BOOL CheckCondition(BOOL bCondition, const char *expression, const char *file, int line)
+{
+	g_CheckAmount++;
+	if (bCondition)
+		return TRUE;
+
+	g_FailureAmount++;
+	printf("%s:%d: check failed: %s\n", file, line, expression);
+	return FALSE;
+}
+
+BOOL CheckEqual(INT64 actual, INT64 expected, const char *expression, const char *file, int line)
+{
+	g_CheckAmount++;
+	if (actual == expected)
+		return TRUE;
+
+	g_FailureAmount++;
+	printf("%s:%d: check failed: %s is %lld, expected %lld\n", file, line, expression, (long long) actual, (long long) expected);
+	return FALSE;
+}
+
+/*
+Print the test's result.
+@return the test's exit code, 0 if every check held, 1 otherwise.
+*/
+int FinishTest()
+{
+	printf("%zu checks, %zu failed\n", g_CheckAmount, g_FailureAmount);
+	return g_FailureAmount ? 1 : 0;
+}
+
+/*
+Read the .text section of a 64-bit ELF file.
+@param path, the path of the file.
+@param pSection, receives the section.
+@return whether the section was read.
+*/
+BOOL ReadTextSection(const char *path, OUT PTEXT_SECTION pSection)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return FALSE;
+
+	std::vector<BYTE> image;
+	BYTE chunk[0x10000];
+	SIZE_T readAmount;
+	while ((readAmount = fread(chunk, 1, sizeof(chunk), file)))
+		image.insert(image.end(), chunk, chunk + readAmount);
+	fclose(file);
+
+	if (image.size() < sizeof(Elf64_Ehdr))
+		return FALSE;
+
+	Elf64_Ehdr *pHeader = (Elf64_Ehdr *) image.data();
+	if (memcmp(pHeader->e_ident, ELFMAG, SELFMAG) || pHeader->e_ident[EI_CLASS] != ELFCLASS64 ||
+		pHeader->e_shoff + (SIZE_T) pHeader->e_shnum * sizeof(Elf64_Shdr) > image.size() || pHeader->e_shstrndx >= pHeader->e_shnum)
+		return FALSE;
+
+	Elf64_Shdr *pSections = (Elf64_Shdr *) (image.data() + pHeader->e_shoff);
+	const char *names = (const char *) image.data() + pSections[pHeader->e_shstrndx].sh_offset;
+	for (SIZE_T i = 0; i < pHeader->e_shnum; i++)
+	{
+		Elf64_Shdr *pSectionHeader = &pSections[i];
+		if (pSectionHeader->sh_type != SHT_PROGBITS || strcmp(names + pSectionHeader->sh_name, ".text") ||
+			pSectionHeader->sh_offset + pSectionHeader->sh_size > image.size())
+			continue;
+
+		pSection->Code.assign(image.data() + pSectionHeader->sh_offset, image.data() + pSectionHeader->sh_offset + pSectionHeader->sh_size);
+		pSection->Address = pSectionHeader->sh_addr;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+Find the local binaries whose .text sections make up the corpus of real code, from the ones that exist on this machine.
+@return the paths of the binaries.
+*/
+std::vector<const char *> FindCorpusBinaries()
+{
+	static const char *candidates[] =
+	{
+		"/bin/ls",
+		"/usr/bin/objdump",
+		"/lib/x86_64-linux-gnu/libc.so.6",
+		"/lib/x86_64-linux-gnu/libstdc++.so.6",
+		"/lib/x86_64-linux-gnu/libm.so.6",
+		"/lib64/libc.so.6",
+		"/lib64/libstdc++.so.6",
+	};
+
+	/* The test itself, by its real path, so other processes (e.g. objdump) may open it as well */
+	static char executable[0x1000];
+	std::vector<const char *> binaries;
+	ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+	if (length > 0)
+	{
+		executable[length] = 0;
+		binaries.push_back(executable);
+	}
+
+	for (const char *candidate : candidates)
+	{
+		if (!access(candidate, R_OK))
+			binaries.push_back(candidate);
+	}
+
+	return binaries;
+}
+
+/*
+Get the binaries given on the command line, or the local binaries if none were given (see FindCorpusBinaries).
+@param argc, the amount of command line arguments.
+@param argv, the command line arguments.
+@return the paths of the binaries.
+*/
+std::vector<const char *> GetCorpusBinaries(int argc, char **argv)
+{
+	if (argc < 2)
+		return FindCorpusBinaries();
+
+	std::vector<const char *> binaries;
+	for (int i = 1; i < argc; i++)
+		binaries.push_back(argv[i]);
+
+	return binaries;
+}
+
+/*
+Generate functions to hook, each of which returns its argument plus its index (LEA RAX, [RDI+index]; RET).
+Their first instruction is 7 bytes long, so they're hooked over it alone.
+@param amount, the amount of functions.
+@param offset, the offset of every function from its GENERATED_TARGET_SIZE boundary, up to 8 (e.g. so its patch crosses an aligned QWORD).
+@return pointer to the first function, the functions are GENERATED_TARGET_SIZE bytes apart, or NULL if the function failed.
+*/
+PBYTE GenerateTargets(SIZE_T amount, SIZE_T offset)
+{
+	SIZE_T size = amount * GENERATED_TARGET_SIZE;
+	PBYTE pTargets = (PBYTE) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pTargets == MAP_FAILED)
+		return NULL;
+
+	/* The functions are padded with INT3s */
+	memset(pTargets, 0xCC, size);
+	for (SIZE_T i = 0; i < amount; i++)
+	{
+		static const BYTE lea[] = { 0x48, 0x8D, 0x87 };
+		PBYTE pTarget = pTargets + i * GENERATED_TARGET_SIZE + offset;
+		DWORD index = (DWORD) i;
+
+		memcpy(pTarget, lea, sizeof(lea));
+		memcpy(pTarget + sizeof(lea), &index, sizeof(index));
+		pTarget[sizeof(lea) + sizeof(index)] = 0xC3;
+	}
+
+	if (mprotect(pTargets, size, PROT_READ | PROT_EXEC))
+	{
+		munmap(pTargets, size);
+		return NULL;
+	}
+
+	return pTargets + offset;
+}
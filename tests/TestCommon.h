@@ -0,0 +1,82 @@
+#pragma once
+#include "TrampyDefs.h"
+#include <stdio.h>
+#include <vector>
+
+/*
+Check a condition, and report it if it doesn't hold.
+A failed check doesn't stop the test, so every failure of a run is reported at once.
+*/
+#define CHECK(condition) \
+	CheckCondition(!!(condition), #condition, __FILE__, __LINE__)
+
+/*
+Check that two integers are equal, and report both of them if they aren't.
+*/
+#define CHECK_EQUAL(actual, expected) \
+	CheckEqual((INT64) (actual), (INT64) (expected), #actual, __FILE__, __LINE__)
+
+/*
+Report a check, and count it if it failed.
+@param bCondition, whether the check holds.
+@param expression, the checked expression.
+@param file, the file the check is in.
+@param line, the line the check is in.
+@return whether the check holds.
+*/
+BOOL CheckCondition(BOOL bCondition, const char *expression, const char *file, int line);
+BOOL CheckEqual(INT64 actual, INT64 expected, const char *expression, const char *file, int line);
+
+/*
+Print the test's result.
+@return the test's exit code, 0 if every check held, 1 otherwise.
+*/
+int FinishTest();
+
+/*
+Struct describing the .text section of an ELF file, read from the disk.
+*/
+typedef struct _TEXT_SECTION
+{
+	/* The section's contents */
+	std::vector<BYTE> Code;
+	/* The virtual address the section is loaded at (relative to the image's base, for position-independent files) */
+	ULONG_PTR Address;
+}
+TEXT_SECTION, *PTEXT_SECTION;
+
+/*
+Read the .text section of a 64-bit ELF file.
+@param path, the path of the file.
+@param pSection, receives the section.
+@return whether the section was read.
+*/
+BOOL ReadTextSection(const char *path, OUT PTEXT_SECTION pSection);
+
+/*
+Find the local binaries whose .text sections make up the corpus of real code, from the ones that exist on this machine.
+@return the paths of the binaries.
+*/
+std::vector<const char *> FindCorpusBinaries();
+
+/*
+Get the binaries given on the command line, or the local binaries if none were given (see FindCorpusBinaries).
+@param argc, the amount of command line arguments.
+@param argv, the command line arguments.
+@return the paths of the binaries.
+*/
+std::vector<const char *> GetCorpusBinaries(int argc, char **argv);
+
+/*
+The distance between generated target functions (see GenerateTargets).
+*/
+#define GENERATED_TARGET_SIZE 16
+
+/*
+Generate functions to hook, each of which returns its argument plus its index (LEA RAX, [RDI+index]; RET).
+Their first instruction is 7 bytes long, so they're hooked over it alone.
+@param amount, the amount of functions.
+@param offset, the offset of every function from its GENERATED_TARGET_SIZE boundary, up to 8 (e.g. so its patch crosses an aligned QWORD).
+@return pointer to the first function, the functions are GENERATED_TARGET_SIZE bytes apart, or NULL if the function failed.
+*/
+PBYTE GenerateTargets(SIZE_T amount, SIZE_T offset = 0);
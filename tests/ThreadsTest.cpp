@@ -0,0 +1,117 @@
+#include "TestCommon.h"
+#include "Threads.h"
+#include <atomic>
+#include <chrono>
+#include <signal.h>
+#include <thread>
+#include <unistd.h>
+
+/*
+Checks suspending the other threads on Linux, and that a suspension which times out leaves nothing behind:
+its signal reaches the thread that blocked it once the thread unblocks it, during a later suspension, which must ignore it.
+*/
+
+/* The suspension signal (see Threads.cpp) */
+#define SUSPEND_SIGNAL SIGRTMIN
+
+/* How long the worker waits before it unblocks the suspension signal, once it's told to, in microseconds */
+#define UNBLOCK_DELAY 50000
+
+/* How long a suspended thread is checked not to run for, in microseconds */
+#define SUSPENDED_CHECK_TIME 20000
+
+std::atomic<bool> g_bReady(false);
+std::atomic<bool> g_bUnblock(false);
+std::atomic<bool> g_bStop(false);
+std::atomic<SIZE_T> g_Counter(0);
+
+/*
+The worker, which keeps counting with the suspension signal blocked, until it's told to unblock it.
+*/
+void Worker()
+{
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SUSPEND_SIGNAL);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	g_bReady = true;
+
+	BOOL bBlocked = TRUE;
+	while (!g_bStop)
+	{
+		g_Counter++;
+
+		if (bBlocked && g_bUnblock)
+		{
+			usleep(UNBLOCK_DELAY);
+			pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+			bBlocked = FALSE;
+		}
+	}
+}
+
+/*
+Wait until the worker counts beyond a given value.
+@return whether it did, within a second.
+*/
+BOOL WaitForCounter(SIZE_T value)
+{
+	auto end = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	while (g_Counter <= value)
+	{
+		if (std::chrono::steady_clock::now() > end)
+			return FALSE;
+
+		sched_yield();
+	}
+
+	return TRUE;
+}
+
+/*
+Suspend the worker, and check it doesn't run until it's resumed.
+@return whether it was suspended.
+*/
+BOOL TestSuspension()
+{
+	PTHREAD_SUSPENSION pSuspension = Threads::SuspendOthers();
+	if (!CHECK(pSuspension))
+		return FALSE;
+
+	CHECK_EQUAL(Threads::Amount(pSuspension), 1);
+	CHECK(Threads::GetInstructionPointer(pSuspension, 0));
+
+	SIZE_T counter = g_Counter;
+	usleep(SUSPENDED_CHECK_TIME);
+	CHECK_EQUAL(g_Counter, counter);
+
+	Threads::Resume(pSuspension);
+	CHECK(WaitForCounter(counter));
+	return TRUE;
+}
+
+int main()
+{
+	std::thread worker(Worker);
+	while (!g_bReady)
+		sched_yield();
+
+	/* The worker blocks the signal, so the suspension times out */
+	auto start = std::chrono::steady_clock::now();
+	PTHREAD_SUSPENSION pSuspension = Threads::SuspendOthers();
+	auto duration = std::chrono::steady_clock::now() - start;
+
+	CHECK(!pSuspension);
+	CHECK(duration >= std::chrono::milliseconds(THREAD_SUSPEND_TIMEOUT));
+	CHECK(WaitForCounter(g_Counter));
+
+	/* The worker unblocks the signal during the next suspension, and receives the timed out suspension's signal first */
+	g_bUnblock = true;
+	if (TestSuspension())
+		TestSuspension();
+
+	g_bStop = true;
+	worker.join();
+
+	return FinishTest();
+}
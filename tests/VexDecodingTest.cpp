@@ -0,0 +1,192 @@
+#include "TestCommon.h"
+#include "Trampy.h"
+#include "disasm/disasm.h"
+
+/*
+Decodes a corpus of VEX & EVEX instructions (the kind that begins vectorized memcpy/memset, hashing & compression kernels),
+whose lengths are computed by the assembler, and hooks functions that begin with VEX instructions.
+*/
+
+extern "C" BYTE VexCorpus[];
+extern "C" BYTE VexCorpusEnd[];
+extern "C" BYTE VexLengths[];
+extern "C" BYTE VexLengthsEnd[];
+extern "C" INT64 VexTarget(INT64 x);
+extern "C" INT64 VexRipTarget(INT64 x);
+
+/*
+Every instruction of the corpus is assembled through the CASE macro, which records its length, as the assembler encoded it, in VexLengths.
+*/
+asm(R"(
+	.intel_syntax noprefix
+
+	.macro CASE instruction:vararg
+.LCaseStart\@:
+	\instruction
+.LCaseEnd\@:
+	.pushsection .rodata
+	.byte .LCaseEnd\@ - .LCaseStart\@
+	.popsection
+	.endm
+
+	.section .rodata
+	.globl VexLengths
+VexLengths:
+
+	.text
+	.globl VexCorpus
+VexCorpus:
+	/* VEX2 */
+	CASE vzeroupper
+	CASE vmovdqu ymm0, ymmword ptr [rsi]
+	CASE vmovdqu ymmword ptr [rdi + rdx - 0x20], ymm1
+	CASE vpxor xmm0, xmm0, xmm0
+	CASE vmovd xmm0, esi
+	CASE vpcmpeqb ymm1, ymm0, ymmword ptr [rdi + 0x1000]
+	CASE vpmovmskb eax, ymm1
+	CASE vmovntdq ymmword ptr [rdi], ymm0
+	CASE vmovdqu xmm8, xmmword ptr [rip + VexCorpus]
+
+	/* VEX3 (0F 38 & 0F 3A maps, REX-like bits, W) */
+	CASE vpbroadcastb ymm0, xmm0
+	CASE vpshufb ymm0, ymm1, ymmword ptr [r8 + r9 * 2 + 0x40]
+	CASE vinserti128 ymm0, ymm0, xmm1, 1
+	CASE vextracti128 xmm1, ymm15, 1
+	CASE vpclmulqdq xmm0, xmm1, xmm2, 0x11
+	CASE vaesenc xmm0, xmm0, xmmword ptr [rax]
+	CASE vfmadd231ps ymm0, ymm1, ymmword ptr [rsp + 8]
+	CASE vgatherdps ymm0, dword ptr [rax + ymm1 * 4], ymm2
+	CASE vpermq ymm0, ymm1, 0x4E
+	CASE vpblendvb ymm0, ymm1, ymm2, ymm3
+	CASE vmovq rax, xmm12
+	CASE kmovq k1, rax
+	CASE andn eax, ebx, ecx
+	CASE shlx rax, qword ptr [rdi], rcx
+	CASE rorx r11, r12, 7
+	CASE {vex} vpdpbusd ymm1, ymm2, ymm3
+
+	/* EVEX (disp8*N, masking, broadcast, rounding, maps 5 & 6) */
+	CASE vmovdqu64 zmm0, zmmword ptr [rsi]
+	CASE vmovdqu64 zmm16, zmmword ptr [rsi + 0x40]
+	CASE vmovdqu64 zmmword ptr [rdi + rcx * 8 + 0x1000], zmm31
+	CASE vmovdqu8 zmm1{k7}{z}, zmmword ptr [rdx - 0x80]
+	CASE vpcmpeqb k1, zmm0, zmmword ptr [rdi + 0x40]
+	CASE vpternlogd zmm0{k1}{z}, zmm1, dword ptr [rdi + 0x40]{1to16}, 0x96
+	CASE vaddps zmm0, zmm1, zmm2, {rn-sae}
+	CASE vpxorq xmm16, xmm16, xmm16
+	CASE vpbroadcastq zmm0, rax
+	CASE vextracti64x4 ymm1, zmm2, 1
+	CASE vpdpbusd ymm1, ymm2, ymm3
+	CASE vaddph zmm1, zmm2, zmm3
+	CASE vfmadd132ph zmm1, zmm2, zmmword ptr [rax + 0x40]
+	CASE vmovdqu32 zmm0, zmmword ptr [rip + VexCorpus]
+
+	.globl VexCorpusEnd
+VexCorpusEnd:
+
+	.section .rodata
+	.globl VexLengthsEnd
+VexLengthsEnd:
+
+	.text
+	.globl VexTarget
+	.p2align 4
+VexTarget:
+	vmovq xmm0, rdi
+	vpaddq xmm0, xmm0, xmm0
+	vmovq rax, xmm0
+	ret
+
+	.globl VexRipTarget
+	.p2align 4
+VexRipTarget:
+	vmovq xmm1, qword ptr [rip + VexRipValue]
+	vmovq xmm0, rdi
+	vpaddq xmm0, xmm0, xmm1
+	vmovq rax, xmm0
+	ret
+
+	.data
+	.p2align 3
+VexRipValue:
+	.quad 1000
+
+	.text
+	.purgem CASE
+	.att_syntax prefix
+)");
+
+/* Hooks add HOOKED_OFFSET to what their Trampoline returns */
+#define HOOKED_OFFSET 1000000
+
+typedef INT64 (*TARGET_FUNCTION)(INT64);
+
+TARGET_FUNCTION g_VexTrampoline;
+TARGET_FUNCTION g_VexRipTrampoline;
+
+INT64 VexHook(INT64 x) { return g_VexTrampoline(x) + HOOKED_OFFSET; }
+INT64 VexRipHook(INT64 x) { return g_VexRipTrampoline(x) + HOOKED_OFFSET; }
+
+/*
+Decode the corpus, and check every instruction's length.
+*/
+void TestCorpus()
+{
+	SIZE_T caseAmount = VexLengthsEnd - VexLengths;
+	SIZE_T size = VexCorpusEnd - VexCorpus;
+
+	INSTRUCTION_ITERATOR iterator;
+	DECODED_INSTRUCTION instruction;
+	Disassembler::InitializeIterator(&iterator, VexCorpus, size, DISASM_MODE_64);
+
+	SIZE_T i = 0;
+	for (; i < caseAmount && Disassembler::NextInstruction(&iterator, &instruction); i++)
+	{
+		if (!CHECK_EQUAL(instruction.Size, VexLengths[i]))
+		{
+			CHAR bytes[MAX_INSTRUCTION_SIZE * 3];
+			Disassembler::FormatBytes(VexCorpus + instruction.Offset, VexLengths[i], bytes, sizeof(bytes));
+			printf("case %zu: %s\n", i, bytes);
+			return;
+		}
+	}
+
+	CHECK_EQUAL(i, caseAmount);
+	CHECK_EQUAL(Disassembler::VerifyBoundaries(&iterator.Context, VexCorpus, size), TRUE);
+}
+
+/*
+Hook a function that begins with VEX instructions, and check it while the Hook is enabled & once it's disabled.
+@param pTarget, the target.
+@param pHooked, the Hook.
+@param ppTrampoline, receives the Trampoline.
+@param expected, what the target returns for 21.
+*/
+void TestHook(TARGET_FUNCTION pTarget, TARGET_FUNCTION pHooked, TARGET_FUNCTION *ppTrampoline, INT64 expected)
+{
+	PHOOK_DESCRIPTOR pHook = Trampy::CreateHook((LPVOID) pTarget, (LPVOID) pHooked, (LPVOID *) ppTrampoline);
+	if (!CHECK(pHook) || !CHECK(Trampy::EnableHook(pHook)))
+		return;
+
+	CHECK_EQUAL(pTarget(21), expected + HOOKED_OFFSET);
+	CHECK_EQUAL((*ppTrampoline)(21), expected);
+
+	CHECK(Trampy::DisableHook(pHook));
+	CHECK_EQUAL(pTarget(21), expected);
+}
+
+int main()
+{
+	TestCorpus();
+
+	if (__builtin_cpu_supports("avx"))
+	{
+		TestHook(VexTarget, VexHook, &g_VexTrampoline, 42);
+		TestHook(VexRipTarget, VexRipHook, &g_VexRipTrampoline, 1021);
+	}
+	else
+		printf("AVX isn't supported, skipped the hooks\n");
+
+	Trampy::DisableAllHooks();
+	return FinishTest();
+}